@@ -0,0 +1,590 @@
+#include "owl-cpu/encoder.h"
+#include "owl-cpu/inline.h"
+#include "owl-cpu/owl-cpu.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Measures the rate at which each engine executes some classic kernels. Every kernel is a guest program that computes
+// a known result in a0 and then makes an ecall, whereupon the benchmark checks the result and starts it again.
+
+namespace
+{
+    using namespace owl::encode;
+
+    constexpr std::uint32_t memorySize = 64 * 1024;
+    constexpr std::uint64_t instructionsPerIteration = 1'000'000;
+
+    // Assembles guest code with named labels, so that kernels needn't count their own branch offsets. Instructions can
+    // be compressed, so code is kept as halfwords.
+    class Program
+    {
+    public:
+        void Emit(std::uint32_t instruction)
+        {
+            m_code.push_back(static_cast<std::uint16_t>(instruction));
+            m_code.push_back(static_cast<std::uint16_t>(instruction >> 16));
+        }
+
+        void Emit(std::uint16_t compressed) { m_code.push_back(compressed); }
+
+        void Label(std::string const& name) { m_labels[name] = Here(); }
+
+        // Emits a branch or jump to a label, encoding it with the offset once the label is known.
+        void To(std::string const& label, std::function<std::uint32_t(std::int32_t)> encode)
+        {
+            m_fixups.push_back({.at = Here(), .label = label, .encode = std::move(encode), .compressed = false});
+            m_code.resize(m_code.size() + 2);
+        }
+
+        // Emits a compressed branch or jump to a label, likewise.
+        void CompressedTo(std::string const& label, std::function<std::uint16_t(std::int32_t)> encode)
+        {
+            m_fixups.push_back({.at = Here(), .label = label, .encode = std::move(encode), .compressed = true});
+            m_code.resize(m_code.size() + 1);
+        }
+
+        auto Build() const -> std::vector<std::uint32_t>
+        {
+            auto code = m_code;
+            for (auto const& fixup : m_fixups)
+            {
+                auto const offset = static_cast<std::int32_t>(m_labels.at(fixup.label) - fixup.at);
+                auto const instruction = fixup.encode(offset);
+                code[fixup.at / 2] = static_cast<std::uint16_t>(instruction);
+                if (!fixup.compressed)
+                {
+                    code[fixup.at / 2 + 1] = static_cast<std::uint16_t>(instruction >> 16);
+                }
+            }
+            std::vector<std::uint32_t> words((code.size() + 1) / 2);
+            std::memcpy(words.data(), code.data(), code.size() * sizeof(code[0]));
+            return words;
+        }
+
+    private:
+        struct Fixup
+        {
+            std::uint32_t at;
+            std::string label;
+            std::function<std::uint32_t(std::int32_t)> encode;
+            bool compressed;
+        };
+
+        auto Here() const -> std::uint32_t { return static_cast<std::uint32_t>(m_code.size() * 2); }
+
+        std::vector<std::uint16_t> m_code;
+        std::map<std::string, std::uint32_t> m_labels;
+        std::vector<Fixup> m_fixups;
+    };
+
+    struct Kernel
+    {
+        char const* name;
+        std::vector<std::uint32_t> code;
+        std::function<void(std::span<std::uint8_t>)> setUp; // writes the kernel's data into guest memory
+        std::uint32_t expected;                              // the kernel's result in a0
+    };
+
+    void Store(std::span<std::uint8_t> memory, std::size_t address, std::uint32_t value)
+    {
+        std::memcpy(memory.data() + address, &value, sizeof(value));
+    }
+
+    // Calls and returns: a0 = fib(18), computed recursively with a stack frame for each call.
+    auto Fib() -> Kernel
+    {
+        Program p;
+        p.Emit(Lui(sp, memorySize >> 12));
+        p.Emit(Addi(a0, zero, 18));
+        p.To("fib", [](std::int32_t offset) { return Jal(ra, offset); });
+        p.Emit(Ecall());
+        p.Label("fib");
+        p.Emit(Addi(t0, zero, 2));
+        p.To("return", [](std::int32_t offset) { return Blt(a0, t0, offset); });
+        p.Emit(Addi(sp, sp, -12));
+        p.Emit(Sw(ra, sp, 0));
+        p.Emit(Sw(a0, sp, 4));
+        p.Emit(Addi(a0, a0, -1));
+        p.To("fib", [](std::int32_t offset) { return Jal(ra, offset); });
+        p.Emit(Sw(a0, sp, 8));
+        p.Emit(Lw(a0, sp, 4));
+        p.Emit(Addi(a0, a0, -2));
+        p.To("fib", [](std::int32_t offset) { return Jal(ra, offset); });
+        p.Emit(Lw(t0, sp, 8));
+        p.Emit(Add(a0, a0, t0));
+        p.Emit(Lw(ra, sp, 0));
+        p.Emit(Addi(sp, sp, 12));
+        p.Label("return");
+        p.Emit(Jalr(zero, ra, 0));
+        return {.name = "Fib", .code = p.Build(), .setUp = {}, .expected = 2584};
+    }
+
+    // The same calls and returns in compressed code, which retires the same instructions in less memory. Its stack
+    // frames are 16 bytes, because compressed code can only adjust sp by multiples of 16.
+    auto CompressedFib() -> Kernel
+    {
+        Program p;
+        p.Emit(Lui(sp, memorySize >> 12));
+        p.Emit(CLi(a0, 18));
+        p.CompressedTo("fib", [](std::int32_t offset) { return CJal(offset); });
+        p.Emit(Ecall());
+        p.Label("fib");
+        p.Emit(CLi(t0, 2));
+        p.To("return", [](std::int32_t offset) { return Blt(a0, t0, offset); });
+        p.Emit(CAddi16sp(-16));
+        p.Emit(CSwsp(ra, 0));
+        p.Emit(CSwsp(a0, 4));
+        p.Emit(CAddi(a0, -1));
+        p.CompressedTo("fib", [](std::int32_t offset) { return CJal(offset); });
+        p.Emit(CSwsp(a0, 8));
+        p.Emit(CLwsp(a0, 4));
+        p.Emit(CAddi(a0, -2));
+        p.CompressedTo("fib", [](std::int32_t offset) { return CJal(offset); });
+        p.Emit(CLwsp(t0, 8));
+        p.Emit(CAdd(a0, t0));
+        p.Emit(CLwsp(ra, 0));
+        p.Emit(CAddi16sp(16));
+        p.Label("return");
+        p.Emit(CJr(ra));
+        return {.name = "CompressedFib", .code = p.Build(), .setUp = {}, .expected = 2584};
+    }
+
+    // Loads and stores: copies 4 KiB a word at a time, then returns the last word copied.
+    auto Memcpy() -> Kernel
+    {
+        constexpr std::uint32_t words = 1024;
+        constexpr std::uint32_t pattern = 0x9e3779b9;
+        Program p;
+        p.Emit(Lui(a1, 1)); // source
+        p.Emit(Lui(a2, 2)); // destination
+        p.Emit(Lui(t2, 1));
+        p.Emit(Add(t2, a1, t2)); // the end of the source
+        p.Label("loop");
+        p.Emit(Lw(t0, a1, 0));
+        p.Emit(Sw(t0, a2, 0));
+        p.Emit(Addi(a1, a1, 4));
+        p.Emit(Addi(a2, a2, 4));
+        p.To("loop", [](std::int32_t offset) { return Bne(a1, t2, offset); });
+        p.Emit(Lw(a0, a2, -4));
+        p.Emit(Ecall());
+        auto const setUp = [](std::span<std::uint8_t> memory) {
+            for (std::uint32_t i = 0; i < words; ++i)
+            {
+                Store(memory, 0x1000 + 4 * i, i * pattern);
+            }
+        };
+        return {.name = "Memcpy", .code = p.Build(), .setUp = setUp, .expected = (words - 1) * pattern};
+    }
+
+    // Byte loads and stores in nested loops: counts the primes below 8192 with the sieve of Eratosthenes.
+    auto Sieve() -> Kernel
+    {
+        Program p;
+        p.Emit(Lui(s0, 4)); // the flags
+        p.Emit(Lui(s1, 2)); // their count
+        p.Emit(Addi(t0, zero, 0));
+        p.Emit(Addi(t1, zero, 1));
+        p.Label("fill");
+        p.Emit(Add(t2, s0, t0));
+        p.Emit(Sb(t1, t2, 0));
+        p.Emit(Addi(t0, t0, 1));
+        p.To("fill", [](std::int32_t offset) { return Bne(t0, s1, offset); });
+        p.Emit(Addi(a0, zero, 0));
+        p.Emit(Addi(t0, zero, 2));
+        p.Label("outer");
+        p.Emit(Add(t2, s0, t0));
+        p.Emit(Lbu(t3, t2, 0));
+        p.To("next", [](std::int32_t offset) { return Beq(t3, zero, offset); });
+        p.Emit(Addi(a0, a0, 1));
+        p.Emit(Add(t4, t0, t0));
+        p.Label("mark");
+        p.To("next", [](std::int32_t offset) { return Bge(t4, s1, offset); });
+        p.Emit(Add(t2, s0, t4));
+        p.Emit(Sb(zero, t2, 0));
+        p.Emit(Add(t4, t4, t0));
+        p.To("mark", [](std::int32_t offset) { return Jal(zero, offset); });
+        p.Label("next");
+        p.Emit(Addi(t0, t0, 1));
+        p.To("outer", [](std::int32_t offset) { return Bne(t0, s1, offset); });
+        p.Emit(Ecall());
+        return {.name = "Sieve", .code = p.Build(), .setUp = {}, .expected = 1028};
+    }
+
+    // The host's version of the state machine kernel.
+    constexpr auto CountAccepts() -> std::uint32_t
+    {
+        std::uint32_t x = 1;
+        std::uint32_t state = 0;
+        std::uint32_t accepts = 0;
+        for (auto i = 0; i < 4096; ++i)
+        {
+            x = x * 0x41c64e6d + 1013;
+            auto const symbol = (x >> 16) & 3;
+            switch (state)
+            {
+            case 0:
+                state = symbol < 2 ? 1 : 2;
+                break;
+            case 1:
+                state = symbol == 3 ? 3 : symbol == 0 ? 0 : 1;
+                break;
+            case 2:
+                state = (symbol & 1) != 0 ? 3 : 0;
+                break;
+            default:
+                accepts += symbol == 0 ? 1 : 0;
+                state = symbol;
+                break;
+            }
+        }
+        return accepts;
+    }
+
+    // Unpredictable branches: drives a four-state machine with pseudo-random symbols and counts its accepts.
+    auto StateMachine() -> Kernel
+    {
+        Program p;
+        auto const next = [](std::int32_t offset) { return Jal(zero, offset); };
+        p.Emit(Addi(s0, zero, 1)); // the generator's state
+        p.Emit(Lui(s1, 0x41c65));
+        p.Emit(Addi(s1, s1, -403)); // its multiplier
+        p.Emit(Lui(s2, 1));         // the number of symbols
+        p.Emit(Addi(a0, zero, 0));
+        p.Emit(Addi(s3, zero, 0)); // the machine's state
+        p.Label("loop");
+        p.Emit(Mul(s0, s0, s1));
+        p.Emit(Addi(s0, s0, 1013));
+        p.Emit(Srli(t0, s0, 16));
+        p.Emit(Andi(t0, t0, 3));
+        p.To("state0", [](std::int32_t offset) { return Beq(s3, zero, offset); });
+        p.Emit(Addi(t1, zero, 1));
+        p.To("state1", [](std::int32_t offset) { return Beq(s3, t1, offset); });
+        p.Emit(Addi(t1, zero, 2));
+        p.To("state2", [](std::int32_t offset) { return Beq(s3, t1, offset); });
+        // In state 3, accept a zero and go to the state named by any other symbol.
+        p.To("state3other", [](std::int32_t offset) { return Bne(t0, zero, offset); });
+        p.Emit(Addi(a0, a0, 1));
+        p.Label("state3other");
+        p.Emit(Mv(s3, t0));
+        p.To("next", next);
+        // In state 0, go to state 1 for a low symbol and to state 2 for a high one.
+        p.Label("state0");
+        p.Emit(Addi(t1, zero, 2));
+        p.To("state0high", [](std::int32_t offset) { return Bge(t0, t1, offset); });
+        p.Emit(Addi(s3, zero, 1));
+        p.To("next", next);
+        p.Label("state0high");
+        p.Emit(Addi(s3, zero, 2));
+        p.To("next", next);
+        // In state 1, go to state 3 for a 3, to state 0 for a 0, and otherwise stay.
+        p.Label("state1");
+        p.Emit(Addi(t1, zero, 3));
+        p.To("state1three", [](std::int32_t offset) { return Beq(t0, t1, offset); });
+        p.To("next", [](std::int32_t offset) { return Bne(t0, zero, offset); });
+        p.Emit(Addi(s3, zero, 0));
+        p.To("next", next);
+        p.Label("state1three");
+        p.Emit(Addi(s3, zero, 3));
+        p.To("next", next);
+        // In state 2, go to state 3 for an odd symbol and to state 0 for an even one.
+        p.Label("state2");
+        p.Emit(Andi(t1, t0, 1));
+        p.To("state2odd", [](std::int32_t offset) { return Bne(t1, zero, offset); });
+        p.Emit(Addi(s3, zero, 0));
+        p.To("next", next);
+        p.Label("state2odd");
+        p.Emit(Addi(s3, zero, 3));
+        p.Label("next");
+        p.Emit(Addi(s2, s2, -1));
+        p.To("loop", [](std::int32_t offset) { return Bne(s2, zero, offset); });
+        p.Emit(Ecall());
+        return {.name = "StateMachine", .code = p.Build(), .setUp = {}, .expected = CountAccepts()};
+    }
+
+    constexpr std::uint32_t dhrystoneLoops = 1000;
+    constexpr char dhrystoneString[] = "DHRYSTONE PROGRAM";
+    constexpr auto dhrystoneLength = static_cast<std::uint32_t>(sizeof(dhrystoneString) - 1);
+
+    // The host's version of the Dhrystone-like kernel.
+    constexpr auto DhrystoneChecksum() -> std::uint32_t
+    {
+        std::uint32_t checksum = 0;
+        for (std::uint32_t i = 0; i < dhrystoneLoops; ++i)
+        {
+            auto const proc = i * 3 / 7 + ((i & 5) != 0 ? 1 : 2);
+            checksum += proc + dhrystoneLength + 2 + i;
+        }
+        return checksum;
+    }
+
+    // A mix in the spirit of Dhrystone: a record copy, a procedure call, integer multiply and divide, and a string
+    // comparison on every iteration.
+    auto Dhrystone() -> Kernel
+    {
+        Program p;
+        p.Emit(Lui(s0, 1)); // the global record, then the local record at +16 and the strings at +256 and +512
+        p.Emit(Addi(s1, zero, 0));
+        p.Emit(Addi(s2, zero, dhrystoneLoops));
+        p.Emit(Addi(a0, zero, 0));
+        p.Label("loop");
+        for (auto field = 0; field < 16; field += 4)
+        {
+            p.Emit(Lw(t0, s0, field));
+            p.Emit(Sw(t0, s0, 16 + field));
+        }
+        p.Emit(Lw(t0, s0, 20));
+        p.Emit(Add(t0, t0, s1));
+        p.Emit(Sw(t0, s0, 20));
+        p.To("proc", [](std::int32_t offset) { return Jal(ra, offset); });
+        p.Emit(Add(a0, a0, a1));
+        p.Emit(Addi(t2, s0, 256));
+        p.Emit(Addi(t3, s0, 512));
+        p.Emit(Addi(t4, zero, 0));
+        p.Label("compare");
+        p.Emit(Lbu(t0, t2, 0));
+        p.Emit(Lbu(t1, t3, 0));
+        p.To("compared", [](std::int32_t offset) { return Bne(t0, t1, offset); });
+        p.To("compared", [](std::int32_t offset) { return Beq(t0, zero, offset); });
+        p.Emit(Addi(t2, t2, 1));
+        p.Emit(Addi(t3, t3, 1));
+        p.Emit(Addi(t4, t4, 1));
+        p.To("compare", [](std::int32_t offset) { return Jal(zero, offset); });
+        p.Label("compared");
+        p.Emit(Add(a0, a0, t4));
+        p.Emit(Lw(t0, s0, 20));
+        p.Emit(Add(a0, a0, t0));
+        p.Emit(Addi(s1, s1, 1));
+        p.To("loop", [](std::int32_t offset) { return Bne(s1, s2, offset); });
+        p.Emit(Ecall());
+        // a1 = i * 3 / 7 + (i & 5 ? 1 : 2)
+        p.Label("proc");
+        p.Emit(Addi(t0, zero, 3));
+        p.Emit(Mul(a1, s1, t0));
+        p.Emit(Addi(t0, zero, 7));
+        p.Emit(Div(a1, a1, t0));
+        p.Emit(Andi(t0, s1, 5));
+        p.To("procone", [](std::int32_t offset) { return Bne(t0, zero, offset); });
+        p.Emit(Addi(a1, a1, 2));
+        p.Emit(Jalr(zero, ra, 0));
+        p.Label("procone");
+        p.Emit(Addi(a1, a1, 1));
+        p.Emit(Jalr(zero, ra, 0));
+        auto const setUp = [](std::span<std::uint8_t> memory) {
+            for (std::uint32_t field = 0; field < 4; ++field)
+            {
+                Store(memory, 0x1000 + 4 * field, field + 1);
+            }
+            std::memcpy(memory.data() + 0x1100, dhrystoneString, sizeof(dhrystoneString));
+            std::memcpy(memory.data() + 0x1200, dhrystoneString, sizeof(dhrystoneString));
+        };
+        return {.name = "Dhrystone", .code = p.Build(), .setUp = setUp, .expected = DhrystoneChecksum()};
+    }
+
+    auto EngineName(owl::Engine engine) -> char const*
+    {
+        switch (engine)
+        {
+        case owl::Engine::Switch:
+            return "Switch";
+        case owl::Engine::Threaded:
+            return "Threaded";
+        case owl::Engine::Block:
+            return "Block";
+        case owl::Engine::Tiered:
+            return "Tiered";
+        case owl::Engine::Timed:
+            return "Timed";
+        }
+        return "Unknown";
+    }
+
+    void RunKernel(benchmark::State& state, Kernel const& kernel, owl::Engine engine)
+    {
+        std::vector<std::uint8_t> memory(memorySize);
+        std::memcpy(memory.data(), kernel.code.data(), kernel.code.size() * sizeof(std::uint32_t));
+        if (kernel.setUp)
+        {
+            kernel.setUp(memory);
+        }
+        owl::Cpu cpu{memory};
+        cpu.SetEngine(engine);
+
+        auto const start = cpu.State().instret;
+        for (auto _ : state)
+        {
+            auto remaining = instructionsPerIteration;
+            while (remaining > 0)
+            {
+                auto const before = cpu.State().instret;
+                auto const exit = cpu.Run(remaining);
+                remaining -= cpu.State().instret - before;
+                if (exit == owl::Exit::Ecall)
+                {
+                    if (cpu.State().x[a0] != kernel.expected)
+                    {
+                        state.SkipWithError("the kernel computed the wrong result");
+                        return;
+                    }
+                    cpu.State().pc = 0;
+                }
+                else if (exit != owl::Exit::BudgetExhausted)
+                {
+                    state.SkipWithError("the kernel stopped unexpectedly");
+                    return;
+                }
+            }
+        }
+        auto const instructions = static_cast<double>(cpu.State().instret - start);
+        state.counters["MIPS"] = benchmark::Counter(instructions / 1e6, benchmark::Counter::kIsRate);
+    }
+
+    // How a core that is starting gets its code: translating it itself, taking it from a core that is already
+    // running, or, as if it were the first core of a new process, from a file that an earlier process saved.
+    enum class Start
+    {
+        Private,
+        Shared,
+        Saved,
+    };
+
+    // Starts a core and runs the beginning of a kernel, as a host that runs many short-lived guests of one program
+    // does.
+    void StartCores(benchmark::State& state, Kernel const& kernel, Start start)
+    {
+        constexpr std::uint64_t startInstructions = 1000;
+        constexpr std::uint64_t image = 1;
+        std::vector<std::uint8_t> memory(memorySize);
+        std::memcpy(memory.data(), kernel.code.data(), kernel.code.size() * sizeof(std::uint32_t));
+        if (kernel.setUp)
+        {
+            kernel.setUp(memory);
+        }
+        auto const pristine = memory;
+        auto const path = std::filesystem::temp_directory_path() / "owl-cpu-bench.code";
+        owl::Cpu first{memory};
+        if (start != Start::Private)
+        {
+            first.ShareCode(image);
+            first.Run(startInstructions);
+        }
+        if (start == Start::Saved)
+        {
+            first.SaveSharedCode(path);
+            first.ShareCode(image + 1); // so that every core maps the file, as none shares the image
+        }
+
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            memory = pristine;
+            state.ResumeTiming();
+            owl::Cpu cpu{memory};
+            cpu.SetEngine(owl::Engine::Switch);
+            if (start != Start::Private)
+            {
+                cpu.ShareCode(image, start == Start::Saved ? path : std::filesystem::path{});
+            }
+            cpu.Run(startInstructions);
+        }
+        state.counters["Cores"] = benchmark::Counter(static_cast<double>(state.iterations()),
+                                                     benchmark::Counter::kIsRate);
+        if (start == Start::Saved)
+        {
+            std::filesystem::remove(path);
+        }
+    }
+
+    // Calls a guest snippet of a few instructions from a host loop, as a host that scripts its hot path in guest code
+    // does, either with a Cpu or with the inline interpreter in owl-cpu/inline.h.
+    void CallSnippets(benchmark::State& state, bool inlined)
+    {
+        constexpr std::uint64_t snippetInstructions = 16;
+        auto const code = std::vector<std::uint32_t>{
+                Slli(a1, a0, 1),
+                Add(a0, a0, a1),
+                Addi(a0, a0, 1),
+                Xori(a0, a0, 0x55),
+                Andi(a0, a0, 0xff),
+                Ecall(),
+        };
+        std::vector<std::uint8_t> memory(memorySize);
+        std::memcpy(memory.data(), code.data(), code.size() * sizeof(std::uint32_t));
+        owl::Cpu cpu{memory};
+        cpu.SetEngine(owl::Engine::Switch);
+        owl::CpuState inlineState{};
+
+        std::uint32_t argument = 0;
+        for (auto _ : state)
+        {
+            auto& core = inlined ? inlineState : cpu.State();
+            core.pc = 0;
+            core.x[a0] = argument++;
+            auto const exit = inlined ? owl::RunSmall(core, memory, snippetInstructions) : cpu.Run(snippetInstructions);
+            if (exit != owl::Exit::Ecall)
+            {
+                state.SkipWithError("the snippet stopped unexpectedly");
+                return;
+            }
+            benchmark::DoNotOptimize(core.x[a0]);
+        }
+        state.counters["Calls"] = benchmark::Counter(static_cast<double>(state.iterations()),
+                                                     benchmark::Counter::kIsRate);
+    }
+} // namespace
+
+auto main(int argc, char** argv) -> int
+{
+    std::vector<Kernel> const kernels{Dhrystone(), Memcpy(), Sieve(), Fib(), CompressedFib(), StateMachine()};
+    for (auto const& kernel : kernels)
+    {
+        for (auto const engine : {owl::Engine::Switch, owl::Engine::Threaded, owl::Engine::Block, owl::Engine::Tiered,
+                                  owl::Engine::Timed})
+        {
+            if (!owl::IsEngineAvailable(engine))
+            {
+                continue;
+            }
+            auto const name = std::string{kernel.name} + '/' + EngineName(engine);
+            benchmark::RegisterBenchmark(name.c_str(), [&kernel, engine](benchmark::State& state) {
+                RunKernel(state, kernel, engine);
+            })->Unit(benchmark::kMillisecond);
+        }
+    }
+
+    for (auto const& [start, startName] : {std::pair{Start::Private, "Private"}, std::pair{Start::Shared, "Shared"},
+                                           std::pair{Start::Saved, "Saved"}})
+    {
+        auto const name = std::string{"StartCores/"} + startName;
+        benchmark::RegisterBenchmark(name.c_str(), [&kernels, start](benchmark::State& state) {
+            StartCores(state, kernels.front(), start);
+        })->Unit(benchmark::kMicrosecond);
+    }
+
+    for (auto const& [inlined, callName] : {std::pair{false, "Cpu"}, std::pair{true, "Inline"}})
+    {
+        auto const name = std::string{"CallSnippets/"} + callName;
+        benchmark::RegisterBenchmark(name.c_str(), [inlined](benchmark::State& state) {
+            CallSnippets(state, inlined);
+        })->Unit(benchmark::kNanosecond);
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -4,6 +4,7 @@ set(
     include/*.hpp
     test/*.cpp test/*.hpp
     example/*.cpp example/*.hpp
+    benchmark/*.cpp benchmark/*.hpp
     CACHE STRING
     "; separated patterns relative to the project source dir to format"
 )
@@ -0,0 +1,73 @@
+# ---- Link-time optimization ----
+
+if(owl-cpu_IPO)
+  include(CheckIPOSupported)
+  check_ipo_supported(RESULT owl-cpu_ipo_supported OUTPUT owl-cpu_ipo_output)
+  if(NOT owl-cpu_ipo_supported)
+    message(
+        FATAL_ERROR
+        "owl-cpu_IPO is not supported by this toolchain: ${owl-cpu_ipo_output}"
+    )
+  endif()
+  set_property(
+      TARGET owl-cpu_owl-cpu
+      PROPERTY INTERPROCEDURAL_OPTIMIZATION ON
+  )
+endif()
+
+# ---- Target architecture ----
+
+if(NOT owl-cpu_ARCH STREQUAL "")
+  if(NOT CMAKE_CXX_COMPILER_ID MATCHES "GNU|Clang")
+    message(FATAL_ERROR "owl-cpu_ARCH is only supported by GCC and Clang")
+  endif()
+  target_compile_options(owl-cpu_owl-cpu PRIVATE "-march=${owl-cpu_ARCH}")
+endif()
+
+# ---- Profile-guided optimization ----
+
+# GCC names each object's profile after the object's path, so both stages have
+# to be built in the same binary directory. Clang writes raw profiles, which
+# have to be merged into default.profdata in the same directory before the use
+# stage, with llvm-profdata merge
+if(owl-cpu_PGO STREQUAL "")
+  return()
+elseif(NOT CMAKE_CXX_COMPILER_ID MATCHES "GNU|Clang")
+  message(FATAL_ERROR "owl-cpu_PGO is only supported by GCC and Clang")
+endif()
+
+if(owl-cpu_PGO STREQUAL "generate")
+  target_compile_options(
+      owl-cpu_owl-cpu PRIVATE
+      "-fprofile-generate=${owl-cpu_PGO_DIR}"
+  )
+  # Whatever links the library has to link the profiling runtime as well
+  target_link_options(
+      owl-cpu_owl-cpu PUBLIC
+      "$<BUILD_INTERFACE:-fprofile-generate=${owl-cpu_PGO_DIR}>"
+  )
+elseif(owl-cpu_PGO STREQUAL "use")
+  # A profile that is missing or out of date for some sources makes the
+  # compiler optimize those as it would without one, rather than fail
+  if(CMAKE_CXX_COMPILER_ID STREQUAL "GNU")
+    target_compile_options(
+        owl-cpu_owl-cpu PRIVATE
+        "-fprofile-use=${owl-cpu_PGO_DIR}"
+        -fprofile-partial-training
+        -Wno-missing-profile
+        -Wno-error=coverage-mismatch
+    )
+  else()
+    target_compile_options(
+        owl-cpu_owl-cpu PRIVATE
+        "-fprofile-use=${owl-cpu_PGO_DIR}/default.profdata"
+        -Wno-profile-instr-out-of-date
+        -Wno-profile-instr-unprofiled
+    )
+  endif()
+else()
+  message(
+      FATAL_ERROR
+      "owl-cpu_PGO must be generate, use or empty, not '${owl-cpu_PGO}'"
+  )
+endif()
@@ -9,6 +9,67 @@ if(PROJECT_IS_TOP_LEVEL)
   option(BUILD_SHARED_LIBS "Build shared libs." OFF)
 endif()
 
+# ---- Dispatch engines ----
+
+# The portable switch engine is always built. The threaded engine dispatches
+# with computed goto, which is a GCC/Clang extension, so it is only on by
+# default for those compilers. When it is built it becomes the default engine,
+# but both can still be selected at runtime with owl::Cpu::SetEngine()
+set(owl-cpu_threaded_dispatch_default OFF)
+if(CMAKE_CXX_COMPILER_ID MATCHES "GNU|Clang")
+  set(owl-cpu_threaded_dispatch_default ON)
+endif()
+option(
+    owl-cpu_THREADED_DISPATCH
+    "Build the computed-goto threaded dispatch engine"
+    "${owl-cpu_threaded_dispatch_default}"
+)
+
+# The tiered engine interprets cold code with the block engine and compiles hot
+# blocks to native code. The JIT only has backends for x86-64 and AArch64, so
+# it is off by default to keep every other platform building out of the box
+option(owl-cpu_JIT "Build the JIT-compiling tiered engine" OFF)
+
+# The profiler counts the operations, blocks and branches that every engine
+# executes into counters for each thread. It costs several lookups for every
+# instruction, so it is compiled out by default and the engines pay nothing
+option(
+    owl-cpu_PROFILER
+    "Count the operations, blocks and branches that guests execute"
+    OFF
+)
+
+# ---- Optimization ----
+
+# These trade portability or build time for speed, so they are all off by
+# default. The release-* presets in CMakePresets.json combine them. They only
+# apply to the library, because that is where the engines' dispatch loops are.
+# owl-cpu_ARCH is passed to GCC and Clang as -march, e.g. native or x86-64-v3.
+# owl-cpu_PGO is the stage of a profile-guided build: generate builds the
+# library instrumented, so that running it writes a profile to
+# owl-cpu_PGO_DIR, and use rebuilds it optimized for that profile
+option(
+    owl-cpu_IPO
+    "Build the library with interprocedural (link-time) optimization"
+    OFF
+)
+set(
+    owl-cpu_ARCH ""
+    CACHE STRING
+    "The -march to build the library for, or empty for the compiler's default"
+)
+set(
+    owl-cpu_PGO ""
+    CACHE STRING
+    "The stage of profile-guided optimization: generate, use or empty for none"
+)
+set_property(CACHE owl-cpu_PGO PROPERTY STRINGS "" generate use)
+set(
+    owl-cpu_PGO_DIR "${PROJECT_BINARY_DIR}/pgo-profile"
+    CACHE PATH
+    "Where profile-guided optimization writes and reads its profile"
+)
+
 # ---- Suppress C4251 on Windows ----
 
 # Please see include/owl-cpu/owl-cpu.hpp for more details
@@ -0,0 +1,67 @@
+#include "owl-cpu/encoder.h"
+#include "owl-cpu/owl-cpu.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+auto main() -> int
+{
+    using namespace owl::encode;
+
+    // Each guest counts the steps that its seed takes to reach 1 under the Collatz map, then makes an ecall.
+    constexpr std::size_t guests = 1000;
+    constexpr std::uint32_t code[] = {
+            Addi(a1, zero, 0),  // steps = 0
+            Addi(t1, zero, 1),  //
+            Beq(a0, t1, 40),    // loop: if n == 1 then done
+            Andi(t0, a0, 1),    //
+            Beq(t0, zero, 20),  // if n is even then halve it
+            Add(t0, a0, a0),    // n = 3n + 1
+            Add(a0, t0, a0),    //
+            Addi(a0, a0, 1),    //
+            Jal(zero, 8),       //
+            Srli(a0, a0, 1),    // halve:
+            Addi(a1, a1, 1),    // steps += 1
+            Jal(zero, -36),     // to loop
+            Ecall(),            // done:
+    };
+
+    std::vector<std::vector<std::uint8_t>> memories;
+    std::vector<owl::Cpu> cpus;
+    memories.reserve(guests);
+    cpus.reserve(guests);
+    for (std::size_t i = 0; i < guests; ++i)
+    {
+        auto& memory = memories.emplace_back(4096);
+        std::memcpy(memory.data(), code, sizeof(code));
+        auto& cpu = cpus.emplace_back(memory);
+        cpu.SetEngine(owl::Engine::Block);
+        cpu.State().x[a0] = static_cast<std::uint32_t>(i + 1);
+    }
+
+    owl::BatchRunner runner;
+    auto const exits = runner.Run(cpus, 1000000);
+
+    std::size_t longest = 0;
+    std::uint64_t instructions = 0;
+    for (std::size_t i = 0; i < guests; ++i)
+    {
+        if (exits[i] != owl::Exit::Ecall)
+        {
+            std::cerr << "Guest " << i << " stopped unexpectedly\n";
+            return 1;
+        }
+        if (cpus[i].State().x[a1] > cpus[longest].State().x[a1])
+        {
+            longest = i;
+        }
+        instructions += cpus[i].State().instret;
+    }
+    std::cout << "Ran " << guests << " guests for " << instructions << " instructions on " << runner.Threads()
+              << " threads\n";
+    std::cout << "The longest Collatz sequence starts at " << longest + 1 << " and takes " << cpus[longest].State().x[a1]
+              << " steps\n";
+}
@@ -1,9 +1,20 @@
+#include "owl-cpu/encoder.h"
 #include "owl-cpu/owl-cpu.h"
 
+#include <array>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 
 auto main() -> int
 {
-    ExportedClass myClass;
-    std::cout << "Hello from " << myClass.name() << '\n';
+    using namespace owl::encode;
+
+    constexpr std::array code{Addi(a0, zero, 42), Ecall()};
+    std::array<std::uint8_t, 64> memory{};
+    std::memcpy(memory.data(), code.data(), sizeof(code));
+
+    owl::Cpu cpu{memory};
+    cpu.Run(100);
+    std::cout << "Hello from owl-cpu, a0 = " << cpu.State().x[a0] << '\n';
 }
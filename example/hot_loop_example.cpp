@@ -0,0 +1,228 @@
+#include "owl-cpu/encoder.h"
+#include "owl-cpu/loader.h"
+#include "owl-cpu/owl-cpu.h"
+#include "owl-cpu/profile.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Loads a guest binary and runs it for the same number of instructions under each engine, printing how fast each ran,
+// what it translated and, if the library was built with owl-cpu_PROFILER, the blocks that it entered most. Every
+// engine must leave the guest in the same state, so this doubles as a smoke test of a build of the library.
+//
+// Usage: hot_loop_example [guest [instructions]], where guest is an ELF executable or a raw binary, which is loaded at
+// rawAddress. Without one it runs a built-in kernel. Each ecall resumes the guest, except for an exit system call (an
+// ecall with a7 = 93), which restarts it from its entry point, so that a short program runs for long enough to measure.
+
+namespace
+{
+    using namespace owl::encode;
+
+    constexpr std::uint32_t rawAddress = 0x10000;
+    constexpr std::uint64_t defaultInstructions = 20'000'000;
+    constexpr std::uint32_t exitCall = 93;
+    constexpr std::size_t topBlocks = 5;
+
+    // Fills a table of 1024 words with a hash chain then sums it, calls the host, and starts again.
+    auto BuiltInKernel() -> std::vector<std::uint32_t>
+    {
+        return {
+                Lui(s0, 0x20),        // s0 = the table at 0x20000
+                Addi(s1, zero, 1024), // s1 = its length in words
+                Addi(a0, zero, 1),    // the hash
+                Addi(t0, s0, 0),      // p
+                Addi(t1, s1, 0),      // n
+                Slli(a1, a0, 5),      // fill: hash = (hash * 33) ^ 0x5a5
+                Add(a0, a0, a1),      //
+                Xori(a0, a0, 0x5a5),  //
+                Sw(a0, t0, 0),        // *p = hash
+                Addi(t0, t0, 4),      //
+                Addi(t1, t1, -1),     //
+                Bne(t1, zero, -24),   // to fill
+                Addi(t0, s0, 0),      //
+                Addi(t1, s1, 0),      //
+                Addi(a0, zero, 0),    // the sum
+                Lw(a1, t0, 0),        // sum: sum += *p
+                Add(a0, a0, a1),      //
+                Addi(t0, t0, 4),      //
+                Addi(t1, t1, -1),     //
+                Bne(t1, zero, -16),   // to sum
+                Ecall(),              //
+                Jal(zero, -84),       // to the start
+        };
+    }
+
+    auto WriteBuiltInKernel() -> std::filesystem::path
+    {
+        auto const code = BuiltInKernel();
+        auto path = std::filesystem::temp_directory_path() / "owl-cpu-hot-loop.bin";
+        std::ofstream out{path, std::ios::binary | std::ios::trunc};
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        out.write(reinterpret_cast<char const*>(code.data()),
+                  static_cast<std::streamsize>(code.size() * sizeof(std::uint32_t)));
+        return path;
+    }
+
+    auto IsElf(std::filesystem::path const& path) -> bool
+    {
+        std::array<char, 4> magic{};
+        std::ifstream in{path, std::ios::binary};
+        in.read(magic.data(), magic.size());
+        return in && magic == std::array{'\x7f', 'E', 'L', 'F'};
+    }
+
+    auto EngineName(owl::Engine engine) -> char const*
+    {
+        switch (engine)
+        {
+        case owl::Engine::Switch:
+            return "Switch";
+        case owl::Engine::Threaded:
+            return "Threaded";
+        case owl::Engine::Block:
+            return "Block";
+        case owl::Engine::Tiered:
+            return "Tiered";
+        case owl::Engine::Timed:
+            return "Timed";
+        }
+        return "Unknown";
+    }
+
+    struct Result
+    {
+        owl::CpuState state;
+        owl::Stats stats;
+        std::vector<owl::Profile::Block> blocks; // the most entered first
+    };
+
+    // Runs the guest under an engine until it has retired `instructions`. Returns false if it stopped for any reason
+    // other than a host call.
+    auto Run(std::filesystem::path const& guest, owl::Engine engine, std::uint64_t instructions, Result& result) -> bool
+    {
+        owl::AddressSpace space;
+        auto const image = IsElf(guest) ? owl::LoadElf(space, guest) : owl::LoadBinary(space, guest, rawAddress);
+        owl::Cpu cpu{space, image.entry};
+        cpu.SetEngine(engine);
+        auto const initial = cpu.State();
+
+        owl::ResetProfile();
+        for (auto remaining = instructions; remaining > 0;)
+        {
+            auto const before = cpu.State().instret;
+            auto const exit = cpu.Run(remaining);
+            remaining -= cpu.State().instret - before;
+            if (exit == owl::Exit::Ecall && cpu.State().x[a7] == exitCall)
+            {
+                auto const instret = cpu.State().instret;
+                cpu.State() = initial;
+                cpu.State().instret = instret;
+            }
+            else if (exit != owl::Exit::Ecall && exit != owl::Exit::BudgetExhausted)
+            {
+                std::cerr << EngineName(engine) << ": the guest stopped with exit " << static_cast<int>(exit)
+                          << " at pc 0x" << std::hex << cpu.State().pc << std::dec << '\n';
+                return false;
+            }
+        }
+
+        result.state = cpu.State();
+        result.stats = cpu.Stats();
+        result.blocks = owl::CollectProfile().blocks;
+        std::ranges::sort(result.blocks, [](auto const& a, auto const& b) { return a.hits > b.hits; });
+        return true;
+    }
+
+    void PrintTopBlocks(owl::Engine engine, std::vector<owl::Profile::Block> const& blocks)
+    {
+        std::cout << "\nTop blocks under Engine::" << EngineName(engine) << ":\n";
+        for (std::size_t i = 0; i < std::min(topBlocks, blocks.size()); ++i)
+        {
+            std::cout << "  0x" << std::hex << std::setw(8) << std::setfill('0') << blocks[i].pc << std::dec
+                      << std::setfill(' ') << std::setw(14) << blocks[i].hits << " hits\n";
+        }
+    }
+} // namespace
+
+auto main(int argc, char** argv) -> int
+{
+    try
+    {
+        auto const args = std::vector<std::string>(argv, argv + argc);
+        auto const builtIn = args.size() < 2;
+        auto const guest = builtIn ? WriteBuiltInKernel() : std::filesystem::path{args[1]};
+        auto const instructions = args.size() < 3 ? defaultInstructions : std::stoull(args[2]);
+
+        std::cout << "Running " << (builtIn ? std::string{"the built-in kernel"} : guest.string()) << " for "
+                  << instructions << " instructions under each engine\n\n";
+        std::cout << std::left << std::setw(10) << "Engine" << std::right << std::setw(10) << "MIPS" << std::setw(8)
+                  << "Pages" << std::setw(8) << "Shared" << std::setw(8) << "Blocks" << std::setw(14) << "Block hits"
+                  << std::setw(14) << "Chain hits" << '\n';
+
+        auto passed = true;
+        std::vector<std::pair<owl::Engine, Result>> results;
+        for (auto const engine : {owl::Engine::Switch, owl::Engine::Threaded, owl::Engine::Block, owl::Engine::Tiered,
+                                  owl::Engine::Timed})
+        {
+            if (!owl::IsEngineAvailable(engine))
+            {
+                continue;
+            }
+            Result result;
+            if (!Run(guest, engine, instructions, result))
+            {
+                passed = false;
+                continue;
+            }
+            auto const& stats = result.stats;
+            std::cout << std::left << std::setw(10) << EngineName(engine) << std::right << std::fixed
+                      << std::setprecision(1) << std::setw(10) << stats.Mips() << std::setw(8) << stats.pageMisses
+                      << std::setw(8) << stats.sharedPages << std::setw(8) << stats.blockMisses << std::setw(14)
+                      << stats.blockHits << std::setw(14) << stats.chainHits << '\n';
+
+            // Every engine retires the same instructions, so must agree on where they left the guest.
+            auto const& reference = results.empty() ? result : results.front().second;
+            if (result.state.x != reference.state.x || result.state.pc != reference.state.pc)
+            {
+                std::cerr << EngineName(engine) << ": the guest's state differs from that under Engine::"
+                          << EngineName(results.front().first) << '\n';
+                passed = false;
+            }
+            results.emplace_back(engine, std::move(result));
+        }
+
+        if (!owl::IsProfilerAvailable())
+        {
+            std::cout << "\nBuild the library with owl-cpu_PROFILER=ON to see the top blocks.\n";
+        }
+        for (auto const& [engine, result] : results)
+        {
+            if (!result.blocks.empty())
+            {
+                PrintTopBlocks(engine, result.blocks);
+            }
+        }
+
+        if (builtIn)
+        {
+            std::filesystem::remove(guest);
+        }
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+}
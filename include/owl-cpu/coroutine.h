@@ -0,0 +1,226 @@
+#pragma once
+
+#include "owl-cpu/owl-cpu.h"
+#include "owl-cpu/owl-cpu_export.hpp"
+
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+/**
+ * @file
+ * @brief Running guests from C++20 coroutines
+ *
+ * A GuestTask is a coroutine that drives one or more cores by awaiting Cpu::RunFor(), for example:
+ *
+ * @code
+ * auto Serve(owl::Cpu& cpu) -> owl::GuestTask
+ * {
+ *     for (;;)
+ *     {
+ *         auto const exit = co_await cpu.RunFor(10000);
+ *         if (exit == owl::Exit::Ecall)
+ *         {
+ *             co_await ServiceHostCall(cpu); // any awaitable that resumes the task through Scheduler::Post()
+ *         }
+ *         else if (exit != owl::Exit::BudgetExhausted)
+ *         {
+ *             co_return;
+ *         }
+ *     }
+ * }
+ * @endcode
+ *
+ * Tasks are spawned onto a Scheduler, whose few threads take turns between them. Awaiting RunFor() suspends the task
+ * at the back of the scheduler's queue and runs the core once the task comes round again, so every task gets its turn
+ * between slices, and a task that is waiting for something else, such as host I/O, takes no thread at all. A task is
+ * only its coroutine frame, so tens of thousands of them cost little more than their cores.
+ *
+ * Await RunFor() into a variable, as above, rather than in a condition, which GCC 12 miscompiles.
+ */
+
+namespace owl
+{
+    namespace detail
+    {
+        class SchedulerPool;
+    } // namespace detail
+
+    class GuestTask;
+
+    /**
+     * @brief Resumes GuestTasks, and any other coroutines that are posted to it, on a pool of threads
+     *
+     * Please see the note in owl-cpu.h for considerations when creating shared libraries.
+     */
+    class OWL_CPU_EXPORT Scheduler
+    {
+    public:
+        /**
+         * @brief Starts a pool of threads, one for each hardware thread if `threads` is zero
+         */
+        explicit Scheduler(unsigned threads = 0);
+
+        /**
+         * @brief Stops the threads. Tasks that haven't finished by then are never resumed, so Wait() for them first.
+         */
+        ~Scheduler();
+
+        Scheduler(Scheduler const&) = delete;
+        auto operator=(Scheduler const&) -> Scheduler& = delete;
+        Scheduler(Scheduler&&) = delete;
+        auto operator=(Scheduler&&) -> Scheduler& = delete;
+
+        /**
+         * @brief Starts a task on one of the threads, after those that are already queued
+         *
+         * Throws std::invalid_argument if the task is empty, because it has been moved from.
+         */
+        void Spawn(GuestTask task);
+
+        /**
+         * @brief Queues a suspended coroutine to be resumed on one of the threads
+         *
+         * Awaitables that complete from elsewhere, for example when host I/O finishes, use this to hand the task that
+         * awaited them back to the scheduler. It may be called from any thread.
+         */
+        void Post(std::coroutine_handle<> handle);
+
+        /**
+         * @brief Waits for every task that has been spawned to finish
+         *
+         * Rethrows the first exception that escaped a task, after the others finish.
+         */
+        void Wait();
+
+        /**
+         * @brief Returns the number of threads
+         */
+        auto Threads() const -> unsigned;
+
+    private:
+        friend class GuestTask;
+
+        void Finish(std::exception_ptr error) noexcept; // called by each task as it finishes
+
+        OWL_CPU_SUPPRESS_C4251
+        std::unique_ptr<detail::SchedulerPool> m_pool;
+    };
+
+    /**
+     * @brief A coroutine that runs guests on a Scheduler
+     *
+     * A task doesn't start until it is spawned, and its frame is freed when it finishes. Destroying a task that was
+     * never spawned destroys its coroutine.
+     */
+    class GuestTask
+    {
+    public:
+        class promise_type
+        {
+        public:
+            auto get_return_object() -> GuestTask { return GuestTask{Handle::from_promise(*this)}; }
+            auto initial_suspend() noexcept -> std::suspend_always { return {}; }
+            auto final_suspend() noexcept -> auto
+            {
+                struct Finished
+                {
+                    auto await_ready() const noexcept -> bool { return false; }
+                    void await_suspend(Handle handle) const noexcept
+                    {
+                        auto* scheduler = handle.promise().m_scheduler;
+                        auto error = std::move(handle.promise().m_error);
+                        handle.destroy();
+                        scheduler->Finish(std::move(error));
+                    }
+                    void await_resume() const noexcept {}
+                };
+                return Finished{};
+            }
+            void return_void() {}
+            void unhandled_exception() { m_error = std::current_exception(); }
+
+            /**
+             * @brief Returns the scheduler that the task was spawned on
+             */
+            auto GetScheduler() const -> Scheduler* { return m_scheduler; }
+
+        private:
+            friend class Scheduler;
+
+            Scheduler* m_scheduler{};
+            std::exception_ptr m_error;
+        };
+
+        using Handle = std::coroutine_handle<promise_type>;
+
+        GuestTask(GuestTask const&) = delete;
+        auto operator=(GuestTask const&) -> GuestTask& = delete;
+        GuestTask(GuestTask&& other) noexcept : m_handle{std::exchange(other.m_handle, {})} {}
+        auto operator=(GuestTask&& other) noexcept -> GuestTask&
+        {
+            if (this != &other)
+            {
+                Reset();
+                m_handle = std::exchange(other.m_handle, {});
+            }
+            return *this;
+        }
+        ~GuestTask() { Reset(); }
+
+    private:
+        friend class Scheduler;
+
+        explicit GuestTask(Handle handle) : m_handle{handle} {}
+
+        void Reset()
+        {
+            if (m_handle)
+            {
+                m_handle.destroy();
+                m_handle = {};
+            }
+        }
+
+        Handle m_handle;
+    };
+
+    /**
+     * @brief What Cpu::RunFor() returns: awaiting it runs the core and produces the owl::Exit from Cpu::Run()
+     *
+     * In a GuestTask, the task goes to the back of its scheduler's queue first. Any other coroutine runs the core
+     * straight away, without suspending.
+     */
+    class RunAwaiter
+    {
+    public:
+        RunAwaiter(Cpu& cpu, std::uint64_t cycles) : m_cpu{cpu}, m_cycles{cycles} {}
+
+        auto await_ready() const noexcept -> bool { return false; }
+
+        template<typename Promise>
+        auto await_suspend(std::coroutine_handle<Promise> handle) const -> std::coroutine_handle<>
+        {
+            if constexpr (std::is_same_v<Promise, GuestTask::promise_type>)
+            {
+                handle.promise().GetScheduler()->Post(handle);
+                return std::noop_coroutine();
+            }
+            else
+            {
+                return handle;
+            }
+        }
+
+        auto await_resume() -> Exit { return m_cpu.Run(m_cycles); }
+
+    private:
+        Cpu& m_cpu;
+        std::uint64_t m_cycles;
+    };
+
+    inline auto Cpu::RunFor(std::uint64_t cycles) -> RunAwaiter { return RunAwaiter{*this, cycles}; }
+} // namespace owl
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+namespace owl::detail
+{
+    // Returns the host word at p for std::atomic_ref to operate on, or nullptr if it isn't aligned for one, which is
+    // always the case for a misaligned guest address if guest memory is aligned on the host.
+    inline auto AtomicWord(std::uint8_t* p) -> std::uint32_t*
+    {
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        if (reinterpret_cast<std::uintptr_t>(p) % std::atomic_ref<std::uint32_t>::required_alignment != 0)
+        {
+            return nullptr;
+        }
+        return reinterpret_cast<std::uint32_t*>(p); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    }
+
+    // Bounds-checked little-endian access to a span of guest memory.
+    class CheckedMemory
+    {
+    public:
+        explicit CheckedMemory(std::span<std::uint8_t> memory) : m_memory{memory} {}
+
+        template<typename T>
+        auto Read(std::uint32_t address, T& value) const -> bool
+        {
+            if (!Contains(address, sizeof(T)))
+            {
+                return false;
+            }
+            std::memcpy(&value, m_memory.data() + address, sizeof(T));
+            return true;
+        }
+
+        template<typename T>
+        auto Write(std::uint32_t address, T value) const -> bool
+        {
+            if (!Contains(address, sizeof(T)))
+            {
+                return false;
+            }
+            std::memcpy(m_memory.data() + address, &value, sizeof(T));
+            return true;
+        }
+
+        auto Word(std::uint32_t address) const -> std::uint32_t*
+        {
+            return Contains(address, sizeof(std::uint32_t)) ? AtomicWord(m_memory.data() + address) : nullptr;
+        }
+
+        // Returns the memory itself, for the JIT to access directly.
+        auto View() const -> std::span<std::uint8_t> { return m_memory; }
+
+        static constexpr auto IsMemory(std::uint32_t /*address*/) -> bool { return true; }
+
+    private:
+        auto Contains(std::uint32_t address, std::size_t size) const -> bool
+        {
+            return size <= m_memory.size() && address <= m_memory.size() - size;
+        }
+
+        std::span<std::uint8_t> m_memory;
+    };
+} // namespace owl::detail
@@ -0,0 +1,724 @@
+#pragma once
+
+#include "owl-cpu/encoder.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace owl::detail
+{
+// Every operation that the decoder can produce, in dispatch table order. FetchFault is not an instruction; it marks
+// instruction slots that lie outside of guest memory. The operations after Ebreak are the specialized forms that the
+// decoder produces for instructions that read or write x0, e.g., Li for addi rd, x0, imm, and Nop for an ALU operation
+// whose result is discarded. The operations after those are the compressed forms of every operation that a 16-bit
+// instruction can decode to and that advances pc past itself, which OWL_CPU_FOR_EACH_COMPRESSION lists.
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define OWL_CPU_FOR_EACH_OP(X)                                                                                         \
+    X(Illegal)                                                                                                         \
+    X(FetchFault)                                                                                                      \
+    X(Lui)                                                                                                             \
+    X(Auipc)                                                                                                           \
+    X(Jal)                                                                                                             \
+    X(Jalr)                                                                                                            \
+    X(Beq)                                                                                                             \
+    X(Bne)                                                                                                             \
+    X(Blt)                                                                                                             \
+    X(Bge)                                                                                                             \
+    X(Bltu)                                                                                                            \
+    X(Bgeu)                                                                                                            \
+    X(Lb)                                                                                                              \
+    X(Lh)                                                                                                              \
+    X(Lw)                                                                                                              \
+    X(Lbu)                                                                                                             \
+    X(Lhu)                                                                                                             \
+    X(Sb)                                                                                                              \
+    X(Sh)                                                                                                              \
+    X(Sw)                                                                                                              \
+    X(Addi)                                                                                                            \
+    X(Slti)                                                                                                            \
+    X(Sltiu)                                                                                                           \
+    X(Xori)                                                                                                            \
+    X(Ori)                                                                                                             \
+    X(Andi)                                                                                                            \
+    X(Slli)                                                                                                            \
+    X(Srli)                                                                                                            \
+    X(Srai)                                                                                                            \
+    X(Add)                                                                                                             \
+    X(Sub)                                                                                                             \
+    X(Sll)                                                                                                             \
+    X(Slt)                                                                                                             \
+    X(Sltu)                                                                                                            \
+    X(Xor)                                                                                                             \
+    X(Srl)                                                                                                             \
+    X(Sra)                                                                                                             \
+    X(Or)                                                                                                              \
+    X(And)                                                                                                             \
+    X(Mul)                                                                                                             \
+    X(Mulh)                                                                                                            \
+    X(Mulhsu)                                                                                                          \
+    X(Mulhu)                                                                                                           \
+    X(Div)                                                                                                             \
+    X(Divu)                                                                                                            \
+    X(Rem)                                                                                                             \
+    X(Remu)                                                                                                            \
+    X(LrW)                                                                                                             \
+    X(ScW)                                                                                                             \
+    X(AmoswapW)                                                                                                        \
+    X(AmoaddW)                                                                                                         \
+    X(AmoxorW)                                                                                                         \
+    X(AmoandW)                                                                                                         \
+    X(AmoorW)                                                                                                          \
+    X(AmominW)                                                                                                         \
+    X(AmomaxW)                                                                                                         \
+    X(AmominuW)                                                                                                        \
+    X(AmomaxuW)                                                                                                        \
+    X(Fence)                                                                                                           \
+    X(Ecall)                                                                                                           \
+    X(Ebreak)                                                                                                          \
+    X(Nop)                                                                                                             \
+    X(Li)                                                                                                              \
+    X(Mv)                                                                                                              \
+    X(J)                                                                                                               \
+    X(Jr)                                                                                                              \
+    X(Beqz)                                                                                                            \
+    X(Bnez)                                                                                                            \
+    X(CLw)                                                                                                             \
+    X(CSw)                                                                                                             \
+    X(CAddi)                                                                                                           \
+    X(CAndi)                                                                                                           \
+    X(CSlli)                                                                                                           \
+    X(CSrli)                                                                                                           \
+    X(CSrai)                                                                                                           \
+    X(CAdd)                                                                                                            \
+    X(CSub)                                                                                                            \
+    X(CXor)                                                                                                            \
+    X(COr)                                                                                                             \
+    X(CAnd)                                                                                                            \
+    X(CJal)                                                                                                            \
+    X(CJalr)                                                                                                           \
+    X(CEbreak)                                                                                                         \
+    X(CNop)                                                                                                            \
+    X(CLi)                                                                                                             \
+    X(CMv)                                                                                                             \
+    X(CBeqz)                                                                                                           \
+    X(CBnez)
+
+// The operations that have compressed forms, each of which is named for its operation with a C in front, e.g., CAddi.
+// A compressed operation executes exactly like its operation, except that it is two bytes long rather than four. Jumps
+// that don't link have none, because they don't advance pc past themselves.
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define OWL_CPU_FOR_EACH_COMPRESSION(X)                                                                                \
+    X(Lw)                                                                                                              \
+    X(Sw)                                                                                                              \
+    X(Addi)                                                                                                            \
+    X(Andi)                                                                                                            \
+    X(Slli)                                                                                                            \
+    X(Srli)                                                                                                            \
+    X(Srai)                                                                                                            \
+    X(Add)                                                                                                             \
+    X(Sub)                                                                                                             \
+    X(Xor)                                                                                                             \
+    X(Or)                                                                                                              \
+    X(And)                                                                                                             \
+    X(Jal)                                                                                                             \
+    X(Jalr)                                                                                                            \
+    X(Ebreak)                                                                                                          \
+    X(Nop)                                                                                                             \
+    X(Li)                                                                                                              \
+    X(Mv)                                                                                                              \
+    X(Beqz)                                                                                                            \
+    X(Bnez)
+
+// The pairs of adjacent operations that block translation fuses into superinstructions, which execute both with a
+// single dispatch. They are the idioms that compilers emit for loading a 32-bit constant with lui, which decodes to Li,
+// then addi, for calling or jumping to a distant function, indexing an array, branching on a comparison and counting a
+// loop down. The second operation needn't use the first one's result, because a fused pair executes exactly as its two
+// operations would.
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define OWL_CPU_FOR_EACH_FUSION(X)                                                                                     \
+    X(Li, Addi)                                                                                                        \
+    X(Auipc, Jalr)                                                                                                     \
+    X(Auipc, Jr)                                                                                                       \
+    X(Slli, Add)                                                                                                       \
+    X(Slt, Beqz)                                                                                                       \
+    X(Slt, Bnez)                                                                                                       \
+    X(Sltu, Beqz)                                                                                                      \
+    X(Sltu, Bnez)                                                                                                      \
+    X(Slti, Beqz)                                                                                                      \
+    X(Slti, Bnez)                                                                                                      \
+    X(Sltiu, Beqz)                                                                                                     \
+    X(Sltiu, Bnez)                                                                                                     \
+    X(Addi, Bne)                                                                                                       \
+    X(Addi, Bnez)
+
+    // The decoder's operations, followed by a fused operation for each pair, e.g., SlliAdd for slli then add. Only
+    // blocks hold fused operations, in place of the first operation of the pair, with the first operation's operands,
+    // and followed by the second operation as it was decoded.
+    enum class Op : std::uint8_t
+    {
+#define OWL_CPU_OP_ENUMERATOR(name) name,
+        OWL_CPU_FOR_EACH_OP(OWL_CPU_OP_ENUMERATOR)
+#undef OWL_CPU_OP_ENUMERATOR
+#define OWL_CPU_FUSION_ENUMERATOR(first, second) first##second,
+        OWL_CPU_FOR_EACH_FUSION(OWL_CPU_FUSION_ENUMERATOR)
+#undef OWL_CPU_FUSION_ENUMERATOR
+    };
+
+#define OWL_CPU_OP_COUNT(...) +1
+    inline constexpr auto opCount = 0 OWL_CPU_FOR_EACH_OP(OWL_CPU_OP_COUNT);
+    inline constexpr auto fusionCount = 0 OWL_CPU_FOR_EACH_FUSION(OWL_CPU_OP_COUNT);
+#undef OWL_CPU_OP_COUNT
+
+// The case labels of every fused operation, for switches over operations that can't hold them.
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define OWL_CPU_FUSION_CASE(first, second) case Op::first##second:
+
+    // Returns true for the fused operations.
+    constexpr auto IsFused(Op op) -> bool { return static_cast<std::size_t>(op) >= opCount; }
+
+    // Returns the index of a fused operation among the fusions.
+    constexpr auto FusionIndex(Op op) -> std::size_t { return static_cast<std::size_t>(op) - opCount; }
+
+    // Returns the fused operation for a pair, or the first operation if the pair doesn't fuse.
+    constexpr auto Fuse(Op first, Op second) -> Op
+    {
+#define OWL_CPU_FUSE(a, b)                                                                                             \
+    if (first == Op::a && second == Op::b)                                                                             \
+    {                                                                                                                  \
+        return Op::a##b;                                                                                               \
+    }
+        OWL_CPU_FOR_EACH_FUSION(OWL_CPU_FUSE)
+#undef OWL_CPU_FUSE
+        return first;
+    }
+
+    // Returns true for the compressed operations.
+    constexpr auto IsCompressed(Op op) -> bool { return op >= Op::CLw && op <= Op::CBnez; }
+
+    // Returns the operation that a compressed operation is the compressed form of, or the operation itself if it isn't
+    // compressed.
+    constexpr auto Uncompress(Op op) -> Op
+    {
+        switch (op)
+        {
+#define OWL_CPU_UNCOMPRESS(name)                                                                                       \
+    case Op::C##name:                                                                                                  \
+        return Op::name;
+            OWL_CPU_FOR_EACH_COMPRESSION(OWL_CPU_UNCOMPRESS)
+#undef OWL_CPU_UNCOMPRESS
+        default:
+            return op;
+        }
+    }
+
+    // Returns the compressed form of an operation, or the operation itself if it has none.
+    constexpr auto Compress(Op op) -> Op
+    {
+        switch (op)
+        {
+#define OWL_CPU_COMPRESS(name)                                                                                         \
+    case Op::name:                                                                                                     \
+        return Op::C##name;
+            OWL_CPU_FOR_EACH_COMPRESSION(OWL_CPU_COMPRESS)
+#undef OWL_CPU_COMPRESS
+        default:
+            return op;
+        }
+    }
+
+    // Returns the length in bytes of an instruction with the given operation, which isn't fused, i.e., how far it
+    // advances pc if it doesn't jump.
+    constexpr auto InstructionSize(Op op) -> std::uint32_t { return IsCompressed(op) ? 2 : 4; }
+
+#define OWL_CPU_COMPRESSION_COUNT(...) +1
+    static_assert(static_cast<std::size_t>(Op::CLw) + (0 OWL_CPU_FOR_EACH_COMPRESSION(OWL_CPU_COMPRESSION_COUNT))
+                          == opCount,
+                  "the compressed operations come last, in the same order as their operations");
+#undef OWL_CPU_COMPRESSION_COUNT
+
+    // Returns the first operation of a fused pair, or the operation itself if it isn't fused.
+    constexpr auto Unfuse(Op op) -> Op
+    {
+        switch (op)
+        {
+#define OWL_CPU_UNFUSE(first, second)                                                                                  \
+    case Op::first##second:                                                                                            \
+        return Op::first;
+            OWL_CPU_FOR_EACH_FUSION(OWL_CPU_UNFUSE)
+#undef OWL_CPU_UNFUSE
+        default:
+            return op;
+        }
+    }
+
+    // An instruction broken out into its operation, register indices and sign-extended immediate. Unused fields are
+    // zero. Shift instructions carry their shift amount in imm. Only loads, including atomics, can have rd = 0, as
+    // every other instruction that writes x0 is decoded to Nop, J or Jr, so handlers can write rd without checking it.
+    // Atomics address memory with rs1 alone. Mv copies rs1 to rd, and Beqz and Bnez compare rs1 with rs2 = 0.
+    // A compressed instruction decodes to the compressed form of the operation that its 32-bit expansion decodes to,
+    // so that its length is part of its operation rather than something that every handler loads.
+    struct Decoded
+    {
+        Op op{Op::Illegal};
+        std::uint8_t rd{};
+        std::uint8_t rs1{};
+        std::uint8_t rs2{};
+        std::int32_t imm{};
+    };
+
+    static_assert(sizeof(Decoded) == 8);
+
+    // The decoder's building blocks, which only Decode() and the decoder's compile-time checks use.
+    namespace decoding
+    {
+        constexpr auto Bits(std::uint32_t word, unsigned hi, unsigned lo) -> std::uint32_t
+        {
+            return (word >> lo) & ((1U << (hi - lo + 1)) - 1);
+        }
+
+        constexpr auto SignExtend(std::uint32_t value, unsigned bits) -> std::int32_t
+        {
+            auto const shift = 32 - bits;
+            return static_cast<std::int32_t>(value << shift) >> shift;
+        }
+
+        constexpr auto ImmI(std::uint32_t word) -> std::int32_t { return SignExtend(Bits(word, 31, 20), 12); }
+
+        constexpr auto ImmS(std::uint32_t word) -> std::int32_t
+        {
+            return SignExtend((Bits(word, 31, 25) << 5) | Bits(word, 11, 7), 12);
+        }
+
+        constexpr auto ImmB(std::uint32_t word) -> std::int32_t
+        {
+            return SignExtend((Bits(word, 31, 31) << 12) | (Bits(word, 7, 7) << 11) | (Bits(word, 30, 25) << 5)
+                                      | (Bits(word, 11, 8) << 1),
+                              13);
+        }
+
+        constexpr auto ImmU(std::uint32_t word) -> std::int32_t { return static_cast<std::int32_t>(word & 0xfffff000); }
+
+        constexpr auto ImmJ(std::uint32_t word) -> std::int32_t
+        {
+            return SignExtend((Bits(word, 31, 31) << 20) | (Bits(word, 19, 12) << 12) | (Bits(word, 20, 20) << 11)
+                                      | (Bits(word, 30, 21) << 1),
+                              21);
+        }
+
+        constexpr auto Rd(std::uint32_t word) -> std::uint8_t { return static_cast<std::uint8_t>(Bits(word, 11, 7)); }
+        constexpr auto Rs1(std::uint32_t word) -> std::uint8_t { return static_cast<std::uint8_t>(Bits(word, 19, 15)); }
+        constexpr auto Rs2(std::uint32_t word) -> std::uint8_t { return static_cast<std::uint8_t>(Bits(word, 24, 20)); }
+
+        constexpr auto TypeR(Op op, std::uint32_t word) -> Decoded
+        {
+            return {.op = op, .rd = Rd(word), .rs1 = Rs1(word), .rs2 = Rs2(word)};
+        }
+
+        constexpr auto TypeI(Op op, std::uint32_t word) -> Decoded
+        {
+            return {.op = op, .rd = Rd(word), .rs1 = Rs1(word), .imm = ImmI(word)};
+        }
+
+        constexpr auto TypeS(Op op, std::uint32_t word) -> Decoded
+        {
+            return {.op = op, .rs1 = Rs1(word), .rs2 = Rs2(word), .imm = ImmS(word)};
+        }
+
+        constexpr auto TypeB(Op op, std::uint32_t word) -> Decoded
+        {
+            return {.op = op, .rs1 = Rs1(word), .rs2 = Rs2(word), .imm = ImmB(word)};
+        }
+
+        constexpr auto Shift(Op op, std::uint32_t word) -> Decoded
+        {
+            return {.op = op, .rd = Rd(word), .rs1 = Rs1(word), .imm = static_cast<std::int32_t>(Bits(word, 24, 20))};
+        }
+
+        // How each major opcode lays out its operands.
+        enum class Format : std::uint8_t
+        {
+            Invalid,
+            R,     // register-register ALU operations, which are further selected by funct7
+            I,     // loads and jalr
+            OpImm, // ALU immediates, whose shifts are further selected by funct7
+            S,
+            B,
+            U,
+            J,
+            Fence,
+            System,
+            Atomic, // word-sized atomics, which are selected by funct5
+        };
+
+        struct Major
+        {
+            Format format{Format::Invalid};
+            std::array<Op, 8> ops{}; // by funct3, with Op::Illegal for the encodings that don't exist
+        };
+
+        constexpr auto Any(Op op) -> std::array<Op, 8> { return {op, op, op, op, op, op, op, op}; }
+        constexpr auto Only(Op op) -> std::array<Op, 8> { return {op}; } // funct3 must be zero
+
+        // The decoding of every major opcode, indexed by bits 6:2 of the instruction.
+        inline constexpr auto majors = [] {
+            std::array<Major, 32> table{};
+            table[0b01101] = {Format::U, Any(Op::Lui)};
+            table[0b00101] = {Format::U, Any(Op::Auipc)};
+            table[0b11011] = {Format::J, Any(Op::Jal)};
+            table[0b11001] = {Format::I, Only(Op::Jalr)};
+            table[0b11000] = {
+                    .format = Format::B,
+                    .ops = {Op::Beq, Op::Bne, Op::Illegal, Op::Illegal, Op::Blt, Op::Bge, Op::Bltu, Op::Bgeu}};
+            table[0b00000] = {Format::I, {Op::Lb, Op::Lh, Op::Lw, Op::Illegal, Op::Lbu, Op::Lhu}};
+            table[0b01000] = {Format::S, {Op::Sb, Op::Sh, Op::Sw}};
+            table[0b00100] = {.format = Format::OpImm,
+                              .ops = {Op::Addi, Op::Slli, Op::Slti, Op::Sltiu, Op::Xori, Op::Srli, Op::Ori, Op::Andi}};
+            table[0b01100] = {Format::R, Any(Op::Illegal)};
+            table[0b00011] = {Format::Fence, Only(Op::Fence)};
+            table[0b01011] = {Format::Atomic, {Op::Illegal, Op::Illegal, Op::AmoaddW}}; // funct3 must be two
+            table[0b11100] = {Format::System, Any(Op::Illegal)};
+            return table;
+        }();
+
+        // The register-register operations by funct3, for each funct7 that has any.
+        inline constexpr std::array<Op, 8> baseOps{Op::Add, Op::Sll, Op::Slt, Op::Sltu,
+                                                   Op::Xor, Op::Srl, Op::Or,  Op::And};
+        inline constexpr std::array<Op, 8> alternateOps{Op::Sub,     Op::Illegal, Op::Illegal, Op::Illegal,
+                                                        Op::Illegal, Op::Sra,     Op::Illegal, Op::Illegal};
+        inline constexpr std::array<Op, 8> multiplyOps{Op::Mul, Op::Mulh, Op::Mulhsu, Op::Mulhu,
+                                                       Op::Div, Op::Divu, Op::Rem,    Op::Remu};
+
+        constexpr auto DecodeOp(std::uint32_t word, std::uint32_t funct3) -> Decoded
+        {
+            switch (Bits(word, 31, 25))
+            {
+            case 0b0000000:
+                return TypeR(baseOps[funct3], word);
+            case 0b0100000:
+                return alternateOps[funct3] == Op::Illegal ? Decoded{} : TypeR(alternateOps[funct3], word);
+            case 0b0000001:
+                return TypeR(multiplyOps[funct3], word);
+            default:
+                return {};
+            }
+        }
+
+        constexpr auto DecodeOpImm(Op op, std::uint32_t word) -> Decoded
+        {
+            if (op != Op::Slli && op != Op::Srli)
+            {
+                return TypeI(op, word);
+            }
+            switch (Bits(word, 31, 25))
+            {
+            case 0b0000000:
+                return Shift(op, word);
+            case 0b0100000:
+                return op == Op::Srli ? Shift(Op::Srai, word) : Decoded{};
+            default:
+                return {};
+            }
+        }
+
+        // Decodes lr.w, sc.w or an AMO, ignoring the aq and rl bits because every atomic is sequentially consistent.
+        constexpr auto DecodeAtomic(std::uint32_t word) -> Decoded
+        {
+            auto const op = [&] {
+                switch (Bits(word, 31, 27))
+                {
+                case 0b00010:
+                    return Rs2(word) == 0 ? Op::LrW : Op::Illegal;
+                case 0b00011:
+                    return Op::ScW;
+                case 0b00001:
+                    return Op::AmoswapW;
+                case 0b00000:
+                    return Op::AmoaddW;
+                case 0b00100:
+                    return Op::AmoxorW;
+                case 0b01100:
+                    return Op::AmoandW;
+                case 0b01000:
+                    return Op::AmoorW;
+                case 0b10000:
+                    return Op::AmominW;
+                case 0b10100:
+                    return Op::AmomaxW;
+                case 0b11000:
+                    return Op::AmominuW;
+                case 0b11100:
+                    return Op::AmomaxuW;
+                default:
+                    return Op::Illegal;
+                }
+            }();
+            return op == Op::Illegal ? Decoded{} : TypeR(op, word);
+        }
+
+        constexpr auto DecodeSystem(std::uint32_t word) -> Decoded
+        {
+            if (word == 0x00000073)
+            {
+                return {.op = Op::Ecall};
+            }
+            if (word == 0x00100073)
+            {
+                return {.op = Op::Ebreak};
+            }
+            return {};
+        }
+
+        // Returns true for operations whose only effect is to write rd and advance pc.
+        constexpr auto OnlyWritesRd(Op op) -> bool
+        {
+            return op == Op::Lui || op == Op::Auipc || (op >= Op::Addi && op <= Op::Remu);
+        }
+
+        // Rewrites instructions that involve x0 into the specialized operations that don't, so that their handlers
+        // needn't read a register that is zero or write one that is discarded. Afterwards, only loads can have rd = 0.
+        constexpr auto Specialize(Decoded d) -> Decoded
+        {
+            if (d.rd == 0 && OnlyWritesRd(d.op))
+            {
+                return {.op = Op::Nop};
+            }
+            switch (d.op)
+            {
+            case Op::Lui:
+                return {.op = Op::Li, .rd = d.rd, .imm = d.imm};
+            case Op::Addi:
+                if (d.rs1 == 0)
+                {
+                    return {.op = Op::Li, .rd = d.rd, .imm = d.imm};
+                }
+                return d.imm == 0 ? Decoded{.op = Op::Mv, .rd = d.rd, .rs1 = d.rs1} : d;
+            case Op::Add:
+            case Op::Or:
+            case Op::Xor:
+                if (d.rs1 == 0 && d.rs2 == 0)
+                {
+                    return {.op = Op::Li, .rd = d.rd};
+                }
+                if (d.rs1 == 0 || d.rs2 == 0)
+                {
+                    return {.op = Op::Mv, .rd = d.rd, .rs1 = static_cast<std::uint8_t>(d.rs1 | d.rs2)};
+                }
+                return d;
+            case Op::Jal:
+                return d.rd == 0 ? Decoded{.op = Op::J, .imm = d.imm} : d;
+            case Op::Jalr:
+                return d.rd == 0 ? Decoded{.op = Op::Jr, .rs1 = d.rs1, .imm = d.imm} : d;
+            case Op::Beq:
+            case Op::Bne:
+                if (d.rs1 != 0 && d.rs2 != 0)
+                {
+                    return d;
+                }
+                return {.op = d.op == Op::Beq ? Op::Beqz : Op::Bnez,
+                        .rs1 = static_cast<std::uint8_t>(d.rs1 | d.rs2),
+                        .imm = d.imm};
+            default:
+                return d;
+            }
+        }
+
+        constexpr auto DecodeWord(std::uint32_t word) -> Decoded
+        {
+            if ((word & 0b11) != 0b11)
+            {
+                return {};
+            }
+
+            auto const& major = majors[Bits(word, 6, 2)];
+            auto const funct3 = Bits(word, 14, 12);
+            auto const op = major.ops[funct3];
+            switch (major.format)
+            {
+            case Format::R:
+                return Specialize(DecodeOp(word, funct3));
+            case Format::I:
+                return op == Op::Illegal ? Decoded{} : Specialize(TypeI(op, word));
+            case Format::OpImm:
+                return Specialize(DecodeOpImm(op, word));
+            case Format::S:
+                return op == Op::Illegal ? Decoded{} : TypeS(op, word);
+            case Format::B:
+                return op == Op::Illegal ? Decoded{} : Specialize(TypeB(op, word));
+            case Format::U:
+                return Specialize({.op = op, .rd = Rd(word), .imm = ImmU(word)});
+            case Format::J:
+                return Specialize({.op = op, .rd = Rd(word), .imm = ImmJ(word)});
+            case Format::Fence:
+                return op == Op::Illegal ? Decoded{} : Decoded{.op = op};
+            case Format::System:
+                return DecodeSystem(word);
+            case Format::Atomic:
+                return op == Op::Illegal ? Decoded{} : DecodeAtomic(word);
+            default:
+                return {};
+            }
+        }
+
+        // The register named by the five-bit field of a compressed instruction at bit lo.
+        constexpr auto Register(std::uint32_t half, unsigned lo) -> encode::Reg
+        {
+            return static_cast<encode::Reg>(Bits(half, lo + 4, lo));
+        }
+
+        // The register named by the three-bit field of a compressed instruction at bit lo, which is one of x8 to x15.
+        constexpr auto Prime(std::uint32_t half, unsigned lo) -> encode::Reg
+        {
+            return static_cast<encode::Reg>(8 + Bits(half, lo + 2, lo));
+        }
+
+        // Expands a compressed instruction into the 32-bit instruction that it stands for, or into zero, which is
+        // illegal, if it doesn't stand for one, so that it decodes to the same operation. Each format scatters the
+        // bits of its immediate differently, so they are gathered here range by range.
+        constexpr auto Expand(std::uint32_t half) -> std::uint32_t
+        {
+            using encode::ra;
+            using encode::sp;
+            using encode::zero;
+
+            auto const rd = Register(half, 7);
+            auto const rs2 = Register(half, 2);
+            auto const rdPrime = Prime(half, 2);
+            auto const rs1Prime = Prime(half, 7);
+            auto const high = Bits(half, 12, 12);
+            auto const imm = SignExtend((high << 5) | Bits(half, 6, 2), 6);
+            auto const shamt = Bits(half, 6, 2);
+            auto const offset = static_cast<std::int32_t>((Bits(half, 12, 10) << 3) | (Bits(half, 6, 6) << 2)
+                                                          | (Bits(half, 5, 5) << 6));
+            auto const jump = SignExtend((high << 11) | (Bits(half, 11, 11) << 4) | (Bits(half, 10, 9) << 8)
+                                                 | (Bits(half, 8, 8) << 10) | (Bits(half, 7, 7) << 6)
+                                                 | (Bits(half, 6, 6) << 7) | (Bits(half, 5, 3) << 1)
+                                                 | (Bits(half, 2, 2) << 5),
+                                         12);
+            auto const branch = SignExtend((high << 8) | (Bits(half, 11, 10) << 3) | (Bits(half, 6, 5) << 6)
+                                                   | (Bits(half, 4, 3) << 1) | (Bits(half, 2, 2) << 5),
+                                           9);
+
+            // By quadrant, in bits 1:0, then funct3.
+            switch ((Bits(half, 1, 0) << 3) | Bits(half, 15, 13))
+            {
+            case 0b00'000: {
+                auto const nzuimm = (Bits(half, 12, 11) << 4) | (Bits(half, 10, 7) << 6) | (Bits(half, 6, 6) << 2)
+                                    | (Bits(half, 5, 5) << 3);
+                return nzuimm == 0 ? 0 : encode::Addi(rdPrime, sp, static_cast<std::int32_t>(nzuimm));
+            }
+            case 0b00'010:
+                return encode::Lw(rdPrime, rs1Prime, offset);
+            case 0b00'110:
+                return encode::Sw(rdPrime, rs1Prime, offset);
+            case 0b01'000:
+                return encode::Addi(rd, rd, imm);
+            case 0b01'001:
+                return encode::Jal(ra, jump);
+            case 0b01'010:
+                return encode::Addi(rd, zero, imm);
+            case 0b01'011:
+                if (rd == sp)
+                {
+                    auto const nzimm = SignExtend((high << 9) | (Bits(half, 6, 6) << 4) | (Bits(half, 5, 5) << 6)
+                                                          | (Bits(half, 4, 3) << 7) | (Bits(half, 2, 2) << 5),
+                                                  10);
+                    return nzimm == 0 ? 0 : encode::Addi(sp, sp, nzimm);
+                }
+                return imm == 0 ? 0 : encode::Lui(rd, static_cast<std::uint32_t>(imm));
+            case 0b01'100:
+                switch (Bits(half, 11, 10))
+                {
+                case 0b00:
+                    return high != 0 ? 0 : encode::Srli(rs1Prime, rs1Prime, shamt);
+                case 0b01:
+                    return high != 0 ? 0 : encode::Srai(rs1Prime, rs1Prime, shamt);
+                case 0b10:
+                    return encode::Andi(rs1Prime, rs1Prime, imm);
+                default:
+                    if (high != 0)
+                    {
+                        return 0;
+                    }
+                    switch (Bits(half, 6, 5))
+                    {
+                    case 0b00:
+                        return encode::Sub(rs1Prime, rs1Prime, rdPrime);
+                    case 0b01:
+                        return encode::Xor(rs1Prime, rs1Prime, rdPrime);
+                    case 0b10:
+                        return encode::Or(rs1Prime, rs1Prime, rdPrime);
+                    default:
+                        return encode::And(rs1Prime, rs1Prime, rdPrime);
+                    }
+                }
+            case 0b01'101:
+                return encode::Jal(zero, jump);
+            case 0b01'110:
+                return encode::Beq(rs1Prime, zero, branch);
+            case 0b01'111:
+                return encode::Bne(rs1Prime, zero, branch);
+            case 0b10'000:
+                return high != 0 ? 0 : encode::Slli(rd, rd, shamt);
+            case 0b10'010: {
+                auto const uimm = (high << 5) | (Bits(half, 6, 4) << 2) | (Bits(half, 3, 2) << 6);
+                return rd == zero ? 0 : encode::Lw(rd, sp, static_cast<std::int32_t>(uimm));
+            }
+            case 0b10'100:
+                if (rs2 != zero)
+                {
+                    return high == 0 ? encode::Add(rd, zero, rs2) : encode::Add(rd, rd, rs2);
+                }
+                if (rd == zero)
+                {
+                    return high == 0 ? 0 : encode::Ebreak();
+                }
+                return encode::Jalr(high == 0 ? zero : ra, rd, 0);
+            case 0b10'110: {
+                auto const uimm = (Bits(half, 12, 9) << 2) | (Bits(half, 8, 7) << 6);
+                return encode::Sw(rs2, sp, static_cast<std::int32_t>(uimm));
+            }
+            default:
+                return 0;
+            }
+        }
+
+        constexpr auto DecodeCompressed(std::uint32_t half) -> Decoded
+        {
+            auto d = DecodeWord(Expand(half));
+            d.op = Compress(d.op);
+            return d;
+        }
+    } // namespace decoding
+
+    // Decodes the instruction that word starts with, which is a 16-bit compressed instruction in its lower half unless
+    // both of its lowest two bits are set. It is inline so that a host that executes with owl-cpu/inline.h can
+    // decode with it too.
+    constexpr auto Decode(std::uint32_t word) -> Decoded
+    {
+        return (word & 0b11) != 0b11 ? decoding::DecodeCompressed(word & 0xffff) : decoding::DecodeWord(word);
+    }
+
+    // Returns true for operations that read from guest memory.
+    constexpr auto IsLoad(Op op) -> bool
+    {
+        return op == Op::Lb || op == Op::Lh || op == Op::Lw || op == Op::Lbu || op == Op::Lhu || op == Op::CLw
+               || (op >= Op::LrW && op <= Op::AmomaxuW && op != Op::ScW);
+    }
+
+    // Returns true for the atomic operations, which access a word of guest memory with a host atomic.
+    constexpr auto IsAtomic(Op op) -> bool { return op >= Op::LrW && op <= Op::AmomaxuW; }
+
+    // Returns true for operations that can write to guest memory.
+    constexpr auto IsStore(Op op) -> bool
+    {
+        return op == Op::Sb || op == Op::Sh || op == Op::Sw || op == Op::CSw || (IsAtomic(op) && op != Op::LrW);
+    }
+
+    // Returns true for conditional branches.
+    constexpr auto IsBranch(Op op) -> bool
+    {
+        return op == Op::Beq || op == Op::Bne || op == Op::Blt || op == Op::Bge || op == Op::Bltu || op == Op::Bgeu
+               || op == Op::Beqz || op == Op::Bnez || op == Op::CBeqz || op == Op::CBnez;
+    }
+} // namespace owl::detail
@@ -0,0 +1,497 @@
+#pragma once
+
+#include "owl-cpu/detail/decoder.h"
+#include "owl-cpu/owl-cpu.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+// The semantics of every operation, shared by the execution engines and by owl-cpu/inline.h so that they can't
+// disagree. They are written against a context, which holds the registers and the pc that an instruction executes
+// with, and which provides:
+//
+// - x, the registers, and state, the CpuState that holds the reservation, which only lr.w and sc.w use
+// - memory, a memory model with Read(), Write(), Word() and IsMemory() as in owl-cpu/detail/checked-memory.h
+// - pc and exit, which an instruction advances or sets if execution must stop
+// - Set(rd, value), which writes rd on behalf of a load, the only kind of instruction that can have rd = 0
+// - OnStore(address, size), which is called after a store to guest memory, for contexts that cache decoded code
+// - CountOp(op) and CountBranch(taken), which are called as each operation and conditional branch executes, for
+//   contexts that profile
+
+namespace owl::detail
+{
+    // A reservation that no sc.w can match, because atomics fault unless their word is aligned.
+    inline constexpr std::uint32_t noReservation = CpuState{}.reservation;
+
+    constexpr auto Signed(std::uint32_t value) -> std::int32_t { return static_cast<std::int32_t>(value); }
+    constexpr auto Unsigned(std::int32_t value) -> std::uint32_t { return static_cast<std::uint32_t>(value); }
+
+    constexpr auto Mulh(std::uint32_t a, std::uint32_t b) -> std::uint32_t
+    {
+        auto const product = static_cast<std::int64_t>(Signed(a)) * static_cast<std::int64_t>(Signed(b));
+        return static_cast<std::uint32_t>(static_cast<std::uint64_t>(product) >> 32);
+    }
+
+    constexpr auto Mulhsu(std::uint32_t a, std::uint32_t b) -> std::uint32_t
+    {
+        auto const product = static_cast<std::int64_t>(Signed(a)) * static_cast<std::int64_t>(b);
+        return static_cast<std::uint32_t>(static_cast<std::uint64_t>(product) >> 32);
+    }
+
+    constexpr auto Mulhu(std::uint32_t a, std::uint32_t b) -> std::uint32_t
+    {
+        return static_cast<std::uint32_t>((static_cast<std::uint64_t>(a) * b) >> 32);
+    }
+
+    constexpr auto Div(std::uint32_t a, std::uint32_t b) -> std::uint32_t
+    {
+        if (b == 0)
+        {
+            return std::numeric_limits<std::uint32_t>::max();
+        }
+        if (Signed(a) == std::numeric_limits<std::int32_t>::min() && Signed(b) == -1)
+        {
+            return a;
+        }
+        return Unsigned(Signed(a) / Signed(b));
+    }
+
+    constexpr auto Divu(std::uint32_t a, std::uint32_t b) -> std::uint32_t
+    {
+        return b == 0 ? std::numeric_limits<std::uint32_t>::max() : a / b;
+    }
+
+    constexpr auto Rem(std::uint32_t a, std::uint32_t b) -> std::uint32_t
+    {
+        if (b == 0)
+        {
+            return a;
+        }
+        if (Signed(a) == std::numeric_limits<std::int32_t>::min() && Signed(b) == -1)
+        {
+            return 0;
+        }
+        return Unsigned(Signed(a) % Signed(b));
+    }
+
+    constexpr auto Remu(std::uint32_t a, std::uint32_t b) -> std::uint32_t { return b == 0 ? a : a % b; }
+
+    // Returns true if an exit retired the instruction that caused it, i.e., pc has moved past it.
+    constexpr auto Retires(Exit exit) -> bool { return exit == Exit::Ecall || exit == Exit::Ebreak; }
+
+    // Executes a single decoded instruction and advances pc. Returns false with the exit reason set if execution must
+    // stop. Faulting instructions leave pc referring to themselves. A compressed operation executes as the operation
+    // that it is the compressed form of, which is `base`.
+    template<Op O, typename ExecutionContext>
+    inline auto Execute(ExecutionContext& c, Decoded const& d) -> bool
+    {
+        constexpr auto base = Uncompress(O);
+        auto const rs1 = c.x[d.rs1];
+        auto const rs2 = c.x[d.rs2];
+        auto const imm = Unsigned(d.imm);
+        auto const next = c.pc + InstructionSize(O);
+        c.CountOp(O);
+
+        auto const branch = [&](bool taken) {
+            c.CountBranch(taken);
+            c.pc = taken ? c.pc + imm : next;
+            return true;
+        };
+
+        auto const load = [&]<typename T>(T value) {
+            if (!c.memory.Read(rs1 + imm, value))
+            {
+                c.exit = Exit::LoadFault;
+                return false;
+            }
+            if constexpr (std::is_signed_v<T>)
+            {
+                c.Set(d.rd, Unsigned(value));
+            }
+            else
+            {
+                c.Set(d.rd, value);
+            }
+            c.pc = next;
+            return true;
+        };
+
+        auto const store = [&]<typename T>(T value) {
+            auto const address = rs1 + imm;
+            if (!c.memory.Write(address, value))
+            {
+                c.exit = Exit::StoreFault;
+                return false;
+            }
+            if (c.memory.IsMemory(address))
+            {
+                c.OnStore(address, sizeof(T));
+            }
+            c.pc = next;
+            return true;
+        };
+
+        // Applies an update to the word at rs1 with a host atomic, which returns the value that rd gets. An atomic that
+        // can't access its word faults as a store, as it would have written to it.
+        auto const atomic = [&](auto update) {
+            auto* const word = c.memory.Word(rs1);
+            if (word == nullptr)
+            {
+                c.exit = Exit::StoreFault;
+                return false;
+            }
+            c.Set(d.rd, update(std::atomic_ref<std::uint32_t>{*word}));
+            c.OnStore(rs1, sizeof(std::uint32_t));
+            c.pc = next;
+            return true;
+        };
+
+        // Replaces the word with the result of combining it with rs2 for AMOs that have no single host atomic.
+        auto const combine = [&](auto with) {
+            return atomic([&](std::atomic_ref<std::uint32_t> word) {
+                auto expected = word.load();
+                while (!word.compare_exchange_weak(expected, with(expected)))
+                {
+                }
+                return expected;
+            });
+        };
+
+        // The decoder turns instructions that would write x0 into Nop, so this needn't preserve it.
+        auto const set = [&](std::uint32_t value) {
+            c.x[d.rd] = value;
+            c.pc = next;
+            return true;
+        };
+
+        auto const stop = [&](Exit exit) {
+            c.exit = exit;
+            if (Retires(exit))
+            {
+                c.pc = next;
+            }
+            return false;
+        };
+
+        if constexpr (base == Op::Illegal)
+        {
+            return stop(Exit::IllegalInstruction);
+        }
+        else if constexpr (base == Op::FetchFault)
+        {
+            return stop(Exit::FetchFault);
+        }
+        else if constexpr (base == Op::Lui)
+        {
+            return set(imm);
+        }
+        else if constexpr (base == Op::Auipc)
+        {
+            return set(c.pc + imm);
+        }
+        else if constexpr (base == Op::Jal)
+        {
+            c.x[d.rd] = next;
+            c.pc += imm;
+            return true;
+        }
+        else if constexpr (base == Op::Jalr)
+        {
+            c.x[d.rd] = next;
+            c.pc = (rs1 + imm) & ~1U;
+            return true;
+        }
+        else if constexpr (base == Op::Beq)
+        {
+            return branch(rs1 == rs2);
+        }
+        else if constexpr (base == Op::Bne)
+        {
+            return branch(rs1 != rs2);
+        }
+        else if constexpr (base == Op::Blt)
+        {
+            return branch(Signed(rs1) < Signed(rs2));
+        }
+        else if constexpr (base == Op::Bge)
+        {
+            return branch(Signed(rs1) >= Signed(rs2));
+        }
+        else if constexpr (base == Op::Bltu)
+        {
+            return branch(rs1 < rs2);
+        }
+        else if constexpr (base == Op::Bgeu)
+        {
+            return branch(rs1 >= rs2);
+        }
+        else if constexpr (base == Op::Lb)
+        {
+            return load(std::int8_t{});
+        }
+        else if constexpr (base == Op::Lh)
+        {
+            return load(std::int16_t{});
+        }
+        else if constexpr (base == Op::Lw)
+        {
+            return load(std::uint32_t{});
+        }
+        else if constexpr (base == Op::Lbu)
+        {
+            return load(std::uint8_t{});
+        }
+        else if constexpr (base == Op::Lhu)
+        {
+            return load(std::uint16_t{});
+        }
+        else if constexpr (base == Op::Sb)
+        {
+            return store(static_cast<std::uint8_t>(rs2));
+        }
+        else if constexpr (base == Op::Sh)
+        {
+            return store(static_cast<std::uint16_t>(rs2));
+        }
+        else if constexpr (base == Op::Sw)
+        {
+            return store(rs2);
+        }
+        else if constexpr (base == Op::Addi)
+        {
+            return set(rs1 + imm);
+        }
+        else if constexpr (base == Op::Slti)
+        {
+            return set(Signed(rs1) < d.imm ? 1 : 0);
+        }
+        else if constexpr (base == Op::Sltiu)
+        {
+            return set(rs1 < imm ? 1 : 0);
+        }
+        else if constexpr (base == Op::Xori)
+        {
+            return set(rs1 ^ imm);
+        }
+        else if constexpr (base == Op::Ori)
+        {
+            return set(rs1 | imm);
+        }
+        else if constexpr (base == Op::Andi)
+        {
+            return set(rs1 & imm);
+        }
+        else if constexpr (base == Op::Slli)
+        {
+            return set(rs1 << imm);
+        }
+        else if constexpr (base == Op::Srli)
+        {
+            return set(rs1 >> imm);
+        }
+        else if constexpr (base == Op::Srai)
+        {
+            return set(Unsigned(Signed(rs1) >> imm));
+        }
+        else if constexpr (base == Op::Add)
+        {
+            return set(rs1 + rs2);
+        }
+        else if constexpr (base == Op::Sub)
+        {
+            return set(rs1 - rs2);
+        }
+        else if constexpr (base == Op::Sll)
+        {
+            return set(rs1 << (rs2 & 31));
+        }
+        else if constexpr (base == Op::Slt)
+        {
+            return set(Signed(rs1) < Signed(rs2) ? 1 : 0);
+        }
+        else if constexpr (base == Op::Sltu)
+        {
+            return set(rs1 < rs2 ? 1 : 0);
+        }
+        else if constexpr (base == Op::Xor)
+        {
+            return set(rs1 ^ rs2);
+        }
+        else if constexpr (base == Op::Srl)
+        {
+            return set(rs1 >> (rs2 & 31));
+        }
+        else if constexpr (base == Op::Sra)
+        {
+            return set(Unsigned(Signed(rs1) >> (rs2 & 31)));
+        }
+        else if constexpr (base == Op::Or)
+        {
+            return set(rs1 | rs2);
+        }
+        else if constexpr (base == Op::And)
+        {
+            return set(rs1 & rs2);
+        }
+        else if constexpr (base == Op::Mul)
+        {
+            return set(rs1 * rs2);
+        }
+        else if constexpr (base == Op::Mulh)
+        {
+            return set(Mulh(rs1, rs2));
+        }
+        else if constexpr (base == Op::Mulhsu)
+        {
+            return set(Mulhsu(rs1, rs2));
+        }
+        else if constexpr (base == Op::Mulhu)
+        {
+            return set(Mulhu(rs1, rs2));
+        }
+        else if constexpr (base == Op::Div)
+        {
+            return set(Div(rs1, rs2));
+        }
+        else if constexpr (base == Op::Divu)
+        {
+            return set(Divu(rs1, rs2));
+        }
+        else if constexpr (base == Op::Rem)
+        {
+            return set(Rem(rs1, rs2));
+        }
+        else if constexpr (base == Op::Remu)
+        {
+            return set(Remu(rs1, rs2));
+        }
+        else if constexpr (base == Op::LrW)
+        {
+            auto* const word = c.memory.Word(rs1);
+            if (word == nullptr)
+            {
+                c.exit = Exit::LoadFault;
+                return false;
+            }
+            c.state.reserved = std::atomic_ref<std::uint32_t>{*word}.load();
+            c.state.reservation = rs1;
+            c.Set(d.rd, c.state.reserved);
+            c.pc = next;
+            return true;
+        }
+        else if constexpr (base == Op::ScW)
+        {
+            // Rather than tracking writes to the reservation, which would need every store to check it, sc.w succeeds
+            // if the word still holds the value that lr.w loaded. Like a compare-and-swap, that can't tell if the word
+            // was changed and then changed back in between, which guests that synchronize with locks never notice.
+            auto const reserved = c.state.reservation == rs1;
+            c.state.reservation = noReservation;
+            return atomic([&](std::atomic_ref<std::uint32_t> word) {
+                auto expected = c.state.reserved;
+                return reserved && word.compare_exchange_strong(expected, rs2) ? 0U : 1U;
+            });
+        }
+        else if constexpr (base == Op::AmoswapW)
+        {
+            return atomic([&](std::atomic_ref<std::uint32_t> word) { return word.exchange(rs2); });
+        }
+        else if constexpr (base == Op::AmoaddW)
+        {
+            return atomic([&](std::atomic_ref<std::uint32_t> word) { return word.fetch_add(rs2); });
+        }
+        else if constexpr (base == Op::AmoxorW)
+        {
+            return atomic([&](std::atomic_ref<std::uint32_t> word) { return word.fetch_xor(rs2); });
+        }
+        else if constexpr (base == Op::AmoandW)
+        {
+            return atomic([&](std::atomic_ref<std::uint32_t> word) { return word.fetch_and(rs2); });
+        }
+        else if constexpr (base == Op::AmoorW)
+        {
+            return atomic([&](std::atomic_ref<std::uint32_t> word) { return word.fetch_or(rs2); });
+        }
+        else if constexpr (base == Op::AmominW)
+        {
+            return combine([&](std::uint32_t value) { return Signed(value) < Signed(rs2) ? value : rs2; });
+        }
+        else if constexpr (base == Op::AmomaxW)
+        {
+            return combine([&](std::uint32_t value) { return Signed(value) > Signed(rs2) ? value : rs2; });
+        }
+        else if constexpr (base == Op::AmominuW)
+        {
+            return combine([&](std::uint32_t value) { return value < rs2 ? value : rs2; });
+        }
+        else if constexpr (base == Op::AmomaxuW)
+        {
+            return combine([&](std::uint32_t value) { return value > rs2 ? value : rs2; });
+        }
+        else if constexpr (base == Op::Fence)
+        {
+            // Other harts on other threads must see this hart's plain loads and stores in order around a fence.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            c.pc = next;
+            return true;
+        }
+        else if constexpr (base == Op::Ecall)
+        {
+            return stop(Exit::Ecall);
+        }
+        else if constexpr (base == Op::Ebreak)
+        {
+            return stop(Exit::Ebreak);
+        }
+        else if constexpr (base == Op::Nop)
+        {
+            c.pc = next;
+            return true;
+        }
+        else if constexpr (base == Op::Li)
+        {
+            return set(imm);
+        }
+        else if constexpr (base == Op::Mv)
+        {
+            return set(rs1);
+        }
+        else if constexpr (base == Op::J)
+        {
+            c.pc += imm;
+            return true;
+        }
+        else if constexpr (base == Op::Jr)
+        {
+            c.pc = (rs1 + imm) & ~1U;
+            return true;
+        }
+        else if constexpr (base == Op::Beqz)
+        {
+            return branch(rs1 == 0);
+        }
+        else if constexpr (base == Op::Bnez)
+        {
+            return branch(rs1 != 0);
+        }
+    }
+
+    // Executes a single decoded instruction, dispatching on its operation with a switch.
+    template<typename ExecutionContext>
+    inline auto Step(ExecutionContext& c, Decoded const& d) -> bool
+    {
+        switch (d.op)
+        {
+#define OWL_CPU_STEP_CASE(name)                                                                                        \
+    case Op::name:                                                                                                     \
+        return Execute<Op::name>(c, d);
+            OWL_CPU_FOR_EACH_OP(OWL_CPU_STEP_CASE)
+#undef OWL_CPU_STEP_CASE
+            OWL_CPU_FOR_EACH_FUSION(OWL_CPU_FUSION_CASE)
+            break; // only blocks hold fused operations, and they execute them with StepFused()
+        }
+        return false;
+    }
+} // namespace owl::detail
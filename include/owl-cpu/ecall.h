@@ -0,0 +1,234 @@
+#pragma once
+
+#include "owl-cpu/owl-cpu.h"
+#include "owl-cpu/owl-cpu_export.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <span>
+#include <vector>
+
+/**
+ * @file
+ * @brief Host calls, and recording and replaying them
+ *
+ * A guest calls the host with `ecall`, passing the call's number in a7 and its arguments in a0 to a5, and taking its
+ * result from a0, as the RISC-V Linux ABI does. A core with an EcallHandler services each call without returning from
+ * Cpu::Run(), unless the handler asks it to.
+ *
+ * Because a guest's execution is deterministic apart from what host calls give it, a session can be re-run offline by
+ * recording what each call wrote into the guest with an EcallRecorder, then feeding it back with an EcallReplayer in
+ * place of the live handler. The log only holds the registers and memory that handlers wrote, not what guests passed
+ * to the host. It starts with the 8 bytes "OWLECALL" and the u32 little-endian format version, which is 1, followed by
+ * an entry for each call: the LEB128 varint pc of the `ecall` and the call's number, a byte that is 1 if the guest
+ * resumed, then the varint size of the writes that follow. Each write is a byte that is 0 for a register, followed by
+ * its index and varint value, or 1 for memory, followed by the varint address and size and the bytes.
+ *
+ * Handlers run on the thread that runs the core, so a slow one holds up that thread. A BatchRunner that is given an
+ * EcallRing instead submits the calls that its cores return from Cpu::Run() with to the ring and carries on with other
+ * cores, while the host takes calls from the ring in batches and completes them in its own time, from any thread.
+ */
+
+namespace owl
+{
+    namespace detail
+    {
+        class EcallQueues;
+    } // namespace detail
+
+    /**
+     * @brief A guest's call to the host, which an EcallHandler services through this so that it can be recorded
+     */
+    class OWL_CPU_EXPORT HostCall
+    {
+    public:
+        /**
+         * @brief Returns the call's number, from a7
+         */
+        auto Number() const -> std::uint32_t;
+
+        /**
+         * @brief Returns one of the call's arguments, from a0 to a5. Throws std::invalid_argument if index > 5.
+         */
+        auto Argument(std::size_t index) const -> std::uint32_t;
+
+        /**
+         * @brief Returns the address of the `ecall` instruction
+         */
+        auto Pc() const -> std::uint32_t;
+
+        /**
+         * @brief Writes one of the guest's registers. Throws std::invalid_argument if index > 31.
+         *
+         * Writes to x0 are ignored.
+         */
+        void SetRegister(std::size_t index, std::uint32_t value);
+
+        /**
+         * @brief Writes the call's result to a0
+         */
+        void Return(std::uint32_t value);
+
+        /**
+         * @brief Copies guest memory to the host, returning false if any of it is outside of guest memory
+         */
+        auto ReadMemory(std::uint32_t address, std::span<std::uint8_t> to) const -> bool;
+
+        /**
+         * @brief Copies host memory into the guest, returning false, having written nothing, if any of it is outside of
+         * guest memory
+         *
+         * This calls Cpu::InvalidateCode() for the bytes that it writes.
+         */
+        auto WriteMemory(std::uint32_t address, std::span<std::uint8_t const> from) -> bool;
+
+        /**
+         * @brief Returns the core that made the call. Changes made directly to it aren't recorded.
+         */
+        auto GetCpu() -> Cpu& { return m_cpu; }
+
+    private:
+        friend class Cpu;
+        friend class EcallRecorder;
+
+        explicit HostCall(Cpu& cpu) : m_cpu{cpu} {}
+
+        Cpu& m_cpu;
+        std::vector<std::uint8_t>* m_record{}; // where an EcallRecorder is encoding the writes, if it is
+    };
+
+    /**
+     * @brief Services the host calls of the cores that it is given to with Cpu::SetEcallHandler()
+     */
+    class OWL_CPU_EXPORT EcallHandler
+    {
+    public:
+        virtual ~EcallHandler();
+
+        /**
+         * @brief Services a call, returning true for the guest to carry on, or false for Cpu::Run() to return
+         * Exit::Ecall
+         *
+         * Either way, the core's pc refers to the instruction after the `ecall`. Exceptions propagate out of
+         * Cpu::Run().
+         */
+        virtual auto OnEcall(HostCall& call) -> bool = 0;
+    };
+
+    /**
+     * @brief An EcallHandler that passes calls on to another one and logs what it wrote into the guest
+     */
+    class OWL_CPU_EXPORT EcallRecorder final : public EcallHandler
+    {
+    public:
+        /**
+         * @brief Writes the log's header. The handler and the stream must outlive the recorder.
+         */
+        EcallRecorder(EcallHandler& live, std::ostream& log);
+
+        auto OnEcall(HostCall& call) -> bool override;
+
+    private:
+        EcallHandler& m_live;
+        std::ostream& m_log;
+    };
+
+    /**
+     * @brief An EcallHandler that services calls by replaying what an EcallRecorder logged
+     */
+    class OWL_CPU_EXPORT EcallReplayer final : public EcallHandler
+    {
+    public:
+        /**
+         * @brief Checks the log's header. Throws std::runtime_error if this isn't a version 1 log.
+         *
+         * The stream must outlive the replayer.
+         */
+        explicit EcallReplayer(std::istream& log);
+
+        /**
+         * @brief Applies the next call's writes to the guest
+         *
+         * Throws std::runtime_error if the log has ended or is malformed, or if the guest has diverged from the
+         * recording, i.e., this call was made from a different pc or has a different number to the next one logged.
+         */
+        auto OnEcall(HostCall& call) -> bool override;
+
+    private:
+        std::istream& m_log;
+    };
+
+    /**
+     * @brief A host call that a core in a batch made, and which it is blocked on until the host completes it
+     */
+    struct EcallRequest
+    {
+        std::size_t core{};                       ///< The index of the core in the batch, which identifies the request
+        Cpu* cpu{};                               ///< The core, which the host may access until it completes the call
+        std::uint32_t number{};                   ///< The call's number, from a7
+        std::array<std::uint32_t, 6> arguments{}; ///< The call's arguments, from a0 to a5
+    };
+
+    /**
+     * @brief The host's answer to an EcallRequest
+     */
+    struct EcallCompletion
+    {
+        std::size_t core{};     ///< The index of the core that made the request
+        std::uint32_t result{}; ///< The call's result, which is written to a0
+        bool resume{true};      ///< False for the core to stop, finishing the batch with Exit::Ecall
+    };
+
+    /**
+     * @brief The queues of host calls that a BatchRunner shares with the host, in the manner of io_uring
+     *
+     * While BatchRunner::Run() is running a batch with a ring, any core that returns Exit::Ecall from Cpu::Run() is
+     * blocked, with its call submitted to the ring, and its worker moves on to another core. The host takes submitted
+     * calls with Poll() or Wait(), services them however it likes, for example by starting asynchronous I/O, and hands
+     * back each one's result with Complete(), which puts the core back in its worker's queue with the rest of its
+     * cycles. Cores that have an EcallHandler only submit the calls that the handler doesn't resume them from.
+     *
+     * Every member may be called from any thread, and a batch only finishes once the host has completed all of its
+     * calls, so the host must service the ring from another thread while BatchRunner::Run() blocks.
+     *
+     * Please see the note in owl-cpu.h for considerations when creating shared libraries.
+     */
+    class OWL_CPU_EXPORT EcallRing
+    {
+    public:
+        EcallRing();
+        ~EcallRing();
+        EcallRing(EcallRing const&) = delete;
+        auto operator=(EcallRing const&) -> EcallRing& = delete;
+        EcallRing(EcallRing&&) = delete;
+        auto operator=(EcallRing&&) -> EcallRing& = delete;
+
+        /**
+         * @brief Takes as many submitted calls as fit, oldest first, returning how many it took
+         */
+        auto Poll(std::span<EcallRequest> requests) -> std::size_t;
+
+        /**
+         * @brief Takes submitted calls like Poll(), but first waits up to the given time for there to be at least one
+         */
+        auto Wait(std::span<EcallRequest> requests, std::chrono::milliseconds timeout) -> std::size_t;
+
+        /**
+         * @brief Completes the given calls, waking the batch's workers to resume their cores
+         *
+         * Each call must be completed once. Throws std::invalid_argument if a completion's core doesn't have a call
+         * outstanding, in which case none of them are applied.
+         */
+        void Complete(std::span<EcallCompletion const> completions);
+
+    private:
+        friend class BatchRunner;
+
+        OWL_CPU_SUPPRESS_C4251
+        std::unique_ptr<detail::EcallQueues> m_queues;
+    };
+} // namespace owl
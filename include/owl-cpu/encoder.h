@@ -0,0 +1,399 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief Constexpr encoders for Owl CPU instructions
+ *
+ * These produce the 32-bit instruction words that owl::Cpu executes, so that hosts, tests and examples can build
+ * small guest programs without an external toolchain. Branch and jump offsets are in bytes, relative to the
+ * address of the instruction being encoded. Operands are in assembler order, so the atomic encoders put the address
+ * register last, e.g., AmoaddW(rd, rs2, rs1) encodes `amoadd.w rd, rs2, (rs1)`.
+ *
+ * The encoders whose names begin with C produce 16-bit compressed instructions, which Pair() packs two at a time
+ * into a word. Those that take registers x8 to x15, i.e., s0, s1 and a0 to a5, say so.
+ */
+namespace owl::encode
+{
+    /**
+     * @brief Integer register numbers, by ABI name
+     */
+    enum Reg : std::uint32_t
+    {
+        zero,
+        ra,
+        sp,
+        gp,
+        tp,
+        t0,
+        t1,
+        t2,
+        s0,
+        s1,
+        a0,
+        a1,
+        a2,
+        a3,
+        a4,
+        a5,
+        a6,
+        a7,
+        s2,
+        s3,
+        s4,
+        s5,
+        s6,
+        s7,
+        s8,
+        s9,
+        s10,
+        s11,
+        t3,
+        t4,
+        t5,
+        t6
+    };
+
+    namespace detail
+    {
+        constexpr auto Imm(std::int32_t imm) -> std::uint32_t { return static_cast<std::uint32_t>(imm); }
+
+        constexpr auto R(std::uint32_t funct7, Reg rs2, Reg rs1, std::uint32_t funct3, Reg rd, std::uint32_t opcode)
+                -> std::uint32_t
+        {
+            return (funct7 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+        }
+
+        constexpr auto I(std::int32_t imm, Reg rs1, std::uint32_t funct3, Reg rd, std::uint32_t opcode)
+                -> std::uint32_t
+        {
+            return ((Imm(imm) & 0xfff) << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+        }
+
+        constexpr auto S(std::int32_t imm, Reg rs2, Reg rs1, std::uint32_t funct3) -> std::uint32_t
+        {
+            auto const u = Imm(imm);
+            return (((u >> 5) & 0x7f) << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | ((u & 0x1f) << 7)
+                    | 0b0100011;
+        }
+
+        constexpr auto B(std::int32_t offset, Reg rs2, Reg rs1, std::uint32_t funct3) -> std::uint32_t
+        {
+            auto const u = Imm(offset);
+            return (((u >> 12) & 1) << 31) | (((u >> 5) & 0x3f) << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12)
+                    | (((u >> 1) & 0xf) << 8) | (((u >> 11) & 1) << 7) | 0b1100011;
+        }
+
+        constexpr auto U(std::uint32_t imm20, Reg rd, std::uint32_t opcode) -> std::uint32_t
+        {
+            return ((imm20 & 0xfffff) << 12) | (rd << 7) | opcode;
+        }
+
+        constexpr auto J(std::int32_t offset, Reg rd) -> std::uint32_t
+        {
+            auto const u = Imm(offset);
+            return (((u >> 20) & 1) << 31) | (((u >> 1) & 0x3ff) << 21) | (((u >> 11) & 1) << 20)
+                    | (((u >> 12) & 0xff) << 12) | (rd << 7) | 0b1101111;
+        }
+
+        constexpr auto Shift(std::uint32_t funct7, std::uint32_t shamt, Reg rs1, std::uint32_t funct3, Reg rd)
+                -> std::uint32_t
+        {
+            return (funct7 << 25) | ((shamt & 31) << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | 0b0010011;
+        }
+
+        constexpr auto Load(std::uint32_t funct3, Reg rd, Reg rs1, std::int32_t imm) -> std::uint32_t
+        {
+            return I(imm, rs1, funct3, rd, 0b0000011);
+        }
+
+        constexpr auto OpImm(std::uint32_t funct3, Reg rd, Reg rs1, std::int32_t imm) -> std::uint32_t
+        {
+            return I(imm, rs1, funct3, rd, 0b0010011);
+        }
+
+        constexpr auto Op(std::uint32_t funct7, std::uint32_t funct3, Reg rd, Reg rs1, Reg rs2) -> std::uint32_t
+        {
+            return R(funct7, rs2, rs1, funct3, rd, 0b0110011);
+        }
+
+        // The aq and rl bits are left clear, as the core makes every atomic operation sequentially consistent anyway.
+        constexpr auto Amo(std::uint32_t funct5, Reg rd, Reg rs1, Reg rs2) -> std::uint32_t
+        {
+            return R(funct5 << 2, rs2, rs1, 0b010, rd, 0b0101111);
+        }
+
+        // Moves bits hi to lo of value to start at bit `to`.
+        constexpr auto Field(std::uint32_t value, unsigned hi, unsigned lo, unsigned to) -> std::uint32_t
+        {
+            return ((value >> lo) & ((1U << (hi - lo + 1)) - 1)) << to;
+        }
+
+        constexpr auto Half(std::uint32_t funct3, std::uint32_t fields, std::uint32_t quadrant) -> std::uint16_t
+        {
+            return static_cast<std::uint16_t>((funct3 << 13) | fields | quadrant);
+        }
+
+        // One of the registers x8 to x15 that the three-bit register fields can hold.
+        constexpr auto Prime(Reg reg) -> std::uint32_t { return (reg - 8) & 7; }
+
+        constexpr auto CI(std::uint32_t funct3, Reg rd, std::int32_t imm, std::uint32_t quadrant) -> std::uint16_t
+        {
+            auto const u = Imm(imm);
+            return Half(funct3, Field(u, 5, 5, 12) | (rd << 7) | Field(u, 4, 0, 2), quadrant);
+        }
+
+        constexpr auto CR(std::uint32_t funct4, Reg rd, Reg rs2) -> std::uint16_t
+        {
+            return static_cast<std::uint16_t>((funct4 << 12) | (rd << 7) | (rs2 << 2) | 0b10);
+        }
+
+        constexpr auto CL(std::uint32_t funct3, Reg rd, Reg rs1, std::uint32_t uimm) -> std::uint16_t
+        {
+            return Half(funct3,
+                        Field(uimm, 5, 3, 10) | (Prime(rs1) << 7) | Field(uimm, 2, 2, 6) | Field(uimm, 6, 6, 5)
+                                | (Prime(rd) << 2),
+                        0b00);
+        }
+
+        constexpr auto CB(std::uint32_t funct3, Reg rs1, std::int32_t offset) -> std::uint16_t
+        {
+            auto const u = Imm(offset);
+            return Half(funct3,
+                        Field(u, 8, 8, 12) | Field(u, 4, 3, 10) | (Prime(rs1) << 7) | Field(u, 7, 6, 5)
+                                | Field(u, 2, 1, 3) | Field(u, 5, 5, 2),
+                        0b01);
+        }
+
+        constexpr auto CJ(std::uint32_t funct3, std::int32_t offset) -> std::uint16_t
+        {
+            auto const u = Imm(offset);
+            return Half(funct3,
+                        Field(u, 11, 11, 12) | Field(u, 4, 4, 11) | Field(u, 9, 8, 9) | Field(u, 10, 10, 8)
+                                | Field(u, 6, 6, 7) | Field(u, 7, 7, 6) | Field(u, 3, 1, 3) | Field(u, 5, 5, 2),
+                        0b01);
+        }
+    } // namespace detail
+
+    constexpr auto Lui(Reg rd, std::uint32_t imm20) -> std::uint32_t { return detail::U(imm20, rd, 0b0110111); }
+    constexpr auto Auipc(Reg rd, std::uint32_t imm20) -> std::uint32_t { return detail::U(imm20, rd, 0b0010111); }
+    constexpr auto Jal(Reg rd, std::int32_t offset) -> std::uint32_t { return detail::J(offset, rd); }
+    constexpr auto Jalr(Reg rd, Reg rs1, std::int32_t imm) -> std::uint32_t
+    {
+        return detail::I(imm, rs1, 0b000, rd, 0b1100111);
+    }
+
+    constexpr auto Beq(Reg rs1, Reg rs2, std::int32_t offset) -> std::uint32_t
+    {
+        return detail::B(offset, rs2, rs1, 0b000);
+    }
+    constexpr auto Bne(Reg rs1, Reg rs2, std::int32_t offset) -> std::uint32_t
+    {
+        return detail::B(offset, rs2, rs1, 0b001);
+    }
+    constexpr auto Blt(Reg rs1, Reg rs2, std::int32_t offset) -> std::uint32_t
+    {
+        return detail::B(offset, rs2, rs1, 0b100);
+    }
+    constexpr auto Bge(Reg rs1, Reg rs2, std::int32_t offset) -> std::uint32_t
+    {
+        return detail::B(offset, rs2, rs1, 0b101);
+    }
+    constexpr auto Bltu(Reg rs1, Reg rs2, std::int32_t offset) -> std::uint32_t
+    {
+        return detail::B(offset, rs2, rs1, 0b110);
+    }
+    constexpr auto Bgeu(Reg rs1, Reg rs2, std::int32_t offset) -> std::uint32_t
+    {
+        return detail::B(offset, rs2, rs1, 0b111);
+    }
+
+    constexpr auto Lb(Reg rd, Reg rs1, std::int32_t imm) -> std::uint32_t { return detail::Load(0b000, rd, rs1, imm); }
+    constexpr auto Lh(Reg rd, Reg rs1, std::int32_t imm) -> std::uint32_t { return detail::Load(0b001, rd, rs1, imm); }
+    constexpr auto Lw(Reg rd, Reg rs1, std::int32_t imm) -> std::uint32_t { return detail::Load(0b010, rd, rs1, imm); }
+    constexpr auto Lbu(Reg rd, Reg rs1, std::int32_t imm) -> std::uint32_t { return detail::Load(0b100, rd, rs1, imm); }
+    constexpr auto Lhu(Reg rd, Reg rs1, std::int32_t imm) -> std::uint32_t { return detail::Load(0b101, rd, rs1, imm); }
+
+    constexpr auto Sb(Reg rs2, Reg rs1, std::int32_t imm) -> std::uint32_t { return detail::S(imm, rs2, rs1, 0b000); }
+    constexpr auto Sh(Reg rs2, Reg rs1, std::int32_t imm) -> std::uint32_t { return detail::S(imm, rs2, rs1, 0b001); }
+    constexpr auto Sw(Reg rs2, Reg rs1, std::int32_t imm) -> std::uint32_t { return detail::S(imm, rs2, rs1, 0b010); }
+
+    constexpr auto Addi(Reg rd, Reg rs1, std::int32_t imm) -> std::uint32_t
+    {
+        return detail::OpImm(0b000, rd, rs1, imm);
+    }
+    constexpr auto Slti(Reg rd, Reg rs1, std::int32_t imm) -> std::uint32_t
+    {
+        return detail::OpImm(0b010, rd, rs1, imm);
+    }
+    constexpr auto Sltiu(Reg rd, Reg rs1, std::int32_t imm) -> std::uint32_t
+    {
+        return detail::OpImm(0b011, rd, rs1, imm);
+    }
+    constexpr auto Xori(Reg rd, Reg rs1, std::int32_t imm) -> std::uint32_t
+    {
+        return detail::OpImm(0b100, rd, rs1, imm);
+    }
+    constexpr auto Ori(Reg rd, Reg rs1, std::int32_t imm) -> std::uint32_t
+    {
+        return detail::OpImm(0b110, rd, rs1, imm);
+    }
+    constexpr auto Andi(Reg rd, Reg rs1, std::int32_t imm) -> std::uint32_t
+    {
+        return detail::OpImm(0b111, rd, rs1, imm);
+    }
+    constexpr auto Slli(Reg rd, Reg rs1, std::uint32_t shamt) -> std::uint32_t
+    {
+        return detail::Shift(0, shamt, rs1, 0b001, rd);
+    }
+    constexpr auto Srli(Reg rd, Reg rs1, std::uint32_t shamt) -> std::uint32_t
+    {
+        return detail::Shift(0, shamt, rs1, 0b101, rd);
+    }
+    constexpr auto Srai(Reg rd, Reg rs1, std::uint32_t shamt) -> std::uint32_t
+    {
+        return detail::Shift(0b0100000, shamt, rs1, 0b101, rd);
+    }
+
+    constexpr auto Add(Reg rd, Reg rs1, Reg rs2) -> std::uint32_t { return detail::Op(0, 0b000, rd, rs1, rs2); }
+    constexpr auto Sub(Reg rd, Reg rs1, Reg rs2) -> std::uint32_t { return detail::Op(0b0100000, 0b000, rd, rs1, rs2); }
+    constexpr auto Sll(Reg rd, Reg rs1, Reg rs2) -> std::uint32_t { return detail::Op(0, 0b001, rd, rs1, rs2); }
+    constexpr auto Slt(Reg rd, Reg rs1, Reg rs2) -> std::uint32_t { return detail::Op(0, 0b010, rd, rs1, rs2); }
+    constexpr auto Sltu(Reg rd, Reg rs1, Reg rs2) -> std::uint32_t { return detail::Op(0, 0b011, rd, rs1, rs2); }
+    constexpr auto Xor(Reg rd, Reg rs1, Reg rs2) -> std::uint32_t { return detail::Op(0, 0b100, rd, rs1, rs2); }
+    constexpr auto Srl(Reg rd, Reg rs1, Reg rs2) -> std::uint32_t { return detail::Op(0, 0b101, rd, rs1, rs2); }
+    constexpr auto Sra(Reg rd, Reg rs1, Reg rs2) -> std::uint32_t { return detail::Op(0b0100000, 0b101, rd, rs1, rs2); }
+    constexpr auto Or(Reg rd, Reg rs1, Reg rs2) -> std::uint32_t { return detail::Op(0, 0b110, rd, rs1, rs2); }
+    constexpr auto And(Reg rd, Reg rs1, Reg rs2) -> std::uint32_t { return detail::Op(0, 0b111, rd, rs1, rs2); }
+
+    constexpr auto Mul(Reg rd, Reg rs1, Reg rs2) -> std::uint32_t { return detail::Op(1, 0b000, rd, rs1, rs2); }
+    constexpr auto Mulh(Reg rd, Reg rs1, Reg rs2) -> std::uint32_t { return detail::Op(1, 0b001, rd, rs1, rs2); }
+    constexpr auto Mulhsu(Reg rd, Reg rs1, Reg rs2) -> std::uint32_t { return detail::Op(1, 0b010, rd, rs1, rs2); }
+    constexpr auto Mulhu(Reg rd, Reg rs1, Reg rs2) -> std::uint32_t { return detail::Op(1, 0b011, rd, rs1, rs2); }
+    constexpr auto Div(Reg rd, Reg rs1, Reg rs2) -> std::uint32_t { return detail::Op(1, 0b100, rd, rs1, rs2); }
+    constexpr auto Divu(Reg rd, Reg rs1, Reg rs2) -> std::uint32_t { return detail::Op(1, 0b101, rd, rs1, rs2); }
+    constexpr auto Rem(Reg rd, Reg rs1, Reg rs2) -> std::uint32_t { return detail::Op(1, 0b110, rd, rs1, rs2); }
+    constexpr auto Remu(Reg rd, Reg rs1, Reg rs2) -> std::uint32_t { return detail::Op(1, 0b111, rd, rs1, rs2); }
+
+    constexpr auto LrW(Reg rd, Reg rs1) -> std::uint32_t { return detail::Amo(0b00010, rd, rs1, zero); }
+    constexpr auto ScW(Reg rd, Reg rs2, Reg rs1) -> std::uint32_t { return detail::Amo(0b00011, rd, rs1, rs2); }
+    constexpr auto AmoswapW(Reg rd, Reg rs2, Reg rs1) -> std::uint32_t { return detail::Amo(0b00001, rd, rs1, rs2); }
+    constexpr auto AmoaddW(Reg rd, Reg rs2, Reg rs1) -> std::uint32_t { return detail::Amo(0b00000, rd, rs1, rs2); }
+    constexpr auto AmoxorW(Reg rd, Reg rs2, Reg rs1) -> std::uint32_t { return detail::Amo(0b00100, rd, rs1, rs2); }
+    constexpr auto AmoandW(Reg rd, Reg rs2, Reg rs1) -> std::uint32_t { return detail::Amo(0b01100, rd, rs1, rs2); }
+    constexpr auto AmoorW(Reg rd, Reg rs2, Reg rs1) -> std::uint32_t { return detail::Amo(0b01000, rd, rs1, rs2); }
+    constexpr auto AmominW(Reg rd, Reg rs2, Reg rs1) -> std::uint32_t { return detail::Amo(0b10000, rd, rs1, rs2); }
+    constexpr auto AmomaxW(Reg rd, Reg rs2, Reg rs1) -> std::uint32_t { return detail::Amo(0b10100, rd, rs1, rs2); }
+    constexpr auto AmominuW(Reg rd, Reg rs2, Reg rs1) -> std::uint32_t { return detail::Amo(0b11000, rd, rs1, rs2); }
+    constexpr auto AmomaxuW(Reg rd, Reg rs2, Reg rs1) -> std::uint32_t { return detail::Amo(0b11100, rd, rs1, rs2); }
+
+    constexpr auto Fence() -> std::uint32_t { return 0x0ff0000f; }
+    constexpr auto Ecall() -> std::uint32_t { return 0x00000073; }
+    constexpr auto Ebreak() -> std::uint32_t { return 0x00100073; }
+
+    /**
+     * @brief Encodes `addi rd, rs, 0`
+     */
+    constexpr auto Mv(Reg rd, Reg rs) -> std::uint32_t { return Addi(rd, rs, 0); }
+
+    /**
+     * @brief Encodes `addi x0, x0, 0`
+     */
+    constexpr auto Nop() -> std::uint32_t { return Addi(zero, zero, 0); }
+
+    /**
+     * @brief Packs two compressed instructions into a word, with `first` at the lower address
+     */
+    constexpr auto Pair(std::uint16_t first, std::uint16_t second) -> std::uint32_t
+    {
+        return (std::uint32_t{second} << 16) | first;
+    }
+
+    constexpr auto CNop() -> std::uint16_t { return 0x0001; }
+    constexpr auto CEbreak() -> std::uint16_t { return 0x9002; }
+
+    constexpr auto CAddi(Reg rd, std::int32_t imm) -> std::uint16_t { return detail::CI(0b000, rd, imm, 0b01); }
+    constexpr auto CLi(Reg rd, std::int32_t imm) -> std::uint16_t { return detail::CI(0b010, rd, imm, 0b01); }
+    constexpr auto CSlli(Reg rd, std::uint32_t shamt) -> std::uint16_t
+    {
+        return detail::CI(0b000, rd, static_cast<std::int32_t>(shamt & 31), 0b10);
+    }
+
+    /**
+     * @brief Encodes `c.addi16sp imm`, which adds a nonzero multiple of 16 to sp
+     */
+    constexpr auto CAddi16sp(std::int32_t imm) -> std::uint16_t
+    {
+        auto const u = detail::Imm(imm);
+        return detail::Half(0b011,
+                            detail::Field(u, 9, 9, 12) | (sp << 7) | detail::Field(u, 4, 4, 6)
+                                    | detail::Field(u, 6, 6, 5) | detail::Field(u, 8, 7, 3) | detail::Field(u, 5, 5, 2),
+                            0b01);
+    }
+
+    /**
+     * @brief Encodes `c.addi4spn rd, uimm`, which sets rd, one of x8 to x15, to sp plus a nonzero multiple of 4
+     */
+    constexpr auto CAddi4spn(Reg rd, std::uint32_t uimm) -> std::uint16_t
+    {
+        return detail::Half(0b000,
+                            detail::Field(uimm, 5, 4, 11) | detail::Field(uimm, 9, 6, 7) | detail::Field(uimm, 2, 2, 6)
+                                    | detail::Field(uimm, 3, 3, 5) | (detail::Prime(rd) << 2),
+                            0b00);
+    }
+
+    constexpr auto CMv(Reg rd, Reg rs2) -> std::uint16_t { return detail::CR(0b1000, rd, rs2); }
+    constexpr auto CAdd(Reg rd, Reg rs2) -> std::uint16_t { return detail::CR(0b1001, rd, rs2); }
+    constexpr auto CJr(Reg rs1) -> std::uint16_t { return detail::CR(0b1000, rs1, zero); }
+    constexpr auto CJalr(Reg rs1) -> std::uint16_t { return detail::CR(0b1001, rs1, zero); }
+
+    /**
+     * @brief Encodes `c.lw rd, uimm(rs1)`, where rd and rs1 are x8 to x15
+     */
+    constexpr auto CLw(Reg rd, Reg rs1, std::uint32_t uimm) -> std::uint16_t
+    {
+        return detail::CL(0b010, rd, rs1, uimm);
+    }
+
+    /**
+     * @brief Encodes `c.sw rs2, uimm(rs1)`, where rs2 and rs1 are x8 to x15
+     */
+    constexpr auto CSw(Reg rs2, Reg rs1, std::uint32_t uimm) -> std::uint16_t
+    {
+        return detail::CL(0b110, rs2, rs1, uimm);
+    }
+
+    constexpr auto CLwsp(Reg rd, std::uint32_t uimm) -> std::uint16_t
+    {
+        return detail::Half(0b010,
+                            detail::Field(uimm, 5, 5, 12) | (rd << 7) | detail::Field(uimm, 4, 2, 4)
+                                    | detail::Field(uimm, 7, 6, 2),
+                            0b10);
+    }
+
+    constexpr auto CSwsp(Reg rs2, std::uint32_t uimm) -> std::uint16_t
+    {
+        return detail::Half(0b110, detail::Field(uimm, 5, 2, 9) | detail::Field(uimm, 7, 6, 7) | (rs2 << 2), 0b10);
+    }
+
+    /**
+     * @brief Encodes `c.sub rd, rs2`, where rd and rs2 are x8 to x15
+     */
+    constexpr auto CSub(Reg rd, Reg rs2) -> std::uint16_t
+    {
+        return detail::Half(0b100, (0b011 << 10) | (detail::Prime(rd) << 7) | (detail::Prime(rs2) << 2), 0b01);
+    }
+
+    /**
+     * @brief Encodes `c.beqz rs1, offset`, where rs1 is x8 to x15
+     */
+    constexpr auto CBeqz(Reg rs1, std::int32_t offset) -> std::uint16_t { return detail::CB(0b110, rs1, offset); }
+
+    /**
+     * @brief Encodes `c.bnez rs1, offset`, where rs1 is x8 to x15
+     */
+    constexpr auto CBnez(Reg rs1, std::int32_t offset) -> std::uint16_t { return detail::CB(0b111, rs1, offset); }
+
+    constexpr auto CJ(std::int32_t offset) -> std::uint16_t { return detail::CJ(0b101, offset); }
+    constexpr auto CJal(std::int32_t offset) -> std::uint16_t { return detail::CJ(0b001, offset); }
+} // namespace owl::encode
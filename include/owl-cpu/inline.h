@@ -0,0 +1,138 @@
+#pragma once
+
+#include "owl-cpu/detail/checked-memory.h"
+#include "owl-cpu/detail/decoder.h"
+#include "owl-cpu/detail/execute.h"
+#include "owl-cpu/owl-cpu.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+/**
+ * @file
+ * @brief A header-only interpreter for running small snippets of guest code from a host's own loop
+ *
+ * Cpu::Run() is the fastest way to run guest code for long, but each call crosses into the library, sets up an engine
+ * and counts what it did, which costs more than the guest code itself when a host runs a few instructions at a time
+ * millions of times a second. RunSmall() and Step() run guest code on a CpuState and a span of guest memory with the
+ * semantics that the library's engines use, which they share with it, and are defined here so that the host's
+ * compiler can inline them into the loop that calls them and specialize them for it, for example:
+ *
+ * @code
+ * owl::CpuState state{};
+ * for (auto const argument : arguments)
+ * {
+ *     state.pc = entry;
+ *     state.x[10] = argument; // a0
+ *     if (owl::RunSmall(state, memory, 64) == owl::Exit::Ecall)
+ *     {
+ *         results.push_back(state.x[10]);
+ *     }
+ * }
+ * @endcode
+ *
+ * They decode each instruction as they fetch it rather than translating pages of code ahead of time, so there is
+ * nothing to discard when a snippet writes to its own code, and they keep no state of their own between calls. Guest
+ * memory is bounds checked, as it is for a Cpu with no devices or address space. Unlike Cpu::Run(), they return every
+ * `ecall` to the caller rather than to an EcallHandler, and they don't count owl::Stats, trace or profile, so a host
+ * that needs any of those, or that runs guest code for long, runs it with a Cpu.
+ */
+
+namespace owl
+{
+    namespace detail
+    {
+        // The context that RunSmall() executes instructions in, which has no code cache to keep up to date with stores
+        // and no profile to count.
+        struct InlineContext
+        {
+            std::array<std::uint32_t, 32>& x;
+            CpuState& state;
+            CheckedMemory memory;
+            std::uint32_t pc;
+            Exit exit{Exit::BudgetExhausted};
+
+            void Set(std::uint8_t rd, std::uint32_t value)
+            {
+                x[rd] = value;
+                x[0] = 0;
+            }
+
+            static void OnStore(std::uint32_t /*address*/, std::size_t /*size*/) {}
+            static void CountOp(Op /*op*/) {}
+            static void CountBranch(bool /*taken*/) {}
+        };
+
+        // Decodes the instruction at pc. Returns false with the exit reason set if it can't be fetched, which, as with
+        // the engines, includes a 32-bit instruction that runs off the end of guest memory.
+        inline auto FetchDecoded(InlineContext& c, Decoded& d) -> bool
+        {
+            if ((c.pc & 1) != 0)
+            {
+                c.exit = Exit::MisalignedFetch;
+                return false;
+            }
+            std::uint16_t half{};
+            if (!c.memory.Read(c.pc, half))
+            {
+                c.exit = Exit::FetchFault;
+                return false;
+            }
+            if ((half & 0b11) != 0b11)
+            {
+                d = Decode(half);
+                return true;
+            }
+            std::uint32_t word{};
+            if (!c.memory.Read(c.pc, word))
+            {
+                c.exit = Exit::FetchFault;
+                return false;
+            }
+            d = Decode(word);
+            return true;
+        }
+    } // namespace detail
+
+    /**
+     * @brief Runs guest code on a core's state for up to `cycles` instructions without calling into the library
+     *
+     * Runs like Cpu::Run() on a Cpu that has no EcallHandler, and leaves the state as it would, so a host can switch
+     * between the two.
+     *
+     * @param state The state of the core, which is updated as it runs
+     * @param memory Guest memory
+     * @param cycles The most instructions to retire
+     * @return Exit::BudgetExhausted if it retired `cycles` instructions, otherwise the reason that it stopped sooner
+     */
+    inline auto RunSmall(CpuState& state, std::span<std::uint8_t> memory, std::uint64_t cycles) -> Exit
+    {
+        auto c = detail::InlineContext{
+                .x = state.x, .state = state, .memory = detail::CheckedMemory{memory}, .pc = state.pc};
+        auto remaining = cycles;
+        while (remaining > 0)
+        {
+            detail::Decoded d{};
+            if (!detail::FetchDecoded(c, d) || !detail::Step(c, d))
+            {
+                break;
+            }
+            --remaining;
+        }
+
+        if (detail::Retires(c.exit))
+        {
+            --remaining;
+        }
+        state.pc = c.pc;
+        state.instret += cycles - remaining;
+        return c.exit;
+    }
+
+    /**
+     * @brief Executes the instruction at pc, like RunSmall() with a budget of one instruction
+     */
+    inline auto Step(CpuState& state, std::span<std::uint8_t> memory) -> Exit { return RunSmall(state, memory, 1); }
+} // namespace owl
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "owl-cpu/owl-cpu.h"
+#include "owl-cpu/owl-cpu_export.hpp"
+
+#include <cstdint>
+#include <filesystem>
+
+namespace owl
+{
+    /**
+     * @brief What the loader placed in an address space
+     */
+    struct Image
+    {
+        std::uint32_t entry{};        ///< The address to start executing from
+        std::uint64_t mappedBytes{};  ///< Bytes mapped copy-on-write from the file, and so shared with the page cache
+        std::uint64_t copiedBytes{};  ///< Bytes that had to be copied, because they couldn't be mapped
+    };
+
+    /**
+     * @brief Loads a 32-bit little-endian RISC-V ELF executable into an address space
+     *
+     * Each PT_LOAD segment is memory-mapped copy-on-write straight from the file where the host allows it, so that
+     * loading costs the same however large the image is, and every address space that loads the file shares its
+     * unmodified pages. Segments that can't be mapped, for example because their file offset and address disagree
+     * modulo the host page size, are copied instead. Bytes of a segment beyond its file contents read as zero.
+     *
+     * Load images before creating a Cpu from the address space, or call Cpu::InvalidateCode() afterwards. Throws
+     * std::runtime_error if the file can't be read or isn't a suitable executable.
+     */
+    OWL_CPU_EXPORT auto LoadElf(AddressSpace& space, std::filesystem::path const& path) -> Image;
+
+    /**
+     * @brief Loads a raw binary image into an address space at the given address, which is also its entry point
+     *
+     * The image is mapped or copied in the same way as an ELF segment. Throws std::runtime_error if the file can't be
+     * read or doesn't fit in the address space.
+     */
+    OWL_CPU_EXPORT auto LoadBinary(AddressSpace& space, std::filesystem::path const& path, std::uint32_t address)
+            -> Image;
+} // namespace owl
@@ -2,7 +2,15 @@
 
 #include "owl-cpu/owl-cpu_export.hpp"
 
-#include <string>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <type_traits>
+#include <vector>
 
 /**
  * A note about the MSVC warning C4251:
@@ -21,9 +29,13 @@
  * C4251 is emitted when an exported class has a non-static data member of a
  * non-exported class type.
  *
- * The exported class in our case is the class below (exported_class), which
- * has a non-static data member (m_name) of a non-exported class type
- * (std::string).
+ * The exported classes in our case are the classes below (owl::Snapshot,
+ * owl::Cpu, owl::BatchRunner and owl::Lockstep) and those in trace.h
+ * (owl::TraceWriter and owl::TraceReader), ecall.h (owl::EcallRing) and
+ * coroutine.h (owl::Scheduler), which have non-static data members (m_image,
+ * m_memory, m_code, m_blocks, m_devices, m_baseline, m_pool, m_lanes,
+ * m_channel, m_trace and m_queues) of non-exported class types (std::span,
+ * std::unique_ptr, std::shared_ptr).
  *
  * The rationale here is that the user of the exported class could attempt to
  * access (directly, or via an inline member function) a static data member or
@@ -37,34 +49,623 @@
  * non-exported class types as private member variables, because they are only
  * accessed by the members of the exported class itself.
  *
- * The name() method below returns a pointer to the stored null-terminated
- * string as a fundamental type (char const), so this is safe to use anywhere.
- * The only downside is that you can have dangling pointers if the pointer
- * outlives the class instance which stored the string.
+ * The Memory() method below returns a copy of the span rather than a reference
+ * to it, and std::span is a header-only template that the user instantiates
+ * themselves, so this is safe to use anywhere. The only downside is that the
+ * span dangles if it outlives the storage that the caller handed to the Cpu.
+ * The caches behind m_code and m_blocks, the windows behind m_devices, the
+ * saved memory behind m_image and m_baseline, the thread pools behind m_pool,
+ * the lanes behind m_lanes, the trace buffers behind m_channel and the queues
+ * behind m_queues are never exposed at all, and m_trace is a span over the
+ * caller's own bytes.
  *
  * Shared libraries are not easy, they need some discipline to get right, but
  * they also solve some other problems that make them worth the time invested.
  */
 
-/**
- * @brief Reports the name of the library
- *
- * Please see the note above for considerations when creating shared libraries.
- */
-class OWL_CPU_EXPORT ExportedClass
+namespace owl
 {
-public:
+    namespace detail
+    {
+        class BatchPool;
+        class BlockCache;
+        class DeviceBus;
+        class LaneGroup;
+        class PredecodeCache;
+        struct SnapshotImage;
+        class TraceChannel;
+    } // namespace detail
+
+    class EcallHandler;
+    class EcallRing;
+    class RunAwaiter;
+    class TraceWriter;
+
+    /**
+     * @brief The reason that Cpu::Run() returned control to the host
+     */
+    enum class Exit : std::uint8_t
+    {
+        BudgetExhausted,    ///< The requested number of cycles was executed
+        Ecall,              ///< The guest executed `ecall`; pc refers to the following instruction
+        Ebreak,             ///< The guest executed `ebreak`; pc refers to the following instruction
+        IllegalInstruction, ///< pc refers to an instruction that could not be decoded
+        MisalignedFetch,    ///< pc is not aligned to an instruction boundary
+        FetchFault,         ///< pc is outside of guest memory
+        LoadFault,          ///< The instruction at pc tried to load from outside of guest memory and of every device
+        StoreFault,         ///< The instruction at pc tried to store to outside of guest memory and of every device
+    };
+
+    /**
+     * @brief The dispatch strategies that Cpu::Run() can use to execute guest code
+     *
+     * Every engine implements identical semantics; they differ only in how they dispatch from one instruction to the
+     * next. Which engines are available is decided when the library is built.
+     *
+     * Engine::Timed is the portable interpreter built a second time with a model of an in-order, five-stage Owl
+     * pipeline that predicts branches not taken, which charges extra cycles for load-use hazards, jumps, taken
+     * branches, multiplies and divides, so that the other engines pay nothing for it. It assumes that every memory
+     * access hits in the cache. A stall that straddles two calls to Cpu::Run() isn't counted.
+     */
+    enum class Engine : std::uint8_t
+    {
+        Switch,   ///< Portable: decodes each instruction then dispatches with a switch
+        Threaded, ///< Dispatches with computed goto from the end of every handler. Requires GCC or Clang.
+        Block,    ///< Translates basic blocks and chains them together, charging the budget once per block
+        Tiered,   ///< Runs like Engine::Block, then compiles hot blocks to host code. Requires owl-cpu_JIT.
+        Timed,    ///< Runs like Engine::Switch, also estimating the cycles that Owl hardware takes in CpuState::cycle
+    };
+
+    /**
+     * @brief Returns true if the library was built with the given engine
+     */
+    OWL_CPU_EXPORT auto IsEngineAvailable(Engine engine) -> bool;
+
+    /**
+     * @brief Returns the engine that new cores use: Engine::Threaded if the library was built with it, otherwise
+     * Engine::Switch
+     */
+    OWL_CPU_EXPORT auto DefaultEngine() -> Engine;
+
+    /**
+     * @brief Returns a thread-safe pool that cores can allocate their tables from
+     *
+     * Unlike the heap, the pool keeps the memory that destroyed cores give back for the next cores to reuse, so that
+     * creating and destroying many short-lived cores doesn't go through malloc each time. It lasts until the program
+     * exits, so cores with static storage duration that use it must be created after it is first called.
+     */
+    OWL_CPU_EXPORT auto SharedPool() -> std::pmr::memory_resource*;
+
+    /**
+     * @brief The architectural state of a single Owl CPU core
+     *
+     * This is a flat, trivially copyable struct so that it can be saved, restored and copied with a memcpy. It is
+     * cache line aligned and begins with the 32 integer registers, which fill exactly two 64-byte lines. The pc
+     * can't join them without dropping a register, so it leads the third line along with the remaining per-step
+     * scalars, meaning that an instruction never touches more than the lines holding its registers and that line.
+     *
+     * The reservation is the word that `lr.w` last loaded, which `sc.w` only stores to if it still holds the value that
+     * was loaded. Each hart has its own, so no hart takes a lock to check another's.
+     */
+    struct alignas(64) CpuState
+    {
+        std::array<std::uint32_t, 32> x{}; ///< Integer registers. x[0] always reads as zero.
+        std::uint32_t pc{};                ///< Address of the next instruction to execute
+        std::uint32_t reservation{1};      ///< Address of the reserved word, which is odd if there is no reservation
+        std::uint64_t instret{};           ///< Number of instructions retired since reset
+        std::uint64_t cycle{};             ///< Estimated cycles taken since reset, which only Engine::Timed advances
+        std::uint32_t reserved{};          ///< The value that the reserved word held when it was reserved
+    };
+
+    static_assert(std::is_trivially_copyable_v<CpuState>);
+    static_assert(sizeof(CpuState) == 192);
+
+    /**
+     * @brief What a core has done since it was created, or what a batch runner's cores have done since it was
+     * created, summed over them
+     *
+     * Only the thread that is running a core adds to its counts, with relaxed atomic operations that are no dearer
+     * than plain ones, so another thread can read them while the core runs without slowing it down. The counts of a
+     * running core are each up to date, but not necessarily consistent with each other. Pages are the code pages that
+     * every engine fetches through; blocks are counted by Engine::Block and Engine::Tiered, and compiled code that
+     * jumps straight to the next block doesn't look it up at all.
+     */
+    struct Stats
+    {
+        std::uint64_t instructions{};    ///< The number of instructions retired by Run()
+        std::uint64_t runs{};            ///< The number of calls to Run()
+        std::uint64_t runNanoseconds{};  ///< The wall-clock time spent in Run(), including in host calls
+        std::uint64_t pageHits{};        ///< The code page lookups that found the page translated already
+        std::uint64_t pageMisses{};      ///< The code page lookups that had to translate the page or share it
+        std::uint64_t sharedPages{};     ///< The misses that took a page from shared code instead of translating it
+        std::uint64_t blockHits{};       ///< The block lookups that found the block translated already
+        std::uint64_t blockMisses{};     ///< The block lookups that had to translate the block
+        std::uint64_t chainHits{};       ///< The transfers between blocks that followed a chain instead of a lookup
+        std::uint64_t ecalls{};          ///< The number of host calls that the guest made
+        std::uint64_t hostNanoseconds{}; ///< The wall-clock time spent in the ecall handler
+
+        /**
+         * @brief Returns the millions of instructions retired per second spent in Run(), which, for a sum over
+         * cores, is the average rate of one of them
+         */
+        auto Mips() const -> double
+        {
+            return runNanoseconds == 0 ? 0.0
+                                       : static_cast<double>(instructions) * 1e3 / static_cast<double>(runNanoseconds);
+        }
+    };
+
+    /**
+     * @brief A whole 32-bit guest address space, reserved as one contiguous block of host memory
+     *
+     * Host pages are only committed when the guest or the host first touches them, so a sparse guest costs no more
+     * than the memory that it uses. Because every 32-bit address is backed, a Cpu that executes from an AddressSpace
+     * accesses memory without bounds checks. The only accesses that fault are those that straddle its top, such as
+     * a word at 0xFFFFFFFE, which fault as they would at the end of any other guest memory rather than wrapping round.
+     */
+    class OWL_CPU_EXPORT AddressSpace
+    {
+    public:
+        static constexpr std::uint64_t size = std::uint64_t{1} << 32; ///< The size of the address space in bytes
+
+        /**
+         * @brief Reserves the address space, which reads as zero
+         *
+         * Throws std::bad_alloc if the host can't reserve it, for example because it is a 32-bit process.
+         */
+        AddressSpace();
+
+        ~AddressSpace();
+        AddressSpace(AddressSpace const&) = delete;
+        auto operator=(AddressSpace const&) -> AddressSpace& = delete;
+        AddressSpace(AddressSpace&& other) noexcept;
+        auto operator=(AddressSpace&& other) noexcept -> AddressSpace&;
+
+        /**
+         * @brief Returns the whole address space, where guest address zero is the first byte
+         */
+        auto View() const -> std::span<std::uint8_t> { return {m_base, static_cast<std::size_t>(size)}; }
+
+    private:
+        std::uint8_t* m_base{};
+    };
+
     /**
-     * @brief Initializes the name field to the name of the project
+     * @brief A saved copy of a core's architectural state and guest memory, taken by Cpu::Snapshot()
+     *
+     * Snapshots are immutable, so copying one is cheap and every copy shares the same saved memory, as do all the
+     * cores that are restored from it or forked from a core that took it.
      */
-    ExportedClass();
+    class OWL_CPU_EXPORT Snapshot
+    {
+    public:
+        /**
+         * @brief Returns the architectural state that was saved
+         */
+        auto State() const -> CpuState const& { return m_state; }
+
+    private:
+        friend class Cpu;
+
+        Snapshot(CpuState const& state, std::shared_ptr<detail::SnapshotImage const> image);
+
+        CpuState m_state;
+        OWL_CPU_SUPPRESS_C4251
+        std::shared_ptr<detail::SnapshotImage const> m_image;
+    };
 
     /**
-     * @brief Returns a non-owning pointer to the string stored in this class
+     * @brief A memory-mapped device, such as a console or a timer, that guests access with loads and stores
+     *
+     * A device is attached to a core at a window of guest addresses with Cpu::AttachDevice(), and is called for every
+     * load or store that lies entirely inside the window, with the access's offset into the window and its size in
+     * bytes, which is 1, 2 or 4. Devices are called on the thread that runs the core.
      */
-    auto name() const -> char const*;
+    class OWL_CPU_EXPORT Device
+    {
+    public:
+        virtual ~Device();
+
+        /**
+         * @brief Reads `size` bytes at `offset` into the low bytes of `value`, returning false to fault the load
+         *
+         * The core sign or zero extends the value as the load requires.
+         */
+        virtual auto Read(std::uint32_t offset, std::uint32_t size, std::uint32_t& value) -> bool = 0;
+
+        /**
+         * @brief Writes the low `size` bytes of `value` at `offset`, returning false to fault the store
+         */
+        virtual auto Write(std::uint32_t offset, std::uint32_t size, std::uint32_t value) -> bool = 0;
+    };
+
+    /**
+     * @brief An RV32IMAC-style Owl CPU core that executes guest code from a caller-owned memory view
+     *
+     * A Cpu consists of its CpuState, a non-owning view of guest memory, where guest address zero is the first byte of
+     * the view, and a cache of predecoded instructions. Accesses outside of the view stop execution with a fault.
+     * Alternatively, a core can execute from an AddressSpace, which has no outside, so only accesses that straddle its
+     * top fault.
+     *
+     * Devices are attached to addresses outside of the view, so that loads and stores only look for them where they
+     * would otherwise fault, and accesses to memory cost the same whether or not a core has devices.
+     *
+     * Instructions are predecoded a page at a time the first time that the page executes. Guest stores into predecoded
+     * pages are detected automatically, but if the host writes code into memory that has already executed then it
+     * must call InvalidateCode().
+     *
+     * A core is one hart, i.e., hardware thread, of a guest, and AddHart() creates more that share its memory, each of
+     * which can run on its own host thread at the same time as the others. Atomic instructions are host atomics on
+     * guest memory, which must be 4-byte aligned on the host for them to succeed, and every one of them is sequentially
+     * consistent, as is `fence`. An atomic that doesn't address an aligned word of guest memory stops the core with
+     * Exit::StoreFault, or with Exit::LoadFault if it is `lr.w`. Aligned word loads and stores are as atomic as the
+     * host makes them. Each hart has its own predecoded instructions, so stores by one only invalidate code that it has
+     * executed itself: a guest that modifies code that runs on another hart must have the host call InvalidateCode() on
+     * that hart too.
+     *
+     * Everything that a core allocates for itself, i.e., its predecoded pages, its translated blocks, the table that it
+     * finds them with, its record of dirty pages and its table of devices, comes from the memory resource that it was
+     * created with, such as a std::pmr::monotonic_buffer_resource arena or SharedPool(), or from the heap if it wasn't
+     * given one. Snapshots are shared between cores, so they always come from the heap, as does memory for host code
+     * in Engine::Tiered.
+     *
+     * Please see the note above for considerations when creating shared libraries.
+     */
+    class OWL_CPU_EXPORT Cpu
+    {
+    public:
+        /**
+         * @brief Creates a core that executes from guest memory, starting at the given entry point
+         *
+         * The core allocates from the given memory resource, which must outlive it, or from the heap if it is null.
+         * Throws std::invalid_argument if the memory view is larger than the 32-bit guest address space.
+         */
+        explicit Cpu(std::span<std::uint8_t> memory, std::uint32_t entry = 0,
+                     std::pmr::memory_resource* resource = nullptr);
+
+        /**
+         * @brief Creates a core that executes from the whole of an address space, starting at the given entry point
+         *
+         * The address space, and the memory resource if there is one, must outlive the core. The table that the core
+         * finds predecoded pages with has an entry for every page of the address space, which is 8 MiB on a 64-bit
+         * host. From the heap it is only committed as it is used, but from a memory resource it is all written up
+         * front.
+         */
+        explicit Cpu(AddressSpace& memory, std::uint32_t entry = 0, std::pmr::memory_resource* resource = nullptr);
+
+        ~Cpu();
+        Cpu(Cpu const&) = delete;
+        auto operator=(Cpu const&) -> Cpu& = delete;
+        Cpu(Cpu&& other) noexcept;
+        auto operator=(Cpu&& other) noexcept -> Cpu&;
+
+        /**
+         * @brief Executes at most the given number of instructions
+         *
+         * Returns Exit::BudgetExhausted if every cycle was used, otherwise the reason that the guest stopped early.
+         * Execution resumes from the current pc on the next call. If the core has an ecall handler then host calls only
+         * stop it when the handler asks.
+         */
+        auto Run(std::uint64_t cycles) -> Exit;
+
+        /**
+         * @brief Returns an awaitable that runs the core like Run(), producing its owl::Exit
+         *
+         * `co_await cpu.RunFor(cycles)` in a GuestTask lets the task's scheduler run other tasks first. See
+         * owl-cpu/coroutine.h, which must be included to use this.
+         */
+        auto RunFor(std::uint64_t cycles) -> RunAwaiter;
+
+        /**
+         * @brief Selects the engine that subsequent calls to Run() use
+         *
+         * Throws std::invalid_argument if the library was built without the engine.
+         */
+        void SetEngine(Engine engine);
+
+        /**
+         * @brief Returns the engine that Run() uses
+         */
+        auto GetEngine() const -> Engine { return m_engine; }
+
+        /**
+         * @brief Records every instruction that subsequent calls to Run() retire with a trace writer, or stops if it is
+         * null
+         *
+         * While a trace is attached, Run() executes with a tracing interpreter whatever the engine, so that the engines
+         * themselves pay nothing for tracing. See owl-cpu/trace.h.
+         */
+        void SetTrace(TraceWriter* trace);
+
+        /**
+         * @brief Services the guest's host calls with a handler from now on, or stops if it is null
+         *
+         * The handler must outlive the core, or be replaced first. See owl-cpu/ecall.h.
+         */
+        void SetEcallHandler(EcallHandler* handler) { m_ecalls = handler; }
+
+        /**
+         * @brief Attaches a device at the window of guest addresses [base, base + size), which must be outside of guest
+         * memory
+         *
+         * The device must outlive the core. Throws std::invalid_argument if the window is empty, runs past the top of
+         * the 32-bit address space or overlaps guest memory or another device, or if the core executes from an
+         * AddressSpace, which leaves no addresses for devices.
+         */
+        void AttachDevice(std::uint32_t base, std::uint32_t size, Device& device);
+
+        /**
+         * @brief Shares predecoded instructions with every other core that shares them for the same image, so that
+         * only the first core to execute each page of its code translates it
+         *
+         * The image is a key that the host chooses to name the program in guest memory, such as a hash of the file
+         * that it loaded. Only cores whose guest memory is the same size share with each other. Each shared page is
+         * checked against the core's own memory before it is used, so a core whose code differs, because it has
+         * modified its code or the key is wrong, translates its own copy of the page instead, and shares that. Shared
+         * translations come from the heap, like snapshots, and are only freed once no core shares them, so each page
+         * only shares a few different translations, after which cores translate any others for themselves, as they
+         * would without sharing.
+         *
+         * Looking up shared pages takes no locks, and cores created from this one by Fork() or AddHart() share them
+         * too. Sharing discards the core's own predecoded instructions.
+         *
+         * If no core shares code for the image yet, and `saved` names a file written by SaveSharedCode(), then the
+         * shared code starts with the pages saved in it, which are memory-mapped rather than read or translated, and
+         * are checked against memory in the same way. A file that is missing is ignored, as is one that was saved by
+         * a version of owl-cpu that decodes differently, or for a different image or size of memory, or that is
+         * damaged. The file must not be modified in place while it is mapped. Throws std::runtime_error if the file
+         * exists but can't be mapped.
+         */
+        void ShareCode(std::uint64_t image, std::filesystem::path const& saved = {});
+
+        /**
+         * @brief Writes the predecoded instructions that this core shares to a file, for ShareCode() to start from
+         * when the image next runs
+         *
+         * The file holds every page that any sharing core has translated so far, including any that were mapped
+         * from a saved file, and is specific to the host. It's written alongside then renamed over the old one, so
+         * processes already mapping the old file are unaffected. Throws std::invalid_argument if the core doesn't
+         * share its code, and std::runtime_error if the file can't be written.
+         */
+        void SaveSharedCode(std::filesystem::path const& path) const;
+
+        /**
+         * @brief Discards predecoded instructions for the given range of guest memory
+         *
+         * Call this after the host modifies guest code that may already have executed, or, once the core has taken a
+         * snapshot, after the host modifies any guest memory, so that Restore() knows to put it back.
+         */
+        void InvalidateCode(std::uint32_t address, std::uint32_t size);
+
+        /**
+         * @brief Saves the core's architectural state and guest memory
+         *
+         * Taking a snapshot reads the whole of guest memory, although pages that are all zero take no space in it. From
+         * then on the core tracks which pages of guest memory are written, so that restoring the snapshot only has to
+         * copy those pages back. Writes by the host are only tracked if it calls InvalidateCode() for them.
+         */
+        auto Snapshot() -> owl::Snapshot;
+
+        /**
+         * @brief Puts the core's architectural state and guest memory back the way that they were in a snapshot
+         *
+         * If the snapshot is the one that the core last took or restored, or was inherited by Fork(), then this only
+         * copies the pages that have been written since. Otherwise it copies the whole of guest memory. Throws
+         * std::invalid_argument if the snapshot was taken from a core whose guest memory is a different size.
+         */
+        void Restore(owl::Snapshot const& snapshot);
+
+        /**
+         * @brief Creates a core that executes from a copy of this core's guest memory, with the same state and engine
+         *
+         * The new core inherits this core's snapshot, if it has one, along with the record of the pages that have been
+         * written since it was taken, so that restoring it is equally cheap. It allocates from the same memory resource
+         * as this core, but has no devices, ecall handler or trace until they are given to it. Throws
+         * std::invalid_argument if the memory isn't the same size as this core's.
+         */
+        auto Fork(std::span<std::uint8_t> memory) const -> Cpu;
+
+        /**
+         * @brief Creates a core that executes from a copy of this core's guest memory in an address space
+         *
+         * This behaves like the other overload, except that the address space must be new, i.e., read as zero, so that
+         * only the pages that may be non-zero need to be copied into it. Throws std::invalid_argument if this core
+         * doesn't execute from a whole address space.
+         */
+        auto Fork(AddressSpace& memory) const -> Cpu;
+
+        /**
+         * @brief Creates another hart that executes from the same guest memory as this core, starting at the given
+         * entry point
+         *
+         * The new hart has its own architectural state, which is reset apart from its pc, and the same engine, and
+         * allocates from the same memory resource as this core. It has no devices, ecall handler or trace until they
+         * are given to it, and doesn't track writes for snapshots, which only the hart that took one does. As on
+         * hardware, a guest can tell its harts apart if the host gives each one its id in a register, such as a0.
+         */
+        auto AddHart(std::uint32_t entry) const -> Cpu;
+
+        /**
+         * @brief Returns what the core has done since it was created
+         *
+         * This can be called from any thread, even while the core is running. A core created by Fork() or AddHart()
+         * starts with no counts of its own.
+         */
+        auto Stats() const -> owl::Stats;
+
+        /**
+         * @brief Returns the core's architectural state
+         */
+        auto State() -> CpuState& { return m_state; }
+
+        /**
+         * @brief Returns the core's architectural state
+         */
+        auto State() const -> CpuState const& { return m_state; }
+
+        /**
+         * @brief Returns the view of guest memory that this core executes from
+         */
+        auto Memory() const -> std::span<std::uint8_t> { return m_memory; }
+
+    private:
+        void InheritFrom(Cpu const& parent); // takes on a parent's state, engine and snapshot when forking
+
+        CpuState m_state;
+        OWL_CPU_SUPPRESS_C4251
+        std::span<std::uint8_t> m_memory;
+        Engine m_engine;
+        bool m_flat{}; // m_memory is a whole AddressSpace, so accesses need no bounds checks
+        OWL_CPU_SUPPRESS_C4251
+        std::unique_ptr<detail::PredecodeCache> m_code;
+        OWL_CPU_SUPPRESS_C4251
+        std::unique_ptr<detail::BlockCache> m_blocks; // created the first time that Engine::Block or Tiered runs
+        OWL_CPU_SUPPRESS_C4251
+        std::unique_ptr<detail::DeviceBus> m_devices; // created when the first device is attached
+        OWL_CPU_SUPPRESS_C4251
+        std::shared_ptr<detail::SnapshotImage const> m_baseline; // what memory holds, apart from its dirty pages
+        detail::TraceChannel* m_trace{};
+        EcallHandler* m_ecalls{};
+    };
+
+    /**
+     * @brief Runs many independent cores across a pool of worker threads
+     *
+     * The runner time-slices the cores that it is given: each one runs for at most one slice of instructions at a
+     * time, and then goes to the back of its worker's queue, so that a long-running guest can't starve the others.
+     * Workers that run out of cores steal queued ones from busy workers. A core only ever runs on one thread at a
+     * time, but the cores in a batch must not share memory that they write to unless they are harts that synchronize
+     * with atomic instructions, as made by Cpu::AddHart().
+     *
+     * Please see the note above for considerations when creating shared libraries.
+     */
+    class OWL_CPU_EXPORT BatchRunner
+    {
+    public:
+        static constexpr std::uint64_t defaultSlice = 10000; ///< The default number of instructions in a slice
+
+        /**
+         * @brief Starts a pool of worker threads, one for each hardware thread if `threads` is zero
+         *
+         * Throws std::invalid_argument if `slice` is zero.
+         */
+        explicit BatchRunner(unsigned threads = 0, std::uint64_t slice = defaultSlice);
+
+        ~BatchRunner();
+        BatchRunner(BatchRunner const&) = delete;
+        auto operator=(BatchRunner const&) -> BatchRunner& = delete;
+        BatchRunner(BatchRunner&& other) noexcept;
+        auto operator=(BatchRunner&& other) noexcept -> BatchRunner&;
+
+        /**
+         * @brief Runs every core for up to the given number of instructions each, returning when they have all stopped
+         *
+         * Returns the reason that each core stopped, which is Exit::BudgetExhausted for cores that used all of their
+         * cycles. Rethrows the first exception that any core threw, after the rest of the batch finishes.
+         */
+        auto Run(std::span<Cpu> cpus, std::uint64_t cycles) -> std::vector<Exit>;
+
+        /**
+         * @brief Runs every core like the other overload, except that host calls are serviced asynchronously through
+         * a ring
+         *
+         * A core that makes a host call waits, without holding up its worker, until the host completes the call. The
+         * call then counts towards neither the core's cycles nor the slice. See owl-cpu/ecall.h.
+         */
+        auto Run(std::span<Cpu> cpus, std::uint64_t cycles, EcallRing& ring) -> std::vector<Exit>;
+
+        /**
+         * @brief Returns what the runner's cores have done while it ran them, summed over every batch so far
+         *
+         * Each worker thread counts what the slices that it runs do, so a core's counts are added to the runner's
+         * as it runs rather than when its batch finishes, and what cores did outside of the runner isn't included.
+         * This can be called from any thread, even while a batch is running.
+         */
+        auto Stats() const -> owl::Stats;
+
+        /**
+         * @brief Returns the number of worker threads
+         */
+        auto Threads() const -> unsigned;
+
+    private:
+        OWL_CPU_SUPPRESS_C4251
+        std::unique_ptr<detail::BatchPool> m_pool;
+    };
+
+    /**
+     * @brief Runs one program on a group of up to 16 guests at once, executing each instruction for all of them
+     * together
+     *
+     * Each guest, or lane, has its own registers and memory, so a group suits running the same code over many inputs.
+     * The registers are held in structure-of-arrays layout, so that an instruction is fetched and dispatched once and
+     * then executes across 8 or 16 lanes with the host's SIMD instructions. Lanes whose control flow diverges are run
+     * in groups that share a pc, lowest first, so they run together again once their paths meet.
+     *
+     * The lanes share one translation of the code, taken from the first lane's memory. A lane that stores to a page
+     * that has been translated, whose copy of a page differs from the first lane's when the group first executes it,
+     * or that executes an atomic instruction leaves the group and runs on its own from then on, in the same way as a
+     * Cpu using Engine::Switch. Keeping data off code pages avoids the first two.
+     *
+     * Please see the note above for considerations when creating shared libraries.
+     */
+    class OWL_CPU_EXPORT Lockstep
+    {
+    public:
+        static constexpr std::size_t maxLanes = 16; ///< The largest number of lanes in a group
+
+        /**
+         * @brief Creates a group with a lane for each memory view, all starting at the given entry point
+         *
+         * Throws std::invalid_argument if there are no views or more than maxLanes, if they aren't all the same size,
+         * or if they are larger than the 32-bit guest address space.
+         */
+        explicit Lockstep(std::span<std::span<std::uint8_t> const> memories, std::uint32_t entry = 0);
+
+        ~Lockstep();
+        Lockstep(Lockstep const&) = delete;
+        auto operator=(Lockstep const&) -> Lockstep& = delete;
+        Lockstep(Lockstep&& other) noexcept;
+        auto operator=(Lockstep&& other) noexcept -> Lockstep&;
+
+        /**
+         * @brief Returns the number of lanes in the group
+         */
+        auto Lanes() const -> std::size_t;
+
+        /**
+         * @brief Returns a copy of a lane's architectural state
+         *
+         * Throws std::invalid_argument if there is no such lane.
+         */
+        auto State(std::size_t lane) const -> CpuState;
+
+        /**
+         * @brief Replaces a lane's architectural state
+         *
+         * Throws std::invalid_argument if there is no such lane.
+         */
+        void SetState(std::size_t lane, CpuState const& state);
+
+        /**
+         * @brief Executes at most the given number of instructions in each lane
+         *
+         * Returns the reason that each lane stopped, in the same way as Cpu::Run(). Execution resumes from each lane's
+         * current pc on the next call.
+         */
+        auto Run(std::uint64_t cycles) -> std::vector<Exit>;
+
+        /**
+         * @brief Discards all predecoded instructions
+         *
+         * Call this after the host modifies guest code that may already have executed.
+         */
+        void InvalidateCode();
+
+    private:
+        void CheckLane(std::size_t lane) const;
 
-private:
-    OWL_CPU_SUPPRESS_C4251
-    std::string m_name;
-};
+        OWL_CPU_SUPPRESS_C4251
+        std::unique_ptr<detail::LaneGroup> m_lanes;
+    };
+} // namespace owl
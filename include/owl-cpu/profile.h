@@ -0,0 +1,94 @@
+#pragma once
+
+#include "owl-cpu/owl-cpu_export.hpp"
+
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+namespace owl
+{
+    /**
+     * @brief What the profiler counted, summed over every thread that has run a core
+     *
+     * Operations are the decoder's, so they include the specialized forms that it gives some instructions, such as Li
+     * for `addi rd, x0, imm`. Every engine counts operations and branches, including the instructions that compiled
+     * code executes; block hits are counted by Engine::Block and Engine::Tiered, for the blocks that they translate.
+     * Counts from different guests are summed by pc, so profile one program at a time.
+     *
+     * Engine::Block and Engine::Tiered also fuse common pairs of adjacent instructions in the blocks that they
+     * translate, such as `slli` then `add`, into superinstructions that execute both with one dispatch. Each fusion
+     * counts how many times its pair was dispatched that way, while the operations still count both instructions, so
+     * a fusion's count divided by that of its first operation is the share of those instructions that it caught.
+     * Compiled code doesn't dispatch, so it doesn't count fusions.
+     */
+    struct Profile
+    {
+        struct Operation
+        {
+            char const* name{};   ///< The operation's name, e.g., "Addi"
+            std::uint64_t count{}; ///< The number of times that it was dispatched, including when it faulted
+        };
+
+        struct Block
+        {
+            std::uint32_t pc{};   ///< The address of the block's first instruction
+            std::uint64_t hits{}; ///< The number of times that execution entered the block
+        };
+
+        struct Fusion
+        {
+            char const* name{};   ///< The names of the pair's operations, e.g., "SlliAdd"
+            std::uint64_t count{}; ///< The number of times that the pair was dispatched as one
+        };
+
+        struct Branch
+        {
+            std::uint32_t pc{};       ///< The address of the branch
+            std::uint64_t taken{};    ///< The number of times that it branched
+            std::uint64_t notTaken{}; ///< The number of times that it fell through
+        };
+
+        std::vector<Operation> operations; ///< Every operation, in the decoder's order
+        std::vector<Block> blocks;         ///< Every block that was entered, by pc
+        std::vector<Branch> branches;      ///< Every branch that was executed, by pc
+        std::vector<Fusion> fusions;       ///< Every pair of operations that can be fused, in the decoder's order
+    };
+
+    /**
+     * @brief Returns true if the library was built with owl-cpu_PROFILER, without which every count is zero
+     */
+    OWL_CPU_EXPORT auto IsProfilerAvailable() -> bool;
+
+    /**
+     * @brief Sums the counts of every thread, including threads that have exited
+     *
+     * This waits for any Cpu::Run() that is in progress on another thread to return.
+     */
+    OWL_CPU_EXPORT auto CollectProfile() -> Profile;
+
+    /**
+     * @brief Sets every thread's counts back to zero
+     */
+    OWL_CPU_EXPORT void ResetProfile();
+
+    /**
+     * @brief Writes a profile as CSV with the columns `kind,name,count,taken`
+     *
+     * Each operation is a row of kind `op` named after it, and each fusion is a row of kind `fusion`. Each block is a
+     * row of kind `block`, and each branch is a row of kind `branch`, named after their pc in hexadecimal. Only
+     * branches have a `taken` count, which is part of their `count`.
+     */
+    OWL_CPU_EXPORT void WriteProfileCsv(Profile const& profile, std::ostream& out);
+
+    /**
+     * @brief Writes a profile as flat little-endian binary
+     *
+     * The file starts with the 8 bytes "OWLPROF", NUL-terminated, then the u32 format version, which is 2, and the u32
+     * numbers of operations, blocks, branches and fusions. The operation records follow, each a NUL-padded 16 byte
+     * name and a u64 count, then the block records, each a u32 pc, 4 bytes of padding and a u64 hit count, then the
+     * branch records, each a u32 pc, 4 bytes of padding and the u64 taken and not taken counts, and lastly the fusion
+     * records, which are laid out like the operation records.
+     */
+    OWL_CPU_EXPORT void WriteProfileBinary(Profile const& profile, std::ostream& out);
+} // namespace owl
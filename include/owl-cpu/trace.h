@@ -0,0 +1,196 @@
+#pragma once
+
+#include "owl-cpu/owl-cpu.h"
+#include "owl-cpu/owl-cpu_export.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <span>
+
+/**
+ * @file
+ * @brief Streaming binary execution traces
+ *
+ * A trace is the sequence of instructions that a core retired, each with the register that it wrote and the value that
+ * it wrote to it. It starts with the 8 bytes "OWLTRACE" and the u32 little-endian format version, which is 2, followed
+ * by records that each begin with a tag byte. Numbers in records are LEB128 varints, and signed numbers are zigzag
+ * encoded first. The tag's top two bits give the kind of record:
+ *
+ * - 0, a step: a 4-byte instruction retired. If bit 0 is set then a signed pc delta follows, otherwise the instruction
+ *   follows the previous one. Bits 1 to 5 hold the register that it wrote, or 0 if it didn't write one. If it did then
+ *   the signed difference between the value written and the register's previous value follows.
+ * - 1, a start: Cpu::Run() was called. The signed delta from the pc that the trace expected next to the core's pc
+ *   follows, then a signed difference for each of x1 to x31, so that a reader knows the state even if the host changed
+ *   it between runs.
+ * - 2, an exit: Cpu::Run() returned. The owl::Exit byte follows, then the signed delta from the pc that the trace
+ *   expected next to the core's pc.
+ * - 3, a compressed step: a 2-byte instruction retired, laid out like a step.
+ *
+ * Deltas are relative to the pc that follows the previous instruction, and registers start at zero. A trace written
+ * with TraceCompression::Lz4 is this stream inside a standard LZ4 frame, so `lz4 -d` recovers it.
+ */
+
+namespace owl
+{
+    namespace detail
+    {
+        class TraceChannel;
+    } // namespace detail
+
+    /**
+     * @brief Where a TraceWriter sends the trace, in chunks, from its background thread
+     */
+    class OWL_CPU_EXPORT TraceSink
+    {
+    public:
+        virtual ~TraceSink();
+
+        /**
+         * @brief Writes the next chunk of the trace. Exceptions are rethrown by TraceWriter::Flush().
+         */
+        virtual void Write(std::span<std::uint8_t const> chunk) = 0;
+    };
+
+    /**
+     * @brief A TraceSink that writes to a file, replacing anything that was already there
+     */
+    class OWL_CPU_EXPORT FileTraceSink final : public TraceSink
+    {
+    public:
+        /**
+         * @brief Creates the file. Throws std::runtime_error if it can't.
+         */
+        explicit FileTraceSink(std::filesystem::path const& path);
+
+        ~FileTraceSink() override;
+        FileTraceSink(FileTraceSink const&) = delete;
+        auto operator=(FileTraceSink const&) -> FileTraceSink& = delete;
+        FileTraceSink(FileTraceSink&&) = delete;
+        auto operator=(FileTraceSink&&) -> FileTraceSink& = delete;
+
+        /**
+         * @brief Appends a chunk to the file. Throws std::runtime_error if it can't.
+         */
+        void Write(std::span<std::uint8_t const> chunk) override;
+
+    private:
+        std::FILE* m_file{};
+    };
+
+    /**
+     * @brief How a TraceWriter compresses the trace before handing it to its sink
+     */
+    enum class TraceCompression : std::uint8_t
+    {
+        None, ///< The sink receives the trace as it is
+        Lz4,  ///< The sink receives an LZ4 frame, compressed on the writer's background thread
+    };
+
+    /**
+     * @brief Encodes the trace of the cores that it is attached to and writes it to a sink on a background thread
+     *
+     * The core that is running encodes records into one of two buffers. When it fills, the buffer is handed to the
+     * writer's thread to be compressed and written, and the core carries on with the other one, only waiting if that
+     * one hasn't been written yet. Attach the writer with Cpu::SetTrace(). It may be attached to more than one core,
+     * but only one of them may run at a time, and the trace is then theirs interleaved, as each run begins with their
+     * state. The writer must outlive the cores that it is attached to, or be detached from them first.
+     *
+     * Please see the note in owl-cpu.h for considerations when creating shared libraries.
+     */
+    class OWL_CPU_EXPORT TraceWriter
+    {
+    public:
+        static constexpr std::size_t defaultBufferSize = std::size_t{1} << 20; ///< The default size of each buffer
+
+        /**
+         * @brief Starts the writer's thread and writes the trace's header
+         *
+         * Throws std::invalid_argument if `bufferSize` is less than 4 KiB.
+         */
+        explicit TraceWriter(TraceSink& sink, TraceCompression compression = TraceCompression::None,
+                             std::size_t bufferSize = defaultBufferSize);
+
+        /**
+         * @brief Writes what remains of the trace and stops the writer's thread
+         */
+        ~TraceWriter();
+
+        TraceWriter(TraceWriter const&) = delete;
+        auto operator=(TraceWriter const&) -> TraceWriter& = delete;
+        TraceWriter(TraceWriter&&) = delete;
+        auto operator=(TraceWriter&&) -> TraceWriter& = delete;
+
+        /**
+         * @brief Waits until the sink has been given everything traced so far
+         *
+         * Rethrows the first exception that the sink threw, if any, after which the rest of the trace is discarded.
+         */
+        void Flush();
+
+    private:
+        friend class Cpu;
+
+        OWL_CPU_SUPPRESS_C4251
+        std::unique_ptr<detail::TraceChannel> m_channel;
+    };
+
+    /**
+     * @brief A record read back from an uncompressed trace, with its deltas resolved
+     */
+    struct TraceRecord
+    {
+        enum class Kind : std::uint8_t
+        {
+            Start, ///< Cpu::Run() was called with the core at `pc`
+            Step,  ///< The instruction at `pc` retired, writing `value` to `rd` unless it is zero
+            Exit,  ///< Cpu::Run() returned `exit`, with the core at `pc`
+        };
+
+        Kind kind{};
+        std::uint32_t pc{};
+        std::uint8_t rd{};
+        std::uint32_t value{};
+        Exit exit{};
+    };
+
+    /**
+     * @brief Reads the records of an uncompressed trace one at a time, keeping track of the registers
+     */
+    class OWL_CPU_EXPORT TraceReader
+    {
+    public:
+        /**
+         * @brief Checks the trace's header. Throws std::runtime_error if this isn't a version 2 trace.
+         *
+         * The bytes must outlive the reader.
+         */
+        explicit TraceReader(std::span<std::uint8_t const> trace);
+
+        /**
+         * @brief Reads the next record, returning false at the end of the trace
+         *
+         * Throws std::runtime_error if the trace is malformed or ends part way through a record.
+         */
+        auto Next(TraceRecord& record) -> bool;
+
+        /**
+         * @brief Returns the registers as they were after the last record that was read
+         */
+        auto Registers() const -> std::array<std::uint32_t, 32> const& { return m_x; }
+
+    private:
+        auto Byte() -> std::uint8_t;
+        auto Varint() -> std::uint32_t;
+        auto Delta() -> std::int32_t;
+
+        OWL_CPU_SUPPRESS_C4251
+        std::span<std::uint8_t const> m_trace;
+        std::size_t m_at{};
+        std::uint32_t m_pc{};
+        std::array<std::uint32_t, 32> m_x{};
+    };
+} // namespace owl
@@ -0,0 +1,66 @@
+#include "owl-cpu/owl-cpu.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace owl
+{
+    AddressSpace::AddressSpace()
+    {
+        if constexpr (sizeof(std::size_t) <= sizeof(std::uint32_t))
+        {
+            // A 32-bit host can't reserve the 32-bit guest's address space.
+            throw std::bad_alloc();
+        }
+        auto const reserved = static_cast<std::size_t>(AddressSpace::size);
+#if defined(_WIN32)
+        // Windows can't commit pages on first touch without an exception handler, so the address space is committed
+        // up front. That only charges it against the commit limit: physical pages are still allocated on first touch.
+        auto* base = VirtualAlloc(nullptr, reserved, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if (base == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+#else
+        auto flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if defined(MAP_NORESERVE)
+        flags |= MAP_NORESERVE;
+#endif
+        auto* base = mmap(nullptr, reserved, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (base == MAP_FAILED)
+        {
+            throw std::bad_alloc();
+        }
+#endif
+        m_base = static_cast<std::uint8_t*>(base);
+    }
+
+    AddressSpace::~AddressSpace()
+    {
+        if (m_base == nullptr)
+        {
+            return;
+        }
+#if defined(_WIN32)
+        VirtualFree(m_base, 0, MEM_RELEASE);
+#else
+        munmap(m_base, static_cast<std::size_t>(AddressSpace::size));
+#endif
+    }
+
+    AddressSpace::AddressSpace(AddressSpace&& other) noexcept : m_base{std::exchange(other.m_base, nullptr)} {}
+
+    auto AddressSpace::operator=(AddressSpace&& other) noexcept -> AddressSpace&
+    {
+        std::swap(m_base, other.m_base);
+        return *this;
+    }
+} // namespace owl
@@ -0,0 +1,360 @@
+#include "owl-cpu/owl-cpu.h"
+#include "owl-cpu/ecall.h"
+
+#include "ecall-ring.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace owl::detail
+{
+    // The worker threads behind a BatchRunner. Each worker has a queue of the indices of the cores that it is
+    // time-slicing. It runs the core at the front of its own queue for a slice and puts it back at the end, and when
+    // its own queue is empty it steals from the end of another worker's. With an ecall ring, a core that makes a host
+    // call is in no queue until the host completes it, whereupon whichever worker sees the completion first queues it.
+    class BatchPool
+    {
+    public:
+        BatchPool(unsigned threads, std::uint64_t slice) : m_slice{slice}, m_queues(threads), m_counters(threads)
+        {
+            m_threads.reserve(threads);
+            for (unsigned i = 0; i < threads; ++i)
+            {
+                m_threads.emplace_back([this, i] { Work(i); });
+            }
+        }
+
+        ~BatchPool()
+        {
+            {
+                std::lock_guard const lock{m_mutex};
+                m_stopping = true;
+            }
+            m_wake.notify_all();
+            for (auto& thread : m_threads)
+            {
+                thread.join();
+            }
+        }
+
+        BatchPool(BatchPool const&) = delete;
+        auto operator=(BatchPool const&) -> BatchPool& = delete;
+        BatchPool(BatchPool&&) = delete;
+        auto operator=(BatchPool&&) -> BatchPool& = delete;
+
+        auto Run(std::span<Cpu> cpus, std::uint64_t cycles, EcallQueues* ring) -> std::vector<Exit>
+        {
+            std::lock_guard const running{m_running};
+            if (cpus.empty() || cycles == 0)
+            {
+                return std::vector<Exit>(cpus.size(), Exit::BudgetExhausted);
+            }
+
+            m_cpus = cpus;
+            m_remaining.assign(cpus.size(), cycles);
+            m_exits.assign(cpus.size(), Exit::BudgetExhausted);
+            m_error = nullptr;
+            for (std::size_t i = 0; i < cpus.size(); ++i)
+            {
+                auto& queue = m_queues[i % m_queues.size()];
+                std::lock_guard const lock{queue.mutex};
+                queue.cores.push_back(i);
+            }
+            m_ring = ring;
+            if (m_ring != nullptr)
+            {
+                m_ring->Open(cpus.size(), [this] {
+                    std::lock_guard const lock{m_mutex};
+                    m_wake.notify_all();
+                });
+            }
+            m_queued = cpus.size();
+            m_unfinished = cpus.size();
+
+            {
+                // Waiting for the workers to leave the batch, as well as for it to finish, means that none of them is
+                // still using the ring when it is handed back.
+                std::unique_lock lock{m_mutex};
+                ++m_batch;
+                m_wake.notify_all();
+                m_done.wait(lock, [this] { return m_unfinished == 0 && m_working == 0; });
+            }
+            if (m_ring != nullptr)
+            {
+                m_ring->Close();
+            }
+
+            if (m_error)
+            {
+                std::rethrow_exception(m_error);
+            }
+            return m_exits;
+        }
+
+        auto Threads() const -> unsigned { return static_cast<unsigned>(m_threads.size()); }
+
+        auto Stats() const -> owl::Stats
+        {
+            StatCounters total;
+            for (auto const& worker : m_counters)
+            {
+                total.Add(worker.counters.Load());
+            }
+            return total.Load();
+        }
+
+    private:
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<std::size_t> cores;
+        };
+
+        // What the slices that one worker ran did, on a cache line of its own so that workers don't contend for it.
+        struct alignas(64) WorkerCounters
+        {
+            StatCounters counters;
+        };
+
+        void Work(std::size_t worker)
+        {
+            auto seen = std::uint64_t{};
+            for (;;)
+            {
+                {
+                    std::unique_lock lock{m_mutex};
+                    m_wake.wait(lock, [&] { return m_stopping || m_batch != seen; });
+                    if (m_stopping)
+                    {
+                        return;
+                    }
+                    seen = m_batch;
+                    ++m_working;
+                }
+
+                std::vector<EcallCompletion> completions;
+                while (m_unfinished > 0)
+                {
+                    if (m_ring != nullptr)
+                    {
+                        Resume(worker, completions);
+                    }
+                    if (auto const core = Take(worker))
+                    {
+                        RunSlice(worker, *core);
+                        continue;
+                    }
+                    // Every unfinished core is running on another worker or waiting for a host call, so wait for one
+                    // of them to be queued or completed.
+                    std::unique_lock lock{m_mutex};
+                    ++m_idle;
+                    m_wake.wait(lock, [this] {
+                        return m_queued > 0 || m_unfinished == 0 || m_stopping
+                               || (m_ring != nullptr && m_ring->HasCompletions());
+                    });
+                    --m_idle;
+                }
+
+                std::lock_guard const lock{m_mutex};
+                --m_working;
+                m_done.notify_all();
+            }
+        }
+
+        // Takes the next core from the worker's own queue, or steals one from another worker.
+        auto Take(std::size_t worker) -> std::optional<std::size_t>
+        {
+            for (std::size_t i = 0; i < m_queues.size(); ++i)
+            {
+                auto& queue = m_queues[(worker + i) % m_queues.size()];
+                std::lock_guard const lock{queue.mutex};
+                if (queue.cores.empty())
+                {
+                    continue;
+                }
+                auto const own = i == 0;
+                auto const core = own ? queue.cores.front() : queue.cores.back();
+                if (own)
+                {
+                    queue.cores.pop_front();
+                }
+                else
+                {
+                    queue.cores.pop_back();
+                }
+                --m_queued;
+                return core;
+            }
+            return std::nullopt;
+        }
+
+        // Puts a core that hasn't finished at the end of the worker's queue, waking an idle worker to steal it.
+        void Give(std::size_t worker, std::size_t core)
+        {
+            {
+                auto& queue = m_queues[worker];
+                std::lock_guard const lock{queue.mutex};
+                queue.cores.push_back(core);
+                ++m_queued; // under the lock, so that a worker taking the core can't count it before it is counted
+            }
+            if (m_idle > 0)
+            {
+                std::lock_guard const lock{m_mutex};
+                m_wake.notify_one();
+            }
+        }
+
+        void RunSlice(std::size_t worker, std::size_t core)
+        {
+            auto& cpu = m_cpus[core];
+            auto const budget = std::min(m_slice, m_remaining[core]);
+            auto const stats = cpu.Stats();
+            auto exit = Exit::BudgetExhausted;
+            try
+            {
+                auto const before = cpu.State().instret;
+                exit = cpu.Run(budget);
+                if (exit == Exit::Ecall && m_ring != nullptr)
+                {
+                    m_remaining[core] -= cpu.State().instret - before;
+                }
+                else
+                {
+                    m_remaining[core] -= exit == Exit::BudgetExhausted ? budget : m_remaining[core];
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard const lock{m_mutex};
+                if (!m_error)
+                {
+                    m_error = std::current_exception();
+                }
+                m_remaining[core] = 0;
+                exit = Exit::BudgetExhausted;
+            }
+            m_counters[worker].counters.Add(Difference(cpu.Stats(), stats));
+
+            if (exit == Exit::Ecall && m_ring != nullptr)
+            {
+                // From here on the core belongs to the host, until it is completed.
+                EcallRequest request{.core = core, .cpu = &cpu, .number = cpu.State().x[a7]};
+                std::copy_n(&cpu.State().x[a0], request.arguments.size(), request.arguments.begin());
+                m_ring->Submit(request);
+                return;
+            }
+            if (m_remaining[core] > 0)
+            {
+                Give(worker, core);
+                return;
+            }
+            Finish(core, exit);
+        }
+
+        // Resumes the cores whose host calls have been completed, or finishes them if the host said to stop.
+        void Resume(std::size_t worker, std::vector<EcallCompletion>& completions)
+        {
+            m_ring->TakeCompletions(completions);
+            for (auto const& completion : completions)
+            {
+                m_cpus[completion.core].State().x[a0] = completion.result;
+                if (!completion.resume)
+                {
+                    Finish(completion.core, Exit::Ecall);
+                }
+                else if (m_remaining[completion.core] > 0)
+                {
+                    Give(worker, completion.core);
+                }
+                else
+                {
+                    Finish(completion.core, Exit::BudgetExhausted);
+                }
+            }
+        }
+
+        void Finish(std::size_t core, Exit exit)
+        {
+            m_exits[core] = exit;
+            if (--m_unfinished == 0)
+            {
+                std::lock_guard const lock{m_mutex};
+                m_done.notify_all();
+                m_wake.notify_all();
+            }
+        }
+
+        static constexpr std::size_t a0 = 10;
+        static constexpr std::size_t a7 = 17;
+
+        std::uint64_t m_slice;
+        std::vector<Queue> m_queues;
+        std::vector<WorkerCounters> m_counters;
+
+        // The batch that is running. Each core's entries are only touched by the worker that holds its index.
+        std::span<Cpu> m_cpus;
+        EcallQueues* m_ring{};
+        std::vector<std::uint64_t> m_remaining;
+        std::vector<Exit> m_exits;
+        std::exception_ptr m_error;
+        std::atomic<std::size_t> m_unfinished{};
+        std::atomic<std::size_t> m_queued{};
+        std::atomic<unsigned> m_idle{};
+
+        std::mutex m_running; // held for the whole of Run(), so that batches don't overlap
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::condition_variable m_done;
+        std::uint64_t m_batch{};
+        unsigned m_working{}; // the workers that are taking part in the batch
+        bool m_stopping{};
+        std::vector<std::thread> m_threads;
+    };
+} // namespace owl::detail
+
+namespace owl
+{
+    BatchRunner::BatchRunner(unsigned threads, std::uint64_t slice)
+    {
+        if (slice == 0)
+        {
+            throw std::invalid_argument("the time slice must be at least one instruction");
+        }
+        if (threads == 0)
+        {
+            threads = std::max(1U, std::thread::hardware_concurrency());
+        }
+        m_pool = std::make_unique<detail::BatchPool>(threads, slice);
+    }
+
+    BatchRunner::~BatchRunner() = default;
+    BatchRunner::BatchRunner(BatchRunner&& other) noexcept = default;
+    auto BatchRunner::operator=(BatchRunner&& other) noexcept -> BatchRunner& = default;
+
+    auto BatchRunner::Run(std::span<Cpu> cpus, std::uint64_t cycles) -> std::vector<Exit>
+    {
+        return m_pool->Run(cpus, cycles, nullptr);
+    }
+
+    auto BatchRunner::Run(std::span<Cpu> cpus, std::uint64_t cycles, EcallRing& ring) -> std::vector<Exit>
+    {
+        return m_pool->Run(cpus, cycles, ring.m_queues.get());
+    }
+
+    auto BatchRunner::Stats() const -> owl::Stats { return m_pool->Stats(); }
+
+    auto BatchRunner::Threads() const -> unsigned { return m_pool->Threads(); }
+} // namespace owl
@@ -0,0 +1,150 @@
+#include "block-cache.h"
+
+#include "owl-cpu/detail/decoder.h"
+
+#include "pooled.h"
+#include "predecode.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace owl::detail
+{
+    namespace
+    {
+        constexpr auto EndsBlock(Op op) -> bool
+        {
+            switch (Uncompress(op))
+            {
+            case Op::Jal:
+            case Op::Jalr:
+            case Op::J:
+            case Op::Jr:
+            case Op::Beq:
+            case Op::Beqz:
+            case Op::Bnez:
+            case Op::Bne:
+            case Op::Blt:
+            case Op::Bge:
+            case Op::Bltu:
+            case Op::Bgeu:
+            case Op::Ecall:
+            case Op::Ebreak:
+            case Op::Illegal:
+            case Op::FetchFault:
+                return true;
+            default:
+                return false;
+            }
+        }
+    } // namespace
+
+    void BlockCache::operator delete(BlockCache* cache, std::destroying_delete_t)
+    {
+        // Not m_code's resource, because the predecode cache may already have gone.
+        DeletePooled(cache, cache->m_blocks.get_allocator().resource());
+    }
+
+    auto BlockCache::Find(std::uint32_t pc, Exit& exit) -> Block*
+    {
+        if (IsStale())
+        {
+            Flush();
+        }
+
+        auto& recent = m_recent[(pc >> slotShift) % m_recent.size()];
+        auto& counters = m_code.Counters();
+        if (recent != nullptr && recent->pc == pc)
+        {
+            counters.blockHits.Increment();
+            return recent;
+        }
+
+        auto* block = [&]() -> Block* {
+            if (auto const found = m_blocks.find(pc); found != m_blocks.end())
+            {
+                counters.blockHits.Increment();
+                return &found->second;
+            }
+            counters.blockMisses.Increment();
+            return Translate(pc, exit);
+        }();
+        if (block != nullptr)
+        {
+            recent = block;
+        }
+        return block;
+    }
+
+    void BlockCache::Flush()
+    {
+        m_blocks.clear();
+        m_recent.fill(nullptr);
+#if defined(OWL_CPU_JIT)
+        m_jit.Clear();
+#endif
+        m_generation = m_code.Generation();
+    }
+
+    auto BlockCache::Translate(std::uint32_t pc, Exit& exit) -> Block*
+    {
+        if ((pc & (slotSize - 1)) != 0)
+        {
+            exit = Exit::MisalignedFetch;
+            return nullptr;
+        }
+        auto const* page = m_code.Lookup(pc);
+        if (page == nullptr)
+        {
+            exit = Exit::FetchFault;
+            return nullptr;
+        }
+
+        auto* block = &m_blocks.try_emplace(pc, m_code.Resource()).first->second;
+        block->pc = pc;
+
+        auto slot = (pc & (codePageSize - 1)) >> slotShift;
+        auto next = pc;
+        for (;;)
+        {
+            auto const& d = page->insns[slot];
+            block->insns.push_back({.d = d});
+            auto const at = next;
+            next += InstructionSize(d.op);
+            slot += InstructionSize(d.op) >> slotShift;
+            if (EndsBlock(d.op))
+            {
+                if (IsBranch(d.op))
+                {
+                    block->successorPc = {at + static_cast<std::uint32_t>(d.imm), next};
+                }
+                else if (Uncompress(d.op) == Op::Jal || d.op == Op::J)
+                {
+                    block->successorPc[0] = at + static_cast<std::uint32_t>(d.imm);
+                }
+                break;
+            }
+            if (slot >= page->insns.size() || block->insns.size() == maxBlockLength)
+            {
+                block->successorPc[0] = next;
+                break;
+            }
+        }
+
+        // Fuse pairs of instructions into superinstructions. The second of a pair keeps its own operation, so that the
+        // block still has one entry per instruction and its last entry is still the one that ends it.
+        auto& insns = block->insns;
+        for (std::size_t i = 0; i + 1 < insns.size(); ++i)
+        {
+            if (auto const fused = Fuse(insns[i].d.op, insns[i + 1].d.op); fused != insns[i].d.op)
+            {
+                insns[i].d.op = fused;
+                ++i;
+            }
+        }
+
+        block->insns.push_back({}); // The end of block marker.
+        return block;
+    }
+} // namespace owl::detail
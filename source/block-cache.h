@@ -0,0 +1,114 @@
+#pragma once
+
+#include "owl-cpu/detail/decoder.h"
+#include "owl-cpu/owl-cpu.h"
+
+#include "jit.h"
+#include "predecode.h"
+
+#include <array>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+namespace owl::detail
+{
+    // A predecoded instruction together with the handler that executes it. Handlers are bound by the engine that
+    // executes the block, because only it knows their addresses.
+    struct BlockInsn
+    {
+        void const* handler{};
+        Decoded d;
+    };
+
+    // A pc that no successor can have, because pc is never odd.
+    inline constexpr std::uint32_t noSuccessor = 1;
+
+    // A straight-line run of instructions that ends with a control transfer, or at the end of its code page. Blocks
+    // never span code pages. Where an instruction is the first of a pair that fuses, its entry holds the fused
+    // operation, and the entry after it is skipped when the block is interpreted.
+    struct Block
+    {
+        explicit Block(std::pmr::memory_resource* resource) : insns{resource} {}
+
+        std::uint32_t pc{};
+        std::pmr::vector<BlockInsn> insns; // followed by one more entry whose handler ends the block
+        // The successors that are known statically, i.e., the fall-through and any branch or jal target, and the
+        // blocks that they are chained to once they have been looked up.
+        std::array<std::uint32_t, 2> successorPc{noSuccessor, noSuccessor};
+        std::array<Block*, 2> successor{};
+        void const* const* boundTo{}; // the handler table that the insns' handlers came from
+        std::uint32_t executions{};   // how many times the tiered engine has interpreted the block
+        NativeBlock native{};         // the block compiled to host code, once it is hot
+
+        auto Count() const -> std::uint32_t { return static_cast<std::uint32_t>(insns.size() - 1); }
+    };
+
+    // Basic blocks translated from the predecode cache, addressed by their starting pc. The blocks come from the
+    // predecode cache's memory resource, as does the cache itself when it is created with MakePooled().
+    class BlockCache
+    {
+    public:
+        explicit BlockCache(PredecodeCache& code) : m_code{code}, m_blocks{code.Resource()} {}
+
+        static void operator delete(BlockCache* cache, std::destroying_delete_t);
+
+        // Returns the block that starts at pc, translating it if necessary, or nullptr with the exit reason set if pc
+        // can't be fetched from.
+        auto Find(std::uint32_t pc, Exit& exit) -> Block*;
+
+        // Returns the block that `from` continues to at pc, chaining the two together if pc is one of its static
+        // successors so that the next transfer between them needs no lookup.
+        auto Next(Block& from, std::uint32_t pc, Exit& exit) -> Block*
+        {
+            if (IsStale())
+            {
+                // `from` is about to be flushed along with every other block.
+                return Find(pc, exit);
+            }
+            for (std::size_t i = 0; i < from.successorPc.size(); ++i)
+            {
+                if (pc == from.successorPc[i])
+                {
+                    if (from.successor[i] == nullptr)
+                    {
+                        from.successor[i] = Find(pc, exit);
+                    }
+                    else
+                    {
+                        m_code.Counters().chainHits.Increment();
+                    }
+                    return from.successor[i];
+                }
+            }
+            return Find(pc, exit);
+        }
+
+        // Returns true if the predecoded instructions that the blocks were translated from have changed.
+        auto IsStale() const -> bool { return m_generation != m_code.Generation(); }
+
+        // Discards every block, which also unlinks every chain.
+        void Flush();
+
+#if defined(OWL_CPU_JIT)
+        // Compiles the block to host code unless the JIT has run out of space for it.
+        void Compile(Block& block) { block.native = m_jit.Compile(block); }
+#endif
+
+    private:
+        static constexpr std::uint32_t maxBlockLength = 128;
+
+        auto Translate(std::uint32_t pc, Exit& exit) -> Block*;
+
+        PredecodeCache& m_code;
+        std::uint64_t m_generation{};
+        std::pmr::unordered_map<std::uint32_t, Block> m_blocks; // whose nodes never move, so blocks can be chained
+        // A direct-mapped cache in front of m_blocks for targets that aren't static, such as returns.
+        std::array<Block*, 1024> m_recent{};
+#if defined(OWL_CPU_JIT)
+        Jit m_jit;
+#endif
+    };
+} // namespace owl::detail
@@ -0,0 +1,271 @@
+#include "owl-cpu/detail/decoder.h"
+
+#include "block-cache.h"
+#include "engines.h"
+#include "execute.h"
+#include "memory.h"
+#include "profile.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// The block engine: execute whole basic blocks, charging the budget once per block instead of once per instruction,
+// and follow the chains between blocks so that statically known transfers don't go back through a lookup. The tiered
+// engine is the same loop, except that it hands blocks that have run often enough to the JIT and runs their compiled
+// code from then on.
+
+#if defined(OWL_CPU_THREADED_DISPATCH) && defined(__GNUC__)
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+namespace owl::detail
+{
+    namespace
+    {
+        // Executes the instructions in the block and returns how many of them retired. It returns early, with the exit
+        // reason set, if an instruction stops execution, or without it if a store modifies code, in which case the
+        // rest of the block may be stale.
+        template<typename Memory>
+        auto ExecuteBlock(Context<Memory>& c, Block& block) -> std::uint32_t
+        {
+            auto const generation = c.code.Generation();
+
+#if defined(OWL_CPU_THREADED_DISPATCH)
+            // Handlers are the addresses of the labels below, in the order of the operations that they execute, with
+            // one more at the end for the end of block marker.
+#define OWL_CPU_LABEL_ADDRESS(name) &&op_##name,
+#define OWL_CPU_FUSED_LABEL_ADDRESS(first, second) &&op_##first##second,
+            static void const* const handlers[] = {
+                    OWL_CPU_FOR_EACH_OP(OWL_CPU_LABEL_ADDRESS) OWL_CPU_FOR_EACH_FUSION(OWL_CPU_FUSED_LABEL_ADDRESS)
+                            &&end_of_block};
+#undef OWL_CPU_FUSED_LABEL_ADDRESS
+#undef OWL_CPU_LABEL_ADDRESS
+            static_assert(sizeof(handlers) / sizeof(handlers[0]) == opCount + fusionCount + 1);
+
+            if (block.boundTo != handlers)
+            {
+                for (auto& insn : block.insns)
+                {
+                    insn.handler = handlers[static_cast<std::uint8_t>(insn.d.op)];
+                }
+                block.insns.back().handler = handlers[opCount + fusionCount];
+                block.boundTo = handlers;
+            }
+
+            auto const* ip = block.insns.data();
+            goto* ip->handler;
+
+#define OWL_CPU_HANDLER(name)                                                                                          \
+    op_##name : if (!Execute<Op::name>(c, ip->d))                                                                      \
+    {                                                                                                                  \
+        goto end_of_block;                                                                                             \
+    }                                                                                                                  \
+    ++ip;                                                                                                              \
+    if constexpr (IsStore(Op::name))                                                                                   \
+    {                                                                                                                  \
+        if (c.code.Generation() != generation)                                                                         \
+        {                                                                                                              \
+            goto end_of_block;                                                                                         \
+        }                                                                                                              \
+    }                                                                                                                  \
+    goto* ip->handler;
+            OWL_CPU_FOR_EACH_OP(OWL_CPU_HANDLER)
+#undef OWL_CPU_HANDLER
+
+            // A fused pair is never a store, so it can't modify code, and its first instruction always retires.
+#define OWL_CPU_FUSED_HANDLER(first, second)                                                                           \
+    op_##first##second : if (!ExecuteFused<Op::first, Op::second>(c, ip[0].d, ip[1].d))                                \
+    {                                                                                                                  \
+        ++ip;                                                                                                          \
+        goto end_of_block;                                                                                             \
+    }                                                                                                                  \
+    ip += 2;                                                                                                           \
+    goto* ip->handler;
+            OWL_CPU_FOR_EACH_FUSION(OWL_CPU_FUSED_HANDLER)
+#undef OWL_CPU_FUSED_HANDLER
+
+        end_of_block:
+            return static_cast<std::uint32_t>(ip - block.insns.data());
+#else
+            auto const count = block.Count();
+            for (std::uint32_t i = 0; i < count; ++i)
+            {
+                if (IsFused(block.insns[i].d.op))
+                {
+                    if (!StepFused(c, block.insns[i].d, block.insns[i + 1].d))
+                    {
+                        return i + 1;
+                    }
+                    ++i;
+                    continue;
+                }
+                if (!Step(c, block.insns[i].d))
+                {
+                    return i;
+                }
+                if (IsStore(block.insns[i].d.op) && c.code.Generation() != generation)
+                {
+                    return i + 1;
+                }
+            }
+            return count;
+#endif
+        }
+
+#if defined(OWL_CPU_JIT)
+        // The number of times that the tiered engine interprets a block before compiling it.
+        constexpr std::uint32_t hotBlockThreshold = 64;
+
+#if defined(OWL_CPU_PROFILER)
+        // Counts what compiled code executed, which is the first `retired` instructions of the block. Only the last
+        // instruction of a block can branch.
+        void CountNative(ProfileCounters& profile, Block const& block, std::uint32_t retired, std::uint32_t pc)
+        {
+            for (std::uint32_t i = 0; i < retired; ++i)
+            {
+                ++profile.ops[static_cast<std::size_t>(Unfuse(block.insns[i].d.op))];
+            }
+            auto const& last = block.insns[block.Count() - 1].d;
+            if (retired == block.Count() && IsBranch(last.op))
+            {
+                auto at = block.pc;
+                for (std::uint32_t i = 0; i + 1 < block.Count(); ++i)
+                {
+                    at += InstructionSize(Unfuse(block.insns[i].d.op));
+                }
+                auto& counts = profile.branches[at];
+                ++(pc == at + InstructionSize(last.op) ? counts.notTaken : counts.taken);
+            }
+        }
+#endif
+#endif
+
+        // Runs blocks from the cache, compiling the hot ones to host code if the engine is tiered.
+        template<bool Tiered, typename Memory>
+        auto Run(CpuState& state, Memory memory, PredecodeCache& code, BlockCache& blocks, std::uint64_t cycles)
+                -> Exit
+        {
+            auto c = Context<Memory>{.x = state.x, .state = state, .memory = memory, .code = code, .pc = state.pc};
+            auto remaining = cycles;
+#if defined(OWL_CPU_JIT)
+            auto const frame = JitFrame{.x = state.x.data(),
+                                        .memory = memory.View().data(),
+                                        .memorySize = memory.View().size(),
+                                        .pages = code.Pages()};
+#endif
+
+            auto* block = remaining > 0 ? blocks.Find(c.pc, c.exit) : nullptr;
+            while (block != nullptr)
+            {
+                auto const count = block->Count();
+#if defined(OWL_CPU_PROFILER)
+                [[maybe_unused]] auto const hits = ++c.profile.blocks[block->pc];
+#endif
+                if (count > remaining)
+                {
+                    // There isn't enough budget left for the whole block, so step through as much of it as there is.
+                    // The steps are fetched afresh in case they modify their own code.
+                    while (remaining > 0)
+                    {
+                        auto const* d = Fetch(c);
+                        if (d == nullptr || !Step(c, *d))
+                        {
+                            break;
+                        }
+                        --remaining;
+                    }
+                    break;
+                }
+
+#if defined(OWL_CPU_JIT)
+                if constexpr (Tiered)
+                {
+#if defined(OWL_CPU_PROFILER)
+                    // The profile remembers how hot the pc has been across flushes and other cores on this thread, so
+                    // a block that has been retranslated compiles as soon as it is entered.
+                    if (hits >= hotBlockThreshold && block->executions + 1 < hotBlockThreshold)
+                    {
+                        block->executions = hotBlockThreshold - 1;
+                    }
+#endif
+                    if (block->native == nullptr && ++block->executions == hotBlockThreshold)
+                    {
+                        blocks.Compile(*block);
+                    }
+                    if (block->native != nullptr)
+                    {
+                        auto const result = block->native(&frame);
+                        auto const retired = static_cast<std::uint32_t>(result >> 32);
+                        c.pc = static_cast<std::uint32_t>(result);
+                        remaining -= retired;
+#if defined(OWL_CPU_PROFILER)
+                        CountNative(c.profile, *block, retired, c.pc);
+#endif
+                        if (retired < count)
+                        {
+                            // The compiled code stopped at an instruction that only the interpreter can execute. There
+                            // is budget for it, because there was budget for the whole block.
+                            auto const* d = Fetch(c);
+                            if (d == nullptr || !Step(c, *d))
+                            {
+                                break;
+                            }
+                            if (--remaining == 0)
+                            {
+                                break;
+                            }
+                            block = blocks.Find(c.pc, c.exit);
+                            continue;
+                        }
+                        if (remaining == 0)
+                        {
+                            break;
+                        }
+                        block = blocks.Next(*block, c.pc, c.exit);
+                        continue;
+                    }
+                }
+#endif
+
+                remaining -= ExecuteBlock(c, *block);
+                if (c.exit != Exit::BudgetExhausted || remaining == 0)
+                {
+                    break;
+                }
+                block = blocks.Next(*block, c.pc, c.exit);
+            }
+
+            if (Retires(c.exit))
+            {
+                --remaining;
+            }
+            state.pc = c.pc;
+            state.instret += cycles - remaining;
+            return c.exit;
+        }
+    } // namespace
+
+    template<typename Memory>
+    auto RunBlocks(CpuState& state, Memory memory, PredecodeCache& code, BlockCache& blocks, std::uint64_t cycles)
+            -> Exit
+    {
+        return Run<false>(state, memory, code, blocks, cycles);
+    }
+
+    template auto RunBlocks(CpuState&, CheckedMemory, PredecodeCache&, BlockCache&, std::uint64_t) -> Exit;
+    template auto RunBlocks(CpuState&, FlatMemory, PredecodeCache&, BlockCache&, std::uint64_t) -> Exit;
+    template auto RunBlocks(CpuState&, DeviceMemory, PredecodeCache&, BlockCache&, std::uint64_t) -> Exit;
+
+#if defined(OWL_CPU_JIT)
+    template<typename Memory>
+    auto RunTiered(CpuState& state, Memory memory, PredecodeCache& code, BlockCache& blocks, std::uint64_t cycles)
+            -> Exit
+    {
+        return Run<true>(state, memory, code, blocks, cycles);
+    }
+
+    template auto RunTiered(CpuState&, CheckedMemory, PredecodeCache&, BlockCache&, std::uint64_t) -> Exit;
+    template auto RunTiered(CpuState&, FlatMemory, PredecodeCache&, BlockCache&, std::uint64_t) -> Exit;
+    template auto RunTiered(CpuState&, DeviceMemory, PredecodeCache&, BlockCache&, std::uint64_t) -> Exit;
+#endif
+} // namespace owl::detail
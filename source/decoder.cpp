@@ -0,0 +1,42 @@
+#include "owl-cpu/detail/decoder.h"
+
+#include "owl-cpu/encoder.h"
+
+// The decoder is defined in its header, so that hosts can inline it, and checked here, once, at compile time.
+
+namespace owl::detail::decoding
+{
+    // The specializations, checked at compile time.
+    static_assert(DecodeWord(encode::Addi(encode::a0, encode::zero, 5)).op == Op::Li);
+    static_assert(DecodeWord(encode::Addi(encode::zero, encode::a0, 5)).op == Op::Nop);
+    static_assert(DecodeWord(encode::Add(encode::a0, encode::zero, encode::a1)).rs1 == encode::a1);
+    static_assert(DecodeWord(encode::Jal(encode::zero, -8)).op == Op::J);
+    static_assert(DecodeWord(encode::Jalr(encode::zero, encode::ra, 0)).op == Op::Jr);
+    static_assert(DecodeWord(encode::Bne(encode::zero, encode::a0, 8)).rs1 == encode::a0);
+    static_assert(DecodeWord(encode::Lw(encode::zero, encode::a0, 0)).op == Op::Lw);
+    static_assert(DecodeWord(encode::Sub(encode::a0, encode::a1, encode::zero)).op == Op::Sub);
+    static_assert(DecodeWord(encode::LrW(encode::a0, encode::a1)).op == Op::LrW);
+    static_assert(DecodeWord(encode::LrW(encode::a0, encode::a1) | (1U << 20)).op == Op::Illegal);
+    static_assert(DecodeWord(encode::ScW(encode::zero, encode::a2, encode::a1)).rs2 == encode::a2);
+    static_assert(DecodeWord(encode::AmomaxuW(encode::a0, encode::a2, encode::a1) | (3U << 25)).op == Op::AmomaxuW);
+    static_assert(DecodeWord(encode::AmoaddW(encode::a0, encode::a2, encode::a1) ^ (1U << 12)).op == Op::Illegal);
+
+    // Some expansions of compressed instructions, likewise.
+    static_assert(Expand(encode::CLi(encode::a0, -3)) == encode::Addi(encode::a0, encode::zero, -3));
+    static_assert(Expand(encode::CAddi16sp(-64)) == encode::Addi(encode::sp, encode::sp, -64));
+    static_assert(Expand(encode::CAddi4spn(encode::a0, 1020)) == encode::Addi(encode::a0, encode::sp, 1020));
+    static_assert(Expand(encode::CLw(encode::a0, encode::s1, 124)) == encode::Lw(encode::a0, encode::s1, 124));
+    static_assert(Expand(encode::CSwsp(encode::ra, 252)) == encode::Sw(encode::ra, encode::sp, 252));
+    static_assert(Expand(encode::CLwsp(encode::ra, 252)) == encode::Lw(encode::ra, encode::sp, 252));
+    static_assert(Expand(encode::CBnez(encode::a5, -256)) == encode::Bne(encode::a5, encode::zero, -256));
+    static_assert(Expand(encode::CJal(-2048)) == encode::Jal(encode::ra, -2048));
+    static_assert(Expand(encode::CJ(2046)) == encode::Jal(encode::zero, 2046));
+    static_assert(Expand(encode::CSub(encode::s0, encode::a5)) == encode::Sub(encode::s0, encode::s0, encode::a5));
+    static_assert(Expand(encode::CJalr(encode::t0)) == encode::Jalr(encode::ra, encode::t0, 0));
+    static_assert(Expand(encode::CEbreak()) == encode::Ebreak());
+    static_assert(DecodeCompressed(encode::CMv(encode::a0, encode::a1)).op == Op::CMv);
+    static_assert(DecodeCompressed(encode::CNop()).op == Op::CNop);
+    static_assert(DecodeCompressed(encode::CJ(-2)).op == Op::J);
+    static_assert(DecodeCompressed(encode::CJr(encode::ra)).op == Op::Jr);
+    static_assert(DecodeCompressed(0x0000).op == Op::Illegal);
+} // namespace owl::detail::decoding
@@ -0,0 +1,58 @@
+#include "device-bus.h"
+
+#include "owl-cpu/owl-cpu.h"
+
+#include "pooled.h"
+#include "predecode.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+
+namespace owl::detail
+{
+    void DeviceBus::operator delete(DeviceBus* bus, std::destroying_delete_t)
+    {
+        DeletePooled(bus, bus->m_windows.get_allocator().resource());
+    }
+
+    void DeviceBus::Attach(std::uint32_t base, std::uint32_t size, Device& device, std::size_t memorySize)
+    {
+        auto const end = std::uint64_t{base} + size;
+        if (size == 0 || end > AddressSpace::size)
+        {
+            throw std::invalid_argument("a device's window must be non-empty and fit in the 32-bit address space");
+        }
+        if (base < memorySize)
+        {
+            throw std::invalid_argument("a device's window must not overlap guest memory");
+        }
+        for (auto const& window : m_windows)
+        {
+            if (base < std::uint64_t{window.base} + window.size && window.base < end)
+            {
+                throw std::invalid_argument("a device's window must not overlap another device's");
+            }
+        }
+        m_windows.push_back({.base = base, .size = size, .device = &device});
+    }
+} // namespace owl::detail
+
+namespace owl
+{
+    Device::~Device() = default;
+
+    void Cpu::AttachDevice(std::uint32_t base, std::uint32_t size, Device& device)
+    {
+        if (m_flat)
+        {
+            throw std::invalid_argument("a core that executes from an address space has no room for devices");
+        }
+        if (!m_devices)
+        {
+            m_devices = detail::MakePooled<detail::DeviceBus>(m_code->Resource(), m_code->Resource());
+        }
+        m_devices->Attach(base, size, device, m_memory.size());
+    }
+} // namespace owl
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "owl-cpu/owl-cpu.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <vector>
+
+namespace owl::detail
+{
+    // The windows of the guest address space that devices are attached at. Devices only live outside of guest memory,
+    // so the memory model only looks here for accesses that miss it, which would otherwise fault, and accesses to
+    // memory take the same path whether or not a core has devices. There are only ever a few windows, so they are
+    // searched in turn.
+    class DeviceBus
+    {
+    public:
+        explicit DeviceBus(std::pmr::memory_resource* resource) : m_windows{resource} {}
+
+        static void operator delete(DeviceBus* bus, std::destroying_delete_t);
+
+        // Attaches a device at [base, base + size). Throws std::invalid_argument if the window is empty, runs past the
+        // top of the address space, or overlaps another window or the first `memorySize` bytes.
+        void Attach(std::uint32_t base, std::uint32_t size, Device& device, std::size_t memorySize);
+
+        // Reads or writes a device like the memory models do memory, returning false if the access doesn't lie
+        // entirely inside one window, or if the device refuses it.
+        template<typename T>
+        auto Read(std::uint32_t address, T& value) const -> bool
+        {
+            auto const* window = Find(address, sizeof(T));
+            std::uint32_t word{};
+            if (window == nullptr || !window->device->Read(address - window->base, sizeof(T), word))
+            {
+                return false;
+            }
+            value = static_cast<T>(word);
+            return true;
+        }
+
+        template<typename T>
+        auto Write(std::uint32_t address, T value) const -> bool
+        {
+            auto const* window = Find(address, sizeof(T));
+            return window != nullptr
+                   && window->device->Write(address - window->base, sizeof(T), static_cast<std::uint32_t>(value));
+        }
+
+    private:
+        struct Window
+        {
+            std::uint32_t base{};
+            std::uint32_t size{};
+            Device* device{};
+        };
+
+        auto Find(std::uint32_t address, std::uint32_t size) const -> Window const*
+        {
+            for (auto const& window : m_windows)
+            {
+                if (address - window.base < window.size && size <= window.size - (address - window.base))
+                {
+                    return &window;
+                }
+            }
+            return nullptr;
+        }
+
+        std::pmr::vector<Window> m_windows;
+    };
+} // namespace owl::detail
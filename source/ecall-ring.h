@@ -0,0 +1,48 @@
+#pragma once
+
+#include "owl-cpu/ecall.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <vector>
+
+// The queues behind an EcallRing. Workers submit requests and the host takes them in batches, and the host completes
+// them in batches and the workers take the completions. Each is guarded by the one mutex, because every operation
+// moves a batch of entries at once, and a core has at most one call outstanding.
+
+namespace owl::detail
+{
+    class EcallQueues
+    {
+    public:
+        // Called by BatchRunner::Run(). The batch's size bounds the calls that can be outstanding, and the listener is
+        // called, without the queues' mutex, whenever completions arrive.
+        void Open(std::size_t cores, std::function<void()> listener);
+        void Close();
+
+        // Called by the batch's workers.
+        void Submit(EcallRequest const& request);
+        auto HasCompletions() -> bool;
+        void TakeCompletions(std::vector<EcallCompletion>& completions); // replaces their contents
+
+        // Called by the host.
+        auto Poll(std::span<EcallRequest> requests) -> std::size_t;
+        auto Wait(std::span<EcallRequest> requests, std::chrono::milliseconds timeout) -> std::size_t;
+        void Complete(std::span<EcallCompletion const> completions);
+
+    private:
+        auto Take(std::span<EcallRequest> requests) -> std::size_t; // with m_mutex held
+
+        std::mutex m_mutex;
+        std::condition_variable m_submitted;
+        std::deque<EcallRequest> m_submissions;
+        std::vector<EcallCompletion> m_completions;
+        std::vector<bool> m_outstanding; // by core, from when a call is submitted until it is completed
+        std::function<void()> m_listener;
+    };
+} // namespace owl::detail
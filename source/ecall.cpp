@@ -0,0 +1,400 @@
+#include "owl-cpu/ecall.h"
+
+#include "ecall-ring.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace owl
+{
+    namespace
+    {
+        constexpr std::array<char, 8> logMagic{'O', 'W', 'L', 'E', 'C', 'A', 'L', 'L'};
+        constexpr std::uint32_t logVersion = 1;
+        constexpr std::size_t a0 = 10;
+        constexpr std::size_t a7 = 17;
+        constexpr std::size_t argumentCount = 6;
+
+        enum class Write : std::uint8_t
+        {
+            Register,
+            Memory,
+        };
+
+        void PutVarint(std::vector<std::uint8_t>& out, std::uint32_t value)
+        {
+            while (value >= 0x80)
+            {
+                out.push_back(static_cast<std::uint8_t>(value | 0x80));
+                value >>= 7;
+            }
+            out.push_back(static_cast<std::uint8_t>(value));
+        }
+
+        // Decodes a varint from a source of bytes.
+        template<typename Next>
+        auto GetVarint(Next&& next) -> std::uint32_t
+        {
+            std::uint32_t value{};
+            for (int shift = 0; shift < 35; shift += 7)
+            {
+                std::uint8_t const byte = next();
+                value |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0)
+                {
+                    return value;
+                }
+            }
+            throw std::runtime_error("malformed ecall log");
+        }
+
+        auto GetByte(std::istream& in) -> std::uint8_t
+        {
+            auto const byte = in.get();
+            if (byte == std::istream::traits_type::eof())
+            {
+                throw std::runtime_error("truncated ecall log");
+            }
+            return static_cast<std::uint8_t>(byte);
+        }
+
+        auto GetVarint(std::istream& in) -> std::uint32_t
+        {
+            return GetVarint([&] { return GetByte(in); });
+        }
+
+        // Reads the writes of a logged call.
+        class Writes
+        {
+        public:
+            explicit Writes(std::span<std::uint8_t const> bytes) : m_bytes{bytes} {}
+
+            auto AtEnd() const -> bool { return m_at == m_bytes.size(); }
+
+            auto Byte() -> std::uint8_t
+            {
+                if (AtEnd())
+                {
+                    throw std::runtime_error("malformed ecall log");
+                }
+                return m_bytes[m_at++];
+            }
+
+            auto Varint() -> std::uint32_t
+            {
+                return GetVarint([this] { return Byte(); });
+            }
+
+            auto Bytes(std::size_t size) -> std::span<std::uint8_t const>
+            {
+                if (size > m_bytes.size() - m_at)
+                {
+                    throw std::runtime_error("malformed ecall log");
+                }
+                auto const bytes = m_bytes.subspan(m_at, size);
+                m_at += size;
+                return bytes;
+            }
+
+        private:
+            std::span<std::uint8_t const> m_bytes;
+            std::size_t m_at{};
+        };
+
+        // Returns true if [address, address + size) lies within guest memory.
+        auto Contains(std::span<std::uint8_t> memory, std::uint32_t address, std::size_t size) -> bool
+        {
+            return address <= memory.size() && size <= memory.size() - address;
+        }
+    } // namespace
+
+    auto HostCall::Number() const -> std::uint32_t { return m_cpu.State().x[a7]; }
+
+    auto HostCall::Argument(std::size_t index) const -> std::uint32_t
+    {
+        if (index >= argumentCount)
+        {
+            throw std::invalid_argument("host calls have at most 6 arguments");
+        }
+        return m_cpu.State().x[a0 + index];
+    }
+
+    auto HostCall::Pc() const -> std::uint32_t { return m_cpu.State().pc - 4; }
+
+    void HostCall::SetRegister(std::size_t index, std::uint32_t value)
+    {
+        auto& x = m_cpu.State().x;
+        if (index >= x.size())
+        {
+            throw std::invalid_argument("there are only 32 registers");
+        }
+        if (index == 0)
+        {
+            return;
+        }
+        x[index] = value;
+        if (m_record != nullptr)
+        {
+            m_record->push_back(static_cast<std::uint8_t>(Write::Register));
+            m_record->push_back(static_cast<std::uint8_t>(index));
+            PutVarint(*m_record, value);
+        }
+    }
+
+    void HostCall::Return(std::uint32_t value) { SetRegister(a0, value); }
+
+    auto HostCall::ReadMemory(std::uint32_t address, std::span<std::uint8_t> to) const -> bool
+    {
+        auto const memory = m_cpu.Memory();
+        if (!Contains(memory, address, to.size()))
+        {
+            return false;
+        }
+        if (!to.empty())
+        {
+            std::memcpy(to.data(), memory.data() + address, to.size());
+        }
+        return true;
+    }
+
+    auto HostCall::WriteMemory(std::uint32_t address, std::span<std::uint8_t const> from) -> bool
+    {
+        auto const memory = m_cpu.Memory();
+        if (!Contains(memory, address, from.size()))
+        {
+            return false;
+        }
+        if (from.empty())
+        {
+            return true;
+        }
+        std::memcpy(memory.data() + address, from.data(), from.size());
+        m_cpu.InvalidateCode(address, static_cast<std::uint32_t>(from.size()));
+        if (m_record != nullptr)
+        {
+            m_record->push_back(static_cast<std::uint8_t>(Write::Memory));
+            PutVarint(*m_record, address);
+            PutVarint(*m_record, static_cast<std::uint32_t>(from.size()));
+            m_record->insert(m_record->end(), from.begin(), from.end());
+        }
+        return true;
+    }
+
+    EcallHandler::~EcallHandler() = default;
+
+    EcallRecorder::EcallRecorder(EcallHandler& live, std::ostream& log) : m_live{live}, m_log{log}
+    {
+        m_log.write(logMagic.data(), logMagic.size());
+        m_log.write(reinterpret_cast<char const*>(&logVersion), sizeof(logVersion));
+    }
+
+    auto EcallRecorder::OnEcall(HostCall& call) -> bool
+    {
+        std::vector<std::uint8_t> entry;
+        PutVarint(entry, call.Pc());
+        PutVarint(entry, call.Number());
+
+        std::vector<std::uint8_t> writes;
+        call.m_record = &writes;
+        bool resume{};
+        try
+        {
+            resume = m_live.OnEcall(call);
+        }
+        catch (...)
+        {
+            call.m_record = nullptr;
+            throw;
+        }
+        call.m_record = nullptr;
+
+        entry.push_back(resume ? 1 : 0);
+        PutVarint(entry, static_cast<std::uint32_t>(writes.size()));
+        entry.insert(entry.end(), writes.begin(), writes.end());
+        m_log.write(reinterpret_cast<char const*>(entry.data()), static_cast<std::streamsize>(entry.size()));
+        return resume;
+    }
+
+    EcallReplayer::EcallReplayer(std::istream& log) : m_log{log}
+    {
+        std::array<char, logMagic.size()> magic{};
+        std::uint32_t version{};
+        m_log.read(magic.data(), magic.size());
+        m_log.read(reinterpret_cast<char*>(&version), sizeof(version));
+        if (!m_log || magic != logMagic)
+        {
+            throw std::runtime_error("not an owl-cpu ecall log");
+        }
+        if (version != logVersion)
+        {
+            throw std::runtime_error("unsupported owl-cpu ecall log version");
+        }
+    }
+
+    auto EcallReplayer::OnEcall(HostCall& call) -> bool
+    {
+        if (m_log.peek() == std::istream::traits_type::eof())
+        {
+            throw std::runtime_error("the guest made more host calls than were recorded");
+        }
+        auto const pc = GetVarint(m_log);
+        auto const number = GetVarint(m_log);
+        if (pc != call.Pc() || number != call.Number())
+        {
+            throw std::runtime_error("the guest has diverged from the recording");
+        }
+        auto const resume = GetByte(m_log) != 0;
+
+        std::vector<std::uint8_t> bytes(GetVarint(m_log));
+        m_log.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        if (!m_log)
+        {
+            throw std::runtime_error("truncated ecall log");
+        }
+        for (Writes writes{bytes}; !writes.AtEnd();)
+        {
+            switch (static_cast<Write>(writes.Byte()))
+            {
+            case Write::Register:
+            {
+                auto const index = writes.Byte();
+                call.SetRegister(index, writes.Varint());
+                break;
+            }
+            case Write::Memory:
+            {
+                auto const address = writes.Varint();
+                if (!call.WriteMemory(address, writes.Bytes(writes.Varint())))
+                {
+                    throw std::runtime_error("the recording writes outside of guest memory");
+                }
+                break;
+            }
+            default:
+                throw std::runtime_error("malformed ecall log");
+            }
+        }
+        return resume;
+    }
+
+    EcallRing::EcallRing() : m_queues{std::make_unique<detail::EcallQueues>()} {}
+
+    EcallRing::~EcallRing() = default;
+
+    auto EcallRing::Poll(std::span<EcallRequest> requests) -> std::size_t { return m_queues->Poll(requests); }
+
+    auto EcallRing::Wait(std::span<EcallRequest> requests, std::chrono::milliseconds timeout) -> std::size_t
+    {
+        return m_queues->Wait(requests, timeout);
+    }
+
+    void EcallRing::Complete(std::span<EcallCompletion const> completions) { m_queues->Complete(completions); }
+} // namespace owl
+
+namespace owl::detail
+{
+    void EcallQueues::Open(std::size_t cores, std::function<void()> listener)
+    {
+        std::lock_guard const lock{m_mutex};
+        m_submissions.clear();
+        m_completions.clear();
+        m_outstanding.assign(cores, false);
+        m_listener = std::move(listener);
+    }
+
+    void EcallQueues::Close()
+    {
+        std::lock_guard const lock{m_mutex};
+        m_outstanding.clear();
+        m_listener = nullptr;
+    }
+
+    void EcallQueues::Submit(EcallRequest const& request)
+    {
+        {
+            std::lock_guard const lock{m_mutex};
+            m_outstanding[request.core] = true;
+            m_submissions.push_back(request);
+        }
+        m_submitted.notify_one();
+    }
+
+    auto EcallQueues::HasCompletions() -> bool
+    {
+        std::lock_guard const lock{m_mutex};
+        return !m_completions.empty();
+    }
+
+    void EcallQueues::TakeCompletions(std::vector<EcallCompletion>& completions)
+    {
+        completions.clear();
+        std::lock_guard const lock{m_mutex};
+        std::swap(completions, m_completions);
+    }
+
+    auto EcallQueues::Poll(std::span<EcallRequest> requests) -> std::size_t
+    {
+        std::lock_guard const lock{m_mutex};
+        return Take(requests);
+    }
+
+    auto EcallQueues::Wait(std::span<EcallRequest> requests, std::chrono::milliseconds timeout) -> std::size_t
+    {
+        std::unique_lock lock{m_mutex};
+        m_submitted.wait_for(lock, timeout, [this] { return !m_submissions.empty(); });
+        return Take(requests);
+    }
+
+    void EcallQueues::Complete(std::span<EcallCompletion const> completions)
+    {
+        std::function<void()> listener;
+        {
+            std::lock_guard const lock{m_mutex};
+            auto applied = std::size_t{};
+            for (; applied < completions.size(); ++applied)
+            {
+                auto const core = completions[applied].core;
+                if (core >= m_outstanding.size() || !m_outstanding[core])
+                {
+                    break;
+                }
+                m_outstanding[core] = false;
+            }
+            if (applied != completions.size())
+            {
+                for (auto const& completion : completions.first(applied))
+                {
+                    m_outstanding[completion.core] = true;
+                }
+                throw std::invalid_argument("a completion's core doesn't have a host call outstanding");
+            }
+            m_completions.insert(m_completions.end(), completions.begin(), completions.end());
+            listener = m_listener;
+        }
+        if (listener)
+        {
+            listener();
+        }
+    }
+
+    auto EcallQueues::Take(std::span<EcallRequest> requests) -> std::size_t
+    {
+        auto const count = std::min(requests.size(), m_submissions.size());
+        std::copy_n(m_submissions.begin(), count, requests.begin());
+        m_submissions.erase(m_submissions.begin(), m_submissions.begin() + static_cast<std::ptrdiff_t>(count));
+        return count;
+    }
+} // namespace owl::detail
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "owl-cpu/owl-cpu.h"
+
+#include "block-cache.h"
+#include "predecode.h"
+
+#include <cstdint>
+
+namespace owl::detail
+{
+    // Each engine executes at most `cycles` instructions from the given state and memory, fetching through the
+    // predecode cache and retiring them into state.instret. They are instantiated in their own translation units for
+    // each memory model.
+
+    template<typename Memory>
+    auto RunSwitch(CpuState& state, Memory memory, PredecodeCache& code, std::uint64_t cycles) -> Exit;
+
+    template<typename Memory>
+    auto RunBlocks(CpuState& state, Memory memory, PredecodeCache& code, BlockCache& blocks, std::uint64_t cycles)
+            -> Exit;
+
+    // Runs like RunSwitch(), also counting the cycles that the instructions would take on Owl hardware into
+    // state.cycle.
+    template<typename Memory>
+    auto RunTimed(CpuState& state, Memory memory, PredecodeCache& code, std::uint64_t cycles) -> Exit;
+
+    // Runs like RunSwitch(), recording every instruction that retires in a trace.
+    template<typename Memory>
+    auto RunTraced(CpuState& state, Memory memory, PredecodeCache& code, TraceChannel& trace, std::uint64_t cycles)
+            -> Exit;
+
+#if defined(OWL_CPU_THREADED_DISPATCH)
+    template<typename Memory>
+    auto RunThreaded(CpuState& state, Memory memory, PredecodeCache& code, std::uint64_t cycles) -> Exit;
+#endif
+
+#if defined(OWL_CPU_JIT)
+    template<typename Memory>
+    auto RunTiered(CpuState& state, Memory memory, PredecodeCache& code, BlockCache& blocks, std::uint64_t cycles)
+            -> Exit;
+#endif
+} // namespace owl::detail
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "owl-cpu/detail/decoder.h"
+#include "owl-cpu/detail/execute.h"
+#include "owl-cpu/owl-cpu.h"
+
+#include "predecode.h"
+#include "profile.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// The context that the execution engines execute the semantics in owl-cpu/detail/execute.h with. Each engine keeps
+// its pc, exit reason and current code page in a local Context so that the compiler can hold them in registers for
+// the duration of a Run().
+
+namespace owl::detail
+{
+    // A page base that no pc can match, because pc & ~pageOffsetMask always clears these bits.
+    inline constexpr std::uint32_t noCodePage = codePageSize - slotSize;
+    inline constexpr std::uint32_t pageOffsetMask = codePageSize - slotSize;
+
+    template<typename Memory>
+    struct Context
+    {
+        std::array<std::uint32_t, 32>& x;
+        CpuState& state; // for the reservation, which only lr.w and sc.w use
+        Memory memory;
+        PredecodeCache& code;
+        std::uint32_t pc;
+        Exit exit{Exit::BudgetExhausted};
+        DecodedPage const* page{};
+        std::uint32_t pageBase{noCodePage};
+#if defined(OWL_CPU_PROFILER)
+        ProfileCounters& profile{ThisThreadProfile()};
+#endif
+
+        // Writes rd on behalf of a load, the only kind of instruction that the decoder leaves with rd = 0.
+        void Set(std::uint8_t rd, std::uint32_t value)
+        {
+            x[rd] = value;
+            x[0] = 0;
+        }
+
+        // Discards the translation of any code page that a store wrote to, including the one that is executing, and
+        // records the first write to each page since a snapshot.
+        void OnStore(std::uint32_t address, std::size_t size)
+        {
+            if (code.IsWatched(address, size)) [[unlikely]]
+            {
+                code.Invalidate(address, size);
+                pageBase = noCodePage;
+            }
+        }
+
+        void CountOp([[maybe_unused]] Op op)
+        {
+#if defined(OWL_CPU_PROFILER)
+            ++profile.ops[static_cast<std::size_t>(op)];
+#endif
+        }
+
+        void CountBranch([[maybe_unused]] bool taken)
+        {
+#if defined(OWL_CPU_PROFILER)
+            auto& counts = profile.branches[pc];
+            ++(taken ? counts.taken : counts.notTaken);
+#endif
+        }
+    };
+
+    // Looks up the code page for pc when it leaves the current one. Returns false with the exit reason set if pc can't
+    // be fetched from.
+    template<typename Memory>
+    auto Refill(Context<Memory>& c) -> bool
+    {
+        if ((c.pc & (slotSize - 1)) != 0)
+        {
+            c.exit = Exit::MisalignedFetch;
+            return false;
+        }
+        c.page = c.code.Lookup(c.pc);
+        if (c.page == nullptr)
+        {
+            c.exit = Exit::FetchFault;
+            return false;
+        }
+        c.pageBase = c.pc & ~pageOffsetMask;
+        return true;
+    }
+
+    // Returns the predecoded instruction at pc, or nullptr with the exit reason set if it can't be fetched. A
+    // misaligned pc never matches pageBase, so the fast path needs only the one comparison.
+    template<typename Memory>
+    inline auto Fetch(Context<Memory>& c) -> Decoded const*
+    {
+        if ((c.pc & ~pageOffsetMask) != c.pageBase) [[unlikely]]
+        {
+            if (!Refill(c))
+            {
+                return nullptr;
+            }
+        }
+        return &c.page->insns[(c.pc & pageOffsetMask) >> slotShift];
+    }
+
+    // Executes a fused pair of instructions, where `first` holds the fused operation and the first instruction's
+    // operands, returning like Execute() does for the second instruction. Neither instruction of any pair can stop
+    // execution, so both always retire.
+    template<Op First, Op Second, typename Memory>
+    inline auto ExecuteFused(Context<Memory>& c, Decoded const& first, Decoded const& second) -> bool
+    {
+#if defined(OWL_CPU_PROFILER)
+        ++c.profile.fusions[FusionIndex(Fuse(First, Second))];
+#endif
+        Execute<First>(c, first);
+        return Execute<Second>(c, second);
+    }
+
+    // Executes a fused pair of instructions, dispatching on the fused operation with a switch.
+    template<typename Memory>
+    inline auto StepFused(Context<Memory>& c, Decoded const& first, Decoded const& second) -> bool
+    {
+        switch (first.op)
+        {
+#define OWL_CPU_STEP_FUSED_CASE(a, b)                                                                                  \
+    case Op::a##b:                                                                                                     \
+        return ExecuteFused<Op::a, Op::b>(c, first, second);
+            OWL_CPU_FOR_EACH_FUSION(OWL_CPU_STEP_FUSED_CASE)
+#undef OWL_CPU_STEP_FUSED_CASE
+        default:
+            return Step(c, first);
+        }
+    }
+} // namespace owl::detail
@@ -0,0 +1,487 @@
+#include "owl-cpu/detail/decoder.h"
+
+#include "block-cache.h"
+#include "jit.h"
+#include "predecode.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// The AArch64 backend. Like the x86-64 one, guest registers stay in CpuState and every instruction loads its operands
+// from there and stores its result back. It only uses AAPCS64 argument and temporary registers:
+//
+//   x0  = the frame, then the result   w13, w14, w15 = scratch
+//   x9  = x, the guest registers       x16, x17      = scratch
+//   x10 = guest memory
+//   x11 = guest memory size
+//   x12 = the predecode page table
+
+namespace owl::detail
+{
+    namespace
+    {
+        enum Reg : std::uint32_t
+        {
+            x0 = 0,
+            x9 = 9,
+            x10 = 10,
+            x11 = 11,
+            x12 = 12,
+            w13 = 13,
+            w14 = 14,
+            w15 = 15,
+            x15 = 15,
+            w16 = 16,
+            x16 = 16,
+            x17 = 17,
+        };
+
+        enum Condition : std::uint32_t
+        {
+            eq = 0x0,
+            ne = 0x1,
+            hs = 0x2,
+            lo = 0x3,
+            hi = 0x8,
+            ge = 0xa,
+            lt = 0xb,
+        };
+
+        // Three register data processing instructions with Rm in bits 16-20, Rn in bits 5-9 and Rd in bits 0-4, and
+        // register offset loads and stores with the same layout for Rm, Rn and Rt.
+        enum Opcode : std::uint32_t
+        {
+            addW = 0x0b000000,
+            subW = 0x4b000000,
+            andW = 0x0a000000,
+            orrW = 0x2a000000,
+            eorW = 0x4a000000,
+            lslvW = 0x1ac02000,
+            lsrvW = 0x1ac02400,
+            asrvW = 0x1ac02800,
+            mulW = 0x1b007c00,
+            orrX = 0xaa000000,
+            ldrbW = 0x38606800,
+            ldrsbW = 0x38e06800,
+            ldrhW = 0x78606800,
+            ldrshW = 0x78e06800,
+            ldrW = 0xb8606800,
+            ldrX = 0xf8607800, // scaled by 8
+            strbW = 0x38206800,
+            strhW = 0x78206800,
+            strW = 0xb8206800,
+        };
+
+        class Emitter
+        {
+        public:
+            explicit Emitter(std::vector<std::uint8_t>& code) : m_code{code} {}
+
+            void Word(std::uint32_t word)
+            {
+                for (auto i = 0; i < 4; ++i)
+                {
+                    m_code.push_back(static_cast<std::uint8_t>(word >> (8 * i)));
+                }
+            }
+
+            void Op(Opcode opcode, Reg rd, Reg rn, Reg rm) { Word(opcode | (rm << 16) | (rn << 5) | rd); }
+
+            // ldr wt, [x9, #4 * guest]
+            void Load(Reg rt, std::uint8_t guest) { Word(0xb9400000 | (std::uint32_t{guest} << 10) | (x9 << 5) | rt); }
+
+            // str wt, [x9, #4 * guest]
+            void Store(std::uint8_t guest, Reg rt) { Word(0xb9000000 | (std::uint32_t{guest} << 10) | (x9 << 5) | rt); }
+
+            // ldr xt, [xn, #offset]
+            void LoadX(Reg rt, Reg rn, std::uint32_t offset)
+            {
+                Word(0xf9400000 | ((offset / 8) << 10) | (rn << 5) | rt);
+            }
+
+            // movz wd, #lo16; movk wd, #hi16, lsl #16
+            void Move(Reg rd, std::uint32_t value)
+            {
+                Word(0x52800000 | ((value & 0xffff) << 5) | rd);
+                if ((value >> 16) != 0)
+                {
+                    Word(0x72a00000 | ((value >> 16) << 5) | rd);
+                }
+            }
+
+            // movz x0, #value; movk x0, #value, lsl #16, #32 and #48. Always four instructions.
+            void Move64(std::uint64_t value)
+            {
+                Word(0xd2800000 | static_cast<std::uint32_t>((value & 0xffff) << 5));
+                for (std::uint32_t hw = 1; hw < 4; ++hw)
+                {
+                    Word(0xf2800000 | (hw << 21) | static_cast<std::uint32_t>(((value >> (16 * hw)) & 0xffff) << 5));
+                }
+            }
+
+            void Ret() { Word(0xd65f03c0); }
+
+            // x0 = (retired << 32) | pc; ret
+            void Return(std::uint32_t retired, std::uint32_t pc)
+            {
+                Move64((std::uint64_t{retired} << 32) | pc);
+                Ret();
+            }
+
+            // cmp wn, wm
+            void Compare(Reg rn, Reg rm) { Word(0x6b00001f | (rm << 16) | (rn << 5)); }
+
+            // cmp xn, xm
+            void CompareX(Reg rn, Reg rm) { Word(0xeb00001f | (rm << 16) | (rn << 5)); }
+
+            // cset wd, condition
+            void Set(Reg rd, Condition condition) { Word(0x1a9f07e0 | ((condition ^ 1) << 12) | rd); }
+
+            // add xd, xn, #imm12
+            void AddX(Reg rd, Reg rn, std::uint32_t imm12) { Word(0x91000000 | (imm12 << 10) | (rn << 5) | rd); }
+
+            // subs wd, wn, #imm12
+            void SubtractSetFlags(Reg rd, Reg rn, std::uint32_t imm12)
+            {
+                Word(0x71000000 | (imm12 << 10) | (rn << 5) | rd);
+            }
+
+            // csel wd, wn, wm, condition
+            void Select(Reg rd, Reg rn, Reg rm, Condition condition)
+            {
+                Word(0x1a800000 | (rm << 16) | (condition << 12) | (rn << 5) | rd);
+            }
+
+            // lsr xd, xn, #codePageShift
+            void ShiftPage(Reg rd, Reg rn) { Word(0xd340fc00 | (codePageShift << 16) | (rn << 5) | rd); }
+
+            // b.cond to `instructions` instructions from here.
+            void BranchIf(Condition condition, std::uint32_t instructions)
+            {
+                Word(0x54000000 | ((instructions & 0x7ffff) << 5) | condition);
+            }
+
+            // b.cond, returning its offset so that it can be patched.
+            auto BranchIf(Condition condition) -> std::size_t
+            {
+                auto const at = Size();
+                Word(0x54000000 | condition);
+                return at;
+            }
+
+            // cbnz xt, returning its offset so that it can be patched.
+            auto BranchIfNotZero(Reg rt) -> std::size_t
+            {
+                auto const at = Size();
+                Word(0xb5000000 | rt);
+                return at;
+            }
+
+            auto Size() const -> std::size_t { return m_code.size(); }
+
+            // Points the 19-bit offset of the b.cond or cbnz at `at` to the code at `target`.
+            void Patch(std::size_t at, std::size_t target)
+            {
+                auto const offset = static_cast<std::uint32_t>((target - at) / 4) & 0x7ffff;
+                std::uint32_t word{};
+                for (auto i = 0; i < 4; ++i)
+                {
+                    word |= std::uint32_t{m_code[at + static_cast<std::size_t>(i)]} << (8 * i);
+                }
+                word |= offset << 5;
+                for (auto i = 0; i < 4; ++i)
+                {
+                    m_code[at + static_cast<std::size_t>(i)] = static_cast<std::uint8_t>(word >> (8 * i));
+                }
+            }
+
+        private:
+            std::vector<std::uint8_t>& m_code;
+        };
+
+        class Compiler
+        {
+        public:
+            explicit Compiler(std::vector<std::uint8_t>& code) : m_emit{code} {}
+
+            void Compile(Block const& block)
+            {
+                m_emit.LoadX(x9, x0, 0);
+                m_emit.LoadX(x10, x0, 8);
+                m_emit.LoadX(x11, x0, 16);
+                m_emit.LoadX(x12, x0, 24);
+
+                auto const count = block.Count();
+                auto ended = false;
+                auto pc = block.pc;
+                for (std::uint32_t i = 0; i < count && !ended; ++i)
+                {
+                    // Compiled code doesn't dispatch, so it gains nothing from fusion.
+                    auto d = block.insns[i].d;
+                    d.op = Unfuse(d.op);
+                    ended = Instruction(d, i, pc);
+                    pc += InstructionSize(d.op);
+                }
+                if (!ended)
+                {
+                    m_emit.Return(count, pc);
+                }
+
+                // The bail-outs for loads and stores that the interpreter has to handle, one for each instruction.
+                auto last = std::pair<std::uint32_t, std::uint32_t>{count, 0};
+                auto stub = std::size_t{};
+                for (auto const& [at, bail] : m_bails)
+                {
+                    if (bail != last)
+                    {
+                        last = bail;
+                        stub = m_emit.Size();
+                        m_emit.Return(bail.first, bail.second);
+                    }
+                    m_emit.Patch(at, stub);
+                }
+            }
+
+        private:
+            // Emits the instruction at index i of the block, returning true if it ends the compiled code.
+            auto Instruction(Decoded const& d, std::uint32_t i, std::uint32_t pc) -> bool
+            {
+                auto const imm = static_cast<std::uint32_t>(d.imm);
+
+                switch (Uncompress(d.op))
+                {
+                case Op::Lui:
+                case Op::Li:
+                    SetImm(d.rd, imm);
+                    return false;
+                case Op::Auipc:
+                    SetImm(d.rd, pc + imm);
+                    return false;
+                case Op::Jal:
+                case Op::J:
+                    SetImm(d.rd, pc + InstructionSize(d.op));
+                    m_emit.Return(i + 1, pc + imm);
+                    return true;
+                case Op::Jalr:
+                case Op::Jr:
+                    m_emit.Load(w15, d.rs1);
+                    m_emit.Move(w14, imm);
+                    m_emit.Op(addW, w15, w15, w14);
+                    m_emit.Move(w14, ~1U);
+                    m_emit.Op(andW, w15, w15, w14);
+                    SetImm(d.rd, pc + InstructionSize(d.op));
+                    m_emit.Move64(std::uint64_t{i + 1} << 32);
+                    m_emit.Op(orrX, x0, x0, x15);
+                    m_emit.Ret();
+                    return true;
+                case Op::Beq:
+                case Op::Beqz:
+                    return Branch(d, eq, i, pc);
+                case Op::Bne:
+                case Op::Bnez:
+                    return Branch(d, ne, i, pc);
+                case Op::Blt:
+                    return Branch(d, lt, i, pc);
+                case Op::Bge:
+                    return Branch(d, ge, i, pc);
+                case Op::Bltu:
+                    return Branch(d, lo, i, pc);
+                case Op::Bgeu:
+                    return Branch(d, hs, i, pc);
+                case Op::Lb:
+                    return Load(d, ldrsbW, 1, i, pc);
+                case Op::Lh:
+                    return Load(d, ldrshW, 2, i, pc);
+                case Op::Lw:
+                    return Load(d, ldrW, 4, i, pc);
+                case Op::Lbu:
+                    return Load(d, ldrbW, 1, i, pc);
+                case Op::Lhu:
+                    return Load(d, ldrhW, 2, i, pc);
+                case Op::Sb:
+                    return Store(d, strbW, 1, i, pc);
+                case Op::Sh:
+                    return Store(d, strhW, 2, i, pc);
+                case Op::Sw:
+                    return Store(d, strW, 4, i, pc);
+                case Op::Addi:
+                    return AluImm(d, addW);
+                case Op::Slti:
+                    return Compare(d, true, lt);
+                case Op::Sltiu:
+                    return Compare(d, true, lo);
+                case Op::Xori:
+                    return AluImm(d, eorW);
+                case Op::Ori:
+                    return AluImm(d, orrW);
+                case Op::Andi:
+                    return AluImm(d, andW);
+                case Op::Slli:
+                    return AluImm(d, lslvW);
+                case Op::Srli:
+                    return AluImm(d, lsrvW);
+                case Op::Srai:
+                    return AluImm(d, asrvW);
+                case Op::Add:
+                    return Alu(d, addW);
+                case Op::Sub:
+                    return Alu(d, subW);
+                case Op::Sll:
+                    return Alu(d, lslvW);
+                case Op::Slt:
+                    return Compare(d, false, lt);
+                case Op::Sltu:
+                    return Compare(d, false, lo);
+                case Op::Xor:
+                    return Alu(d, eorW);
+                case Op::Srl:
+                    return Alu(d, lsrvW);
+                case Op::Sra:
+                    return Alu(d, asrvW);
+                case Op::Or:
+                    return Alu(d, orrW);
+                case Op::And:
+                    return Alu(d, andW);
+                case Op::Mul:
+                    return Alu(d, mulW);
+                case Op::Mv:
+                    m_emit.Load(w13, d.rs1);
+                    m_emit.Store(d.rd, w13);
+                    return false;
+                case Op::Nop:
+                    return false;
+                default:
+                    // Leave everything else, such as ecall, division, atomics and fences, to the interpreter.
+                    m_emit.Return(i, pc);
+                    return true;
+                }
+            }
+
+            void SetImm(std::uint8_t rd, std::uint32_t value)
+            {
+                if (rd != 0)
+                {
+                    m_emit.Move(w13, value);
+                    m_emit.Store(rd, w13);
+                }
+            }
+
+            // The register forms of shifts take their amount modulo 32, so they also serve for the immediate forms.
+            auto AluImm(Decoded const& d, Opcode opcode) -> bool
+            {
+                if (d.rd != 0)
+                {
+                    m_emit.Load(w13, d.rs1);
+                    m_emit.Move(w14, static_cast<std::uint32_t>(d.imm));
+                    m_emit.Op(opcode, w13, w13, w14);
+                    m_emit.Store(d.rd, w13);
+                }
+                return false;
+            }
+
+            auto Alu(Decoded const& d, Opcode opcode) -> bool
+            {
+                if (d.rd != 0)
+                {
+                    m_emit.Load(w13, d.rs1);
+                    m_emit.Load(w14, d.rs2);
+                    m_emit.Op(opcode, w13, w13, w14);
+                    m_emit.Store(d.rd, w13);
+                }
+                return false;
+            }
+
+            auto Compare(Decoded const& d, bool immediate, Condition condition) -> bool
+            {
+                if (d.rd != 0)
+                {
+                    m_emit.Load(w13, d.rs1);
+                    if (immediate)
+                    {
+                        m_emit.Move(w14, static_cast<std::uint32_t>(d.imm));
+                    }
+                    else
+                    {
+                        m_emit.Load(w14, d.rs2);
+                    }
+                    m_emit.Compare(w13, w14);
+                    m_emit.Set(w13, condition);
+                    m_emit.Store(d.rd, w13);
+                }
+                return false;
+            }
+
+            auto Branch(Decoded const& d, Condition condition, std::uint32_t i, std::uint32_t pc) -> bool
+            {
+                m_emit.Load(w13, d.rs1);
+                m_emit.Load(w14, d.rs2);
+                m_emit.Compare(w13, w14);
+                m_emit.BranchIf(condition, 1 + returnLength); // past the next Return
+                m_emit.Return(i + 1, pc + InstructionSize(d.op));
+                m_emit.Return(i + 1, pc + static_cast<std::uint32_t>(d.imm));
+                return true;
+            }
+
+            // Leaves the guest address of a load or store in w15, zero extended into x15, and bails out if any of the
+            // `size` bytes there are outside of guest memory.
+            void Address(Decoded const& d, std::uint32_t size, std::uint32_t i, std::uint32_t pc)
+            {
+                m_emit.Load(w15, d.rs1);
+                if (d.imm != 0)
+                {
+                    m_emit.Move(w14, static_cast<std::uint32_t>(d.imm));
+                    m_emit.Op(addW, w15, w15, w14);
+                }
+                m_emit.AddX(x16, x15, size);
+                m_emit.CompareX(x16, x11);
+                m_bails.push_back({m_emit.BranchIf(hi), {i, pc}});
+            }
+
+            auto Load(Decoded const& d, Opcode load, std::uint32_t size, std::uint32_t i, std::uint32_t pc) -> bool
+            {
+                Address(d, size, i, pc);
+                if (d.rd != 0)
+                {
+                    m_emit.Op(load, w13, x10, w15);
+                    m_emit.Store(d.rd, w13);
+                }
+                return false;
+            }
+
+            auto Store(Decoded const& d, Opcode store, std::uint32_t size, std::uint32_t i, std::uint32_t pc) -> bool
+            {
+                Address(d, size, i, pc);
+                // Stores into watched pages go through the interpreter so that it can discard or record them. Like
+                // PredecodeCache::IsWatched(), this checks the pages of the slot before the address and of its last
+                // byte.
+                for (auto const first : {true, false})
+                {
+                    if (first)
+                    {
+                        m_emit.SubtractSetFlags(w16, w15, slotSize);
+                        m_emit.Select(w16, w15, w16, lo);
+                    }
+                    else
+                    {
+                        m_emit.AddX(x16, x15, size - 1);
+                    }
+                    m_emit.ShiftPage(x16, x16);
+                    m_emit.Op(ldrX, x17, x12, x16);
+                    m_bails.push_back({m_emit.BranchIfNotZero(x17), {i, pc}});
+                }
+                m_emit.Load(w13, d.rs2);
+                m_emit.Op(store, w13, x10, w15);
+                return false;
+            }
+
+            static constexpr std::uint32_t returnLength = 5; // the instructions in a Return
+
+            Emitter m_emit;
+            std::vector<std::pair<std::size_t, std::pair<std::uint32_t, std::uint32_t>>> m_bails;
+        };
+    } // namespace
+
+    void EmitBlock(Block const& block, std::vector<std::uint8_t>& code) { Compiler{code}.Compile(block); }
+} // namespace owl::detail
@@ -0,0 +1,440 @@
+#include "owl-cpu/detail/decoder.h"
+
+#include "block-cache.h"
+#include "jit.h"
+#include "predecode.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+// The x86-64 backend. Guest registers stay in CpuState and every instruction loads its operands from there and stores
+// its result back, so that compiled code needs no register allocator and leaves nothing to write back when it exits.
+// It only uses registers that both the System V and the Windows calling conventions treat as volatile:
+//
+//   r8  = x, the guest registers       eax, ecx, edx = scratch
+//   r9  = guest memory                 rax           = the result
+//   r10 = guest memory size
+//   r11 = the predecode page table
+
+namespace owl::detail
+{
+    namespace
+    {
+        enum Reg : std::uint8_t
+        {
+            eax = 0,
+            ecx = 1,
+            edx = 2,
+        };
+
+        // The low nibble of the jcc and setcc opcodes.
+        enum Condition : std::uint8_t
+        {
+            below = 0x2,
+            aboveOrEqual = 0x3,
+            equal = 0x4,
+            notEqual = 0x5,
+            above = 0x7,
+            less = 0xc,
+            greaterOrEqual = 0xd,
+        };
+
+        class Emitter
+        {
+        public:
+            explicit Emitter(std::vector<std::uint8_t>& code) : m_code{code} {}
+
+            void Bytes(std::initializer_list<std::uint8_t> bytes) { m_code.insert(m_code.end(), bytes); }
+
+            void Imm32(std::uint32_t value)
+            {
+                for (auto i = 0; i < 4; ++i)
+                {
+                    m_code.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+                }
+            }
+
+            void Imm64(std::uint64_t value)
+            {
+                Imm32(static_cast<std::uint32_t>(value));
+                Imm32(static_cast<std::uint32_t>(value >> 32));
+            }
+
+            // mov reg, [r8 + 4 * guest]
+            void Load(Reg reg, std::uint8_t guest) { Bytes({0x41, 0x8b, ModRmDisp8(reg), Disp(guest)}); }
+
+            // mov [r8 + 4 * guest], reg
+            void Store(std::uint8_t guest, Reg reg) { Bytes({0x41, 0x89, ModRmDisp8(reg), Disp(guest)}); }
+
+            // mov dword [r8 + 4 * guest], value
+            void StoreImm(std::uint8_t guest, std::uint32_t value)
+            {
+                Bytes({0x41, 0xc7, 0x40, Disp(guest)});
+                Imm32(value);
+            }
+
+            // One of the `op eax, imm32` forms.
+            void AluImm(std::uint8_t opcode, std::uint32_t value)
+            {
+                Bytes({opcode});
+                Imm32(value);
+            }
+
+            // mov rax, (retired << 32) | pc; ret
+            void Return(std::uint32_t retired, std::uint32_t pc)
+            {
+                Bytes({0x48, 0xb8});
+                Imm64((std::uint64_t{retired} << 32) | pc);
+                Bytes({0xc3});
+            }
+
+            // jcc rel32, returning the offset of rel32 so that it can be patched.
+            auto JumpIf(Condition condition) -> std::size_t
+            {
+                Bytes({0x0f, static_cast<std::uint8_t>(0x80 | condition)});
+                auto const at = m_code.size();
+                Imm32(0);
+                return at;
+            }
+
+            auto Size() const -> std::size_t { return m_code.size(); }
+
+            // Points the rel32 at `at` to the code at `target`.
+            void Patch(std::size_t at, std::size_t target)
+            {
+                auto const rel = static_cast<std::uint32_t>(target - (at + 4));
+                for (auto i = 0; i < 4; ++i)
+                {
+                    m_code[at + static_cast<std::size_t>(i)] = static_cast<std::uint8_t>(rel >> (8 * i));
+                }
+            }
+
+        private:
+            static constexpr auto ModRmDisp8(Reg reg) -> std::uint8_t
+            {
+                return static_cast<std::uint8_t>(0x40 | (reg << 3));
+            }
+
+            static constexpr auto Disp(std::uint8_t guest) -> std::uint8_t
+            {
+                return static_cast<std::uint8_t>(guest * 4);
+            }
+
+            std::vector<std::uint8_t>& m_code;
+        };
+
+        class Compiler
+        {
+        public:
+            explicit Compiler(std::vector<std::uint8_t>& code) : m_emit{code} {}
+
+            void Compile(Block const& block)
+            {
+                // endbr64, in case the host enforces indirect branch tracking, then load the frame into r8 to r11.
+                m_emit.Bytes({0xf3, 0x0f, 0x1e, 0xfa});
+#if defined(_WIN32)
+                m_emit.Bytes({0x48, 0x89, 0xc8}); // mov rax, rcx
+#else
+                m_emit.Bytes({0x48, 0x89, 0xf8}); // mov rax, rdi
+#endif
+                m_emit.Bytes({0x4c, 0x8b, 0x00});       // mov r8, [rax]
+                m_emit.Bytes({0x4c, 0x8b, 0x48, 0x08}); // mov r9, [rax + 8]
+                m_emit.Bytes({0x4c, 0x8b, 0x50, 0x10}); // mov r10, [rax + 16]
+                m_emit.Bytes({0x4c, 0x8b, 0x58, 0x18}); // mov r11, [rax + 24]
+
+                auto const count = block.Count();
+                auto ended = false;
+                auto pc = block.pc;
+                for (std::uint32_t i = 0; i < count && !ended; ++i)
+                {
+                    // Compiled code doesn't dispatch, so it gains nothing from fusion.
+                    auto d = block.insns[i].d;
+                    d.op = Unfuse(d.op);
+                    ended = Instruction(d, i, pc);
+                    pc += InstructionSize(d.op);
+                }
+                if (!ended)
+                {
+                    m_emit.Return(count, pc);
+                }
+
+                // The bail-outs for loads and stores that the interpreter has to handle, one for each instruction.
+                auto last = std::pair<std::uint32_t, std::uint32_t>{count, 0};
+                auto stub = std::size_t{};
+                for (auto const& [at, bail] : m_bails)
+                {
+                    if (bail != last)
+                    {
+                        last = bail;
+                        stub = m_emit.Size();
+                        m_emit.Return(bail.first, bail.second);
+                    }
+                    m_emit.Patch(at, stub);
+                }
+            }
+
+        private:
+            // Emits the instruction at index i of the block, returning true if it ends the compiled code.
+            auto Instruction(Decoded const& d, std::uint32_t i, std::uint32_t pc) -> bool
+            {
+                auto const imm = static_cast<std::uint32_t>(d.imm);
+
+                switch (Uncompress(d.op))
+                {
+                case Op::Lui:
+                case Op::Li:
+                    SetImm(d.rd, imm);
+                    return false;
+                case Op::Auipc:
+                    SetImm(d.rd, pc + imm);
+                    return false;
+                case Op::Jal:
+                case Op::J:
+                    SetImm(d.rd, pc + InstructionSize(d.op));
+                    m_emit.Return(i + 1, pc + imm);
+                    return true;
+                case Op::Jalr:
+                case Op::Jr:
+                    m_emit.Load(ecx, d.rs1);
+                    m_emit.Bytes({0x81, 0xc1}); // add ecx, imm32
+                    m_emit.Imm32(imm);
+                    m_emit.Bytes({0x83, 0xe1, 0xfe}); // and ecx, -2
+                    SetImm(d.rd, pc + InstructionSize(d.op));
+                    m_emit.Bytes({0x89, 0xc8}); // mov eax, ecx
+                    m_emit.Bytes({0x48, 0xba}); // mov rdx, imm64
+                    m_emit.Imm64(std::uint64_t{i + 1} << 32);
+                    m_emit.Bytes({0x48, 0x09, 0xd0, 0xc3}); // or rax, rdx; ret
+                    return true;
+                case Op::Beq:
+                case Op::Beqz:
+                    return Branch(d, equal, i, pc);
+                case Op::Bne:
+                case Op::Bnez:
+                    return Branch(d, notEqual, i, pc);
+                case Op::Blt:
+                    return Branch(d, less, i, pc);
+                case Op::Bge:
+                    return Branch(d, greaterOrEqual, i, pc);
+                case Op::Bltu:
+                    return Branch(d, below, i, pc);
+                case Op::Bgeu:
+                    return Branch(d, aboveOrEqual, i, pc);
+                case Op::Lb:
+                    return Load(d, {0x41, 0x0f, 0xbe, 0x0c, 0x01}, 1, i, pc); // movsx ecx, byte [r9 + rax]
+                case Op::Lh:
+                    return Load(d, {0x41, 0x0f, 0xbf, 0x0c, 0x01}, 2, i, pc); // movsx ecx, word [r9 + rax]
+                case Op::Lw:
+                    return Load(d, {0x41, 0x8b, 0x0c, 0x01}, 4, i, pc); // mov ecx, [r9 + rax]
+                case Op::Lbu:
+                    return Load(d, {0x41, 0x0f, 0xb6, 0x0c, 0x01}, 1, i, pc); // movzx ecx, byte [r9 + rax]
+                case Op::Lhu:
+                    return Load(d, {0x41, 0x0f, 0xb7, 0x0c, 0x01}, 2, i, pc); // movzx ecx, word [r9 + rax]
+                case Op::Sb:
+                    return Store(d, {0x41, 0x88, 0x0c, 0x01}, 1, i, pc); // mov [r9 + rax], cl
+                case Op::Sh:
+                    return Store(d, {0x66, 0x41, 0x89, 0x0c, 0x01}, 2, i, pc); // mov [r9 + rax], cx
+                case Op::Sw:
+                    return Store(d, {0x41, 0x89, 0x0c, 0x01}, 4, i, pc); // mov [r9 + rax], ecx
+                case Op::Addi:
+                    return AluImm(d, 0x05); // add eax, imm32
+                case Op::Slti:
+                    return Compare(d, true, less);
+                case Op::Sltiu:
+                    return Compare(d, true, below);
+                case Op::Xori:
+                    return AluImm(d, 0x35); // xor eax, imm32
+                case Op::Ori:
+                    return AluImm(d, 0x0d); // or eax, imm32
+                case Op::Andi:
+                    return AluImm(d, 0x25); // and eax, imm32
+                case Op::Slli:
+                    return ShiftImm(d, 0xe0); // shl eax, imm8
+                case Op::Srli:
+                    return ShiftImm(d, 0xe8); // shr eax, imm8
+                case Op::Srai:
+                    return ShiftImm(d, 0xf8); // sar eax, imm8
+                case Op::Add:
+                    return Alu(d, {0x01, 0xc8}); // add eax, ecx
+                case Op::Sub:
+                    return Alu(d, {0x29, 0xc8}); // sub eax, ecx
+                case Op::Sll:
+                    return Alu(d, {0xd3, 0xe0}); // shl eax, cl
+                case Op::Slt:
+                    return Compare(d, false, less);
+                case Op::Sltu:
+                    return Compare(d, false, below);
+                case Op::Xor:
+                    return Alu(d, {0x31, 0xc8}); // xor eax, ecx
+                case Op::Srl:
+                    return Alu(d, {0xd3, 0xe8}); // shr eax, cl
+                case Op::Sra:
+                    return Alu(d, {0xd3, 0xf8}); // sar eax, cl
+                case Op::Or:
+                    return Alu(d, {0x09, 0xc8}); // or eax, ecx
+                case Op::And:
+                    return Alu(d, {0x21, 0xc8}); // and eax, ecx
+                case Op::Mul:
+                    return Alu(d, {0x0f, 0xaf, 0xc1}); // imul eax, ecx
+                case Op::Mv:
+                    m_emit.Load(eax, d.rs1);
+                    m_emit.Store(d.rd, eax);
+                    return false;
+                case Op::Nop:
+                    return false;
+                default:
+                    // Leave everything else, such as ecall, division, atomics and fences, to the interpreter.
+                    m_emit.Return(i, pc);
+                    return true;
+                }
+            }
+
+            void SetImm(std::uint8_t rd, std::uint32_t value)
+            {
+                if (rd != 0)
+                {
+                    m_emit.StoreImm(rd, value);
+                }
+            }
+
+            auto AluImm(Decoded const& d, std::uint8_t opcode) -> bool
+            {
+                if (d.rd != 0)
+                {
+                    m_emit.Load(eax, d.rs1);
+                    m_emit.AluImm(opcode, static_cast<std::uint32_t>(d.imm));
+                    m_emit.Store(d.rd, eax);
+                }
+                return false;
+            }
+
+            auto ShiftImm(Decoded const& d, std::uint8_t modRm) -> bool
+            {
+                if (d.rd != 0)
+                {
+                    m_emit.Load(eax, d.rs1);
+                    m_emit.Bytes({0xc1, modRm, static_cast<std::uint8_t>(d.imm)});
+                    m_emit.Store(d.rd, eax);
+                }
+                return false;
+            }
+
+            auto Alu(Decoded const& d, std::initializer_list<std::uint8_t> op) -> bool
+            {
+                if (d.rd != 0)
+                {
+                    m_emit.Load(eax, d.rs1);
+                    m_emit.Load(ecx, d.rs2);
+                    m_emit.Bytes(op);
+                    m_emit.Store(d.rd, eax);
+                }
+                return false;
+            }
+
+            auto Compare(Decoded const& d, bool immediate, Condition condition) -> bool
+            {
+                if (d.rd != 0)
+                {
+                    m_emit.Load(eax, d.rs1);
+                    if (!immediate)
+                    {
+                        m_emit.Load(ecx, d.rs2);
+                    }
+                    m_emit.Bytes({0x31, 0xd2}); // xor edx, edx
+                    if (immediate)
+                    {
+                        m_emit.AluImm(0x3d, static_cast<std::uint32_t>(d.imm)); // cmp eax, imm32
+                    }
+                    else
+                    {
+                        m_emit.Bytes({0x39, 0xc8}); // cmp eax, ecx
+                    }
+                    m_emit.Bytes({0x0f, static_cast<std::uint8_t>(0x90 | condition), 0xc2}); // setcc dl
+                    m_emit.Store(d.rd, edx);
+                }
+                return false;
+            }
+
+            auto Branch(Decoded const& d, Condition condition, std::uint32_t i, std::uint32_t pc) -> bool
+            {
+                m_emit.Load(eax, d.rs1);
+                m_emit.Load(ecx, d.rs2);
+                m_emit.Bytes({0x39, 0xc8}); // cmp eax, ecx
+                // jcc rel8, past the next Return
+                m_emit.Bytes({static_cast<std::uint8_t>(0x70 | condition), returnSize});
+                m_emit.Return(i + 1, pc + InstructionSize(d.op));
+                m_emit.Return(i + 1, pc + static_cast<std::uint32_t>(d.imm));
+                return true;
+            }
+
+            // Leaves the guest address of a load or store in eax, zero extended into rax, and bails out if any of the
+            // `size` bytes there are outside of guest memory.
+            void Address(Decoded const& d, std::uint8_t size, std::uint32_t i, std::uint32_t pc)
+            {
+                m_emit.Load(eax, d.rs1);
+                if (d.imm != 0)
+                {
+                    m_emit.AluImm(0x05, static_cast<std::uint32_t>(d.imm)); // add eax, imm32
+                }
+                m_emit.Bytes({0x48, 0x8d, 0x50, size}); // lea rdx, [rax + size]
+                m_emit.Bytes({0x4c, 0x39, 0xd2});       // cmp rdx, r10
+                Bail(above, i, pc);
+            }
+
+            auto Load(Decoded const& d, std::initializer_list<std::uint8_t> load, std::uint8_t size, std::uint32_t i,
+                      std::uint32_t pc) -> bool
+            {
+                Address(d, size, i, pc);
+                if (d.rd != 0)
+                {
+                    m_emit.Bytes(load);
+                    m_emit.Store(d.rd, ecx);
+                }
+                return false;
+            }
+
+            auto Store(Decoded const& d, std::initializer_list<std::uint8_t> store, std::uint8_t size, std::uint32_t i,
+                       std::uint32_t pc) -> bool
+            {
+                Address(d, size, i, pc);
+                // Stores into watched pages go through the interpreter so that it can discard or record them. Like
+                // PredecodeCache::IsWatched(), this checks the pages of the slot before the address and of its last
+                // byte.
+                for (auto const first : {true, false})
+                {
+                    m_emit.Bytes({0x89, 0xc2}); // mov edx, eax
+                    if (first)
+                    {
+                        m_emit.Bytes({0x83, 0xea, slotSize}); // sub edx, slotSize
+                        m_emit.Bytes({0x0f, 0x42, 0xd0});     // cmovb edx, eax
+                    }
+                    else if (size > 1)
+                    {
+                        m_emit.Bytes({0x83, 0xc2, static_cast<std::uint8_t>(size - 1)}); // add edx, size - 1
+                    }
+                    m_emit.Bytes({0xc1, 0xea, codePageShift});     // shr edx, codePageShift
+                    m_emit.Bytes({0x49, 0x83, 0x3c, 0xd3, 0x00}); // cmp qword [r11 + rdx * 8], 0
+                    Bail(notEqual, i, pc);
+                }
+                m_emit.Load(ecx, d.rs2);
+                m_emit.Bytes(store);
+                return false;
+            }
+
+            // Jumps to a bail-out that returns to the interpreter at the instruction if the condition holds.
+            void Bail(Condition condition, std::uint32_t i, std::uint32_t pc)
+            {
+                m_bails.push_back({m_emit.JumpIf(condition), {i, pc}});
+            }
+
+            static constexpr std::uint8_t returnSize = 11;
+
+            Emitter m_emit;
+            std::vector<std::pair<std::size_t, std::pair<std::uint32_t, std::uint32_t>>> m_bails;
+        };
+    } // namespace
+
+    void EmitBlock(Block const& block, std::vector<std::uint8_t>& code) { Compiler{code}.Compile(block); }
+} // namespace owl::detail
@@ -0,0 +1,108 @@
+#include "jit.h"
+
+#include "block-cache.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace owl::detail
+{
+    namespace
+    {
+        auto MapArena(std::size_t size) -> std::uint8_t*
+        {
+#if defined(_WIN32)
+            auto* arena = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+            if (arena == nullptr)
+            {
+                throw std::bad_alloc();
+            }
+#else
+            auto* arena = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (arena == MAP_FAILED)
+            {
+                throw std::bad_alloc();
+            }
+#endif
+            return static_cast<std::uint8_t*>(arena);
+        }
+
+        void UnmapArena(std::uint8_t* arena, std::size_t size)
+        {
+#if defined(_WIN32)
+            static_cast<void>(size);
+            VirtualFree(arena, 0, MEM_RELEASE);
+#else
+            munmap(arena, size);
+#endif
+        }
+
+        void Protect(std::uint8_t* arena, std::size_t size, bool executable)
+        {
+#if defined(_WIN32)
+            DWORD previous{};
+            if (!VirtualProtect(arena, size, executable ? PAGE_EXECUTE_READ : PAGE_READWRITE, &previous))
+            {
+                throw std::bad_alloc();
+            }
+            if (executable)
+            {
+                FlushInstructionCache(GetCurrentProcess(), arena, size);
+            }
+#else
+            if (mprotect(arena, size, executable ? PROT_READ | PROT_EXEC : PROT_READ | PROT_WRITE) != 0)
+            {
+                throw std::bad_alloc();
+            }
+            if (executable)
+            {
+                __builtin___clear_cache(reinterpret_cast<char*>(arena), reinterpret_cast<char*>(arena + size));
+            }
+#endif
+        }
+    } // namespace
+
+    Jit::~Jit()
+    {
+        if (m_arena != nullptr)
+        {
+            UnmapArena(m_arena, arenaSize);
+        }
+    }
+
+    auto Jit::Compile(Block const& block) -> NativeBlock
+    {
+        m_code.clear();
+        EmitBlock(block, m_code);
+
+        constexpr std::size_t alignment = 16;
+        auto const start = (m_used + alignment - 1) & ~(alignment - 1);
+        if (start + m_code.size() > arenaSize)
+        {
+            return nullptr;
+        }
+        if (m_arena == nullptr)
+        {
+            m_arena = MapArena(arenaSize);
+        }
+        else
+        {
+            Protect(m_arena, arenaSize, false);
+        }
+        std::memcpy(m_arena + start, m_code.data(), m_code.size());
+        m_used = start + m_code.size();
+        Protect(m_arena, arenaSize, true);
+
+        // Converting an object pointer to a function pointer is conditionally supported, but every platform with a
+        // backend supports it.
+        return reinterpret_cast<NativeBlock>(m_arena + start); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    }
+} // namespace owl::detail
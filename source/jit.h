@@ -0,0 +1,58 @@
+#pragma once
+
+#include "predecode.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The JIT that the tiered engine uses to compile hot blocks to host code. Compiled blocks work directly on CpuState's
+// registers and guest memory, so the engine can switch between them and the interpreter on any block boundary.
+
+namespace owl::detail
+{
+    struct Block;
+
+    // Everything that compiled code needs, passed to it in a single pointer.
+    struct JitFrame
+    {
+        std::uint32_t* x;
+        std::uint8_t* memory;
+        std::uint64_t memorySize;
+        DecodedPage const* const* pages; // the predecode cache's page table, for spotting stores into watched pages
+    };
+
+    // A compiled block. It returns the number of instructions that it retired in the upper 32 bits and the next pc in
+    // the lower 32 bits. If it retired fewer instructions than the block holds, then pc refers to an instruction that
+    // compiled code doesn't handle, such as ecall or a load that faults, which the interpreter must execute instead.
+    using NativeBlock = auto (*)(JitFrame const* frame) -> std::uint64_t;
+
+    // Appends host code for the block to `code`. Each backend implements this for its own architecture.
+    void EmitBlock(Block const& block, std::vector<std::uint8_t>& code);
+
+    // An executable arena for compiled blocks. Every block compiled into it stays valid until the next Clear().
+    class Jit
+    {
+    public:
+        Jit() = default;
+        ~Jit();
+
+        Jit(Jit const&) = delete;
+        auto operator=(Jit const&) -> Jit& = delete;
+        Jit(Jit&&) = delete;
+        auto operator=(Jit&&) -> Jit& = delete;
+
+        // Compiles the block, returning nullptr if the arena is full.
+        auto Compile(Block const& block) -> NativeBlock;
+
+        // Discards every compiled block.
+        void Clear() { m_used = 0; }
+
+    private:
+        static constexpr std::size_t arenaSize = std::size_t{4} << 20;
+
+        std::uint8_t* m_arena{}; // mapped on first use, and only ever writable or executable, never both
+        std::size_t m_used{};
+        std::vector<std::uint8_t> m_code;
+    };
+} // namespace owl::detail
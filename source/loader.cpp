@@ -0,0 +1,182 @@
+#include "owl-cpu/loader.h"
+
+#include "owl-cpu/owl-cpu.h"
+
+#include "mapped-file.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace owl
+{
+    namespace
+    {
+        [[noreturn]] void Fail(std::filesystem::path const& path, char const* reason)
+        {
+            throw std::runtime_error(path.string() + ": " + reason);
+        }
+
+#if !defined(_WIN32)
+        // Maps `size` bytes of the file at `offset` over guest memory at `address`, copy-on-write, restoring the bytes
+        // that share the first and last host pages with it. Returns false if the host can't map them.
+        auto Map(std::uint8_t* base, detail::MappedFile const& file, std::uint32_t address, std::uint64_t offset,
+                 std::uint64_t size) -> bool
+        {
+            auto const page = static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+            if (size == 0 || address % page != offset % page)
+            {
+                return false;
+            }
+            auto const start = address - address % page;
+            auto const end = std::uint64_t{address} + size;
+            auto const mapEnd = (end + page - 1) / page * page;
+
+            std::vector<std::uint8_t> const before(base + start, base + address);
+            std::vector<std::uint8_t> const after(base + end, base + mapEnd);
+            auto* mapped = mmap(base + start, mapEnd - start, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+                                file.Descriptor(), static_cast<off_t>(offset - (address - start)));
+            if (mapped == MAP_FAILED)
+            {
+                return false;
+            }
+            std::copy(before.begin(), before.end(), base + start);
+            std::copy(after.begin(), after.end(), base + end);
+            return true;
+        }
+
+        // Replaces whole host pages of guest memory with fresh ones, which read as zero and aren't committed.
+        auto Discard(std::uint8_t* base, std::uint64_t start, std::uint64_t end) -> bool
+        {
+            auto flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED;
+#if defined(MAP_NORESERVE)
+            flags |= MAP_NORESERVE;
+#endif
+            auto const length = static_cast<std::size_t>(end - start);
+            return mmap(base + start, length, PROT_READ | PROT_WRITE, flags, -1, 0) != MAP_FAILED;
+        }
+#endif
+
+        // Puts a segment of the file at `offset` into guest memory at `address`, zero filling it from `fileSize` to
+        // `memorySize`.
+        void Place(AddressSpace& space, detail::MappedFile const& file, std::filesystem::path const& path,
+                   std::uint32_t address, std::uint64_t offset, std::uint64_t fileSize, std::uint64_t memorySize,
+                   Image& image)
+        {
+            if (fileSize > memorySize || address + memorySize > AddressSpace::size)
+            {
+                Fail(path, "a segment doesn't fit in the address space");
+            }
+            if (offset > file.Bytes().size() || fileSize > file.Bytes().size() - offset)
+            {
+                Fail(path, "a segment is outside of the file");
+            }
+
+            auto* base = space.View().data();
+            auto const fileEnd = std::uint64_t{address} + fileSize;
+            auto const end = std::uint64_t{address} + memorySize;
+#if defined(_WIN32)
+            auto const mapped = false;
+#else
+            auto const mapped = Map(base, file, address, offset, fileSize);
+#endif
+            if (mapped)
+            {
+                image.mappedBytes += fileSize;
+            }
+            else if (fileSize > 0)
+            {
+                std::memcpy(base + address, file.Bytes().data() + offset, static_cast<std::size_t>(fileSize));
+                image.copiedBytes += fileSize;
+            }
+
+            // Zero the remainder, discarding any whole pages of it rather than touching them.
+            auto zeroEnd = end;
+#if !defined(_WIN32)
+            auto const page = static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+            auto const firstWhole = (fileEnd + page - 1) / page * page;
+            auto const lastWhole = end / page * page;
+            if (firstWhole < lastWhole && Discard(base, firstWhole, lastWhole))
+            {
+                std::fill(base + lastWhole, base + end, std::uint8_t{0});
+                zeroEnd = firstWhole;
+            }
+#endif
+            std::fill(base + fileEnd, base + std::max(fileEnd, zeroEnd), std::uint8_t{0});
+        }
+
+        template<typename T>
+        auto ReadAt(std::span<std::uint8_t const> bytes, std::size_t offset) -> T
+        {
+            T value{};
+            std::memcpy(&value, bytes.data() + offset, sizeof(T));
+            return value;
+        }
+    } // namespace
+
+    auto LoadElf(AddressSpace& space, std::filesystem::path const& path) -> Image
+    {
+        constexpr std::size_t headerSize = 52;
+        constexpr std::size_t programHeaderSize = 32;
+        constexpr std::uint16_t machineRiscV = 243;
+        constexpr std::uint32_t loadSegment = 1;
+
+        detail::MappedFile const file{path};
+        auto const bytes = file.Bytes();
+        if (bytes.size() < headerSize || bytes[0] != 0x7f || bytes[1] != 'E' || bytes[2] != 'L' || bytes[3] != 'F')
+        {
+            Fail(path, "not an ELF file");
+        }
+        constexpr auto elfClass32 = 1;
+        constexpr auto littleEndian = 1;
+        if (bytes[4] != elfClass32 || bytes[5] != littleEndian || ReadAt<std::uint16_t>(bytes, 18) != machineRiscV)
+        {
+            Fail(path, "not a 32-bit little-endian RISC-V ELF file");
+        }
+
+        auto image = Image{.entry = ReadAt<std::uint32_t>(bytes, 24)};
+        auto const programHeaders = std::size_t{ReadAt<std::uint32_t>(bytes, 28)};
+        auto const entrySize = std::size_t{ReadAt<std::uint16_t>(bytes, 42)};
+        auto const count = std::size_t{ReadAt<std::uint16_t>(bytes, 44)};
+        if (entrySize < programHeaderSize || programHeaders > bytes.size()
+            || count > (bytes.size() - programHeaders) / entrySize)
+        {
+            Fail(path, "the program headers are outside of the file");
+        }
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            auto const header = programHeaders + i * entrySize;
+            if (ReadAt<std::uint32_t>(bytes, header) != loadSegment)
+            {
+                continue;
+            }
+            auto const offset = ReadAt<std::uint32_t>(bytes, header + 4);
+            auto const address = ReadAt<std::uint32_t>(bytes, header + 8);
+            auto const fileSize = ReadAt<std::uint32_t>(bytes, header + 16);
+            auto const memorySize = ReadAt<std::uint32_t>(bytes, header + 20);
+            Place(space, file, path, address, offset, fileSize, memorySize, image);
+        }
+        return image;
+    }
+
+    auto LoadBinary(AddressSpace& space, std::filesystem::path const& path, std::uint32_t address) -> Image
+    {
+        detail::MappedFile const file{path};
+        auto const size = file.Bytes().size();
+        auto image = Image{.entry = address};
+        Place(space, file, path, address, 0, size, size, image);
+        return image;
+    }
+} // namespace owl
@@ -0,0 +1,785 @@
+#include "owl-cpu/owl-cpu.h"
+
+#include "owl-cpu/detail/decoder.h"
+
+#include "engines.h"
+#include "execute.h"
+#include "memory.h"
+#include "pooled.h"
+#include "predecode.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+// Lockstep execution: the registers of every lane are held in structure-of-arrays layout, and each instruction is
+// fetched and dispatched once and then executed for all of the selected lanes by loops over fixed-size lane arrays.
+// Those loops are written so that the compiler can vectorize them for whichever SIMD instructions the target has,
+// such as SSE2, AVX2 or AVX-512 on x86-64, and NEON on AArch64, blending results into the unselected lanes rather
+// than branching on them.
+
+namespace owl::detail
+{
+    // The lanes of a Lockstep, behind an interface so that the public class doesn't depend on how many there are.
+    class LaneGroup
+    {
+    public:
+        LaneGroup() = default;
+        virtual ~LaneGroup() = default;
+
+        LaneGroup(LaneGroup const&) = delete;
+        auto operator=(LaneGroup const&) -> LaneGroup& = delete;
+        LaneGroup(LaneGroup&&) = delete;
+        auto operator=(LaneGroup&&) -> LaneGroup& = delete;
+
+        virtual auto Lanes() const -> std::size_t = 0;
+        virtual auto State(std::size_t lane) const -> CpuState = 0;
+        virtual void SetState(std::size_t lane, CpuState const& state) = 0;
+        virtual auto Run(std::uint64_t cycles) -> std::vector<Exit> = 0;
+        virtual void InvalidateCode() = 0;
+    };
+
+    namespace
+    {
+        // A pc that no lane can be at, because every pc that the guest can reach is even.
+        constexpr std::uint32_t diverged = 1;
+
+        template<std::size_t Width>
+        class SimdLanes final : public LaneGroup
+        {
+        public:
+            // One 32-bit value for each lane.
+            using Lane = std::array<std::uint32_t, Width>;
+
+            SimdLanes(std::span<std::span<std::uint8_t> const> memories, std::uint32_t entry)
+                : m_used{memories.size()}, m_code{memories[0]}
+            {
+                for (std::size_t i = 0; i < m_used; ++i)
+                {
+                    m_memory[i] = memories[i];
+                    m_pc[i] = entry;
+                    m_reservation[i] = CpuState{}.reservation;
+                }
+            }
+
+            auto Lanes() const -> std::size_t override { return m_used; }
+
+            auto State(std::size_t lane) const -> CpuState override
+            {
+                CpuState state;
+                for (std::size_t r = 0; r < state.x.size(); ++r)
+                {
+                    state.x[r] = m_x[r][lane];
+                }
+                state.pc = m_pc[lane];
+                state.reservation = m_reservation[lane];
+                state.instret = m_instret[lane];
+                state.reserved = m_reserved[lane];
+                return state;
+            }
+
+            void SetState(std::size_t lane, CpuState const& state) override
+            {
+                for (std::size_t r = 0; r < state.x.size(); ++r)
+                {
+                    m_x[r][lane] = r == 0 ? 0 : state.x[r];
+                }
+                m_pc[lane] = state.pc;
+                m_reservation[lane] = state.reservation;
+                m_instret[lane] = state.instret;
+                m_reserved[lane] = state.reserved;
+            }
+
+            auto Run(std::uint64_t cycles) -> std::vector<Exit> override
+            {
+                std::array<std::uint64_t, Width> remaining{};
+                for (std::size_t i = 0; i < Width; ++i)
+                {
+                    auto const runnable = i < m_used && cycles > 0;
+                    remaining[i] = runnable ? cycles : 0;
+                    m_exits[i] = Exit::BudgetExhausted;
+                    m_stopped[i] = !runnable || m_detached[i];
+                }
+
+                for (;;)
+                {
+                    // Select the lanes at the lowest pc of those that are still running. Lanes that took different
+                    // paths through the code usually reconverge there.
+                    auto pc = std::numeric_limits<std::uint32_t>::max();
+                    auto any = false;
+                    for (std::size_t i = 0; i < Width; ++i)
+                    {
+                        if (!m_stopped[i])
+                        {
+                            pc = std::min(pc, m_pc[i]);
+                            any = true;
+                        }
+                    }
+                    if (!any)
+                    {
+                        break;
+                    }
+                    auto budget = std::numeric_limits<std::uint64_t>::max();
+                    auto converged = true;
+                    Lane selected{};
+                    for (std::size_t i = 0; i < Width; ++i)
+                    {
+                        auto const in = !m_stopped[i] && m_pc[i] == pc;
+                        selected[i] = in ? ~0U : 0U;
+                        budget = in ? std::min(budget, remaining[i]) : budget;
+                        converged = converged && (in || m_stopped[i]);
+                    }
+                    m_mask = selected;
+
+                    // Run the selected lanes together until they diverge, stop, or reach a lane that was waiting.
+                    m_steps = 0;
+                    auto next = pc;
+                    while (m_steps < budget)
+                    {
+                        ++m_steps;
+                        auto const* d = Fetch(next);
+                        if (d == nullptr)
+                        {
+                            StopAll(m_fetchExit, next);
+                            break;
+                        }
+                        next = Step(*d, next);
+                        if (next == diverged || (!converged && Joins(next)))
+                        {
+                            break;
+                        }
+                    }
+
+                    for (std::size_t i = 0; i < Width; ++i)
+                    {
+                        if (selected[i] == 0)
+                        {
+                            continue;
+                        }
+                        auto const running = m_mask[i] != 0;
+                        auto const retired = running ? m_steps : m_retired[i];
+                        m_instret[i] += retired;
+                        remaining[i] -= retired;
+                        if (running)
+                        {
+                            m_pc[i] = next == diverged ? m_pc[i] : next;
+                            m_stopped[i] = remaining[i] == 0;
+                        }
+                    }
+                }
+
+                // Lanes that left the group run on their own, each with its own translation of its code.
+                for (std::size_t i = 0; i < m_used; ++i)
+                {
+                    if (m_detached[i] && m_exits[i] == Exit::BudgetExhausted && remaining[i] > 0)
+                    {
+                        if (!m_ownCode[i])
+                        {
+                            m_ownCode[i] = MakePooled<PredecodeCache>(std::pmr::new_delete_resource(), m_memory[i]);
+                        }
+                        auto state = State(i);
+                        m_exits[i] = RunSwitch(state, CheckedMemory{m_memory[i]}, *m_ownCode[i], remaining[i]);
+                        SetState(i, state);
+                    }
+                }
+                return {m_exits.begin(), m_exits.begin() + static_cast<std::ptrdiff_t>(m_used)};
+            }
+
+            void InvalidateCode() override
+            {
+                m_code.Clear();
+                m_pageBase = noCodePage;
+                for (auto& code : m_ownCode)
+                {
+                    if (code)
+                    {
+                        code->Clear();
+                    }
+                }
+            }
+
+        private:
+            // Returns the predecoded instruction at pc from the shared translation, or nullptr with m_fetchExit set if
+            // it can't be fetched.
+            auto Fetch(std::uint32_t pc) -> Decoded const*
+            {
+                if ((pc & ~pageOffsetMask) != m_pageBase) [[unlikely]]
+                {
+                    if ((pc & (slotSize - 1)) != 0)
+                    {
+                        m_fetchExit = Exit::MisalignedFetch;
+                        return nullptr;
+                    }
+                    auto const fresh = pc < m_memory[0].size() && m_code.Pages()[pc >> codePageShift] == nullptr;
+                    m_page = m_code.Lookup(pc);
+                    if (m_page == nullptr)
+                    {
+                        m_fetchExit = Exit::FetchFault;
+                        return nullptr;
+                    }
+                    m_pageBase = pc & ~pageOffsetMask;
+                    if (fresh)
+                    {
+                        DetachLanesWithOtherCode(pc);
+                        if (!Any())
+                        {
+                            return nullptr;
+                        }
+                    }
+                }
+                return &m_page->insns[(pc & pageOffsetMask) >> slotShift];
+            }
+
+            // Detaches every lane in the group whose copy of the page that the group has just translated for pc
+            // differs from the first lane's, which it was translated from, because the lane stored to it before then.
+            // A selected lane leaves without retiring the instruction at pc, and then runs it on its own.
+            void DetachLanesWithOtherCode(std::uint32_t pc)
+            {
+                auto const base = pc & ~pageOffsetMask;
+                auto const size = std::min<std::size_t>(sizeof(PageBytes), m_memory[0].size() - base);
+                auto const code = m_memory[0].subspan(base, size);
+                for (std::size_t i = 1; i < m_used; ++i)
+                {
+                    if (m_detached[i] || std::ranges::equal(code, m_memory[i].subspan(base, size)))
+                    {
+                        continue;
+                    }
+                    m_detached[i] = true;
+                    if (m_mask[i] != 0)
+                    {
+                        Stop(i, Exit::BudgetExhausted, pc);
+                        m_retired[i] = m_steps - 1;
+                    }
+                    else
+                    {
+                        m_stopped[i] = true;
+                    }
+                }
+            }
+
+            // Returns true if a running lane that isn't selected is waiting at pc, so that it can join the selection.
+            auto Joins(std::uint32_t pc) const -> bool
+            {
+                auto joins = false;
+                for (std::size_t i = 0; i < Width; ++i)
+                {
+                    joins = joins || (!m_stopped[i] && m_mask[i] == 0 && m_pc[i] == pc);
+                }
+                return joins;
+            }
+
+            auto Any() const -> bool
+            {
+                auto any = 0U;
+                for (auto const lane : m_mask)
+                {
+                    any |= lane;
+                }
+                return any != 0;
+            }
+
+            // Stops a selected lane with the given exit, leaving it at pc. The instruction that stopped it is retired
+            // unless it faulted.
+            void Stop(std::size_t lane, Exit exit, std::uint32_t pc)
+            {
+                auto const faulted = exit != Exit::BudgetExhausted && !Retires(exit);
+                m_retired[lane] = faulted ? m_steps - 1 : m_steps;
+                m_exits[lane] = exit;
+                m_stopped[lane] = true;
+                m_pc[lane] = pc;
+                m_mask[lane] = 0;
+            }
+
+            void StopAll(Exit exit, std::uint32_t pc)
+            {
+                for (std::size_t i = 0; i < Width; ++i)
+                {
+                    if (m_mask[i] != 0)
+                    {
+                        Stop(i, exit, pc);
+                    }
+                }
+            }
+
+            // Writes value(lane) to rd in each selected lane.
+            template<typename F>
+            void Set(std::uint8_t rd, F value)
+            {
+                if (rd == 0)
+                {
+                    return;
+                }
+                auto& out = m_x[rd];
+                for (std::size_t i = 0; i < Width; ++i)
+                {
+                    out[i] = (value(i) & m_mask[i]) | (out[i] & ~m_mask[i]);
+                }
+            }
+
+            // Moves each selected lane to its own target, returning the target if they all agree.
+            auto Jump(Lane const& target) -> std::uint32_t
+            {
+                auto first = diverged;
+                auto same = true;
+                for (std::size_t i = 0; i < Width; ++i)
+                {
+                    if (m_mask[i] != 0)
+                    {
+                        first = first == diverged ? target[i] : first;
+                        same = same && target[i] == first;
+                    }
+                }
+                if (same)
+                {
+                    return first;
+                }
+                for (std::size_t i = 0; i < Width; ++i)
+                {
+                    m_pc[i] = (target[i] & m_mask[i]) | (m_pc[i] & ~m_mask[i]);
+                }
+                return diverged;
+            }
+
+            // Executes a single decoded instruction at pc for the selected lanes. Returns the pc that all of them move
+            // on to, or `diverged` if they don't agree, in which case the pc of each selected lane has been updated.
+            // Lanes that stop leave the selection.
+            template<Op O>
+            auto Execute(Decoded const& d, std::uint32_t pc) -> std::uint32_t
+            {
+                constexpr auto base = Uncompress(O);
+                auto const& rs1 = m_x[d.rs1];
+                auto const& rs2 = m_x[d.rs2];
+                auto const imm = Unsigned(d.imm);
+                auto const next = pc + InstructionSize(O);
+
+                auto const set = [&](auto value) {
+                    Set(d.rd, value);
+                    return next;
+                };
+
+                auto const branch = [&](auto taken) {
+                    Lane target{};
+                    for (std::size_t i = 0; i < Width; ++i)
+                    {
+                        target[i] = taken(i) ? pc + imm : next;
+                    }
+                    return Jump(target);
+                };
+
+                auto const load = [&]<typename T>(T) {
+                    Lane value{};
+                    for (std::size_t i = 0; i < Width; ++i)
+                    {
+                        T loaded{};
+                        if (m_mask[i] != 0 && !CheckedMemory{m_memory[i]}.Read(rs1[i] + imm, loaded))
+                        {
+                            Stop(i, Exit::LoadFault, pc);
+                        }
+                        if constexpr (std::is_signed_v<T>)
+                        {
+                            value[i] = Unsigned(loaded);
+                        }
+                        else
+                        {
+                            value[i] = loaded;
+                        }
+                    }
+                    Set(d.rd, [&](std::size_t i) { return value[i]; });
+                    return Any() ? next : diverged;
+                };
+
+                auto const store = [&]<typename T>(T) {
+                    for (std::size_t i = 0; i < Width; ++i)
+                    {
+                        if (m_mask[i] == 0)
+                        {
+                            continue;
+                        }
+                        auto const address = rs1[i] + imm;
+                        if (!CheckedMemory{m_memory[i]}.Write(address, static_cast<T>(rs2[i])))
+                        {
+                            Stop(i, Exit::StoreFault, pc);
+                        }
+                        else if (m_code.IsWatched(address, sizeof(T))) [[unlikely]]
+                        {
+                            // The lane may have changed its copy of the shared code, so it can't stay in the group.
+                            m_detached[i] = true;
+                            Stop(i, Exit::BudgetExhausted, next);
+                        }
+                    }
+                    return Any() ? next : diverged;
+                };
+
+                auto const stop = [&](Exit exit) {
+                    StopAll(exit, Retires(exit) ? next : pc);
+                    return diverged;
+                };
+
+                if constexpr (base == Op::Illegal)
+                {
+                    return stop(Exit::IllegalInstruction);
+                }
+                else if constexpr (base == Op::FetchFault)
+                {
+                    return stop(Exit::FetchFault);
+                }
+                else if constexpr (base == Op::Lui)
+                {
+                    return set([&](std::size_t) { return imm; });
+                }
+                else if constexpr (base == Op::Auipc)
+                {
+                    return set([&](std::size_t) { return pc + imm; });
+                }
+                else if constexpr (base == Op::Jal)
+                {
+                    Set(d.rd, [&](std::size_t) { return next; });
+                    return pc + imm;
+                }
+                else if constexpr (base == Op::Jalr)
+                {
+                    Lane target{};
+                    for (std::size_t i = 0; i < Width; ++i)
+                    {
+                        target[i] = (rs1[i] + imm) & ~1U;
+                    }
+                    Set(d.rd, [&](std::size_t) { return next; });
+                    return Jump(target);
+                }
+                else if constexpr (base == Op::Beq)
+                {
+                    return branch([&](std::size_t i) { return rs1[i] == rs2[i]; });
+                }
+                else if constexpr (base == Op::Bne)
+                {
+                    return branch([&](std::size_t i) { return rs1[i] != rs2[i]; });
+                }
+                else if constexpr (base == Op::Blt)
+                {
+                    return branch([&](std::size_t i) { return Signed(rs1[i]) < Signed(rs2[i]); });
+                }
+                else if constexpr (base == Op::Bge)
+                {
+                    return branch([&](std::size_t i) { return Signed(rs1[i]) >= Signed(rs2[i]); });
+                }
+                else if constexpr (base == Op::Bltu)
+                {
+                    return branch([&](std::size_t i) { return rs1[i] < rs2[i]; });
+                }
+                else if constexpr (base == Op::Bgeu)
+                {
+                    return branch([&](std::size_t i) { return rs1[i] >= rs2[i]; });
+                }
+                else if constexpr (base == Op::Lb)
+                {
+                    return load(std::int8_t{});
+                }
+                else if constexpr (base == Op::Lh)
+                {
+                    return load(std::int16_t{});
+                }
+                else if constexpr (base == Op::Lw)
+                {
+                    return load(std::uint32_t{});
+                }
+                else if constexpr (base == Op::Lbu)
+                {
+                    return load(std::uint8_t{});
+                }
+                else if constexpr (base == Op::Lhu)
+                {
+                    return load(std::uint16_t{});
+                }
+                else if constexpr (base == Op::Sb)
+                {
+                    return store(std::uint8_t{});
+                }
+                else if constexpr (base == Op::Sh)
+                {
+                    return store(std::uint16_t{});
+                }
+                else if constexpr (base == Op::Sw)
+                {
+                    return store(std::uint32_t{});
+                }
+                else if constexpr (base == Op::Addi)
+                {
+                    return set([&](std::size_t i) { return rs1[i] + imm; });
+                }
+                else if constexpr (base == Op::Slti)
+                {
+                    return set([&](std::size_t i) { return Signed(rs1[i]) < d.imm ? 1U : 0U; });
+                }
+                else if constexpr (base == Op::Sltiu)
+                {
+                    return set([&](std::size_t i) { return rs1[i] < imm ? 1U : 0U; });
+                }
+                else if constexpr (base == Op::Xori)
+                {
+                    return set([&](std::size_t i) { return rs1[i] ^ imm; });
+                }
+                else if constexpr (base == Op::Ori)
+                {
+                    return set([&](std::size_t i) { return rs1[i] | imm; });
+                }
+                else if constexpr (base == Op::Andi)
+                {
+                    return set([&](std::size_t i) { return rs1[i] & imm; });
+                }
+                else if constexpr (base == Op::Slli)
+                {
+                    return set([&](std::size_t i) { return rs1[i] << imm; });
+                }
+                else if constexpr (base == Op::Srli)
+                {
+                    return set([&](std::size_t i) { return rs1[i] >> imm; });
+                }
+                else if constexpr (base == Op::Srai)
+                {
+                    return set([&](std::size_t i) { return Unsigned(Signed(rs1[i]) >> imm); });
+                }
+                else if constexpr (base == Op::Add)
+                {
+                    return set([&](std::size_t i) { return rs1[i] + rs2[i]; });
+                }
+                else if constexpr (base == Op::Sub)
+                {
+                    return set([&](std::size_t i) { return rs1[i] - rs2[i]; });
+                }
+                else if constexpr (base == Op::Sll)
+                {
+                    return set([&](std::size_t i) { return rs1[i] << (rs2[i] & 31); });
+                }
+                else if constexpr (base == Op::Slt)
+                {
+                    return set([&](std::size_t i) { return Signed(rs1[i]) < Signed(rs2[i]) ? 1U : 0U; });
+                }
+                else if constexpr (base == Op::Sltu)
+                {
+                    return set([&](std::size_t i) { return rs1[i] < rs2[i] ? 1U : 0U; });
+                }
+                else if constexpr (base == Op::Xor)
+                {
+                    return set([&](std::size_t i) { return rs1[i] ^ rs2[i]; });
+                }
+                else if constexpr (base == Op::Srl)
+                {
+                    return set([&](std::size_t i) { return rs1[i] >> (rs2[i] & 31); });
+                }
+                else if constexpr (base == Op::Sra)
+                {
+                    return set([&](std::size_t i) { return Unsigned(Signed(rs1[i]) >> (rs2[i] & 31)); });
+                }
+                else if constexpr (base == Op::Or)
+                {
+                    return set([&](std::size_t i) { return rs1[i] | rs2[i]; });
+                }
+                else if constexpr (base == Op::And)
+                {
+                    return set([&](std::size_t i) { return rs1[i] & rs2[i]; });
+                }
+                else if constexpr (base == Op::Mul)
+                {
+                    return set([&](std::size_t i) { return rs1[i] * rs2[i]; });
+                }
+                else if constexpr (base == Op::Mulh)
+                {
+                    return set([&](std::size_t i) { return Mulh(rs1[i], rs2[i]); });
+                }
+                else if constexpr (base == Op::Mulhsu)
+                {
+                    return set([&](std::size_t i) { return Mulhsu(rs1[i], rs2[i]); });
+                }
+                else if constexpr (base == Op::Mulhu)
+                {
+                    return set([&](std::size_t i) { return Mulhu(rs1[i], rs2[i]); });
+                }
+                else if constexpr (base == Op::Div)
+                {
+                    return set([&](std::size_t i) { return Div(rs1[i], rs2[i]); });
+                }
+                else if constexpr (base == Op::Divu)
+                {
+                    return set([&](std::size_t i) { return Divu(rs1[i], rs2[i]); });
+                }
+                else if constexpr (base == Op::Rem)
+                {
+                    return set([&](std::size_t i) { return Rem(rs1[i], rs2[i]); });
+                }
+                else if constexpr (base == Op::Remu)
+                {
+                    return set([&](std::size_t i) { return Remu(rs1[i], rs2[i]); });
+                }
+                else if constexpr (IsAtomic(base))
+                {
+                    // Atomics are for harts that share memory, which lanes don't, so the group doesn't run them. Lanes
+                    // that execute one leave the group without retiring it, and then run it on their own.
+                    for (std::size_t i = 0; i < Width; ++i)
+                    {
+                        if (m_mask[i] != 0)
+                        {
+                            m_detached[i] = true;
+                            Stop(i, Exit::BudgetExhausted, pc);
+                            m_retired[i] = m_steps - 1;
+                        }
+                    }
+                    return diverged;
+                }
+                else if constexpr (base == Op::Fence)
+                {
+                    return next;
+                }
+                else if constexpr (base == Op::Ecall)
+                {
+                    return stop(Exit::Ecall);
+                }
+                else if constexpr (base == Op::Ebreak)
+                {
+                    return stop(Exit::Ebreak);
+                }
+                else if constexpr (base == Op::Nop)
+                {
+                    return next;
+                }
+                else if constexpr (base == Op::Li)
+                {
+                    return set([&](std::size_t) { return imm; });
+                }
+                else if constexpr (base == Op::Mv)
+                {
+                    return set([&](std::size_t i) { return rs1[i]; });
+                }
+                else if constexpr (base == Op::J)
+                {
+                    return pc + imm;
+                }
+                else if constexpr (base == Op::Jr)
+                {
+                    Lane target{};
+                    for (std::size_t i = 0; i < Width; ++i)
+                    {
+                        target[i] = (rs1[i] + imm) & ~1U;
+                    }
+                    return Jump(target);
+                }
+                else if constexpr (base == Op::Beqz)
+                {
+                    return branch([&](std::size_t i) { return rs1[i] == 0; });
+                }
+                else if constexpr (base == Op::Bnez)
+                {
+                    return branch([&](std::size_t i) { return rs1[i] != 0; });
+                }
+            }
+
+            auto Step(Decoded const& d, std::uint32_t pc) -> std::uint32_t
+            {
+                switch (d.op)
+                {
+#define OWL_CPU_LANES_CASE(name)                                                                                       \
+    case Op::name:                                                                                                     \
+        return Execute<Op::name>(d, pc);
+                    OWL_CPU_FOR_EACH_OP(OWL_CPU_LANES_CASE)
+#undef OWL_CPU_LANES_CASE
+                    OWL_CPU_FOR_EACH_FUSION(OWL_CPU_FUSION_CASE)
+                    break; // lanes execute predecoded instructions, which are never fused
+                }
+                return diverged;
+            }
+
+            std::size_t m_used;
+            alignas(64) std::array<Lane, 32> m_x{};
+            alignas(64) Lane m_pc{};
+            alignas(64) Lane m_mask{}; // ~0 for each lane that is executing the current instruction, otherwise 0
+            std::array<std::uint64_t, Width> m_instret{};
+            std::array<std::span<std::uint8_t>, Width> m_memory{};
+
+            // The translation that the group shares, taken from the first lane's memory.
+            PredecodeCache m_code;
+            DecodedPage const* m_page{};
+            std::uint32_t m_pageBase{noCodePage};
+            Exit m_fetchExit{Exit::FetchFault};
+
+            // Lanes that stored to the shared code, whose code differs from it, or that executed an atomic, their own
+            // translations of the code, and the reservations that they hold between calls to Run().
+            std::array<bool, Width> m_detached{};
+            std::array<std::unique_ptr<PredecodeCache>, Width> m_ownCode;
+            std::array<std::uint32_t, Width> m_reservation{};
+            std::array<std::uint32_t, Width> m_reserved{};
+
+            // The state of each lane during a Run().
+            std::array<Exit, Width> m_exits{};
+            std::array<bool, Width> m_stopped{};
+            std::uint64_t m_steps{}; // the number of instructions that the selected lanes have executed so far
+            std::array<std::uint64_t, Width> m_retired{}; // the number that a lane retired before it stopped
+        };
+    } // namespace
+} // namespace owl::detail
+
+namespace owl
+{
+    Lockstep::Lockstep(std::span<std::span<std::uint8_t> const> memories, std::uint32_t entry)
+    {
+        if (memories.empty() || memories.size() > maxLanes)
+        {
+            throw std::invalid_argument("a lockstep group must have between one and sixteen lanes");
+        }
+        for (auto const memory : memories)
+        {
+            if (memory.size() != memories[0].size())
+            {
+                throw std::invalid_argument("every lane's memory must be the same size");
+            }
+        }
+        if (memories[0].size() > AddressSpace::size)
+        {
+            throw std::invalid_argument("guest memory must fit within the 32-bit address space");
+        }
+        if (memories.size() <= 8)
+        {
+            m_lanes = std::make_unique<detail::SimdLanes<8>>(memories, entry);
+        }
+        else
+        {
+            m_lanes = std::make_unique<detail::SimdLanes<16>>(memories, entry);
+        }
+    }
+
+    Lockstep::~Lockstep() = default;
+    Lockstep::Lockstep(Lockstep&& other) noexcept = default;
+    auto Lockstep::operator=(Lockstep&& other) noexcept -> Lockstep& = default;
+
+    auto Lockstep::Lanes() const -> std::size_t { return m_lanes->Lanes(); }
+
+    auto Lockstep::State(std::size_t lane) const -> CpuState
+    {
+        CheckLane(lane);
+        return m_lanes->State(lane);
+    }
+
+    void Lockstep::SetState(std::size_t lane, CpuState const& state)
+    {
+        CheckLane(lane);
+        m_lanes->SetState(lane, state);
+    }
+
+    auto Lockstep::Run(std::uint64_t cycles) -> std::vector<Exit> { return m_lanes->Run(cycles); }
+
+    void Lockstep::InvalidateCode() { m_lanes->InvalidateCode(); }
+
+    void Lockstep::CheckLane(std::size_t lane) const
+    {
+        if (lane >= m_lanes->Lanes())
+        {
+            throw std::invalid_argument("there is no such lane");
+        }
+    }
+} // namespace owl
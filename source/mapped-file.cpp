@@ -0,0 +1,108 @@
+#include "mapped-file.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace owl::detail
+{
+    namespace
+    {
+        [[noreturn]] void Fail(std::filesystem::path const& path, char const* reason)
+        {
+            throw std::runtime_error(path.string() + ": " + reason);
+        }
+    } // namespace
+
+    // A constructor that throws doesn't run the destructor, so each failure closes whatever it had opened first.
+    MappedFile::MappedFile(std::filesystem::path const& path)
+    {
+#if defined(_WIN32)
+        auto* file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                 FILE_ATTRIBUTE_NORMAL, nullptr);
+        m_file = file == INVALID_HANDLE_VALUE ? nullptr : file;
+        LARGE_INTEGER size{};
+        if (m_file == nullptr || !GetFileSizeEx(m_file, &size))
+        {
+            Close();
+            Fail(path, "can't open the file");
+        }
+        m_size = static_cast<std::size_t>(size.QuadPart);
+        if (m_size == 0)
+        {
+            return;
+        }
+        m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        m_data = m_mapping == nullptr ? nullptr : MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+        if (m_data == nullptr)
+        {
+            Close();
+            Fail(path, "can't map the file");
+        }
+#else
+        m_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat info{};
+        if (m_fd < 0 || fstat(m_fd, &info) != 0)
+        {
+            Close();
+            Fail(path, "can't open the file");
+        }
+        m_size = static_cast<std::size_t>(info.st_size);
+        if (m_size == 0)
+        {
+            return;
+        }
+        m_data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+        if (m_data == MAP_FAILED)
+        {
+            m_data = nullptr;
+            Close();
+            Fail(path, "can't map the file");
+        }
+#endif
+    }
+
+    MappedFile::~MappedFile() { Close(); }
+
+    void MappedFile::Close()
+    {
+#if defined(_WIN32)
+        if (m_data != nullptr)
+        {
+            UnmapViewOfFile(m_data);
+            m_data = nullptr;
+        }
+        if (m_mapping != nullptr)
+        {
+            CloseHandle(m_mapping);
+            m_mapping = nullptr;
+        }
+        if (m_file != nullptr)
+        {
+            CloseHandle(m_file);
+            m_file = nullptr;
+        }
+#else
+        if (m_data != nullptr)
+        {
+            munmap(m_data, m_size);
+            m_data = nullptr;
+        }
+        if (m_fd >= 0)
+        {
+            close(m_fd);
+            m_fd = -1;
+        }
+#endif
+    }
+} // namespace owl::detail
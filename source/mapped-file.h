@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+
+namespace owl::detail
+{
+    // A whole file, memory-mapped read-only. Throws std::runtime_error if the file can't be opened or mapped.
+    class MappedFile
+    {
+    public:
+        explicit MappedFile(std::filesystem::path const& path);
+        ~MappedFile();
+
+        MappedFile(MappedFile const&) = delete;
+        auto operator=(MappedFile const&) -> MappedFile& = delete;
+        MappedFile(MappedFile&&) = delete;
+        auto operator=(MappedFile&&) -> MappedFile& = delete;
+
+        auto Bytes() const -> std::span<std::uint8_t const>
+        {
+            return {static_cast<std::uint8_t const*>(m_data), m_size};
+        }
+
+#if !defined(_WIN32)
+        auto Descriptor() const -> int { return m_fd; }
+#endif
+
+    private:
+        // Unmaps and closes whatever is mapped and open.
+        void Close();
+
+#if defined(_WIN32)
+        void* m_file{};    // HANDLE, or null if the file isn't open
+        void* m_mapping{}; // HANDLE
+#else
+        int m_fd{-1};
+#endif
+        void* m_data{};
+        std::size_t m_size{};
+    };
+} // namespace owl::detail
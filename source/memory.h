@@ -0,0 +1,102 @@
+#pragma once
+
+#include "owl-cpu/detail/checked-memory.h"
+
+#include "device-bus.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <span>
+
+namespace owl::detail
+{
+    // The memory models that the engines are instantiated for. Each provides Read() and Write(), which return false if
+    // the access is outside of guest memory, Word(), which returns the word that an atomic operates on, View() and
+    // IsMemory(), which is true if a successful access to an address was to guest memory rather than to a device.
+    // CheckedMemory is in owl-cpu/detail/checked-memory.h, as owl-cpu/inline.h uses it too.
+
+    // Little-endian access to a whole AddressSpace, where every 32-bit address is backed, so the only check is for a
+    // multi-byte access that straddles the top of it, which faults rather than wrapping around.
+    class FlatMemory
+    {
+    public:
+        explicit FlatMemory(std::span<std::uint8_t> memory) : m_memory{memory} {}
+
+        template<typename T>
+        auto Read(std::uint32_t address, T& value) const -> bool
+        {
+            if (Straddles<T>(address))
+            {
+                return false;
+            }
+            std::memcpy(&value, m_memory.data() + address, sizeof(T));
+            return true;
+        }
+
+        template<typename T>
+        auto Write(std::uint32_t address, T value) const -> bool
+        {
+            if (Straddles<T>(address))
+            {
+                return false;
+            }
+            std::memcpy(m_memory.data() + address, &value, sizeof(T));
+            return true;
+        }
+
+        // An atomic's word can't straddle the top, as the address space is aligned and a misaligned word isn't used.
+        auto Word(std::uint32_t address) const -> std::uint32_t* { return AtomicWord(m_memory.data() + address); }
+
+        // Returns the memory itself, for the JIT to access directly.
+        auto View() const -> std::span<std::uint8_t> { return m_memory; }
+
+        static constexpr auto IsMemory(std::uint32_t /*address*/) -> bool { return true; }
+
+    private:
+        // Returns true if an access runs past the last address, which is never the case for a single byte.
+        template<typename T>
+        static constexpr auto Straddles(std::uint32_t address) -> bool
+        {
+            return address > std::numeric_limits<std::uint32_t>::max() - (sizeof(T) - 1);
+        }
+
+        std::span<std::uint8_t> m_memory;
+    };
+
+    // Bounds-checked access like CheckedMemory, except that accesses outside of guest memory go to the devices on a bus
+    // instead of faulting straight away. Only cores that have devices use it, so the others pay nothing for them.
+    class DeviceMemory
+    {
+    public:
+        DeviceMemory(std::span<std::uint8_t> memory, DeviceBus const& devices) : m_memory{memory}, m_devices{devices} {}
+
+        template<typename T>
+        auto Read(std::uint32_t address, T& value) const -> bool
+        {
+            return m_memory.Read(address, value) || m_devices.Read(address, value);
+        }
+
+        template<typename T>
+        auto Write(std::uint32_t address, T value) const -> bool
+        {
+            return m_memory.Write(address, value) || m_devices.Write(address, value);
+        }
+
+        // Devices have no atomics, so only guest memory does.
+        auto Word(std::uint32_t address) const -> std::uint32_t* { return m_memory.Word(address); }
+
+        // Returns the memory itself, for the JIT to access directly. Compiled code leaves accesses outside of it,
+        // including those to devices, to the interpreter.
+        auto View() const -> std::span<std::uint8_t> { return m_memory.View(); }
+
+        // Devices are all above guest memory, and no access can straddle the two.
+        auto IsMemory(std::uint32_t address) const -> bool { return address < m_memory.View().size(); }
+
+    private:
+        CheckedMemory m_memory;
+        DeviceBus const& m_devices;
+    };
+} // namespace owl::detail
@@ -1,7 +1,214 @@
 #include "owl-cpu/owl-cpu.h"
+#include "owl-cpu/ecall.h"
+#include "owl-cpu/trace.h"
 
-#include <string>
+#include "block-cache.h"
+#include "device-bus.h"
+#include "engines.h"
+#include "memory.h"
+#include "pooled.h"
+#include "predecode.h"
+#include "profile.h"
+#include "shared-code.h"
 
-ExportedClass::ExportedClass() : m_name{"owl-cpu"} {}
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <span>
+#include <stdexcept>
 
-auto ExportedClass::name() const -> char const* { return m_name.c_str(); }
+static_assert(std::endian::native == std::endian::little, "Guest memory is accessed in host byte order");
+
+namespace owl
+{
+    auto IsEngineAvailable(Engine engine) -> bool
+    {
+        switch (engine)
+        {
+        case Engine::Switch:
+        case Engine::Block:
+        case Engine::Timed:
+            return true;
+        case Engine::Threaded:
+#if defined(OWL_CPU_THREADED_DISPATCH)
+            return true;
+#else
+            return false;
+#endif
+        case Engine::Tiered:
+#if defined(OWL_CPU_JIT)
+            return true;
+#else
+            return false;
+#endif
+        }
+        return false;
+    }
+
+    auto DefaultEngine() -> Engine
+    {
+#if defined(OWL_CPU_THREADED_DISPATCH)
+        return Engine::Threaded;
+#else
+        return Engine::Switch;
+#endif
+    }
+
+    namespace
+    {
+        template<typename Memory>
+        auto RunEngine(Engine engine, CpuState& state, Memory memory, detail::PredecodeCache& code,
+                       std::unique_ptr<detail::BlockCache>& blocks, detail::TraceChannel* trace,
+                       std::uint64_t cycles) -> Exit
+        {
+            if (trace != nullptr)
+            {
+                return detail::RunTraced(state, memory, code, *trace, cycles);
+            }
+            if ((engine == Engine::Block || engine == Engine::Tiered) && !blocks)
+            {
+                blocks = detail::MakePooled<detail::BlockCache>(code.Resource(), code);
+            }
+            switch (engine)
+            {
+            case Engine::Block:
+                return detail::RunBlocks(state, memory, code, *blocks, cycles);
+            case Engine::Timed:
+                return detail::RunTimed(state, memory, code, cycles);
+#if defined(OWL_CPU_JIT)
+            case Engine::Tiered:
+                return detail::RunTiered(state, memory, code, *blocks, cycles);
+#endif
+#if defined(OWL_CPU_THREADED_DISPATCH)
+            case Engine::Threaded:
+                return detail::RunThreaded(state, memory, code, cycles);
+#endif
+            default:
+                return detail::RunSwitch(state, memory, code, cycles);
+            }
+        }
+
+        auto NanosecondsSince(std::chrono::steady_clock::time_point start) -> std::uint64_t
+        {
+            auto const elapsed = std::chrono::steady_clock::now() - start;
+            return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+    } // namespace
+
+    auto SharedPool() -> std::pmr::memory_resource*
+    {
+        static std::pmr::synchronized_pool_resource pool;
+        return &pool;
+    }
+
+    Cpu::Cpu(std::span<std::uint8_t> memory, std::uint32_t entry, std::pmr::memory_resource* resource)
+        : m_memory{memory}, m_engine{DefaultEngine()}
+    {
+        if (memory.size() > AddressSpace::size)
+        {
+            throw std::invalid_argument("guest memory must fit in a 32-bit address space");
+        }
+        auto* const from = detail::ResourceOrHeap(resource);
+        m_code = detail::MakePooled<detail::PredecodeCache>(from, memory, from);
+        m_state.pc = entry;
+    }
+
+    Cpu::Cpu(AddressSpace& memory, std::uint32_t entry, std::pmr::memory_resource* resource)
+        : Cpu{memory.View(), entry, resource}
+    {
+        m_flat = true;
+    }
+
+    Cpu::~Cpu() = default;
+    Cpu::Cpu(Cpu&& other) noexcept = default;
+    auto Cpu::operator=(Cpu&& other) noexcept -> Cpu& = default;
+
+    auto Cpu::Run(std::uint64_t cycles) -> Exit
+    {
+#if defined(OWL_CPU_PROFILER)
+        std::lock_guard const profiling{detail::ThisThreadProfile().mutex};
+#endif
+        auto& counters = m_code->Counters();
+        auto const started = std::chrono::steady_clock::now();
+        auto const start = m_state.instret;
+        auto const exit = [&] {
+            for (;;)
+            {
+                auto const remaining = cycles - (m_state.instret - start);
+                auto const run = [&](auto memory) {
+                    return RunEngine(m_engine, m_state, memory, *m_code, m_blocks, m_trace, remaining);
+                };
+                auto const stopped = m_flat      ? run(detail::FlatMemory{m_memory})
+                                     : m_devices ? run(detail::DeviceMemory{m_memory, *m_devices})
+                                                 : run(detail::CheckedMemory{m_memory});
+                if (stopped == Exit::Ecall)
+                {
+                    counters.ecalls.Increment();
+                }
+                if (stopped != Exit::Ecall || m_ecalls == nullptr)
+                {
+                    return stopped;
+                }
+                HostCall call{*this};
+                auto const called = std::chrono::steady_clock::now();
+                auto const resume = m_ecalls->OnEcall(call);
+                counters.hostNanoseconds.Add(NanosecondsSince(called));
+                if (!resume)
+                {
+                    return stopped;
+                }
+                if (m_state.instret - start == cycles)
+                {
+                    return Exit::BudgetExhausted;
+                }
+            }
+        }();
+        counters.instructions.Add(m_state.instret - start);
+        counters.runs.Increment();
+        counters.runNanoseconds.Add(NanosecondsSince(started));
+        return exit;
+    }
+
+    auto Cpu::Stats() const -> owl::Stats { return m_code->Counters().Load(); }
+
+    void Cpu::SetEngine(Engine engine)
+    {
+        if (!IsEngineAvailable(engine))
+        {
+            throw std::invalid_argument("this build of owl-cpu does not include the requested engine");
+        }
+        m_engine = engine;
+    }
+
+    auto Cpu::AddHart(std::uint32_t entry) const -> Cpu
+    {
+        Cpu hart{m_memory, entry, m_code->Resource()};
+        hart.m_flat = m_flat;
+        hart.m_engine = m_engine;
+        hart.m_code->Share(m_code->Shared());
+        return hart;
+    }
+
+    void Cpu::SetTrace(TraceWriter* trace) { m_trace = trace != nullptr ? trace->m_channel.get() : nullptr; }
+
+    void Cpu::ShareCode(std::uint64_t image, std::filesystem::path const& saved)
+    {
+        m_code->Share(detail::SharedCode::For(image, m_memory.size(), saved));
+    }
+
+    void Cpu::SaveSharedCode(std::filesystem::path const& path) const
+    {
+        auto const& shared = m_code->Shared();
+        if (!shared)
+        {
+            throw std::invalid_argument("a core that doesn't share its code has no shared code to save");
+        }
+        shared->Save(path);
+    }
+
+    void Cpu::InvalidateCode(std::uint32_t address, std::uint32_t size) { m_code->Invalidate(address, size); }
+} // namespace owl
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <utility>
+
+namespace owl::detail
+{
+    // The memory resource that a core's tables come from: the one that the host gave, or the heap if it gave none.
+    inline auto ResourceOrHeap(std::pmr::memory_resource* resource) -> std::pmr::memory_resource*
+    {
+        return resource != nullptr ? resource : std::pmr::new_delete_resource();
+    }
+
+    // Creates an object in memory from a resource. The object's class gives the memory back to the same resource with
+    // a destroying operator delete that calls DeletePooled(), so that the result can be owned by a plain unique_ptr.
+    template<typename T, typename... Args>
+    auto MakePooled(std::pmr::memory_resource* resource, Args&&... args) -> std::unique_ptr<T>
+    {
+        void* memory = resource->allocate(sizeof(T), alignof(T));
+        try
+        {
+            return std::unique_ptr<T>{::new (memory) T(std::forward<Args>(args)...)};
+        }
+        catch (...)
+        {
+            resource->deallocate(memory, sizeof(T), alignof(T));
+            throw;
+        }
+    }
+
+    template<typename T>
+    void DeletePooled(T* object, std::pmr::memory_resource* resource)
+    {
+        object->~T();
+        resource->deallocate(object, sizeof(T), alignof(T));
+    }
+} // namespace owl::detail
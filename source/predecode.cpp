@@ -0,0 +1,271 @@
+#include "predecode.h"
+
+#include "owl-cpu/detail/decoder.h"
+
+#include "pooled.h"
+#include "shared-code.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory_resource>
+#include <new>
+#include <span>
+
+namespace owl::detail
+{
+    namespace
+    {
+        // What the page table holds for clean pages that aren't translated. It only needs to be distinct from null and
+        // from every real translation, so it is never read.
+        DecodedPage clean;
+    } // namespace
+
+    auto CopyPageBytes(std::span<std::uint8_t const> memory, std::uint32_t page, PageBytes& bytes) -> std::size_t
+    {
+        auto const base = std::size_t{page} << codePageShift;
+        auto const available = base < memory.size() ? std::min(memory.size() - base, bytes.size()) : 0;
+        if (available > 0)
+        {
+            std::memcpy(bytes.data(), memory.data() + base, available);
+        }
+        return available;
+    }
+
+    void DecodePage(PageBytes const& bytes, std::size_t available, DecodedPage& decoded)
+    {
+        for (std::size_t i = 0; i < decoded.insns.size(); ++i)
+        {
+            auto const offset = i * slotSize;
+            std::uint32_t word{};
+            std::memcpy(&word, bytes.data() + offset, sizeof(word));
+            auto const size = (word & 0b11) == 0b11 ? sizeof(word) : slotSize;
+            if (offset + size > available)
+            {
+                // The tail of a page that runs off the end of guest memory.
+                decoded.insns[i] = {.op = Op::FetchFault};
+                continue;
+            }
+            decoded.insns[i] = Decode(word);
+        }
+    }
+
+    PredecodeCache::PredecodeCache(std::span<std::uint8_t> memory, std::pmr::memory_resource* resource)
+        : m_resource{ResourceOrHeap(resource)},
+          m_memory{memory},
+          m_pageCount{std::max<std::size_t>(1, (memory.size() + codePageSize - 1) >> codePageShift)},
+          m_pages{nullptr, {m_resource, m_pageCount}},
+          m_translated{m_resource},
+          m_dirty{m_resource},
+          m_dirtyPages{m_resource},
+          m_private{m_resource}
+    {
+        if (m_resource == std::pmr::new_delete_resource())
+        {
+            // NOLINTNEXTLINE(cppcoreguidelines-no-malloc)
+            m_pages.reset(static_cast<DecodedPage const**>(std::calloc(m_pageCount, sizeof(DecodedPage*))));
+            if (!m_pages)
+            {
+                throw std::bad_alloc();
+            }
+        }
+        else
+        {
+            auto* table = static_cast<DecodedPage const**>(m_resource->allocate(m_pageCount * sizeof(DecodedPage*)));
+            std::fill_n(table, m_pageCount, nullptr);
+            m_pages.reset(table);
+        }
+    }
+
+    PredecodeCache::~PredecodeCache() { Clear(); }
+
+    void PredecodeCache::operator delete(PredecodeCache* cache, std::destroying_delete_t)
+    {
+        DeletePooled(cache, cache->m_resource);
+    }
+
+    auto PredecodeCache::Lookup(std::uint32_t address) -> DecodedPage const*
+    {
+        if (address >= m_memory.size())
+        {
+            return nullptr;
+        }
+        auto const page = address >> codePageShift;
+        if (auto const* decoded = m_pages[page]; decoded != nullptr && decoded != &clean)
+        {
+            m_counters.pageHits.Increment();
+            return decoded;
+        }
+        m_counters.pageMisses.Increment();
+        return Translate(page);
+    }
+
+    void PredecodeCache::Invalidate(std::uint32_t address, std::size_t size)
+    {
+        if (size == 0 || address >= m_memory.size())
+        {
+            return;
+        }
+        if (auto const page = address >> codePageShift; page > 0 && (address & (codePageSize - 1)) < slotSize)
+        {
+            // The range starts with bytes of the previous page's last instruction if that is one that ends here.
+            auto const* previous = m_pages[page - 1];
+            if (previous != nullptr && previous != &clean && InstructionSize(previous->insns.back().op) > slotSize)
+            {
+                Discard(page - 1);
+            }
+        }
+        auto const end = std::min<std::uint64_t>(std::uint64_t{address} + size, m_memory.size());
+        auto const last = static_cast<std::uint32_t>((end - 1) >> codePageShift);
+        for (auto page = address >> codePageShift; page <= last; ++page)
+        {
+            auto const* decoded = m_pages[page];
+            if (decoded == nullptr)
+            {
+                continue;
+            }
+            if (IsTrackingWrites())
+            {
+                MarkDirty(page);
+            }
+            if (decoded != &clean)
+            {
+                Discard(page);
+            }
+        }
+    }
+
+    void PredecodeCache::Clear()
+    {
+        ++m_generation;
+        for (auto const page : m_translated)
+        {
+            Release(page);
+            m_pages[page] = Untranslated(page);
+        }
+        m_translated.clear();
+    }
+
+    void PredecodeCache::Share(std::shared_ptr<SharedCode> shared)
+    {
+        Clear();
+        m_shared = std::move(shared);
+        m_private.assign(m_shared ? (m_pageCount + 63) / 64 : 0, 0);
+    }
+
+    void PredecodeCache::TrackWrites()
+    {
+        m_dirty.assign((m_pageCount + 63) / 64, 0);
+        m_dirtyPages.clear();
+        for (std::size_t page = 0; page < m_pageCount; ++page)
+        {
+            if (m_pages[page] == nullptr)
+            {
+                m_pages[page] = &clean;
+            }
+        }
+    }
+
+    void PredecodeCache::MarkDirty(std::uint32_t page)
+    {
+        if (IsDirty(page))
+        {
+            return;
+        }
+        m_dirty[page / 64] |= std::uint64_t{1} << (page % 64);
+        m_dirtyPages.push_back(page);
+        if (m_pages[page] == &clean)
+        {
+            m_pages[page] = nullptr;
+        }
+    }
+
+    void PredecodeCache::CleanDirtyPages()
+    {
+        for (auto const page : m_dirtyPages)
+        {
+            m_dirty[page / 64] &= ~(std::uint64_t{1} << (page % 64));
+            if (m_pages[page] == nullptr)
+            {
+                m_pages[page] = &clean;
+            }
+            else
+            {
+                Discard(page);
+            }
+        }
+        m_dirtyPages.clear();
+    }
+
+    auto PredecodeCache::Translate(std::uint32_t page) -> DecodedPage const*
+    {
+        DecodedPage const* decoded{};
+        if (m_shared)
+        {
+            auto translated = false;
+            decoded = m_shared->Lookup(m_memory, page, translated);
+            if (decoded == nullptr)
+            {
+                m_private[page / 64] |= std::uint64_t{1} << (page % 64);
+            }
+            else if (!translated)
+            {
+                m_counters.sharedPages.Increment();
+            }
+        }
+        if (decoded == nullptr)
+        {
+            auto* own = ::new (m_resource->allocate(sizeof(DecodedPage), alignof(DecodedPage))) DecodedPage;
+            PageBytes bytes{};
+            DecodePage(bytes, CopyPageBytes(m_memory, page, bytes), *own);
+            decoded = own;
+        }
+        m_pages[page] = decoded;
+        m_translated.push_back(page);
+        return decoded;
+    }
+
+    void PredecodeCache::Discard(std::uint32_t page)
+    {
+        ++m_generation;
+        Release(page);
+        m_pages[page] = Untranslated(page);
+        m_translated.erase(std::find(m_translated.begin(), m_translated.end(), page));
+    }
+
+    void PredecodeCache::Release(std::uint32_t page)
+    {
+        if (m_shared)
+        {
+            auto& word = m_private[page / 64];
+            auto const bit = std::uint64_t{1} << (page % 64);
+            if ((word & bit) == 0)
+            {
+                return;
+            }
+            word &= ~bit;
+        }
+        // The cache allocated it, and only ever reads it through the table.
+        auto* const decoded = const_cast<DecodedPage*>(m_pages[page]);
+        m_resource->deallocate(decoded, sizeof(DecodedPage), alignof(DecodedPage));
+    }
+
+    auto PredecodeCache::Untranslated(std::uint32_t page) const -> DecodedPage const*
+    {
+        return IsTrackingWrites() && !IsDirty(page) ? &clean : nullptr;
+    }
+
+    void PredecodeCache::FreeTable::operator()(DecodedPage const** table) const
+    {
+        if (resource == std::pmr::new_delete_resource())
+        {
+            std::free(static_cast<void*>(table)); // NOLINT(cppcoreguidelines-no-malloc)
+        }
+        else
+        {
+            resource->deallocate(static_cast<void*>(table), count * sizeof(DecodedPage*));
+        }
+    }
+} // namespace owl::detail
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "owl-cpu/detail/decoder.h"
+
+#include "stats.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <span>
+#include <vector>
+
+namespace owl::detail
+{
+    inline constexpr std::uint32_t codePageShift = 12;
+    inline constexpr std::uint32_t codePageSize = 1U << codePageShift;
+
+    // Instructions are either two or four bytes long, and are aligned to two, so a page has a slot for every two bytes.
+    // The slot in the middle of a four-byte instruction holds whatever the bytes from there decode to, in case a jump
+    // lands there. The last slot of a page can hold a four-byte instruction that ends in the next page.
+    inline constexpr std::uint32_t slotShift = 1;
+    inline constexpr std::uint32_t slotSize = 1U << slotShift;
+
+    // Every instruction slot in one guest code page, predecoded.
+    struct DecodedPage
+    {
+        std::array<Decoded, codePageSize / slotSize> insns;
+    };
+
+    // The bytes that translating a page reads, which are the page's own and those at the start of the next page that
+    // its last instruction can reach.
+    using PageBytes = std::array<std::uint8_t, codePageSize + slotSize>;
+
+    // Copies a page's bytes from guest memory, leaving any that lie outside of it as zero, and returns how many lie
+    // inside it.
+    auto CopyPageBytes(std::span<std::uint8_t const> memory, std::uint32_t page, PageBytes& bytes) -> std::size_t;
+
+    // Decodes every slot of a page from its bytes, of which the first `available` lie inside guest memory.
+    void DecodePage(PageBytes const& bytes, std::size_t available, DecodedPage& decoded);
+
+    class SharedCode;
+
+    // Predecoded instructions for guest memory, translated a whole code page at a time on first execution and
+    // addressed by guest pc. Stores into a translated page discard its translation, so self-modifying code sees its
+    // own writes.
+    //
+    // The cache can also track which pages are written, for snapshots. Every clean page is watched in the same way as
+    // a translated one, so only the first store to it takes the slow path and records it as dirty, and stores to pages
+    // that are already dirty cost nothing extra.
+    //
+    // Everything that the cache allocates comes from one memory resource. A cache that is created with MakePooled()
+    // comes from it too, and gives itself back to it when it is deleted. Alternatively, a cache can take its
+    // translations from shared code, which owns them, so that discarding one only forgets it, except for pages whose
+    // shared translations are full, which it translates and frees itself.
+    class PredecodeCache
+    {
+    public:
+        explicit PredecodeCache(std::span<std::uint8_t> memory, std::pmr::memory_resource* resource = nullptr);
+        ~PredecodeCache();
+
+        static void operator delete(PredecodeCache* cache, std::destroying_delete_t);
+
+        PredecodeCache(PredecodeCache const&) = delete;
+        auto operator=(PredecodeCache const&) -> PredecodeCache& = delete;
+        PredecodeCache(PredecodeCache&&) = delete;
+        auto operator=(PredecodeCache&&) -> PredecodeCache& = delete;
+
+        // Returns the decoded page containing the address, translating it if necessary, or nullptr if the address is
+        // outside of guest memory.
+        auto Lookup(std::uint32_t address) -> DecodedPage const*;
+
+        // Returns true if any of the given bytes, which must be inside guest memory, belong to a page that is either
+        // translated or clean, or could belong to an instruction that starts in one, i.e., if a store to them must
+        // call Invalidate().
+        auto IsWatched(std::uint32_t address, std::size_t size) const -> bool
+        {
+            auto const first = address < slotSize ? 0 : address - slotSize;
+            auto const last = address + static_cast<std::uint32_t>(size - 1);
+            return (m_pages[first >> codePageShift] != nullptr) || (m_pages[last >> codePageShift] != nullptr);
+        }
+
+        // Discards the translations of any pages that overlap the given range, or whose last instruction does, and
+        // records the pages that overlap it as dirty if writes are being tracked.
+        void Invalidate(std::uint32_t address, std::size_t size);
+
+        // Discards all translations.
+        void Clear();
+
+        // Discards all translations, then takes them from shared code from now on, or translates its own again if
+        // it is null.
+        void Share(std::shared_ptr<SharedCode> shared);
+
+        // Returns the shared code that translations come from, if there is any.
+        auto Shared() const -> std::shared_ptr<SharedCode> const& { return m_shared; }
+
+        // Starts tracking writes afresh, with every page clean.
+        void TrackWrites();
+
+        // Returns true if TrackWrites() has been called.
+        auto IsTrackingWrites() const -> bool { return !m_dirty.empty(); }
+
+        // Returns the pages that have been written since tracking started or since CleanDirtyPages().
+        auto DirtyPages() const -> std::span<std::uint32_t const> { return m_dirtyPages; }
+
+        // Records a page as dirty, if it isn't already. Writes must be being tracked.
+        void MarkDirty(std::uint32_t page);
+
+        // Makes every dirty page clean again, discarding its translation, because the caller has restored it.
+        void CleanDirtyPages();
+
+        // Returns the table of decoded pages, which has an entry for each page of guest memory that is null unless the
+        // page is watched. Entries for watched pages that aren't translated don't point to a real translation.
+        auto Pages() const -> DecodedPage const* const* { return m_pages.get(); }
+
+        // Returns a count that changes whenever a translation is discarded, so that anything derived from the
+        // predecoded instructions can tell when it is stale.
+        auto Generation() const -> std::uint64_t { return m_generation; }
+
+        // Returns the memory resource that the cache allocates from, which anything derived from it should use too.
+        auto Resource() const -> std::pmr::memory_resource* { return m_resource; }
+
+        // Returns the counters behind the core's Stats, which live here because every engine reaches the cache.
+        auto Counters() -> StatCounters& { return m_counters; }
+        auto Counters() const -> StatCounters const& { return m_counters; }
+
+    private:
+        // Frees the table of decoded pages, which comes from calloc() when the resource is the heap.
+        struct FreeTable
+        {
+            std::pmr::memory_resource* resource;
+            std::size_t count;
+
+            void operator()(DecodedPage const** table) const;
+        };
+
+        auto Translate(std::uint32_t page) -> DecodedPage const*;
+        void Discard(std::uint32_t page);
+        void Release(std::uint32_t page); // frees a page's translation unless it is shared
+        auto IsDirty(std::uint32_t page) const -> bool { return ((m_dirty[page / 64] >> (page % 64)) & 1) != 0; }
+
+        // The entry for a page that isn't translated: watched if it is clean, otherwise null.
+        auto Untranslated(std::uint32_t page) const -> DecodedPage const*;
+
+        std::pmr::memory_resource* m_resource;
+        std::span<std::uint8_t> m_memory;
+        std::size_t m_pageCount;
+        // One entry per guest page. From the heap, it is calloc'd so that a large, sparsely used table stays as
+        // untouched zero pages.
+        std::unique_ptr<DecodedPage const*[], FreeTable> m_pages;
+        std::pmr::vector<std::uint32_t> m_translated;
+        std::uint64_t m_generation{};
+        std::pmr::vector<std::uint64_t> m_dirty; // a bit for each page, but empty unless writes are being tracked
+        std::pmr::vector<std::uint32_t> m_dirtyPages; // the pages whose bits are set, in the order that they were set
+        std::shared_ptr<SharedCode> m_shared;
+        std::pmr::vector<std::uint64_t> m_private; // a bit for each page that the cache translated although it shares
+        StatCounters m_counters;
+    };
+} // namespace owl::detail
@@ -0,0 +1,256 @@
+#include "owl-cpu/profile.h"
+
+#include "owl-cpu/detail/decoder.h"
+
+#include "profile.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace owl::detail
+{
+    namespace
+    {
+        // Every thread's counters, and the sum of those of the threads that have exited.
+        struct Registry
+        {
+            std::mutex mutex;
+            std::vector<ProfileCounters*> live;
+            ProfileCounters exited;
+        };
+
+        auto TheRegistry() -> Registry&
+        {
+            static Registry registry;
+            return registry;
+        }
+
+        void Add(ProfileCounters& to, ProfileCounters const& from)
+        {
+            for (std::size_t i = 0; i < to.ops.size(); ++i)
+            {
+                to.ops[i] += from.ops[i];
+            }
+            for (std::size_t i = 0; i < to.fusions.size(); ++i)
+            {
+                to.fusions[i] += from.fusions[i];
+            }
+            for (auto const& [pc, hits] : from.blocks)
+            {
+                to.blocks[pc] += hits;
+            }
+            for (auto const& [pc, counts] : from.branches)
+            {
+                auto& total = to.branches[pc];
+                total.taken += counts.taken;
+                total.notTaken += counts.notTaken;
+            }
+        }
+
+        void Zero(ProfileCounters& counters)
+        {
+            counters.ops.fill(0);
+            counters.fusions.fill(0);
+            counters.blocks.clear();
+            counters.branches.clear();
+        }
+
+        // Registers the thread's counters for as long as the thread lives.
+        class ThreadProfile
+        {
+        public:
+            ThreadProfile()
+            {
+                auto& registry = TheRegistry();
+                std::lock_guard const lock{registry.mutex};
+                registry.live.push_back(&m_counters);
+            }
+
+            ~ThreadProfile()
+            {
+                auto& registry = TheRegistry();
+                std::lock_guard const lock{registry.mutex};
+                Add(registry.exited, m_counters);
+                std::erase(registry.live, &m_counters);
+            }
+
+            ThreadProfile(ThreadProfile const&) = delete;
+            auto operator=(ThreadProfile const&) -> ThreadProfile& = delete;
+            ThreadProfile(ThreadProfile&&) = delete;
+            auto operator=(ThreadProfile&&) -> ThreadProfile& = delete;
+
+            auto Counters() -> ProfileCounters& { return m_counters; }
+
+        private:
+            ProfileCounters m_counters;
+        };
+
+        constexpr std::array<char const*, opCount> opNames{
+#define OWL_CPU_OP_NAME(name) #name,
+                OWL_CPU_FOR_EACH_OP(OWL_CPU_OP_NAME)
+#undef OWL_CPU_OP_NAME
+        };
+
+        constexpr std::array<char const*, fusionCount> fusionNames{
+#define OWL_CPU_FUSION_NAME(first, second) #first #second,
+                OWL_CPU_FOR_EACH_FUSION(OWL_CPU_FUSION_NAME)
+#undef OWL_CPU_FUSION_NAME
+        };
+    } // namespace
+
+    auto ThisThreadProfile() -> ProfileCounters&
+    {
+        thread_local ThreadProfile profile;
+        return profile.Counters();
+    }
+} // namespace owl::detail
+
+namespace owl
+{
+    namespace
+    {
+        template<typename T>
+        void Put(std::vector<char>& out, T value)
+        {
+            auto const at = out.size();
+            out.resize(at + sizeof(T));
+            std::memcpy(out.data() + at, &value, sizeof(T));
+        }
+
+        auto Hex(std::uint32_t pc) -> std::array<char, 11>
+        {
+            std::array<char, 11> text{};
+            std::snprintf(text.data(), text.size(), "0x%08x", static_cast<unsigned>(pc));
+            return text;
+        }
+    } // namespace
+
+    auto IsProfilerAvailable() -> bool
+    {
+#if defined(OWL_CPU_PROFILER)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    auto CollectProfile() -> Profile
+    {
+        detail::ProfileCounters total;
+        {
+            auto& registry = detail::TheRegistry();
+            std::lock_guard const lock{registry.mutex};
+            detail::Add(total, registry.exited);
+            for (auto* counters : registry.live)
+            {
+                std::lock_guard const running{counters->mutex};
+                detail::Add(total, *counters);
+            }
+        }
+
+        Profile profile;
+        for (std::size_t i = 0; i < total.ops.size(); ++i)
+        {
+            profile.operations.push_back({.name = detail::opNames[i], .count = total.ops[i]});
+        }
+        for (std::size_t i = 0; i < total.fusions.size(); ++i)
+        {
+            profile.fusions.push_back({.name = detail::fusionNames[i], .count = total.fusions[i]});
+        }
+        for (auto const& [pc, hits] : total.blocks)
+        {
+            profile.blocks.push_back({.pc = pc, .hits = hits});
+        }
+        for (auto const& [pc, counts] : total.branches)
+        {
+            profile.branches.push_back({.pc = pc, .taken = counts.taken, .notTaken = counts.notTaken});
+        }
+        std::ranges::sort(profile.blocks, {}, &Profile::Block::pc);
+        std::ranges::sort(profile.branches, {}, &Profile::Branch::pc);
+        return profile;
+    }
+
+    void ResetProfile()
+    {
+        auto& registry = detail::TheRegistry();
+        std::lock_guard const lock{registry.mutex};
+        detail::Zero(registry.exited);
+        for (auto* counters : registry.live)
+        {
+            std::lock_guard const running{counters->mutex};
+            detail::Zero(*counters);
+        }
+    }
+
+    void WriteProfileCsv(Profile const& profile, std::ostream& out)
+    {
+        out << "kind,name,count,taken\n";
+        for (auto const& op : profile.operations)
+        {
+            out << "op," << op.name << ',' << op.count << ",\n";
+        }
+        for (auto const& fusion : profile.fusions)
+        {
+            out << "fusion," << fusion.name << ',' << fusion.count << ",\n";
+        }
+        for (auto const& block : profile.blocks)
+        {
+            out << "block," << Hex(block.pc).data() << ',' << block.hits << ",\n";
+        }
+        for (auto const& branch : profile.branches)
+        {
+            out << "branch," << Hex(branch.pc).data() << ',' << branch.taken + branch.notTaken << ',' << branch.taken
+                << '\n';
+        }
+    }
+
+    void WriteProfileBinary(Profile const& profile, std::ostream& out)
+    {
+        constexpr std::uint32_t version = 2;
+        constexpr std::size_t nameSize = 16;
+
+        auto const putName = [](std::vector<char>& bytes, char const* text) {
+            std::array<char, nameSize> name{};
+            std::strncpy(name.data(), text, name.size() - 1);
+            bytes.insert(bytes.end(), name.begin(), name.end());
+        };
+
+        std::vector<char> bytes{'O', 'W', 'L', 'P', 'R', 'O', 'F', '\0'};
+        Put(bytes, version);
+        Put(bytes, static_cast<std::uint32_t>(profile.operations.size()));
+        Put(bytes, static_cast<std::uint32_t>(profile.blocks.size()));
+        Put(bytes, static_cast<std::uint32_t>(profile.branches.size()));
+        Put(bytes, static_cast<std::uint32_t>(profile.fusions.size()));
+        for (auto const& op : profile.operations)
+        {
+            putName(bytes, op.name);
+            Put(bytes, op.count);
+        }
+        for (auto const& block : profile.blocks)
+        {
+            Put(bytes, block.pc);
+            Put(bytes, std::uint32_t{});
+            Put(bytes, block.hits);
+        }
+        for (auto const& branch : profile.branches)
+        {
+            Put(bytes, branch.pc);
+            Put(bytes, std::uint32_t{});
+            Put(bytes, branch.taken);
+            Put(bytes, branch.notTaken);
+        }
+        for (auto const& fusion : profile.fusions)
+        {
+            putName(bytes, fusion.name);
+            Put(bytes, fusion.count);
+        }
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    }
+} // namespace owl
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "owl-cpu/detail/decoder.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+// The profiler's counters. With owl-cpu_PROFILER, each engine counts into the counters of the thread that it runs on,
+// which only that thread writes to, so counting needs no atomics. Cpu::Run() holds their mutex while it runs so that
+// CollectProfile() can read them from another thread.
+
+namespace owl::detail
+{
+    struct BranchCounts
+    {
+        std::uint64_t taken{};
+        std::uint64_t notTaken{};
+    };
+
+    struct ProfileCounters
+    {
+        std::recursive_mutex mutex; // recursive so that a guest's host calls can run other cores
+        std::array<std::uint64_t, opCount> ops{};
+        std::array<std::uint64_t, fusionCount> fusions{}; // how many times each fused pair was dispatched
+        std::unordered_map<std::uint32_t, std::uint64_t> blocks; // hits by the pc that the block starts at
+        std::unordered_map<std::uint32_t, BranchCounts> branches;
+    };
+
+    // Returns the calling thread's counters, which are folded into a total for exited threads when the thread exits.
+    auto ThisThreadProfile() -> ProfileCounters&;
+} // namespace owl::detail
@@ -0,0 +1,153 @@
+#include "owl-cpu/coroutine.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace owl::detail
+{
+    // The threads behind a Scheduler, which resume coroutines from one shared queue in the order that they were
+    // posted. A resumed task runs until it next suspends, which for a guest is at its next RunFor().
+    class SchedulerPool
+    {
+    public:
+        explicit SchedulerPool(unsigned threads)
+        {
+            m_threads.reserve(threads);
+            for (unsigned i = 0; i < threads; ++i)
+            {
+                m_threads.emplace_back([this] { Work(); });
+            }
+        }
+
+        ~SchedulerPool()
+        {
+            {
+                std::lock_guard const lock{m_mutex};
+                m_stopping = true;
+            }
+            m_wake.notify_all();
+            for (auto& thread : m_threads)
+            {
+                thread.join();
+            }
+        }
+
+        SchedulerPool(SchedulerPool const&) = delete;
+        auto operator=(SchedulerPool const&) -> SchedulerPool& = delete;
+        SchedulerPool(SchedulerPool&&) = delete;
+        auto operator=(SchedulerPool&&) -> SchedulerPool& = delete;
+
+        void Spawned()
+        {
+            std::lock_guard const lock{m_mutex};
+            ++m_unfinished;
+        }
+
+        void Post(std::coroutine_handle<> handle)
+        {
+            {
+                std::lock_guard const lock{m_mutex};
+                m_ready.push_back(handle);
+            }
+            m_wake.notify_one();
+        }
+
+        void Finish(std::exception_ptr error) noexcept
+        {
+            std::lock_guard const lock{m_mutex};
+            if (error && !m_error)
+            {
+                m_error = std::move(error);
+            }
+            if (--m_unfinished == 0)
+            {
+                m_done.notify_all();
+            }
+        }
+
+        void Wait()
+        {
+            std::unique_lock lock{m_mutex};
+            m_done.wait(lock, [this] { return m_unfinished == 0; });
+            if (m_error)
+            {
+                std::rethrow_exception(std::exchange(m_error, nullptr));
+            }
+        }
+
+        auto Threads() const -> unsigned { return static_cast<unsigned>(m_threads.size()); }
+
+    private:
+        void Work()
+        {
+            for (;;)
+            {
+                std::coroutine_handle<> handle;
+                {
+                    std::unique_lock lock{m_mutex};
+                    m_wake.wait(lock, [this] { return m_stopping || !m_ready.empty(); });
+                    if (m_stopping)
+                    {
+                        return;
+                    }
+                    handle = m_ready.front();
+                    m_ready.pop_front();
+                }
+                handle.resume();
+            }
+        }
+
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::condition_variable m_done;
+        std::deque<std::coroutine_handle<>> m_ready;
+        std::size_t m_unfinished{};
+        std::exception_ptr m_error;
+        bool m_stopping{};
+        std::vector<std::thread> m_threads;
+    };
+} // namespace owl::detail
+
+namespace owl
+{
+    Scheduler::Scheduler(unsigned threads)
+    {
+        if (threads == 0)
+        {
+            threads = std::max(1U, std::thread::hardware_concurrency());
+        }
+        m_pool = std::make_unique<detail::SchedulerPool>(threads);
+    }
+
+    Scheduler::~Scheduler() = default;
+
+    void Scheduler::Spawn(GuestTask task)
+    {
+        if (!task.m_handle)
+        {
+            throw std::invalid_argument("the task has already been spawned or moved from");
+        }
+        auto const handle = std::exchange(task.m_handle, {});
+        handle.promise().m_scheduler = this;
+        m_pool->Spawned();
+        m_pool->Post(handle);
+    }
+
+    void Scheduler::Post(std::coroutine_handle<> handle) { m_pool->Post(handle); }
+
+    void Scheduler::Wait() { m_pool->Wait(); }
+
+    auto Scheduler::Threads() const -> unsigned { return m_pool->Threads(); }
+
+    void Scheduler::Finish(std::exception_ptr error) noexcept { m_pool->Finish(std::move(error)); }
+} // namespace owl
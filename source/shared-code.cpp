@@ -0,0 +1,290 @@
+#include "shared-code.h"
+
+#include "owl-cpu/detail/decoder.h"
+
+#include "mapped-file.h"
+#include "predecode.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace owl::detail
+{
+    namespace
+    {
+        constexpr std::array<char, 8> savedMagic{'O', 'W', 'L', 'C', 'O', 'D', 'E', '\0'};
+
+        // Change this whenever decoding a page gives a different result, so that files saved before then are ignored.
+        constexpr std::uint32_t savedVersion = 1;
+
+        // Hashes the names of the operations, so that a file saved before they were added to or reordered is ignored.
+        constexpr auto HashOps() -> std::uint64_t
+        {
+            auto hash = std::uint64_t{14695981039346656037U};
+            auto const mix = [&hash](char c) {
+                hash ^= static_cast<std::uint8_t>(c);
+                hash *= 1099511628211U;
+            };
+#define OWL_CPU_OP_NAME(name) std::string_view{#name},
+            for (auto const name : {OWL_CPU_FOR_EACH_OP(OWL_CPU_OP_NAME)})
+#undef OWL_CPU_OP_NAME
+            {
+                std::ranges::for_each(name, mix);
+                mix('\0');
+            }
+            return hash;
+        }
+
+        constexpr auto savedOps = HashOps();
+
+        // Returns true if the engines can dispatch an instruction from a saved page, which was decoded by a decoder
+        // with the same operations, unless the file is damaged.
+        auto Dispatchable(Decoded const& d) -> bool
+        {
+            return static_cast<std::size_t>(d.op) < opCount && d.rd < 32 && d.rs1 < 32 && d.rs2 < 32;
+        }
+    } // namespace
+
+    auto SharedCode::For(std::uint64_t image, std::size_t memorySize, std::filesystem::path const& saved)
+            -> std::shared_ptr<SharedCode>
+    {
+        // Only looking up the shared code takes the lock, which cores do when they start sharing rather than whenever
+        // they translate a page.
+        static std::mutex mutex;
+        static std::map<std::pair<std::uint64_t, std::size_t>, std::weak_ptr<SharedCode>> shared;
+
+        std::lock_guard const lock{mutex};
+        std::erase_if(shared, [](auto const& entry) { return entry.second.expired(); });
+        auto& entry = shared[{image, memorySize}];
+        auto code = entry.lock();
+        if (!code)
+        {
+            code = std::make_shared<SharedCode>(image, memorySize, saved);
+            entry = code;
+        }
+        return code;
+    }
+
+    SharedCode::SharedCode(std::uint64_t image, std::size_t memorySize, std::filesystem::path const& saved)
+        : m_image{image},
+          m_memorySize{memorySize},
+          m_pages(std::max<std::size_t>(1, (memorySize + codePageSize - 1) >> codePageShift))
+    {
+        static_assert(std::has_unique_object_representations_v<SavedHeader>, "a saved header has no padding");
+        static_assert(std::has_unique_object_representations_v<SavedPage>, "a saved page has no padding");
+        static_assert(sizeof(SavedHeader) % alignof(SavedPage) == 0 && sizeof(SavedPage) % alignof(std::uint64_t) == 0,
+                      "saved pages are aligned in the file");
+
+        // Nothing reads the saved pages until this returns, so indexing them needs no synchronization.
+        if (!saved.empty())
+        {
+            Load(saved);
+        }
+    }
+
+    SharedCode::~SharedCode()
+    {
+        for (auto& page : m_pages)
+        {
+            for (auto const* translation = page.load(std::memory_order_relaxed); translation != nullptr;)
+            {
+                delete std::exchange(translation, translation->next);
+            }
+        }
+    }
+
+    auto SharedCode::Lookup(std::span<std::uint8_t const> memory, std::uint32_t page, bool& translated)
+            -> DecodedPage const*
+    {
+        PageBytes bytes{};
+        auto const available = CopyPageBytes(memory, page, bytes);
+        for (auto const& saved : Saved(page))
+        {
+            if (saved.bytes == bytes)
+            {
+                return &saved.decoded;
+            }
+        }
+        auto& head = m_pages[page];
+        auto const* first = head.load(std::memory_order_acquire);
+        std::size_t length = 0;
+        if (auto const* found = Find(first, nullptr, bytes, length); found != nullptr)
+        {
+            return &found->decoded;
+        }
+        if (length >= maxTranslations)
+        {
+            return nullptr;
+        }
+
+        // Decode from the copy, which another hart can't store to partway through.
+        auto translation = std::make_unique<Translation>();
+        translation->bytes = bytes;
+        DecodePage(bytes, available, translation->decoded);
+        translated = true;
+        for (;;)
+        {
+            translation->next = first;
+            auto* const candidate = translation.get();
+            if (head.compare_exchange_weak(first, candidate, std::memory_order_release, std::memory_order_acquire))
+            {
+                return &translation.release()->decoded;
+            }
+            // Another core added to the list first. Its translation is as good as this one if it is of the same bytes,
+            // and the list may now be full.
+            if (auto const* found = Find(first, translation->next, bytes, length); found != nullptr)
+            {
+                return &found->decoded;
+            }
+            if (length >= maxTranslations)
+            {
+                return nullptr;
+            }
+        }
+    }
+
+    auto SharedCode::Find(Translation const* first, Translation const* last, PageBytes const& bytes,
+                          std::size_t& length) -> Translation const*
+    {
+        for (auto const* translation = first; translation != last; translation = translation->next)
+        {
+            ++length;
+            if (translation->bytes == bytes)
+            {
+                return translation;
+            }
+        }
+        return nullptr;
+    }
+
+    void SharedCode::Save(std::filesystem::path const& path) const
+    {
+        struct Entry
+        {
+            std::uint32_t page;
+            DecodedPage const* decoded;
+            PageBytes const* bytes;
+        };
+
+        // Other cores can still be adding translations, so this saves those that were translated before it looked.
+        std::vector<Entry> entries;
+        for (std::uint32_t page = 0; page < m_pages.size(); ++page)
+        {
+            for (auto const& saved : Saved(page))
+            {
+                entries.push_back({page, &saved.decoded, &saved.bytes});
+            }
+            for (auto const* t = m_pages[page].load(std::memory_order_acquire); t != nullptr; t = t->next)
+            {
+                entries.push_back({page, &t->decoded, &t->bytes});
+            }
+        }
+
+        // Write a new file then rename it, as a process that maps the old one would see it change if it were
+        // rewritten in place.
+        auto temporary = path;
+        temporary += ".tmp";
+        {
+            std::ofstream out{temporary, std::ios::binary | std::ios::trunc};
+            SavedHeader const header{
+                    .magic = savedMagic,
+                    .version = savedVersion,
+                    .pageSize = sizeof(SavedPage),
+                    .ops = savedOps,
+                    .image = m_image,
+                    .memorySize = m_memorySize,
+                    .count = entries.size(),
+            };
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+            out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+            auto const saved = std::make_unique<SavedPage>();
+            for (auto const& entry : entries)
+            {
+                saved->page = entry.page;
+                saved->decoded = *entry.decoded;
+                saved->bytes = *entry.bytes;
+                // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+                out.write(reinterpret_cast<char const*>(saved.get()), sizeof(SavedPage));
+            }
+            out.close();
+            if (!out)
+            {
+                std::error_code ignored;
+                std::filesystem::remove(temporary, ignored);
+                throw std::runtime_error(path.string() + ": can't write the file");
+            }
+        }
+        std::filesystem::rename(temporary, path);
+    }
+
+    void SharedCode::Load(std::filesystem::path const& path)
+    {
+        std::error_code error;
+        if (!std::filesystem::exists(path, error))
+        {
+            return;
+        }
+        auto file = std::make_unique<MappedFile>(path);
+        auto const bytes = file->Bytes();
+        SavedHeader header{};
+        if (bytes.size() < sizeof(header))
+        {
+            return;
+        }
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        auto const size = bytes.size() - sizeof(header);
+        if (header.magic != savedMagic || header.version != savedVersion || header.pageSize != sizeof(SavedPage)
+            || header.ops != savedOps || header.image != m_image || header.memorySize != m_memorySize
+            || size % sizeof(SavedPage) != 0 || header.count != size / sizeof(SavedPage))
+        {
+            return;
+        }
+
+        // The file is aligned by the mapping, and saved pages by their size.
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        auto const saved = std::span{reinterpret_cast<SavedPage const*>(bytes.data() + sizeof(header)),
+                                     static_cast<std::size_t>(header.count)};
+        std::vector<std::size_t> first(m_pages.size() + 1);
+        std::uint32_t previous = 0;
+        for (auto const& page : saved)
+        {
+            if (page.page < previous || page.page >= m_pages.size()
+                || !std::ranges::all_of(page.decoded.insns, Dispatchable))
+            {
+                return;
+            }
+            previous = page.page;
+            ++first[page.page + 1];
+        }
+        std::partial_sum(first.begin(), first.end(), first.begin());
+
+        m_file = std::move(file);
+        m_saved = saved;
+        m_first = std::move(first);
+    }
+
+    auto SharedCode::Saved(std::uint32_t page) const -> std::span<SavedPage const>
+    {
+        if (m_first.empty())
+        {
+            return {};
+        }
+        return m_saved.subspan(m_first[page], m_first[page + 1] - m_first[page]);
+    }
+} // namespace owl::detail
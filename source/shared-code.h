@@ -0,0 +1,109 @@
+#pragma once
+
+#include "mapped-file.h"
+#include "predecode.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace owl::detail
+{
+    // Predecoded pages that every core running the same program shares, so that only the first core to execute a page
+    // translates it. There is one for each image key and size of guest memory, which lasts as long as any core shares
+    // it, and it has a slot for each page of guest memory holding a list of that page's translations.
+    //
+    // Each translation keeps a copy of the bytes that it was translated from, and a core only uses one whose bytes
+    // match its own memory, so cores that have modified their code, or share a key by mistake, translate their own.
+    // Translations are only ever added to the front of a list, and are freed with the whole object, so looking them up
+    // takes no locks: a core reads a list while others add to it. A page stops taking new translations once its list
+    // holds maxTranslations, so that a guest that keeps storing to a page of its code neither grows the list without
+    // bound nor makes looking it up slower, and a core that misses in a full list translates the page for itself.
+    //
+    // Shared code can be saved to a file and mapped back in by the next process to run the image, so that it starts
+    // with the pages that the last one translated. A saved page is used in the same way as one in a list, and only if
+    // its bytes match, so each page's saved translations are in effect the oldest in its list. The file is host
+    // specific, and is only used if it was saved in the same format, which includes the decoder's operations, for the
+    // same image and size of memory, and if every saved instruction is one that the engines can dispatch.
+    class SharedCode
+    {
+    public:
+        // Returns the shared code for an image in guest memory of the given size, creating it if no core shares it,
+        // in which case it starts with the translations saved in `saved`, if that names a file that it can use.
+        static auto For(std::uint64_t image, std::size_t memorySize, std::filesystem::path const& saved = {})
+                -> std::shared_ptr<SharedCode>;
+
+        SharedCode(std::uint64_t image, std::size_t memorySize, std::filesystem::path const& saved = {});
+        ~SharedCode();
+
+        SharedCode(SharedCode const&) = delete;
+        auto operator=(SharedCode const&) -> SharedCode& = delete;
+        SharedCode(SharedCode&&) = delete;
+        auto operator=(SharedCode&&) -> SharedCode& = delete;
+
+        // The most translations that a page's list holds.
+        static constexpr std::size_t maxTranslations = 8;
+
+        // Returns the translation of a page of the given memory, translating it and sharing the result if no core has
+        // translated the same bytes. Sets `translated` if it decoded the page, even if another core shared its
+        // translation first. Returns nullptr if the page's list is full and none of it matches, in which case the
+        // caller translates the page itself.
+        auto Lookup(std::span<std::uint8_t const> memory, std::uint32_t page, bool& translated) -> DecodedPage const*;
+
+        // Writes every translation, including those that it was created with, to a file, replacing it as a whole so
+        // that a process mapping the old file is unaffected. Throws std::runtime_error if the file can't be written.
+        void Save(std::filesystem::path const& path) const;
+
+    private:
+        struct Translation
+        {
+            DecodedPage decoded;
+            PageBytes bytes;
+            Translation const* next; // an older translation of the same page from different bytes
+        };
+
+        // A saved file is this header followed by `count` saved pages in the order of their page numbers.
+        struct SavedHeader
+        {
+            std::array<char, 8> magic;
+            std::uint32_t version;
+            std::uint32_t pageSize; // the size of a saved page
+            std::uint64_t ops;      // a hash of the names of the decoder's operations, in order
+            std::uint64_t image;
+            std::uint64_t memorySize;
+            std::uint64_t count;
+        };
+
+        struct SavedPage
+        {
+            std::uint32_t page;
+            std::uint32_t reserved;
+            DecodedPage decoded;
+            PageBytes bytes;
+            std::array<std::uint8_t, 6> padding; // keeps the next saved page aligned
+        };
+
+        // Returns the first translation of the bytes in the list that starts at `first`, stopping before `last`, and
+        // adds the number of translations that it compared to `length`.
+        static auto Find(Translation const* first, Translation const* last, PageBytes const& bytes, std::size_t& length)
+                -> Translation const*;
+
+        // Maps a saved file and indexes its pages, unless it can't be used, in which case it's ignored.
+        void Load(std::filesystem::path const& path);
+
+        // Returns the saved translations of a page.
+        auto Saved(std::uint32_t page) const -> std::span<SavedPage const>;
+
+        std::uint64_t m_image;
+        std::size_t m_memorySize;
+        std::vector<std::atomic<Translation const*>> m_pages;
+        std::unique_ptr<MappedFile> m_file;
+        std::span<SavedPage const> m_saved; // every page in the saved file
+        std::vector<std::size_t> m_first;   // where each page's saved pages start in m_saved, then where all end
+    };
+} // namespace owl::detail
@@ -0,0 +1,207 @@
+#include "owl-cpu/owl-cpu.h"
+
+#include "predecode.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace owl::detail
+{
+    // Guest memory as it was when a snapshot was taken, a code page at a time. Pages that were all zero aren't stored,
+    // so that a snapshot of a sparsely used AddressSpace is no larger than the memory that the guest was using.
+    struct SnapshotImage
+    {
+        static constexpr std::uint32_t zeroPage = ~std::uint32_t{};
+
+        std::size_t size{};               // the size of the guest memory that it was taken from
+        std::vector<std::uint32_t> slots; // the index of each page in `data`, or zeroPage
+        std::vector<std::uint8_t> data;   // the stored pages, each padded to the full code page size
+    };
+} // namespace owl::detail
+
+namespace owl
+{
+    namespace
+    {
+        using detail::codePageShift;
+        using detail::codePageSize;
+        using detail::SnapshotImage;
+
+        auto PageCount(std::span<std::uint8_t> memory) -> std::size_t
+        {
+            return (memory.size() + codePageSize - 1) >> codePageShift;
+        }
+
+        // Returns the bytes of guest memory in a page, which may be fewer than a whole page at the end of memory.
+        auto PageBytes(std::span<std::uint8_t> memory, std::size_t page) -> std::span<std::uint8_t>
+        {
+            auto const offset = page << codePageShift;
+            return memory.subspan(offset, std::min<std::size_t>(codePageSize, memory.size() - offset));
+        }
+
+        auto IsZero(std::span<std::uint8_t const> bytes) -> bool
+        {
+            static constexpr std::array<std::uint8_t, codePageSize> zeros{};
+            return std::memcmp(bytes.data(), zeros.data(), bytes.size()) == 0;
+        }
+
+        auto Capture(std::span<std::uint8_t> memory) -> std::shared_ptr<SnapshotImage>
+        {
+            auto image = std::make_shared<SnapshotImage>();
+            image->size = memory.size();
+            image->slots.resize(PageCount(memory), SnapshotImage::zeroPage);
+            for (std::size_t page = 0; page < image->slots.size(); ++page)
+            {
+                auto const bytes = PageBytes(memory, page);
+                if (IsZero(bytes))
+                {
+                    continue;
+                }
+                auto const offset = image->data.size();
+                image->slots[page] = static_cast<std::uint32_t>(offset >> codePageShift);
+                image->data.resize(offset + codePageSize);
+                std::memcpy(image->data.data() + offset, bytes.data(), bytes.size());
+            }
+            return image;
+        }
+
+        // Puts a page of guest memory back the way that it was in the image. Zero pages that are already zero are left
+        // untouched so that restoring doesn't commit pages of an AddressSpace that the guest never used.
+        void RestorePage(SnapshotImage const& image, std::span<std::uint8_t> memory, std::size_t page)
+        {
+            auto const bytes = PageBytes(memory, page);
+            auto const slot = image.slots[page];
+            if (slot != SnapshotImage::zeroPage)
+            {
+                std::memcpy(bytes.data(), image.data.data() + (std::size_t{slot} << codePageShift), bytes.size());
+            }
+            else if (!IsZero(bytes))
+            {
+                std::memset(bytes.data(), 0, bytes.size());
+            }
+        }
+
+        void CopyPage(std::span<std::uint8_t> from, std::span<std::uint8_t> to, std::size_t page)
+        {
+            auto const bytes = PageBytes(from, page);
+            std::memcpy(to.data() + (page << codePageShift), bytes.data(), bytes.size());
+        }
+    } // namespace
+
+    Snapshot::Snapshot(CpuState const& state, std::shared_ptr<detail::SnapshotImage const> image)
+        : m_state{state}, m_image{std::move(image)}
+    {
+    }
+
+    auto Cpu::Snapshot() -> owl::Snapshot
+    {
+        auto image = Capture(m_memory);
+        m_code->TrackWrites();
+        m_baseline = image;
+        return owl::Snapshot{m_state, std::move(image)};
+    }
+
+    void Cpu::Restore(owl::Snapshot const& snapshot)
+    {
+        auto const& image = *snapshot.m_image;
+        if (image.size != m_memory.size())
+        {
+            throw std::invalid_argument("the snapshot was taken from guest memory of a different size");
+        }
+
+        if (snapshot.m_image == m_baseline)
+        {
+            for (auto const page : m_code->DirtyPages())
+            {
+                RestorePage(image, m_memory, page);
+            }
+            m_code->CleanDirtyPages();
+        }
+        else
+        {
+            for (std::size_t page = 0; page < image.slots.size(); ++page)
+            {
+                RestorePage(image, m_memory, page);
+            }
+            m_code->Clear();
+            m_code->TrackWrites();
+            m_baseline = snapshot.m_image;
+        }
+        m_state = snapshot.m_state;
+    }
+
+    auto Cpu::Fork(std::span<std::uint8_t> memory) const -> Cpu
+    {
+        if (memory.size() != m_memory.size())
+        {
+            throw std::invalid_argument("a fork's guest memory must be the same size as its parent's");
+        }
+        if (!memory.empty())
+        {
+            std::memcpy(memory.data(), m_memory.data(), memory.size());
+        }
+        Cpu fork{memory, 0, m_code->Resource()};
+        fork.InheritFrom(*this);
+        return fork;
+    }
+
+    auto Cpu::Fork(AddressSpace& memory) const -> Cpu
+    {
+        if (!m_flat)
+        {
+            throw std::invalid_argument("only a core that executes from an address space can be forked into one");
+        }
+        if (m_baseline)
+        {
+            // Every page that is neither in the snapshot nor dirty is still zero.
+            for (std::size_t page = 0; page < m_baseline->slots.size(); ++page)
+            {
+                if (m_baseline->slots[page] != SnapshotImage::zeroPage)
+                {
+                    CopyPage(m_memory, memory.View(), page);
+                }
+            }
+            for (auto const page : m_code->DirtyPages())
+            {
+                CopyPage(m_memory, memory.View(), page);
+            }
+        }
+        else
+        {
+            for (std::size_t page = 0; page < PageCount(m_memory); ++page)
+            {
+                if (!IsZero(PageBytes(m_memory, page)))
+                {
+                    CopyPage(m_memory, memory.View(), page);
+                }
+            }
+        }
+        Cpu fork{memory, 0, m_code->Resource()};
+        fork.InheritFrom(*this);
+        return fork;
+    }
+
+    void Cpu::InheritFrom(Cpu const& parent)
+    {
+        m_state = parent.m_state;
+        m_engine = parent.m_engine;
+        m_code->Share(parent.m_code->Shared());
+        if (parent.m_baseline)
+        {
+            m_code->TrackWrites();
+            for (auto const page : parent.m_code->DirtyPages())
+            {
+                m_code->MarkDirty(page);
+            }
+            m_baseline = parent.m_baseline;
+        }
+    }
+} // namespace owl
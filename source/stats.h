@@ -0,0 +1,80 @@
+#pragma once
+
+#include "owl-cpu/owl-cpu.h"
+
+#include <atomic>
+#include <cstdint>
+
+// Every count in owl::Stats, in order.
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define OWL_CPU_FOR_EACH_STAT(X)                                                                                       \
+    X(instructions)                                                                                                    \
+    X(runs)                                                                                                            \
+    X(runNanoseconds)                                                                                                  \
+    X(pageHits)                                                                                                        \
+    X(pageMisses)                                                                                                      \
+    X(sharedPages)                                                                                                     \
+    X(blockHits)                                                                                                       \
+    X(blockMisses)                                                                                                     \
+    X(chainHits)                                                                                                       \
+    X(ecalls)                                                                                                          \
+    X(hostNanoseconds)
+
+namespace owl::detail
+{
+#define OWL_CPU_STAT_COUNT(...) +1
+    static_assert(sizeof(Stats) == sizeof(std::uint64_t) * (0 OWL_CPU_FOR_EACH_STAT(OWL_CPU_STAT_COUNT)),
+                  "every count in Stats is in OWL_CPU_FOR_EACH_STAT");
+#undef OWL_CPU_STAT_COUNT
+
+    // A count that only one thread at a time adds to, but that any thread can read while it does. Adding is a relaxed
+    // load and store rather than a read-modify-write, so it costs the same as adding to a plain integer.
+    class Counter
+    {
+    public:
+        void Add(std::uint64_t n)
+        {
+            m_value.store(m_value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+        void Increment() { Add(1); }
+        auto Load() const -> std::uint64_t { return m_value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<std::uint64_t> m_value{};
+    };
+
+    // The counters behind a Stats, one for each of its counts.
+    struct StatCounters
+    {
+#define OWL_CPU_STAT_COUNTER(name) Counter name;
+        OWL_CPU_FOR_EACH_STAT(OWL_CPU_STAT_COUNTER)
+#undef OWL_CPU_STAT_COUNTER
+
+        auto Load() const -> Stats
+        {
+            Stats stats;
+#define OWL_CPU_STAT_LOAD(name) stats.name = name.Load();
+            OWL_CPU_FOR_EACH_STAT(OWL_CPU_STAT_LOAD)
+#undef OWL_CPU_STAT_LOAD
+            return stats;
+        }
+
+        void Add(Stats const& stats)
+        {
+#define OWL_CPU_STAT_ADD(name) name.Add(stats.name);
+            OWL_CPU_FOR_EACH_STAT(OWL_CPU_STAT_ADD)
+#undef OWL_CPU_STAT_ADD
+        }
+    };
+
+    // Returns what was counted between two loads of the same counters.
+    inline auto Difference(Stats const& after, Stats const& before) -> Stats
+    {
+        Stats difference;
+#define OWL_CPU_STAT_SUBTRACT(name) difference.name = after.name - before.name;
+        OWL_CPU_FOR_EACH_STAT(OWL_CPU_STAT_SUBTRACT)
+#undef OWL_CPU_STAT_SUBTRACT
+        return difference;
+    }
+} // namespace owl::detail
@@ -0,0 +1,76 @@
+#include "owl-cpu/detail/decoder.h"
+
+#include "engines.h"
+#include "execute.h"
+#include "memory.h"
+#include "timing.h"
+
+#include <cstdint>
+
+// The portable engine: fetch each predecoded instruction then dispatch on its operation with a switch. The timed
+// engine is the same loop instantiated with a timing policy that counts the cycles that each instruction takes.
+
+namespace owl::detail
+{
+    namespace
+    {
+        template<typename Timing, typename Memory>
+        auto Interpret(CpuState& state, Memory memory, PredecodeCache& code, std::uint64_t cycles) -> Exit
+        {
+            auto c = Context<Memory>{.x = state.x, .state = state, .memory = memory, .code = code, .pc = state.pc};
+            auto timing = Timing{state};
+            auto remaining = cycles;
+
+            while (remaining > 0)
+            {
+                auto const* d = Fetch(c);
+                if (d == nullptr)
+                {
+                    break;
+                }
+                // A store can invalidate the instruction that it was fetched from, so timing sees a copy of it.
+                auto const insn = *d;
+                auto const pc = c.pc;
+                auto const stepped = Step(c, insn);
+                if (stepped || Retires(c.exit))
+                {
+                    timing.Retire(insn, pc, c.pc);
+                }
+                if (!stepped)
+                {
+                    break;
+                }
+                --remaining;
+            }
+
+            if (Retires(c.exit))
+            {
+                --remaining;
+            }
+            state.pc = c.pc;
+            state.instret += cycles - remaining;
+            timing.Finish(state);
+            return c.exit;
+        }
+    } // namespace
+
+    template<typename Memory>
+    auto RunSwitch(CpuState& state, Memory memory, PredecodeCache& code, std::uint64_t cycles) -> Exit
+    {
+        return Interpret<NoTiming>(state, memory, code, cycles);
+    }
+
+    template auto RunSwitch(CpuState&, CheckedMemory, PredecodeCache&, std::uint64_t) -> Exit;
+    template auto RunSwitch(CpuState&, FlatMemory, PredecodeCache&, std::uint64_t) -> Exit;
+    template auto RunSwitch(CpuState&, DeviceMemory, PredecodeCache&, std::uint64_t) -> Exit;
+
+    template<typename Memory>
+    auto RunTimed(CpuState& state, Memory memory, PredecodeCache& code, std::uint64_t cycles) -> Exit
+    {
+        return Interpret<PipelineTiming>(state, memory, code, cycles);
+    }
+
+    template auto RunTimed(CpuState&, CheckedMemory, PredecodeCache&, std::uint64_t) -> Exit;
+    template auto RunTimed(CpuState&, FlatMemory, PredecodeCache&, std::uint64_t) -> Exit;
+    template auto RunTimed(CpuState&, DeviceMemory, PredecodeCache&, std::uint64_t) -> Exit;
+} // namespace owl::detail
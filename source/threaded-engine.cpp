@@ -0,0 +1,64 @@
+#include "owl-cpu/detail/decoder.h"
+
+#include "engines.h"
+#include "execute.h"
+#include "memory.h"
+
+#include <cstdint>
+
+// The threaded engine: every handler ends with its own fetch and indirect jump to the next handler, using the
+// GCC/Clang computed goto extension. Replicating the dispatch gives the branch predictor a separate history for each
+// handler, so it can learn common instruction sequences instead of mispredicting one shared switch jump.
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+namespace owl::detail
+{
+    template<typename Memory>
+    auto RunThreaded(CpuState& state, Memory memory, PredecodeCache& code, std::uint64_t cycles) -> Exit
+    {
+#define OWL_CPU_LABEL_ADDRESS(name) &&op_##name,
+        static void* const handlers[] = {OWL_CPU_FOR_EACH_OP(OWL_CPU_LABEL_ADDRESS)};
+#undef OWL_CPU_LABEL_ADDRESS
+        static_assert(sizeof(handlers) / sizeof(handlers[0]) == opCount);
+
+        auto c = Context<Memory>{.x = state.x, .state = state, .memory = memory, .code = code, .pc = state.pc};
+        auto remaining = cycles;
+        Decoded const* d{};
+
+#define OWL_CPU_DISPATCH()                                                                                             \
+    if (remaining == 0 || (d = Fetch(c)) == nullptr)                                                                   \
+    {                                                                                                                  \
+        goto done;                                                                                                     \
+    }                                                                                                                  \
+    goto* handlers[static_cast<std::uint8_t>(d->op)]
+
+        OWL_CPU_DISPATCH();
+
+#define OWL_CPU_HANDLER(name)                                                                                          \
+    op_##name : if (!Execute<Op::name>(c, *d))                                                                         \
+    {                                                                                                                  \
+        goto done;                                                                                                     \
+    }                                                                                                                  \
+    --remaining;                                                                                                       \
+    OWL_CPU_DISPATCH();
+        OWL_CPU_FOR_EACH_OP(OWL_CPU_HANDLER)
+#undef OWL_CPU_HANDLER
+#undef OWL_CPU_DISPATCH
+
+    done:
+        if (Retires(c.exit))
+        {
+            --remaining;
+        }
+        state.pc = c.pc;
+        state.instret += cycles - remaining;
+        return c.exit;
+    }
+
+    template auto RunThreaded(CpuState&, CheckedMemory, PredecodeCache&, std::uint64_t) -> Exit;
+    template auto RunThreaded(CpuState&, FlatMemory, PredecodeCache&, std::uint64_t) -> Exit;
+    template auto RunThreaded(CpuState&, DeviceMemory, PredecodeCache&, std::uint64_t) -> Exit;
+} // namespace owl::detail
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "owl-cpu/detail/decoder.h"
+#include "owl-cpu/owl-cpu.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+
+namespace owl::detail
+{
+    // The timing policies that the interpreter is instantiated with. A policy is told about every instruction that
+    // retires, along with its pc and the pc that it went to, and leaves what it measured in the core's state at the end
+    // of the run.
+
+    // The functional engine's policy, which does nothing, so that the engine pays nothing for timing.
+    class NoTiming
+    {
+    public:
+        explicit NoTiming(CpuState const& /*state*/) {}
+
+        void Retire(Decoded const& /*d*/, std::uint32_t /*pc*/, std::uint32_t /*next*/) {}
+        void Finish(CpuState& /*state*/) const {}
+    };
+
+    namespace pipeline
+    {
+        inline constexpr std::uint8_t loadUseStall = 1;
+        inline constexpr std::uint8_t jumpPenalty = 1;
+        inline constexpr std::uint8_t mispredictPenalty = 2;
+        inline constexpr std::uint8_t multiplyStall = 2;
+        inline constexpr std::uint8_t divideStall = 32;
+
+        // What an operation costs, looked up by the operation so that timing doesn't need a switch of its own.
+        struct Cost
+        {
+            std::uint8_t always{1}; // the cycles that it always takes
+            std::uint8_t taken{};   // the extra cycles that it takes if it doesn't go on to the next instruction
+            bool loads{};
+        };
+
+        constexpr auto Costs() -> std::array<Cost, opCount>
+        {
+            std::array<Cost, opCount> costs{};
+            for (std::size_t i = 0; i < costs.size(); ++i)
+            {
+                auto const op = static_cast<Op>(i);
+                costs[i].loads = IsLoad(op);
+                costs[i].taken = IsBranch(op) ? mispredictPenalty : 0;
+            }
+            auto const add = [&](std::initializer_list<Op> ops, std::uint8_t cycles) {
+                for (auto const op : ops)
+                {
+                    costs[static_cast<std::size_t>(op)].always += cycles;
+                }
+            };
+            add({Op::Jal, Op::CJal, Op::J}, jumpPenalty);
+            add({Op::Jalr, Op::CJalr, Op::Jr}, mispredictPenalty);
+            add({Op::Mul, Op::Mulh, Op::Mulhsu, Op::Mulhu}, multiplyStall);
+            add({Op::Div, Op::Divu, Op::Rem, Op::Remu}, divideStall);
+            return costs;
+        }
+
+        inline constexpr auto costs = Costs();
+    } // namespace pipeline
+
+    // Counts the cycles that an in-order, five-stage Owl pipeline with full forwarding would take, if it predicted that
+    // no branch is taken. Every instruction takes one cycle, and some take more:
+    // - an instruction that reads the register that a load immediately before it wrote stalls until the load's data
+    //   arrives
+    // - jumps flush the instruction that was fetched after them, as their targets are only known after decoding, and
+    //   jalr and taken branches also flush the one after that, since theirs are only known after executing
+    // - multiplies and divides hold up the pipeline while the iterative multiplier and divider work
+    // Memory is assumed to hit in the cache every time. A load-use stall that straddles two calls to Cpu::Run() isn't
+    // counted, because the pipeline drains between them.
+    class PipelineTiming
+    {
+    public:
+        explicit PipelineTiming(CpuState const& state) : m_cycle{state.cycle} {}
+
+        void Retire(Decoded const& d, std::uint32_t pc, std::uint32_t next)
+        {
+            auto const& cost = pipeline::costs[static_cast<std::size_t>(d.op)];
+            auto cycles = std::uint64_t{cost.always};
+            if (next != pc + InstructionSize(d.op))
+            {
+                cycles += cost.taken;
+            }
+            if (m_loaded != 0 && (d.rs1 == m_loaded || d.rs2 == m_loaded))
+            {
+                cycles += pipeline::loadUseStall;
+            }
+            m_loaded = cost.loads ? d.rd : 0;
+            m_cycle += cycles;
+        }
+
+        void Finish(CpuState& state) const { state.cycle = m_cycle; }
+
+    private:
+        std::uint64_t m_cycle;
+        std::uint8_t m_loaded{}; // the register that the previous instruction loaded, or 0 if it wasn't a load
+    };
+} // namespace owl::detail
@@ -0,0 +1,58 @@
+#include "owl-cpu/detail/decoder.h"
+
+#include "engines.h"
+#include "execute.h"
+#include "memory.h"
+#include "trace.h"
+
+#include <cstdint>
+
+// The tracing engine: the switch engine, recording each instruction that retires and the register that it wrote.
+
+namespace owl::detail
+{
+    template<typename Memory>
+    auto RunTraced(CpuState& state, Memory memory, PredecodeCache& code, TraceChannel& trace, std::uint64_t cycles)
+            -> Exit
+    {
+        auto c = Context<Memory>{.x = state.x, .state = state, .memory = memory, .code = code, .pc = state.pc};
+        auto remaining = cycles;
+        trace.Start(state);
+
+        while (remaining > 0)
+        {
+            auto const* d = Fetch(c);
+            if (d == nullptr)
+            {
+                break;
+            }
+            // A store into its own page discards the instruction, so take what the trace needs first.
+            auto const pc = c.pc;
+            auto const size = InstructionSize(d->op);
+            auto const rd = d->rd;
+            auto const stepped = Step(c, *d);
+            if (stepped || Retires(c.exit))
+            {
+                trace.Step(pc, size, rd, c.x[rd]);
+            }
+            if (!stepped)
+            {
+                break;
+            }
+            --remaining;
+        }
+
+        if (Retires(c.exit))
+        {
+            --remaining;
+        }
+        state.pc = c.pc;
+        state.instret += cycles - remaining;
+        trace.End(c.exit, c.pc);
+        return c.exit;
+    }
+
+    template auto RunTraced(CpuState&, CheckedMemory, PredecodeCache&, TraceChannel&, std::uint64_t) -> Exit;
+    template auto RunTraced(CpuState&, FlatMemory, PredecodeCache&, TraceChannel&, std::uint64_t) -> Exit;
+    template auto RunTraced(CpuState&, DeviceMemory, PredecodeCache&, TraceChannel&, std::uint64_t) -> Exit;
+} // namespace owl::detail
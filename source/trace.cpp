@@ -0,0 +1,436 @@
+#include "owl-cpu/trace.h"
+
+#include "trace.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace owl::detail
+{
+    namespace
+    {
+        constexpr std::array<std::uint8_t, 8> traceMagic{'O', 'W', 'L', 'T', 'R', 'A', 'C', 'E'};
+        constexpr std::uint32_t traceVersion = 2;
+        constexpr std::size_t minBufferSize = 4096;
+
+        // LZ4 frames, as described by https://github.com/lz4/lz4/blob/dev/doc/lz4_Frame_format.md, made of independent
+        // blocks of at most 64 KiB, without checksums, so that the stock `lz4` tool and library can read them.
+        constexpr std::uint32_t lz4Magic = 0x184d2204;
+        constexpr std::uint8_t lz4Flags = 0x60;        // version 1, independent blocks
+        constexpr std::uint8_t lz4BlockMaximum = 0x40; // 64 KiB
+        constexpr std::size_t lz4BlockSize = std::size_t{64} << 10;
+        constexpr std::uint32_t lz4Uncompressed = 0x80000000; // set in a block's size if it is stored as it is
+
+        // The xxHash32 of a few bytes, which is how the frame header is checksummed.
+        constexpr auto Xxh32(std::span<std::uint8_t const> bytes) -> std::uint32_t
+        {
+            constexpr std::uint32_t prime1 = 0x9e3779b1;
+            constexpr std::uint32_t prime2 = 0x85ebca77;
+            constexpr std::uint32_t prime3 = 0xc2b2ae3d;
+            constexpr std::uint32_t prime5 = 0x165667b1;
+
+            auto hash = prime5 + static_cast<std::uint32_t>(bytes.size());
+            for (auto const byte : bytes)
+            {
+                hash = std::rotl(hash + byte * prime5, 11) * prime1;
+            }
+            hash = (hash ^ (hash >> 15)) * prime2;
+            hash = (hash ^ (hash >> 13)) * prime3;
+            return hash ^ (hash >> 16);
+        }
+
+        constexpr std::array<std::uint8_t, 2> lz4Descriptor{lz4Flags, lz4BlockMaximum};
+        constexpr auto lz4HeaderChecksum = static_cast<std::uint8_t>(Xxh32(lz4Descriptor) >> 8);
+
+        template<typename T>
+        void Put(std::vector<std::uint8_t>& out, T value)
+        {
+            auto const at = out.size();
+            out.resize(at + sizeof(T));
+            std::memcpy(out.data() + at, &value, sizeof(T));
+        }
+
+        auto Load32(std::uint8_t const* p) -> std::uint32_t
+        {
+            std::uint32_t value;
+            std::memcpy(&value, p, sizeof(value));
+            return value;
+        }
+
+        // Writes an LZ4 length that doesn't fit in its token as a run of 255s and a remainder.
+        void PutLength(std::vector<std::uint8_t>& out, std::size_t length)
+        {
+            for (; length >= 255; length -= 255)
+            {
+                out.push_back(255);
+            }
+            out.push_back(static_cast<std::uint8_t>(length));
+        }
+
+        void PutSequence(std::vector<std::uint8_t>& out, std::span<std::uint8_t const> literals, std::size_t offset,
+                         std::size_t match)
+        {
+            constexpr std::size_t minMatch = 4;
+            auto const literalToken = std::min<std::size_t>(literals.size(), 15);
+            auto const matchToken = match != 0 ? std::min<std::size_t>(match - minMatch, 15) : 0;
+            out.push_back(static_cast<std::uint8_t>(literalToken << 4 | matchToken));
+            if (literalToken == 15)
+            {
+                PutLength(out, literals.size() - 15);
+            }
+            out.insert(out.end(), literals.begin(), literals.end());
+            if (match == 0)
+            {
+                return;
+            }
+            Put(out, static_cast<std::uint16_t>(offset));
+            if (matchToken == 15)
+            {
+                PutLength(out, match - minMatch - 15);
+            }
+        }
+
+        // Compresses a block with a single-probe hash of every position, in the way of LZ4's fast mode. The format
+        // requires the last 5 bytes to be literals and the last match to start at least 12 bytes before the end.
+        void CompressLz4Block(std::span<std::uint8_t const> in, std::vector<std::uint8_t>& out)
+        {
+            constexpr std::size_t lastLiterals = 5;
+            constexpr std::size_t matchLimit = 12;
+            constexpr std::size_t maxOffset = 65535;
+            constexpr int hashBits = 12;
+
+            std::array<std::uint32_t, std::size_t{1} << hashBits> table{};
+            auto const* data = in.data();
+            std::size_t anchor = 0;
+            for (std::size_t at = 0; at + matchLimit <= in.size();)
+            {
+                auto const sequence = Load32(data + at);
+                auto& slot = table[(sequence * 2654435761U) >> (32 - hashBits)];
+                auto const candidate = std::size_t{slot};
+                slot = static_cast<std::uint32_t>(at);
+                if (candidate >= at || at - candidate > maxOffset || Load32(data + candidate) != sequence)
+                {
+                    ++at;
+                    continue;
+                }
+                auto match = sizeof(sequence);
+                while (at + match < in.size() - lastLiterals && data[candidate + match] == data[at + match])
+                {
+                    ++match;
+                }
+                PutSequence(out, in.subspan(anchor, at - anchor), at - candidate, match);
+                at += match;
+                anchor = at;
+            }
+            PutSequence(out, in.subspan(anchor), 0, 0);
+        }
+    } // namespace
+
+    TraceChannel::TraceChannel(TraceSink& sink, TraceCompression compression, std::size_t bufferSize)
+        : m_sink{sink}, m_compression{compression}
+    {
+        if (bufferSize < minBufferSize)
+        {
+            throw std::invalid_argument("a trace writer's buffers must be at least 4 KiB");
+        }
+        for (auto& buffer : m_buffers)
+        {
+            buffer.resize(bufferSize);
+        }
+        m_out = m_buffers[0].data();
+        m_end = m_out + bufferSize;
+
+        std::memcpy(m_out, traceMagic.data(), traceMagic.size());
+        m_out += traceMagic.size();
+        std::memcpy(m_out, &traceVersion, sizeof(traceVersion));
+        m_out += sizeof(traceVersion);
+
+        if (m_compression == TraceCompression::Lz4)
+        {
+            std::vector<std::uint8_t> header;
+            Put(header, lz4Magic);
+            header.insert(header.end(), lz4Descriptor.begin(), lz4Descriptor.end());
+            header.push_back(lz4HeaderChecksum);
+            m_sink.Write(header);
+        }
+        m_thread = std::thread{[this] { Drain(); }};
+    }
+
+    TraceChannel::~TraceChannel()
+    {
+        Swap();
+        {
+            std::unique_lock lock{m_mutex};
+            m_changed.wait(lock, [this] { return !m_pending; });
+            m_stopping = true;
+        }
+        m_changed.notify_all();
+        m_thread.join();
+
+        if (m_compression == TraceCompression::Lz4 && !m_error)
+        {
+            try
+            {
+                std::vector<std::uint8_t> endMark;
+                Put(endMark, std::uint32_t{});
+                m_sink.Write(endMark);
+            }
+            catch (...)
+            {
+                // There's nobody left to report it to.
+            }
+        }
+    }
+
+    void TraceChannel::Start(CpuState const& state)
+    {
+        Reserve(startSize);
+        *m_out++ = startTag;
+        PutDelta(state.pc - m_pc);
+        for (std::size_t i = 1; i < state.x.size(); ++i)
+        {
+            PutDelta(state.x[i] - m_x[i]);
+        }
+        m_x = state.x;
+        m_pc = state.pc;
+    }
+
+    void TraceChannel::End(Exit exit, std::uint32_t pc)
+    {
+        Reserve(stepSize);
+        *m_out++ = exitTag;
+        *m_out++ = static_cast<std::uint8_t>(exit);
+        PutDelta(pc - m_pc);
+        m_pc = pc;
+    }
+
+    void TraceChannel::Flush()
+    {
+        Swap();
+        std::unique_lock lock{m_mutex};
+        m_changed.wait(lock, [this] { return !m_pending; });
+        if (m_error)
+        {
+            std::rethrow_exception(std::exchange(m_error, nullptr));
+        }
+    }
+
+    void TraceChannel::Swap()
+    {
+        auto const size = static_cast<std::size_t>(m_out - m_buffers[m_current].data());
+        if (size == 0)
+        {
+            return;
+        }
+        {
+            std::unique_lock lock{m_mutex};
+            m_changed.wait(lock, [this] { return !m_pending; });
+            m_pendingSize = size;
+            m_pending = true;
+            m_current ^= 1;
+        }
+        m_changed.notify_all();
+        m_out = m_buffers[m_current].data();
+        m_end = m_out + m_buffers[m_current].size();
+    }
+
+    void TraceChannel::Drain()
+    {
+        std::unique_lock lock{m_mutex};
+        for (;;)
+        {
+            m_changed.wait(lock, [this] { return m_pending || m_stopping; });
+            if (!m_pending)
+            {
+                return;
+            }
+            auto const chunk = std::span<std::uint8_t const>{m_buffers[m_current ^ 1]}.first(m_pendingSize);
+            auto const failed = m_error != nullptr;
+            lock.unlock();
+
+            std::exception_ptr error;
+            if (!failed)
+            {
+                try
+                {
+                    Emit(chunk);
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+            }
+
+            lock.lock();
+            if (error && !m_error)
+            {
+                m_error = error;
+            }
+            m_pending = false;
+            m_changed.notify_all();
+        }
+    }
+
+    void TraceChannel::Emit(std::span<std::uint8_t const> chunk)
+    {
+        if (m_compression == TraceCompression::None)
+        {
+            m_sink.Write(chunk);
+            return;
+        }
+
+        m_compressed.clear();
+        for (std::size_t at = 0; at < chunk.size(); at += lz4BlockSize)
+        {
+            auto const block = chunk.subspan(at, std::min(lz4BlockSize, chunk.size() - at));
+            auto const sizeAt = m_compressed.size();
+            Put(m_compressed, std::uint32_t{});
+            CompressLz4Block(block, m_compressed);
+            auto size = static_cast<std::uint32_t>(m_compressed.size() - sizeAt - sizeof(std::uint32_t));
+            if (size >= block.size())
+            {
+                m_compressed.resize(sizeAt + sizeof(std::uint32_t));
+                m_compressed.insert(m_compressed.end(), block.begin(), block.end());
+                size = static_cast<std::uint32_t>(block.size()) | lz4Uncompressed;
+            }
+            std::memcpy(m_compressed.data() + sizeAt, &size, sizeof(size));
+        }
+        m_sink.Write(m_compressed);
+    }
+} // namespace owl::detail
+
+namespace owl
+{
+    TraceSink::~TraceSink() = default;
+
+    FileTraceSink::FileTraceSink(std::filesystem::path const& path)
+    {
+#if defined(_WIN32)
+        m_file = _wfopen(path.c_str(), L"wb");
+#else
+        m_file = std::fopen(path.c_str(), "wb");
+#endif
+        if (m_file == nullptr)
+        {
+            throw std::runtime_error("cannot create trace file " + path.string());
+        }
+    }
+
+    FileTraceSink::~FileTraceSink() { std::fclose(m_file); }
+
+    void FileTraceSink::Write(std::span<std::uint8_t const> chunk)
+    {
+        if (std::fwrite(chunk.data(), 1, chunk.size(), m_file) != chunk.size())
+        {
+            throw std::runtime_error("cannot write to trace file");
+        }
+    }
+
+    TraceWriter::TraceWriter(TraceSink& sink, TraceCompression compression, std::size_t bufferSize)
+        : m_channel{std::make_unique<detail::TraceChannel>(sink, compression, bufferSize)}
+    {
+    }
+
+    TraceWriter::~TraceWriter() = default;
+
+    void TraceWriter::Flush() { m_channel->Flush(); }
+
+    TraceReader::TraceReader(std::span<std::uint8_t const> trace) : m_trace{trace}
+    {
+        std::uint32_t version{};
+        if (trace.size() < detail::traceMagic.size() + sizeof(version)
+            || !std::equal(detail::traceMagic.begin(), detail::traceMagic.end(), trace.begin()))
+        {
+            throw std::runtime_error("not an owl-cpu trace");
+        }
+        std::memcpy(&version, trace.data() + detail::traceMagic.size(), sizeof(version));
+        if (version != detail::traceVersion)
+        {
+            throw std::runtime_error("unsupported owl-cpu trace version");
+        }
+        m_at = detail::traceMagic.size() + sizeof(version);
+    }
+
+    auto TraceReader::Next(TraceRecord& record) -> bool
+    {
+        if (m_at == m_trace.size())
+        {
+            return false;
+        }
+
+        auto const tag = Byte();
+        switch (tag >> 6)
+        {
+        case 0:
+        case 3:
+            record.kind = TraceRecord::Kind::Step;
+            record.rd = static_cast<std::uint8_t>((tag >> 1) & 31);
+            record.pc = m_pc + ((tag & 1) != 0 ? static_cast<std::uint32_t>(Delta()) : 0);
+            if (record.rd != 0)
+            {
+                m_x[record.rd] += static_cast<std::uint32_t>(Delta());
+            }
+            record.value = m_x[record.rd];
+            m_pc = record.pc + ((tag >> 6) == 3 ? 2 : 4);
+            return true;
+        case 1:
+            record.kind = TraceRecord::Kind::Start;
+            record.pc = m_pc += static_cast<std::uint32_t>(Delta());
+            for (std::size_t i = 1; i < m_x.size(); ++i)
+            {
+                m_x[i] += static_cast<std::uint32_t>(Delta());
+            }
+            return true;
+        case 2:
+            record.kind = TraceRecord::Kind::Exit;
+            record.exit = static_cast<Exit>(Byte());
+            record.pc = m_pc += static_cast<std::uint32_t>(Delta());
+            return true;
+        default:
+            throw std::runtime_error("malformed owl-cpu trace");
+        }
+    }
+
+    auto TraceReader::Byte() -> std::uint8_t
+    {
+        if (m_at == m_trace.size())
+        {
+            throw std::runtime_error("truncated owl-cpu trace");
+        }
+        return m_trace[m_at++];
+    }
+
+    auto TraceReader::Varint() -> std::uint32_t
+    {
+        std::uint32_t value{};
+        for (int shift = 0; shift < 35; shift += 7)
+        {
+            auto const byte = Byte();
+            value |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                return value;
+            }
+        }
+        throw std::runtime_error("malformed owl-cpu trace");
+    }
+
+    auto TraceReader::Delta() -> std::int32_t
+    {
+        auto const zigzag = Varint();
+        return static_cast<std::int32_t>((zigzag >> 1) ^ (0 - (zigzag & 1)));
+    }
+} // namespace owl
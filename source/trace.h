@@ -0,0 +1,117 @@
+#pragma once
+
+#include "owl-cpu/owl-cpu.h"
+#include "owl-cpu/trace.h"
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+// The encoding half of a TraceWriter, which the tracing interpreter feeds with records, and the background thread that
+// compresses full buffers and hands them to the sink. The core that is running owns the buffer being filled and the
+// writer's thread owns the other one while it is pending, so only the hand-over between them takes the mutex.
+
+namespace owl::detail
+{
+    class TraceChannel
+    {
+    public:
+        TraceChannel(TraceSink& sink, TraceCompression compression, std::size_t bufferSize);
+        ~TraceChannel();
+        TraceChannel(TraceChannel const&) = delete;
+        auto operator=(TraceChannel const&) -> TraceChannel& = delete;
+        TraceChannel(TraceChannel&&) = delete;
+        auto operator=(TraceChannel&&) -> TraceChannel& = delete;
+
+        // Records the start of a run, with the core's state.
+        void Start(CpuState const& state);
+
+        // Records that the instruction at pc, which is `size` bytes long, retired, writing value to rd unless rd is
+        // zero.
+        void Step(std::uint32_t pc, std::uint32_t size, std::uint8_t rd, std::uint32_t value)
+        {
+            Reserve(stepSize);
+            auto* out = m_out++;
+            auto tag = static_cast<std::uint8_t>((size == 2 ? compressedStepTag : 0) | (rd << 1));
+            if (pc != m_pc)
+            {
+                tag |= jumped;
+                PutDelta(pc - m_pc);
+            }
+            if (rd != 0)
+            {
+                PutDelta(value - m_x[rd]);
+                m_x[rd] = value;
+            }
+            *out = tag;
+            m_pc = pc + size;
+        }
+
+        // Records the end of a run, with the reason that it stopped and the core's pc.
+        void End(Exit exit, std::uint32_t pc);
+
+        // Hands the buffer being filled to the writer's thread, waits until it has been written, then rethrows the
+        // sink's first exception, if it threw one.
+        void Flush();
+
+    private:
+        static constexpr std::uint8_t jumped = 0x01;
+        static constexpr std::uint8_t startTag = 0x40;
+        static constexpr std::uint8_t exitTag = 0x80;
+        static constexpr std::uint8_t compressedStepTag = 0xc0;
+        static constexpr std::size_t varintSize = 5;
+        static constexpr std::size_t stepSize = 1 + 2 * varintSize;
+        static constexpr std::size_t startSize = 1 + 32 * varintSize;
+
+        void Reserve(std::size_t size)
+        {
+            if (static_cast<std::size_t>(m_end - m_out) < size) [[unlikely]]
+            {
+                Swap();
+            }
+        }
+
+        void PutDelta(std::uint32_t delta)
+        {
+            auto zigzag = (delta << 1) ^ (0 - (delta >> 31));
+            while (zigzag >= 0x80)
+            {
+                *m_out++ = static_cast<std::uint8_t>(zigzag | 0x80);
+                zigzag >>= 7;
+            }
+            *m_out++ = static_cast<std::uint8_t>(zigzag);
+        }
+
+        void Swap();                                    // hands over the buffer being filled
+        void Drain();                                   // the writer's thread
+        void Emit(std::span<std::uint8_t const> chunk); // compresses a chunk, if asked to, and writes it
+
+        TraceSink& m_sink;
+        TraceCompression m_compression;
+        std::array<std::vector<std::uint8_t>, 2> m_buffers;
+        std::vector<std::uint8_t> m_compressed; // only touched by the writer's thread
+
+        // The encoder's state, which only the core that is running touches.
+        std::size_t m_current{}; // the buffer being filled
+        std::uint8_t* m_out{};
+        std::uint8_t* m_end{};
+        std::uint32_t m_pc{}; // the pc that the trace expects next
+        std::array<std::uint32_t, 32> m_x{};
+
+        // The hand-over, guarded by m_mutex.
+        std::mutex m_mutex;
+        std::condition_variable m_changed;
+        std::size_t m_pendingSize{}; // the size of the other buffer, if it is waiting to be written
+        bool m_pending{};
+        bool m_stopping{};
+        std::exception_ptr m_error;
+
+        std::thread m_thread;
+    };
+} // namespace owl::detail
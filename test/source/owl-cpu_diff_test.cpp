@@ -0,0 +1,417 @@
+#include "owl-cpu/encoder.h"
+#include "owl-cpu/owl-cpu.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+// Runs random programs on every engine side by side with Engine::Switch, comparing hashes of their architectural state
+// each time that they stop at a block boundary, so that billions of instructions can be checked without comparing
+// every instruction. Each program is an endless loop of random instructions that ends with an ecall, which is where
+// every engine stops and is compared. Usage: owl-cpu_diff_test [instructions per program [programs [seed]]].
+
+namespace
+{
+    using namespace owl::encode;
+
+    constexpr std::size_t memorySize = 16384;
+    constexpr std::uint32_t dataBase = 0x2000; // where the data that loads and stores address starts
+    constexpr std::size_t memoryCheckInterval = 64;
+
+    // s0 holds dataBase and s1 counts inner loops, so no random instruction writes them.
+    constexpr std::array<Reg, 30> writable{zero, ra, sp, gp, tp, t0, t1, t2, a0, a1, a2, a3, a4, a5, a6,
+                                           a7,   s2, s3, s4, s5, s6, s7, s8, s9, s10, s11, t3, t4, t5, t6};
+    constexpr std::array<Reg, 6> compressedWritable{a0, a1, a2, a3, a4, a5};
+
+    // An instruction, or an inner loop, that is encoded once the program's layout is known. A branch or jump skips the
+    // given number of items after it, and is encoded with the offset to the item after those.
+    struct Item
+    {
+        std::uint32_t size{};
+        std::function<std::vector<std::uint16_t>(std::int32_t offset)> encode;
+        std::size_t skip{};
+    };
+
+    auto Halves(std::uint32_t word) -> std::vector<std::uint16_t>
+    {
+        return {static_cast<std::uint16_t>(word), static_cast<std::uint16_t>(word >> 16)};
+    }
+
+    class Generator
+    {
+    public:
+        explicit Generator(std::uint64_t seed) : m_random{seed} {}
+
+        // Returns guest memory holding a program of `count` items in a loop.
+        auto Program(std::size_t count) -> std::vector<std::uint8_t>
+        {
+            std::vector<Item> items;
+            items.push_back(Fixed(Lui(s0, dataBase >> 12)));
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                items.push_back(Below(16) == 0 ? Loop() : Random(count - i - 1));
+            }
+            items.push_back(Fixed(Ecall()));
+            auto const loopSize = Size(items, 1, items.size());
+            items.push_back(Fixed(Jal(zero, -static_cast<std::int32_t>(loopSize))));
+
+            std::vector<std::uint16_t> halves;
+            for (std::size_t i = 0; i < items.size(); ++i)
+            {
+                auto const offset = Size(items, i, i + 1 + items[i].skip);
+                auto const encoded = items[i].encode(static_cast<std::int32_t>(offset));
+                halves.insert(halves.end(), encoded.begin(), encoded.end());
+            }
+            std::vector<std::uint8_t> memory(memorySize);
+            std::memcpy(memory.data(), halves.data(), halves.size() * sizeof(std::uint16_t));
+            return memory;
+        }
+
+    private:
+        static auto Size(std::vector<Item> const& items, std::size_t first, std::size_t last) -> std::uint32_t
+        {
+            std::uint32_t size = 0;
+            for (auto i = first; i < last; ++i)
+            {
+                size += items[i].size;
+            }
+            return size;
+        }
+
+        static auto Fixed(std::uint32_t word) -> Item
+        {
+            return {.size = 4, .encode = [word](std::int32_t) { return Halves(word); }};
+        }
+
+        static auto Fixed(std::uint16_t half) -> Item
+        {
+            return {.size = 2, .encode = [half](std::int32_t) { return std::vector<std::uint16_t>{half}; }};
+        }
+
+        auto Below(std::uint32_t n) -> std::uint32_t
+        {
+            return std::uniform_int_distribution<std::uint32_t>{0, n - 1}(m_random);
+        }
+
+        auto Imm(std::int32_t low, std::int32_t high) -> std::int32_t
+        {
+            return std::uniform_int_distribution<std::int32_t>{low, high}(m_random);
+        }
+
+        auto AnyReg() -> Reg { return static_cast<Reg>(Below(32)); }
+        auto Rd() -> Reg { return writable[Below(writable.size())]; }
+        auto CompressedRd() -> Reg { return compressedWritable[Below(compressedWritable.size())]; }
+
+        // An offset from s0 into the data, aligned to `size`.
+        auto DataOffset(std::uint32_t size) -> std::int32_t
+        {
+            return static_cast<std::int32_t>(Below(2048 / size) * size);
+        }
+
+        // A counted loop of straight-line instructions.
+        auto Loop() -> Item
+        {
+            std::vector<std::uint32_t> body;
+            auto const length = 1 + Below(8);
+            for (std::uint32_t i = 0; i < length; ++i)
+            {
+                body.push_back(Straight());
+            }
+            auto const iterations = static_cast<std::int32_t>(1 + Below(16));
+            auto const bodySize = static_cast<std::int32_t>(4 * (body.size() + 1));
+            std::vector<std::uint16_t> halves = Halves(Addi(s1, zero, iterations));
+            for (auto const word : body)
+            {
+                auto const encoded = Halves(word);
+                halves.insert(halves.end(), encoded.begin(), encoded.end());
+            }
+            for (auto const word : {Addi(s1, s1, -1), Bne(s1, zero, -bodySize)})
+            {
+                auto const encoded = Halves(word);
+                halves.insert(halves.end(), encoded.begin(), encoded.end());
+            }
+            auto const size = static_cast<std::uint32_t>(halves.size() * sizeof(std::uint16_t));
+            return {.size = size, .encode = [halves](std::int32_t) { return halves; }};
+        }
+
+        // A 32-bit instruction that falls through to the next.
+        auto Straight() -> std::uint32_t
+        {
+            using RType = std::uint32_t (*)(Reg, Reg, Reg);
+            using IType = std::uint32_t (*)(Reg, Reg, std::int32_t);
+            using Shift = std::uint32_t (*)(Reg, Reg, std::uint32_t);
+            using Amo = std::uint32_t (*)(Reg, Reg, Reg);
+            static constexpr std::array<RType, 18> rTypes{Add, Sub, Sll, Slt,  Sltu,   Xor,   Srl, Sra,  Or,
+                                                           And, Mul, Mulh, Mulhsu, Mulhu, Div, Divu, Rem, Remu};
+            static constexpr std::array<IType, 6> iTypes{Addi, Slti, Sltiu, Xori, Ori, Andi};
+            static constexpr std::array<Shift, 3> shifts{Slli, Srli, Srai};
+            static constexpr std::array<IType, 5> loads{Lb, Lbu, Lh, Lhu, Lw};
+            static constexpr std::array<std::uint32_t, 5> loadSizes{1, 1, 2, 2, 4};
+            static constexpr std::array<IType, 3> stores{Sb, Sh, Sw};
+            static constexpr std::array<std::uint32_t, 3> storeSizes{1, 2, 4};
+            static constexpr std::array<Amo, 9> amos{AmoswapW, AmoaddW, AmoxorW, AmoandW, AmoorW,
+                                                     AmominW,  AmomaxW, AmominuW, AmomaxuW};
+
+            switch (Below(16))
+            {
+            case 0:
+            case 1:
+            case 2:
+            case 3:
+                return rTypes[Below(rTypes.size())](Rd(), AnyReg(), AnyReg());
+            case 4:
+            case 5:
+            case 6:
+                return iTypes[Below(iTypes.size())](Rd(), AnyReg(), Imm(-2048, 2047));
+            case 7:
+                return shifts[Below(shifts.size())](Rd(), AnyReg(), Below(32));
+            case 8:
+                return Below(2) == 0 ? Lui(Rd(), Below(1U << 20)) : Auipc(Rd(), Below(1U << 20));
+            case 9:
+            case 10:
+            {
+                auto const i = Below(loads.size());
+                return loads[i](Rd(), s0, DataOffset(loadSizes[i]));
+            }
+            case 11:
+            case 12:
+            {
+                auto const i = Below(stores.size());
+                return stores[i](AnyReg(), s0, DataOffset(storeSizes[i]));
+            }
+            case 13:
+                return amos[Below(amos.size())](Rd(), AnyReg(), s0);
+            case 14:
+                return Below(2) == 0 ? LrW(Rd(), s0) : ScW(Rd(), AnyReg(), s0);
+            default:
+                return Below(4) == 0 ? Fence() : Nop();
+            }
+        }
+
+        // Any instruction, including forward branches and jumps over up to `left` items.
+        auto Random(std::size_t left) -> Item
+        {
+            using Branch = std::uint32_t (*)(Reg, Reg, std::int32_t);
+            static constexpr std::array<Branch, 6> branches{Beq, Bne, Blt, Bge, Bltu, Bgeu};
+
+            auto const skip = std::min<std::size_t>(left, Below(6));
+            switch (Below(8))
+            {
+            case 0:
+            {
+                auto const branch = branches[Below(branches.size())];
+                auto const rs1 = AnyReg();
+                auto const rs2 = AnyReg();
+                return {.size = 4,
+                        .encode = [=](std::int32_t offset) { return Halves(branch(rs1, rs2, offset)); },
+                        .skip = skip};
+            }
+            case 1:
+            {
+                auto const rd = Rd();
+                return {.size = 4,
+                        .encode = [=](std::int32_t offset) { return Halves(Jal(rd, offset)); },
+                        .skip = skip};
+            }
+            case 2:
+            {
+                auto const rs1 = CompressedRd();
+                auto const ifZero = Below(2) == 0;
+                return {.size = 2,
+                        .encode = [=](std::int32_t offset) {
+                            return std::vector<std::uint16_t>{ifZero ? CBeqz(rs1, offset) : CBnez(rs1, offset)};
+                        },
+                        .skip = skip};
+            }
+            case 3:
+                return Compressed();
+            default:
+                return Fixed(Straight());
+            }
+        }
+
+        // A 16-bit instruction that falls through to the next.
+        auto Compressed() -> Item
+        {
+            auto const rd = CompressedRd();
+            auto const nonZero = [this] {
+                auto const imm = Imm(-32, 30);
+                return imm >= 0 ? imm + 1 : imm;
+            };
+            switch (Below(8))
+            {
+            case 0:
+                return Fixed(CAddi(rd, nonZero()));
+            case 1:
+                return Fixed(CLi(rd, Imm(-32, 31)));
+            case 2:
+                return Fixed(CSlli(rd, 1 + Below(31)));
+            case 3:
+                return Fixed(CMv(rd, static_cast<Reg>(1 + Below(31))));
+            case 4:
+                return Fixed(CAdd(rd, static_cast<Reg>(1 + Below(31))));
+            case 5:
+                return Fixed(CSub(rd, CompressedRd()));
+            case 6:
+                return Fixed(CLw(rd, s0, Below(32) * 4));
+            default:
+                return Fixed(CSw(CompressedRd(), s0, Below(32) * 4));
+            }
+        }
+
+        std::mt19937_64 m_random;
+    };
+
+    // FNV-1a, which is quick enough to hash the state at every checkpoint.
+    constexpr std::uint64_t hashBasis = 14695981039346656037U;
+
+    auto MixBytes(std::uint64_t hash, std::span<std::uint8_t const> bytes) -> std::uint64_t
+    {
+        for (auto const byte : bytes)
+        {
+            hash = (hash ^ byte) * 1099511628211U;
+        }
+        return hash;
+    }
+
+    template<typename T>
+    auto Mix(std::uint64_t hash, T const& value) -> std::uint64_t
+    {
+        return MixBytes(hash, std::span{reinterpret_cast<std::uint8_t const*>(&value), sizeof(value)});
+    }
+
+    // Hashes everything that every engine must agree on, which is all of the state apart from the cycle estimate.
+    auto Hash(owl::CpuState const& state) -> std::uint64_t
+    {
+        auto hash = hashBasis;
+        hash = Mix(hash, state.x);
+        hash = Mix(hash, state.pc);
+        hash = Mix(hash, state.reservation);
+        hash = Mix(hash, state.reserved);
+        return Mix(hash, state.instret);
+    }
+
+    auto Hash(std::vector<std::uint8_t> const& memory) -> std::uint64_t
+    {
+        return MixBytes(hashBasis, memory);
+    }
+
+    struct Lane
+    {
+        Lane(owl::Engine engine, std::vector<std::uint8_t> const& image) : memory{image}, cpu{memory}
+        {
+            cpu.SetEngine(engine);
+        }
+
+        std::vector<std::uint8_t> memory;
+        owl::Cpu cpu;
+    };
+
+    void Report(owl::Engine engine, std::uint64_t seed, std::uint64_t from, Lane const& lane, owl::Exit exit,
+                Lane const& reference, owl::Exit expectedExit)
+    {
+        std::cerr << "FAILED: engine " << static_cast<int>(engine) << " diverged from Engine::Switch on seed " << seed
+                  << " after instret " << from << ", by instret " << reference.cpu.State().instret << '\n';
+        auto const& expected = reference.cpu.State();
+        auto const& actual = lane.cpu.State();
+        auto const differs = [](auto const& name, std::uint64_t value, std::uint64_t expectedValue) {
+            if (value != expectedValue)
+            {
+                std::cerr << "  " << name << ' ' << value << " instead of " << expectedValue << '\n';
+            }
+        };
+        differs("exit", static_cast<std::uint64_t>(exit), static_cast<std::uint64_t>(expectedExit));
+        differs("pc", actual.pc, expected.pc);
+        differs("instret", actual.instret, expected.instret);
+        differs("reservation", actual.reservation, expected.reservation);
+        differs("reserved", actual.reserved, expected.reserved);
+        for (std::size_t i = 0; i < expected.x.size(); ++i)
+        {
+            auto name = std::string{"x"};
+            name += std::to_string(i);
+            differs(name, actual.x[i], expected.x[i]);
+        }
+        if (lane.memory != reference.memory)
+        {
+            std::cerr << "  memory differs\n";
+        }
+    }
+
+    // Runs a program on every engine until it has retired `instructions`, and returns true if they all agree.
+    auto Agrees(std::vector<owl::Engine> const& engines, std::uint64_t seed, std::uint64_t instructions) -> bool
+    {
+        auto const image = Generator{seed}.Program(200);
+        Lane reference{owl::Engine::Switch, image};
+        std::vector<std::unique_ptr<Lane>> lanes;
+        for (auto const engine : engines)
+        {
+            lanes.push_back(std::make_unique<Lane>(engine, image));
+        }
+
+        std::uint64_t agreed = 0;
+        for (std::size_t checkpoint = 1; agreed < instructions; ++checkpoint)
+        {
+            auto const cycles = instructions - agreed;
+            auto const exit = reference.cpu.Run(cycles);
+            if (exit != owl::Exit::Ecall && exit != owl::Exit::BudgetExhausted)
+            {
+                std::cerr << "FAILED: seed " << seed << " stopped with exit " << static_cast<int>(exit) << '\n';
+                return false;
+            }
+            auto const expected = Hash(reference.cpu.State());
+            auto const checkMemory = checkpoint % memoryCheckInterval == 0 || exit == owl::Exit::BudgetExhausted;
+            auto const expectedMemory = checkMemory ? Hash(reference.memory) : 0;
+            for (std::size_t i = 0; i < lanes.size(); ++i)
+            {
+                auto& lane = *lanes[i];
+                auto const laneExit = lane.cpu.Run(cycles);
+                if (laneExit != exit || Hash(lane.cpu.State()) != expected
+                    || (checkMemory && Hash(lane.memory) != expectedMemory))
+                {
+                    Report(engines[i], seed, agreed, lane, laneExit, reference, exit);
+                    return false;
+                }
+            }
+            agreed = reference.cpu.State().instret;
+        }
+        return true;
+    }
+
+    auto Argument(int argc, char** argv, int index, std::uint64_t otherwise) -> std::uint64_t
+    {
+        return index < argc ? std::stoull(argv[index]) : otherwise;
+    }
+} // namespace
+
+auto main(int argc, char** argv) -> int
+{
+    auto const instructions = Argument(argc, argv, 1, 2'000'000);
+    auto const programs = Argument(argc, argv, 2, 16);
+    auto const seed = Argument(argc, argv, 3, 1);
+
+    std::vector<owl::Engine> engines;
+    for (auto const engine : {owl::Engine::Threaded, owl::Engine::Block, owl::Engine::Tiered, owl::Engine::Timed})
+    {
+        if (owl::IsEngineAvailable(engine))
+        {
+            engines.push_back(engine);
+        }
+    }
+
+    auto passed = true;
+    for (std::uint64_t program = 0; program < programs; ++program)
+    {
+        passed &= Agrees(engines, seed + program, instructions);
+    }
+    return passed ? 0 : 1;
+}
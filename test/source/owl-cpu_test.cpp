@@ -1,10 +1,1786 @@
+#include "owl-cpu/coroutine.h"
+#include "owl-cpu/ecall.h"
+#include "owl-cpu/encoder.h"
+#include "owl-cpu/inline.h"
+#include "owl-cpu/loader.h"
 #include "owl-cpu/owl-cpu.h"
+#include "owl-cpu/profile.h"
+#include "owl-cpu/trace.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <iterator>
+#include <memory_resource>
+#include <span>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
 
-auto main() -> int
+namespace
 {
-    auto const exported = ExportedClass{};
+    using namespace owl::encode;
+
+    auto Assemble(std::initializer_list<std::uint32_t> code, std::size_t memorySize = 4096) -> std::vector<std::uint8_t>
+    {
+        std::vector<std::uint8_t> memory(memorySize);
+        std::memcpy(memory.data(), code.begin(), code.size() * sizeof(std::uint32_t));
+        return memory;
+    }
+
+    auto SumsALoop(owl::Engine engine) -> bool
+    {
+        // a0 = 1 + 2 + ... + 10
+        auto memory = Assemble({
+                Addi(a0, zero, 0),
+                Addi(t0, zero, 10),
+                Add(a0, a0, t0),  // loop:
+                Addi(t0, t0, -1), //
+                Bne(t0, zero, -8),
+                Ecall(),
+        });
+        owl::Cpu cpu{memory};
+        cpu.SetEngine(engine);
+        auto const exit = cpu.Run(1000);
+        auto const& state = cpu.State();
+        return exit == owl::Exit::Ecall && state.x[a0] == 55 && state.pc == 24 && state.instret == 2 + 3 * 10 + 1;
+    }
+
+    auto StopsWhenTheBudgetIsExhausted(owl::Engine engine) -> bool
+    {
+        auto memory = Assemble({Jal(zero, 0)});
+        owl::Cpu cpu{memory};
+        cpu.SetEngine(engine);
+        return cpu.Run(123) == owl::Exit::BudgetExhausted && cpu.State().instret == 123 && cpu.State().pc == 0;
+    }
+
+    auto ResumesAcrossSmallBudgets(owl::Engine engine) -> bool
+    {
+        auto memory = Assemble({
+                Addi(a0, zero, 0),
+                Addi(t0, zero, 100),
+                Add(a0, a0, t0),  // loop:
+                Addi(t0, t0, -1), //
+                Bne(t0, zero, -8),
+                Ecall(),
+        });
+        owl::Cpu cpu{memory};
+        cpu.SetEngine(engine);
+        auto exit = owl::Exit::BudgetExhausted;
+        auto runs = 0;
+        while (exit == owl::Exit::BudgetExhausted)
+        {
+            exit = cpu.Run(2);
+            ++runs;
+        }
+        auto const& state = cpu.State();
+        return exit == owl::Exit::Ecall && state.x[a0] == 5050 && state.instret == 2 + 3 * 100 + 1 && runs == 152;
+    }
+
+    auto LoadsAndStoresLittleEndian(owl::Engine engine) -> bool
+    {
+        auto memory = Assemble({
+                Lui(t0, 0x12345),
+                Addi(t0, t0, 0x678),
+                Sw(t0, zero, 256),
+                Lbu(a0, zero, 256),
+                Lh(a1, zero, 258),
+                Addi(t1, zero, -1),
+                Sb(t1, zero, 260),
+                Lb(a2, zero, 260),
+                Lbu(a3, zero, 260),
+                Ebreak(),
+        });
+        owl::Cpu cpu{memory};
+        cpu.SetEngine(engine);
+        auto const exit = cpu.Run(100);
+        auto const& x = cpu.State().x;
+        return exit == owl::Exit::Ebreak && x[a0] == 0x78 && x[a1] == 0x1234 && x[a2] == 0xffffffff && x[a3] == 0xff;
+    }
+
+    auto KeepsX0Zero(owl::Engine engine) -> bool
+    {
+        auto memory = Assemble({Addi(zero, zero, 42), Add(a0, zero, zero), Ecall()});
+        owl::Cpu cpu{memory};
+        cpu.SetEngine(engine);
+        return cpu.Run(10) == owl::Exit::Ecall && cpu.State().x[0] == 0 && cpu.State().x[a0] == 0;
+    }
+
+    auto RunsInstructionsWithX0Operands(owl::Engine engine) -> bool
+    {
+        auto memory = Assemble({
+                Addi(t0, zero, 7),
+                Add(t1, zero, t0),
+                Or(t2, t0, zero),
+                Lw(zero, zero, 256),
+                Beq(zero, t1, 8),
+                Bne(zero, t1, 8),
+                Ebreak(),
+                Jal(zero, 8),
+                Ebreak(),
+                Addi(a0, t2, 0),
+                Lui(zero, 1),
+                Addi(a1, zero, 5),
+                Xor(a1, zero, zero),
+                Jalr(zero, zero, 60),
+                Ebreak(),
+                Sub(a2, zero, t0), // 60:
+                Ecall(),
+        });
+        memory[256] = 0xff;
+        owl::Cpu cpu{memory};
+        cpu.SetEngine(engine);
+        auto const exit = cpu.Run(100);
+        auto const& state = cpu.State();
+        return exit == owl::Exit::Ecall && state.x[0] == 0 && state.x[t1] == 7 && state.x[t2] == 7 && state.x[a0] == 7
+               && state.x[a1] == 0 && state.x[a2] == 0xfffffff9 && state.instret == 14;
+    }
+
+    auto CallsAndReturns(owl::Engine engine) -> bool
+    {
+        auto memory = Assemble({
+                Jal(ra, 12),
+                Addi(a0, a0, 1),
+                Ecall(),
+                Addi(a0, zero, 41), // function:
+                Jalr(zero, ra, 0),
+        });
+        owl::Cpu cpu{memory};
+        cpu.SetEngine(engine);
+        return cpu.Run(100) == owl::Exit::Ecall && cpu.State().x[a0] == 42 && cpu.State().x[ra] == 4;
+    }
+
+    auto DividesLikeRiscV(owl::Engine engine) -> bool
+    {
+        auto memory = Assemble({
+                Addi(t0, zero, -7),
+                Addi(t1, zero, 2),
+                Div(a0, t0, t1),
+                Rem(a1, t0, t1),
+                Div(a2, t0, zero),
+                Remu(a3, t0, zero),
+                Mulh(a4, t0, t1),
+                Ecall(),
+        });
+        owl::Cpu cpu{memory};
+        cpu.SetEngine(engine);
+        auto const exit = cpu.Run(100);
+        auto const& x = cpu.State().x;
+        return exit == owl::Exit::Ecall && x[a0] == static_cast<std::uint32_t>(-3)
+               && x[a1] == static_cast<std::uint32_t>(-1) && x[a2] == 0xffffffff && x[a3] == x[t0]
+               && x[a4] == 0xffffffff;
+    }
+
+    auto ReportsFaults(owl::Engine engine) -> bool
+    {
+        auto loadMemory = Assemble({Lw(a0, zero, 4094)});
+        owl::Cpu load{loadMemory};
+        load.SetEngine(engine);
+
+        auto storeMemory = Assemble({Lui(t0, 1), Sw(zero, t0, 0)});
+        owl::Cpu store{storeMemory};
+        store.SetEngine(engine);
+
+        auto illegalMemory = Assemble({0xffffffff});
+        owl::Cpu illegal{illegalMemory};
+        illegal.SetEngine(engine);
+
+        auto misalignedMemory = Assemble({Nop()});
+        owl::Cpu misaligned{misalignedMemory, 1};
+        misaligned.SetEngine(engine);
+
+        auto runawayMemory = Assemble({Lui(t0, 1), Jalr(zero, t0, 0)});
+        owl::Cpu runaway{runawayMemory};
+        runaway.SetEngine(engine);
+
+        return load.Run(10) == owl::Exit::LoadFault && load.State().pc == 0 && store.Run(10) == owl::Exit::StoreFault
+               && store.State().pc == 4 && illegal.Run(10) == owl::Exit::IllegalInstruction
+               && misaligned.Run(10) == owl::Exit::MisalignedFetch && misaligned.State().pc == 1
+               && runaway.Run(10) == owl::Exit::FetchFault && runaway.State().pc == 4096;
+    }
+
+    auto SeesItsOwnCodeWrites(owl::Engine engine) -> bool
+    {
+        auto memory = Assemble({
+                Lw(t0, zero, 256),
+                Sw(t0, zero, 12),
+                Nop(),
+                Addi(a0, zero, 1), // overwritten by the store above
+                Ecall(),
+        });
+        constexpr auto replacement = Addi(a0, zero, 7);
+        std::memcpy(memory.data() + 256, &replacement, sizeof(replacement));
+        owl::Cpu cpu{memory};
+        cpu.SetEngine(engine);
+        return cpu.Run(100) == owl::Exit::Ecall && cpu.State().x[a0] == 7;
+    }
+
+    auto SeesHostCodeWritesAfterInvalidating(owl::Engine engine) -> bool
+    {
+        auto memory = Assemble({Addi(a0, zero, 1), Ecall()});
+        owl::Cpu cpu{memory};
+        cpu.SetEngine(engine);
+        auto const first = cpu.Run(100) == owl::Exit::Ecall && cpu.State().x[a0] == 1;
+
+        constexpr auto replacement = Addi(a0, zero, 2);
+        std::memcpy(memory.data(), &replacement, sizeof(replacement));
+        cpu.InvalidateCode(0, sizeof(replacement));
+        cpu.State().pc = 0;
+        return first && cpu.Run(100) == owl::Exit::Ecall && cpu.State().x[a0] == 2;
+    }
+
+    auto FaultsFetchingPastTheEndOfMemory(owl::Engine engine) -> bool
+    {
+        // The last code page is only partly backed by memory, which ends with the first half of a 4-byte instruction.
+        auto memory = Assemble({Lui(t0, 1), Jalr(zero, t0, 0)}, 4096 + 2);
+        memory[4096] = Nop() & 0xff;
+        owl::Cpu cpu{memory};
+        cpu.SetEngine(engine);
+        auto const exit = cpu.Run(10);
+        return exit == owl::Exit::FetchFault && cpu.State().pc == 4096 && cpu.State().instret == 2;
+    }
+
+    auto RunsInAnAddressSpace(owl::Engine engine) -> bool
+    {
+        constexpr std::array code{
+                Lui(t0, 0xfffff),
+                Addi(t1, zero, 123),
+                Sw(t1, t0, 2044),
+                Lw(a0, t0, 2044),
+                Sw(t1, zero, -4), // the very top of the address space
+                Lw(a1, zero, -4),
+                Ecall(),
+        };
+        owl::AddressSpace space;
+        auto const memory = space.View();
+        std::memcpy(memory.data() + 0x10000, code.data(), sizeof(code));
+        owl::Cpu cpu{space, 0x10000};
+        cpu.SetEngine(engine);
+        auto const exit = cpu.Run(100);
+        auto const& x = cpu.State().x;
+        return exit == owl::Exit::Ecall && x[a0] == 123 && x[a1] == 123 && memory[0xfffffffc] == 123
+               && memory.size() == owl::AddressSpace::size;
+    }
+
+    auto FaultsAtTheTopOfAnAddressSpace(owl::Engine engine) -> bool
+    {
+        // Each access straddles the top of the address space, so it faults rather than wrapping around to address zero
+        // or running off the end of the host's reservation.
+        owl::AddressSpace space;
+        auto const memory = space.View();
+        auto const faults = [engine, &space, memory](std::uint32_t access, owl::Exit expected, std::uint32_t pc) {
+            std::array const code{Addi(t0, zero, -2), Addi(t1, zero, -1), access};
+            std::memcpy(memory.data() + 0x10000, code.data(), sizeof(code));
+            owl::Cpu cpu{space, 0x10000};
+            cpu.SetEngine(engine);
+            return cpu.Run(100) == expected && cpu.State().pc == pc;
+        };
+        constexpr auto load = owl::Exit::LoadFault;
+        constexpr auto store = owl::Exit::StoreFault;
+        auto passed = faults(Lw(a0, zero, -2), load, 0x10008) && faults(Lhu(a0, zero, -1), load, 0x10008)
+                      && faults(Sw(t1, zero, -3), store, 0x10008) && faults(Sh(t1, zero, -1), store, 0x10008)
+                      && faults(LrW(a0, t0), load, 0x10008) && faults(AmoaddW(a0, t1, t0), store, 0x10008);
+
+        // The first half of a 32-bit instruction in the last two bytes.
+        memory[0xfffffffe] = 0x13;
+        passed = passed && faults(Jalr(zero, t0, 0), owl::Exit::FetchFault, 0xfffffffe);
+        return passed && memory[0] == 0 && memory[0xfffffffd] == 0 && memory[0xffffffff] == 0;
+    }
+
+    template<typename T>
+    void Put(std::vector<std::uint8_t>& bytes, std::size_t offset, T value)
+    {
+        std::memcpy(bytes.data() + offset, &value, sizeof(value));
+    }
+
+    auto WriteFile(char const* name, std::vector<std::uint8_t> const& bytes) -> std::filesystem::path
+    {
+        auto path = std::filesystem::temp_directory_path() / name;
+        std::ofstream{path, std::ios::binary}.write(reinterpret_cast<char const*>(bytes.data()),
+                                                    static_cast<std::streamsize>(bytes.size()));
+        return path;
+    }
+
+    auto LoadsElfSegments(owl::Engine engine) -> bool
+    {
+        // Text at 0x10000 and data at 0x20000, whose last 0x1ff8 bytes are bss. The data page is followed in the file
+        // by bytes that must not show through the bss.
+        constexpr std::array code{
+                Lui(t0, 0x20),
+                Lw(a0, t0, 0),
+                Lw(a1, t0, 8), // bss
+                Lui(t1, 0x21),
+                Lw(a2, t1, 0), // bss on the next page
+                Addi(a3, a0, 1),
+                Sw(a3, t0, 0),
+                Ecall(),
+        };
+        std::vector<std::uint8_t> elf(0x3000, 0xee);
+        std::fill_n(elf.begin(), 0x1000, std::uint8_t{0});
+        elf[0] = 0x7f;
+        elf[1] = 'E';
+        elf[2] = 'L';
+        elf[3] = 'F';
+        elf[4] = 1; // 32-bit
+        elf[5] = 1; // little-endian
+        elf[6] = 1;
+        Put<std::uint16_t>(elf, 16, 2);   // executable
+        Put<std::uint16_t>(elf, 18, 243); // RISC-V
+        Put<std::uint32_t>(elf, 20, 1);
+        Put<std::uint32_t>(elf, 24, 0x10000); // entry
+        Put<std::uint32_t>(elf, 28, 52);      // program headers
+        Put<std::uint16_t>(elf, 40, 52);
+        Put<std::uint16_t>(elf, 42, 32);
+        Put<std::uint16_t>(elf, 44, 2);
+        for (auto const [header, offset, address, fileSize, memorySize] :
+             {std::array<std::uint32_t, 5>{52, 0x1000, 0x10000, sizeof(code), sizeof(code)},
+              std::array<std::uint32_t, 5>{84, 0x2000, 0x20000, 8, 0x2000}})
+        {
+            Put<std::uint32_t>(elf, header, 1); // PT_LOAD
+            Put<std::uint32_t>(elf, header + 4, offset);
+            Put<std::uint32_t>(elf, header + 8, address);
+            Put<std::uint32_t>(elf, header + 16, fileSize);
+            Put<std::uint32_t>(elf, header + 20, memorySize);
+        }
+        std::memcpy(elf.data() + 0x1000, code.data(), sizeof(code));
+        Put<std::uint32_t>(elf, 0x2000, 41);
+        auto const path = WriteFile("owl-cpu_test.elf", elf);
+
+        owl::AddressSpace space;
+        auto const image = owl::LoadElf(space, path);
+        owl::Cpu cpu{space, image.entry};
+        cpu.SetEngine(engine);
+        auto const exit = cpu.Run(100);
+        auto const& x = cpu.State().x;
+
+        // The guest's store must not reach the file.
+        std::ifstream file{path, std::ios::binary};
+        std::uint32_t stored{};
+        file.seekg(0x2000);
+        file.read(reinterpret_cast<char*>(&stored), sizeof(stored));
+        std::filesystem::remove(path);
+
+        return exit == owl::Exit::Ecall && image.entry == 0x10000 && x[a0] == 41 && x[a1] == 0 && x[a2] == 0
+               && x[a3] == 42 && stored == 41 && image.mappedBytes + image.copiedBytes == sizeof(code) + 8;
+    }
+
+    auto LoadsRawBinaries(owl::Engine engine) -> bool
+    {
+        std::vector<std::uint8_t> binary(3 * sizeof(std::uint32_t));
+        Put(binary, 0, Addi(a0, zero, 42));
+        Put(binary, 4, Auipc(a1, 0));
+        Put(binary, 8, Ecall());
+        auto const path = WriteFile("owl-cpu_test.bin", binary);
+
+        owl::AddressSpace space;
+        auto const image = owl::LoadBinary(space, path, 0x8000);
+        std::filesystem::remove(path);
+        owl::Cpu cpu{space, image.entry};
+        cpu.SetEngine(engine);
+        auto const ran = cpu.Run(100) == owl::Exit::Ecall && cpu.State().x[a0] == 42 && cpu.State().x[a1] == 0x8004;
+
+        // A directory opens but can't be mapped, and failing to load it mustn't leave it open, which the host can
+        // count if it lists its descriptors in /proc.
+        auto const descriptors = [] {
+            std::error_code error;
+            auto const listing = std::filesystem::directory_iterator{"/proc/self/fd", error};
+            return error ? 0 : std::distance(listing, std::filesystem::directory_iterator{});
+        };
+        auto const before = descriptors();
+        auto failures = 0;
+        for (auto i = 0; i < 10; ++i)
+        {
+            try
+            {
+                owl::LoadBinary(space, std::filesystem::temp_directory_path(), 0x8000);
+            }
+            catch (std::runtime_error const&)
+            {
+                ++failures;
+            }
+        }
+        return ran && failures == 10 && descriptors() == before;
+    }
+
+    auto AgreesWithTheSwitchEngineOnHotCode(owl::Engine engine) -> bool
+    {
+        // A loop that runs long enough for the tiered engine to compile it, and that mixes instructions that compiled
+        // code handles with ones that it leaves to the interpreter.
+        auto const program = Assemble(
+                {
+                        Addi(s0, zero, 300),  // iterations
+                        Lui(s1, 1),           // data at 4096
+                        Addi(a0, zero, 1),    //
+                        Addi(a1, zero, -5),   //
+                        Andi(t0, s0, 63),     // loop:
+                        Slli(t0, t0, 2),      //
+                        Add(t0, t0, s1),      //
+                        Lw(t1, t0, 0),        //
+                        Add(t1, t1, a0),      //
+                        Sw(t1, t0, 0),        //
+                        Sh(a1, t0, 258),      //
+                        Lh(t2, t0, 258),      //
+                        Lbu(t3, t0, 258),     //
+                        Sb(t3, t0, 512),      //
+                        Lb(t4, t0, 512),      //
+                        Mul(a0, a0, s0),      //
+                        Xori(a0, a0, 0x5a5),  //
+                        Srai(t5, a0, 3),      //
+                        Srl(t6, a0, s0),      //
+                        Sra(t5, t5, t6),      //
+                        Or(a2, t5, t4),       //
+                        Slt(a3, t2, a0),      //
+                        Sltiu(a4, t3, 200),   //
+                        Divu(a5, a0, s0),     // left to the interpreter
+                        Sub(a6, a5, a2),      //
+                        Auipc(a7, 0),         //
+                        Jal(ra, 20),          // call function
+                        Addi(s0, s0, -1),     //
+                        Bne(s0, zero, -96),   // to loop
+                        Ecall(),              //
+                        Nop(),                //
+                        Xor(a1, a1, a6),      // function:
+                        Bltu(a1, a3, 8),      //
+                        Sll(a1, a1, a4),      //
+                        Jalr(zero, ra, 0),    //
+                },
+                8192);
+
+        auto reference = program;
+        owl::Cpu expected{reference};
+        expected.SetEngine(owl::Engine::Switch);
+        auto const expectedExit = expected.Run(100000);
+
+        // Run in odd sized slices so that the tiers hand over to each other in the middle of the loop.
+        auto memory = program;
+        owl::Cpu cpu{memory};
+        cpu.SetEngine(engine);
+        auto exit = owl::Exit::BudgetExhausted;
+        for (auto runs = 0; exit == owl::Exit::BudgetExhausted && runs < 10000; ++runs)
+        {
+            exit = cpu.Run(37);
+        }
+        auto const& state = cpu.State();
+        return expectedExit == owl::Exit::Ecall && exit == expectedExit && state.x == expected.State().x
+               && state.pc == expected.State().pc && state.instret == expected.State().instret && memory == reference;
+    }
+
+    auto SeesItsOwnCodeWritesFromHotCode(owl::Engine engine) -> bool
+    {
+        // The loop stores to data until its last iteration, when it patches the instruction that follows it.
+        auto memory = Assemble(
+                {
+                        Addi(t0, zero, 100),  // iterations
+                        Lw(t1, zero, 512),    // the replacement
+                        Lui(s0, 1),           // data at 4096
+                        Addi(s1, zero, 48),   //
+                        Sub(s1, s1, s0),      // the distance from the data to the patch
+                        Sltiu(t3, t0, 2),     // loop: t3 = t0 == 1
+                        Sub(t3, zero, t3),    //
+                        And(t3, t3, s1),      //
+                        Add(t3, t3, s0),      //
+                        Sw(t1, t3, 0),        //
+                        Addi(t0, t0, -1),     //
+                        Bne(t0, zero, -24),   // to loop
+                        Addi(a1, zero, 1),    // patched by the last iteration
+                        Ecall(),              //
+                },
+                8192);
+        constexpr auto replacement = Addi(a1, zero, 7);
+        std::memcpy(memory.data() + 512, &replacement, sizeof(replacement));
+        owl::Cpu cpu{memory};
+        cpu.SetEngine(engine);
+        auto const exit = cpu.Run(10000);
+        std::uint32_t stored{};
+        std::memcpy(&stored, memory.data() + 4096, sizeof(stored));
+        return exit == owl::Exit::Ecall && cpu.State().x[a1] == 7 && stored == replacement
+               && cpu.State().instret == 5 + 7 * 100 + 2;
+    }
+
+    // Increments the word at 4096, then stores a countdown to the word at 8192 for long enough to get hot.
+    auto AssembleCounter(std::size_t memorySize) -> std::vector<std::uint8_t>
+    {
+        auto memory = Assemble(
+                {
+                        Lui(s0, 1),
+                        Lui(s1, 2),
+                        Lw(a0, s0, 0),
+                        Addi(a0, a0, 1),
+                        Sw(a0, s0, 0),
+                        Addi(t0, zero, 200),
+                        Sw(t0, s1, 0), // loop:
+                        Addi(t0, t0, -1),
+                        Bne(t0, zero, -8),
+                        Ecall(),
+                },
+                memorySize);
+        memory[4096] = 41;
+        return memory;
+    }
+
+    constexpr std::uint64_t counterInstructions = 6 + 3 * 200 + 1;
+
+    auto RestoresASnapshot(owl::Engine engine) -> bool
+    {
+        auto memory = AssembleCounter(16384);
+        auto const original = memory;
+        owl::Cpu cpu{memory};
+        cpu.SetEngine(engine);
+        auto const snapshot = cpu.Snapshot();
+
+        auto passed = true;
+        for (auto i = 0; i < 3; ++i)
+        {
+            passed &= cpu.Run(1000) == owl::Exit::Ecall && cpu.State().x[a0] == 42 && memory[4096] == 42
+                      && cpu.State().instret == counterInstructions;
+
+            // The host replaces the ecall and writes to a page that the guest never touches.
+            constexpr auto replacement = Ebreak();
+            std::memcpy(memory.data() + 36, &replacement, sizeof(replacement));
+            cpu.InvalidateCode(36, sizeof(replacement));
+            memory[12288] = 1;
+            cpu.InvalidateCode(12288, 1);
+
+            cpu.Restore(snapshot);
+            passed &= memory == original && cpu.State().pc == 0 && cpu.State().instret == 0;
+        }
+
+        // Restoring a snapshot that isn't the core's latest puts back the whole of memory.
+        std::vector<std::uint8_t> other(memory.size());
+        owl::Cpu stranger{other};
+        stranger.Restore(snapshot);
+        return passed && other == original && stranger.Run(1000) == owl::Exit::Ecall && stranger.State().x[a0] == 42;
+    }
+
+    auto ForksACore(owl::Engine engine) -> bool
+    {
+        auto memory = AssembleCounter(16384);
+        auto const original = memory;
+        owl::Cpu cpu{memory};
+        cpu.SetEngine(engine);
+        auto const snapshot = cpu.Snapshot();
+        // Stop in the middle of the loop, after it has stored 200, 199 ... 196.
+        auto passed = cpu.Run(20) == owl::Exit::BudgetExhausted;
+
+        std::vector<std::uint8_t> copy(memory.size(), 0xcc);
+        auto fork = cpu.Fork(copy);
+        passed &= copy == memory && fork.State().pc == cpu.State().pc && fork.GetEngine() == engine;
+        passed &= fork.Run(1000) == owl::Exit::Ecall && fork.State().x[a0] == 42
+                  && fork.State().instret == counterInstructions && copy[8192] == 1 && memory[8192] == 196;
+        fork.Restore(snapshot);
+        passed &= copy == original && memory[8192] == 196;
+
+        // A core in an address space forks into another one.
+        owl::AddressSpace space;
+        std::memcpy(space.View().data(), original.data(), original.size());
+        owl::Cpu flat{space};
+        flat.SetEngine(engine);
+        auto const flatSnapshot = flat.Snapshot();
+        passed &= flat.Run(20) == owl::Exit::BudgetExhausted;
+        owl::AddressSpace forkSpace;
+        auto flatFork = flat.Fork(forkSpace);
+        passed &= flatFork.Run(1000) == owl::Exit::Ecall && flatFork.State().x[a0] == 42;
+        flatFork.Restore(flatSnapshot);
+        auto const restored = forkSpace.View();
+        return passed && std::equal(original.begin(), original.end(), restored.begin()) && restored[16384] == 0;
+    }
+
+    // A memory resource that counts what is outstanding from it.
+    class CountingResource : public std::pmr::memory_resource
+    {
+    public:
+        std::size_t allocations{};
+        std::size_t outstanding{};
+
+    private:
+        auto do_allocate(std::size_t bytes, std::size_t alignment) -> void* override
+        {
+            ++allocations;
+            ++outstanding;
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+
+        void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+        {
+            --outstanding;
+            std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+        }
+
+        auto do_is_equal(std::pmr::memory_resource const& other) const noexcept -> bool override
+        {
+            return this == &other;
+        }
+    };
+
+    auto AllocatesFromAMemoryResource(owl::Engine engine) -> bool
+    {
+        auto memory = AssembleCounter(16384);
+        std::vector<std::uint8_t> copy(memory.size());
+        CountingResource resource;
+        auto passed = true;
+        {
+            owl::Cpu cpu{memory, 0, &resource};
+            cpu.SetEngine(engine);
+            auto const snapshot = cpu.Snapshot();
+            passed &= cpu.Run(1000) == owl::Exit::Ecall && cpu.State().x[a0] == 42;
+            auto const used = resource.allocations;
+
+            // A fork allocates from its parent's resource.
+            auto fork = cpu.Fork(copy);
+            cpu.Restore(snapshot);
+            fork.Restore(snapshot);
+            passed &= cpu.Run(1000) == owl::Exit::Ecall && fork.Run(1000) == owl::Exit::Ecall;
+            passed &= used > 0 && resource.allocations > used && fork.State().x[a0] == 42;
+        }
+        passed &= resource.outstanding == 0;
+
+        // So can cores that share the library's pool.
+        auto fresh = AssembleCounter(16384);
+        owl::Cpu pooled{fresh, 0, owl::SharedPool()};
+        pooled.SetEngine(engine);
+        return passed && pooled.Run(1000) == owl::Exit::Ecall && pooled.State().x[a0] == 42;
+    }
+
+    auto ProfilesExecution(owl::Engine engine) -> bool
+    {
+        // Enough iterations for the tiered engine to compile the loop, so that compiled code is counted too.
+        auto memory = Assemble({
+                Addi(a0, zero, 0),
+                Addi(t0, zero, 100),
+                Add(a0, a0, t0),  // loop:
+                Addi(t0, t0, -1), //
+                Bne(t0, zero, -8),
+                Ecall(),
+        });
+        owl::Cpu cpu{memory};
+        cpu.SetEngine(engine);
+        owl::ResetProfile();
+        auto const exit = cpu.Run(1000);
+        auto const profile = owl::CollectProfile();
+
+        auto const count = [&](std::string const& name) {
+            auto const op = std::ranges::find(profile.operations, name, &owl::Profile::Operation::name);
+            return op == profile.operations.end() ? ~std::uint64_t{} : op->count;
+        };
+        if (!owl::IsProfilerAvailable())
+        {
+            return exit == owl::Exit::Ecall && count("Add") == 0 && profile.blocks.empty() && profile.branches.empty();
+        }
+
+        auto passed = exit == owl::Exit::Ecall && count("Li") == 2 && count("Add") == 100 && count("Addi") == 100
+                      && count("Bnez") == 100 && count("Ecall") == 1 && profile.branches.size() == 1
+                      && profile.branches[0].pc == 16 && profile.branches[0].taken == 99
+                      && profile.branches[0].notTaken == 1;
+        if (engine == owl::Engine::Block || engine == owl::Engine::Tiered)
+        {
+            // The first block runs from the start to the first branch, then the loop repeats from its second
+            // instruction.
+            passed &= profile.blocks.size() == 3 && profile.blocks[0].pc == 0 && profile.blocks[0].hits == 1
+                      && profile.blocks[1].pc == 8 && profile.blocks[1].hits == 99 && profile.blocks[2].pc == 20;
+        }
+
+        std::ostringstream csv;
+        owl::WriteProfileCsv(profile, csv);
+        std::ostringstream binary;
+        owl::WriteProfileBinary(profile, binary);
+        auto const expectedSize = 28 + 24 * profile.operations.size() + 16 * profile.blocks.size()
+                                  + 24 * profile.branches.size() + 24 * profile.fusions.size();
+        return passed && csv.str().find("\nop,Add,100,\n") != std::string::npos
+               && csv.str().find("\nbranch,0x00000010,100,99\n") != std::string::npos
+               && csv.str().find("\nfusion,AddiBnez,") != std::string::npos && binary.str().size() == expectedSize
+               && binary.str().starts_with(std::string{"OWLPROF\0", 8});
+    }
+
+    auto FusesInstructionPairs(owl::Engine engine) -> bool
+    {
+        // Pairs that the block engines fuse, with results that show that both instructions of each one ran.
+        auto memory = Assemble({
+                Lui(a0, 0x12345),
+                Addi(a0, a0, 0x678),
+                Addi(t0, zero, 5),
+                Slli(a1, t0, 2),
+                Add(a1, a1, a0),
+                Slt(a2, t0, a0),
+                Bne(a2, zero, 8),
+                Ebreak(),
+                Auipc(t1, 0),
+                Jalr(ra, t1, 12),
+                Ebreak(),
+                Sltiu(a3, t0, 4),
+                Beq(a3, zero, 8),
+                Ebreak(),
+                Ecall(),
+        });
+        owl::Cpu cpu{memory};
+        cpu.SetEngine(engine);
+        owl::ResetProfile();
+        auto const exit = cpu.Run(100);
+        auto const& state = cpu.State();
+        auto passed = exit == owl::Exit::Ecall && state.x[a0] == 0x12345678 && state.x[a1] == 0x12345678 + 20
+                      && state.x[a2] == 1 && state.x[t1] == 32 && state.x[ra] == 40 && state.x[a3] == 0
+                      && state.pc == 60 && state.instret == 12;
+
+        // Only the block engines dispatch fused pairs, and none of these blocks gets hot enough to be compiled.
+        auto const profile = owl::CollectProfile();
+        auto const fused = engine == owl::Engine::Block || engine == owl::Engine::Tiered;
+        auto const expected = owl::IsProfilerAvailable() && fused ? 1U : 0U;
+        for (auto const& fusion : profile.fusions)
+        {
+            auto const name = std::string{fusion.name};
+            auto const used = name == "LiAddi" || name == "SlliAdd" || name == "SltBnez" || name == "AuipcJalr"
+                              || name == "SltiuBeqz";
+            passed &= fusion.count == (used ? expected : 0);
+        }
+        return passed;
+    }
+
+    auto EstimatesCycles(owl::Engine engine) -> bool
+    {
+        auto memory = Assemble({
+                Addi(t0, zero, 3),
+                Lw(t1, zero, 256),
+                Add(t2, t1, t0), // which waits for the load
+                Mul(t3, t2, t2),
+                Div(t4, t3, t0),
+                Addi(t0, t0, -1), // loop:
+                Bne(t0, zero, -4),
+                Jal(zero, 8),
+                Ebreak(),
+                Ecall(),
+        });
+        owl::Cpu cpu{memory};
+        cpu.SetEngine(engine);
+        auto const exit = cpu.Run(100);
+        auto const& state = cpu.State();
+        auto const instret = std::uint64_t{5 + 2 * 3 + 2};
+        // One cycle each, 1 for the load-use stall, 2 for the multiply, 32 for the divide, 2 for each of the two
+        // taken branches and 1 for the jump.
+        auto const expected = engine == owl::Engine::Timed ? instret + 1 + 2 + 32 + 2 * 2 + 1 : 0;
+        return exit == owl::Exit::Ecall && state.instret == instret && state.cycle == expected;
+    }
+
+    auto RunsCompressedCode(owl::Engine engine) -> bool
+    {
+        std::vector<std::uint8_t> memory(8192);
+        auto const put = [&](std::uint32_t address, auto insn) {
+            std::memcpy(memory.data() + address, &insn, sizeof(insn));
+        };
 
-    return std::string("owl-cpu") == exported.name() ? 0 : 1;
+        // a0 = 1 + 2 + ... + 100, enough for the tiered engine to compile the loop, with four-byte instructions that
+        // are only aligned to two, then a call to a compressed function that stores a0, reloads it and doubles it.
+        put(0, CLi(a0, 0));
+        put(2, Addi(a1, zero, 100));
+        put(6, CAdd(a0, a1)); // loop:
+        put(8, CAddi(a1, -1));
+        put(10, CBnez(a1, -4));
+        put(12, Lui(s0, 1));
+        put(16, CJal(6));
+        put(18, Ecall());
+        put(22, CSw(a0, s0, 4));
+        put(24, CLw(a2, s0, 4));
+        put(26, CSlli(a2, 1));
+        put(28, CJr(ra));
+        owl::Cpu cpu{memory};
+        cpu.SetEngine(engine);
+        auto const exit = cpu.Run(1000);
+        auto const& state = cpu.State();
+        auto const ran = exit == owl::Exit::Ecall && state.instret == 2 + 3 * 100 + 6 + 1 && state.pc == 22
+                         && state.x[a0] == 5050 && state.x[a2] == 10100 && state.x[ra] == 18;
+
+        // A four-byte instruction at the end of the first page ends in the second, where the guest rewrites its
+        // immediate between two calls to it.
+        std::vector<std::uint8_t> straddling(8192);
+        memory.swap(straddling);
+        put(0, Jal(ra, 4094));
+        put(4, Lui(t0, 1));
+        put(8, Lhu(t1, t0, 0));
+        put(12, Addi(t1, t1, 1 << 4)); // adds 1 to the immediate, which starts at bit 20 of the instruction
+        put(16, Sh(t1, t0, 0));
+        put(20, Jal(ra, 4094 - 20));
+        put(24, Ecall());
+        put(4094, Addi(a0, a0, 1));
+        put(4098, CJr(ra));
+        memory.swap(straddling);
+        owl::Cpu rewriting{straddling};
+        rewriting.SetEngine(engine);
+        return ran && rewriting.Run(100) == owl::Exit::Ecall && rewriting.State().x[a0] == 3;
+    }
+
+    auto ExecutesAtomics(owl::Engine engine) -> bool
+    {
+        auto memory = Assemble(
+                {
+                        Lui(a1, 1),             // a1 = 4096, which holds 5
+                        Addi(t0, zero, 5),      //
+                        Sw(t0, a1, 0),          //
+                        Addi(a2, zero, -3),     //
+                        AmoaddW(a3, a2, a1),    // a3 = 5, leaving 2
+                        AmominW(a4, a2, a1),    // a4 = 2, leaving -3
+                        AmomaxuW(a5, t0, a1),   // a5 = -3, leaving -3, which is larger unsigned
+                        AmoswapW(a6, t0, a1),   // a6 = -3, leaving 5
+                        ScW(a7, a2, a1),        // fails without a reservation
+                        LrW(s2, a1),            // s2 = 5
+                        ScW(s3, a2, a1),        // succeeds, leaving -3
+                        ScW(s4, t0, a1),        // fails, because the last sc.w used the reservation
+                        AmoxorW(zero, t0, a1),  // leaving -3 ^ 5
+                        Lw(s5, a1, 0),          //
+                        Ecall(),                //
+                        Addi(a1, a1, 2),        //
+                        AmoorW(zero, t0, a1),   // faults, because it is misaligned
+                },
+                8192);
+        owl::Cpu cpu{memory};
+        cpu.SetEngine(engine);
+        auto const ran = cpu.Run(100) == owl::Exit::Ecall;
+        auto const& x = cpu.State().x;
+        auto const minus3 = static_cast<std::uint32_t>(-3);
+        auto const results = x[a3] == 5 && x[a4] == 2 && x[a5] == minus3 && x[a6] == minus3 && x[a7] == 1
+                             && x[s2] == 5 && x[s3] == 0 && x[s4] == 1 && x[s5] == (minus3 ^ 5);
+        return ran && results && cpu.Run(100) == owl::Exit::StoreFault && cpu.State().pc == 64;
+    }
+
+    auto RunsHartsInParallel(owl::Engine engine) -> bool
+    {
+        // Each hart counts to 1000 twice in shared memory, once with amoadd.w and once with lr.w and sc.w.
+        constexpr std::size_t harts = 4;
+        constexpr std::uint32_t counts = 1000;
+        auto memory = Assemble(
+                {
+                        Lui(a1, 1),             // a1 = 4096
+                        Addi(a4, a1, 4),        // a4 = 4100
+                        Addi(a2, zero, counts), //
+                        Addi(a3, zero, 1),      //
+                        AmoaddW(zero, a3, a1),  // loop:
+                        LrW(t0, a4),            // retry:
+                        Addi(t0, t0, 1),        //
+                        ScW(t1, t0, a4),        //
+                        Bne(t1, zero, -12),     // to retry
+                        Addi(a2, a2, -1),       //
+                        Bne(a2, zero, -24),     // to loop
+                        Ecall(),                //
+                },
+                8192);
+        std::vector<owl::Cpu> cpus;
+        cpus.reserve(harts);
+        cpus.emplace_back(memory);
+        cpus.back().SetEngine(engine);
+        cpus.back().ShareCode(harts); // so that the harts look up each other's translations at the same time
+        for (std::size_t i = 1; i < harts; ++i)
+        {
+            cpus.push_back(cpus.front().AddHart(0));
+        }
+
+        std::vector<owl::Exit> exits(harts);
+        std::vector<std::thread> threads;
+        for (std::size_t i = 0; i < harts; ++i)
+        {
+            threads.emplace_back([&, i] { exits[i] = cpus[i].Run(1000000); });
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        std::array<std::uint32_t, 2> counters{};
+        std::memcpy(counters.data(), memory.data() + 4096, sizeof(counters));
+        auto const ran = std::ranges::all_of(exits, [](owl::Exit exit) { return exit == owl::Exit::Ecall; });
+        auto const sameEngine = cpus.back().GetEngine() == engine && cpus.back().Memory().data() == memory.data();
+        return ran && sameEngine && counters[0] == harts * counts && counters[1] == harts * counts;
+    }
+
+    auto SharesTranslatedCode(owl::Engine engine) -> bool
+    {
+        // Three cores share code for the same image, but the third's differs, so it mustn't use the others' pages.
+        constexpr std::uint64_t image = 0x5eed;
+        auto const program = Assemble({Addi(a0, zero, 7), Ecall()});
+        auto first = program;
+        auto second = program;
+        auto third = Assemble({Addi(a0, zero, 9), Ecall()});
+        auto const run = [engine](owl::Cpu& cpu) {
+            cpu.SetEngine(engine);
+            cpu.State().pc = 0;
+            return cpu.Run(100) == owl::Exit::Ecall ? cpu.State().x[a0] : 0;
+        };
+        owl::Cpu a{first};
+        owl::Cpu b{second};
+        owl::Cpu c{third};
+        a.ShareCode(image);
+        b.ShareCode(image);
+        c.ShareCode(image);
+        auto passed = run(a) == 7 && run(b) == 7 && run(c) == 9;
+
+        // The host rewrites the first core's code, which only that core sees.
+        auto const rewritten = Addi(a0, zero, 5);
+        std::memcpy(first.data(), &rewritten, sizeof(rewritten));
+        a.InvalidateCode(0, sizeof(rewritten));
+        passed = passed && run(a) == 5 && run(b) == 7;
+
+        // A fork shares code like its parent.
+        std::vector<std::uint8_t> forked(program.size());
+        auto fork = b.Fork(forked);
+        return passed && run(fork) == 7;
+    }
+
+    auto SharesCodeThatStoresToItsPage(owl::Engine engine) -> bool
+    {
+        // Two cores count in a word on the same page as their loop, so every store changes the page's bytes. Once the
+        // page has had enough translations, the cores translate it for themselves, so the shared code stops growing.
+        constexpr std::uint64_t image = 0x5e1f;
+        auto const program = Assemble({
+                Lw(t1, zero, 0x400), // loop:
+                Addi(t1, t1, 1),
+                Sw(t1, zero, 0x400),
+                Addi(t0, t0, -1),
+                Bne(t0, zero, -16), // to loop
+                Ecall(),
+        });
+        auto first = program;
+        auto second = program;
+        owl::Cpu a{first};
+        owl::Cpu b{second};
+        a.ShareCode(image);
+        b.ShareCode(image);
+        auto const count = [engine](owl::Cpu& cpu, std::uint32_t times) {
+            cpu.SetEngine(engine);
+            cpu.State().pc = 0;
+            cpu.State().x[t0] = times;
+            return cpu.Run(10 * times) == owl::Exit::Ecall;
+        };
+        auto const path = std::filesystem::temp_directory_path() / "owl-cpu-test-stores.code";
+        auto const savedSize = [&a, &path] {
+            a.SaveSharedCode(path);
+            return std::filesystem::file_size(path);
+        };
+
+        auto passed = count(a, 100) && count(b, 100);
+        auto const before = savedSize();
+        passed = passed && count(a, 1000) && count(b, 1000) && savedSize() == before;
+        std::filesystem::remove(path);
+
+        std::uint32_t counted{};
+        std::memcpy(&counted, first.data() + 0x400, sizeof(counted));
+        auto const same = std::equal(first.begin(), first.end(), second.begin());
+        return passed && counted == 1100 && same;
+    }
+
+    auto SavesSharedCode(owl::Engine engine) -> bool
+    {
+        // Each core is the only one sharing code for the image while it runs, so it starts from whatever is saved.
+        constexpr std::uint64_t image = 0x5a7ed;
+        auto const path = std::filesystem::temp_directory_path() / "owl-cpu-test.code";
+        std::filesystem::remove(path);
+        auto const run = [engine, &path](std::vector<std::uint8_t> memory, std::uint64_t key) {
+            owl::Cpu cpu{memory};
+            cpu.ShareCode(key, path);
+            cpu.SetEngine(engine);
+            auto const result = cpu.Run(100) == owl::Exit::Ecall ? cpu.State().x[a0] : 0;
+            cpu.SaveSharedCode(path);
+            return result;
+        };
+
+        // The first run saves its pages, which later runs start from, and save again along with their own.
+        auto const program = Assemble({Addi(a0, zero, 7), Ecall()});
+        auto passed = run(program, image) == 7 && run(program, image) == 7;
+
+        // Saved pages of different code aren't used, and nor is a file saved for a different image, or a damaged one.
+        passed = passed && run(Assemble({Addi(a0, zero, 9), Ecall()}), image) == 9 && run(program, image) == 7
+                 && run(Assemble({Addi(a0, zero, 5), Ecall()}), image + 1) == 5 && run(program, image) == 7;
+        std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+        passed = passed && run(program, image) == 7;
+        std::filesystem::remove(path);
+
+        // A core that doesn't share its code has none to save.
+        auto memory = program;
+        owl::Cpu unshared{memory};
+        try
+        {
+            unshared.SaveSharedCode(path);
+            return false;
+        }
+        catch (std::invalid_argument const&)
+        {
+            return passed && !std::filesystem::exists(path);
+        }
+    }
+
+    // A console that collects the bytes written to its first register, and reports how many there are in its second.
+    class ConsoleDevice : public owl::Device
+    {
+    public:
+        auto Read(std::uint32_t offset, std::uint32_t size, std::uint32_t& value) -> bool override
+        {
+            if (offset == 4 && size == 4)
+            {
+                value = static_cast<std::uint32_t>(written.size());
+                return true;
+            }
+            if (offset == 8 && size == 2)
+            {
+                value = 0xfffe;
+                return true;
+            }
+            return false;
+        }
+
+        auto Write(std::uint32_t offset, std::uint32_t size, std::uint32_t value) -> bool override
+        {
+            if (offset != 0 || size != 1)
+            {
+                return false;
+            }
+            written.push_back(static_cast<std::uint8_t>(value));
+            return true;
+        }
+
+        std::vector<std::uint8_t> written;
+    };
+
+    auto AccessesDevices(owl::Engine engine) -> bool
+    {
+        // Writes 100 down to 1 to the console, enough for the tiered engine to compile the loop, then reads it back.
+        auto memory = Assemble({
+                Lui(t0, 0x10),
+                Addi(t1, zero, 100),
+                Sb(t1, t0, 0), // loop:
+                Addi(t1, t1, -1),
+                Bne(t1, zero, -8),
+                Lw(a0, t0, 4),
+                Lh(a1, t0, 8),
+                Sw(a0, t0, 0), // which the console refuses
+        });
+        owl::Cpu cpu{memory};
+        cpu.SetEngine(engine);
+        ConsoleDevice console;
+        cpu.AttachDevice(0x10000, 16, console);
+        auto const exit = cpu.Run(1000);
+        auto const& state = cpu.State();
+        auto passed = exit == owl::Exit::StoreFault && state.pc == 28 && state.instret == 2 + 3 * 100 + 2
+                      && state.x[a0] == 100 && state.x[a1] == 0xfffffffe && console.written.size() == 100
+                      && console.written.front() == 100 && console.written.back() == 1;
+
+        // Windows can't overlap guest memory or each other, and must fit in the address space.
+        auto const refused = [&](owl::Cpu& core, std::uint32_t base, std::uint32_t size) {
+            try
+            {
+                core.AttachDevice(base, size, console);
+                return false;
+            }
+            catch (std::invalid_argument const&)
+            {
+                return true;
+            }
+        };
+        passed &= refused(cpu, 4092, 16) && refused(cpu, 0x10008, 16) && refused(cpu, 0xfffffff0, 32)
+                  && refused(cpu, 0x20000, 0);
+        owl::AddressSpace space;
+        owl::Cpu flat{space};
+        return passed && refused(flat, 0, 16);
+    }
+
+    class MemoryTraceSink : public owl::TraceSink
+    {
+    public:
+        void Write(std::span<std::uint8_t const> chunk) override
+        {
+            bytes.insert(bytes.end(), chunk.begin(), chunk.end());
+        }
+
+        std::vector<std::uint8_t> bytes;
+    };
+
+    // Unpacks the LZ4 frames that TraceCompression::Lz4 writes, which have independent blocks and no checksums.
+    auto DecompressLz4(std::span<std::uint8_t const> frame) -> std::vector<std::uint8_t>
+    {
+        std::vector<std::uint8_t> out;
+        auto at = std::size_t{7};
+        auto const u32 = [&] {
+            std::uint32_t value{};
+            std::memcpy(&value, frame.data() + at, sizeof(value));
+            at += sizeof(value);
+            return value;
+        };
+        auto const length = [&](std::size_t value) {
+            for (auto more = value == 15; more; ++at)
+            {
+                value += frame[at];
+                more = frame[at] == 255;
+            }
+            return value;
+        };
+        for (auto size = u32(); size != 0; size = u32())
+        {
+            auto const end = at + (size & 0x7fffffff);
+            if ((size & 0x80000000) != 0)
+            {
+                auto const stored = frame.subspan(at, end - at);
+                out.insert(out.end(), stored.begin(), stored.end());
+                at = end;
+                continue;
+            }
+            while (at < end)
+            {
+                auto const token = frame[at++];
+                auto const literals = frame.subspan(at, length(token >> 4));
+                out.insert(out.end(), literals.begin(), literals.end());
+                at += literals.size();
+                if (at == end)
+                {
+                    break;
+                }
+                auto const offset = std::size_t{frame[at]} | std::size_t{frame[at + 1]} << 8;
+                at += 2;
+                auto const match = length(token & 15) + 4;
+                for (std::size_t i = 0; i < match; ++i)
+                {
+                    out.push_back(out[out.size() - offset]);
+                }
+            }
+        }
+        return out;
+    }
+
+    auto TracesExecution(owl::Engine engine) -> bool
+    {
+        // Many small runs, so that the trace fills several buffers.
+        auto memory = Assemble({
+                Addi(a0, zero, 0),
+                Addi(t0, zero, 100),
+                Add(a0, a0, t0),  // loop:
+                Addi(t0, t0, -1), //
+                Bne(t0, zero, -8),
+                Ecall(),
+        });
+        MemoryTraceSink raw;
+        MemoryTraceSink compressed;
+        auto runs = 0;
+        {
+            owl::TraceWriter rawWriter{raw, owl::TraceCompression::None, 4096};
+            owl::TraceWriter lz4Writer{compressed, owl::TraceCompression::Lz4, 4096};
+            owl::Cpu cpu{memory};
+            owl::Cpu twin{memory};
+            cpu.SetEngine(engine);
+            cpu.SetTrace(&rawWriter);
+            twin.SetTrace(&lz4Writer);
+            auto exit = owl::Exit::BudgetExhausted;
+            while (exit == owl::Exit::BudgetExhausted)
+            {
+                exit = cpu.Run(2);
+                twin.Run(2);
+                ++runs;
+            }
+            rawWriter.Flush();
+        }
+
+        owl::TraceReader reader{raw.bytes};
+        owl::TraceRecord record;
+        std::uint64_t steps = 0;
+        auto starts = 0;
+        auto expected = std::uint32_t{};
+        auto passed = raw.bytes.size() > 4096;
+        while (reader.Next(record))
+        {
+            switch (record.kind)
+            {
+            case owl::TraceRecord::Kind::Start:
+                ++starts;
+                passed &= record.pc == expected;
+                break;
+            case owl::TraceRecord::Kind::Step:
+                ++steps;
+                passed &= record.pc == expected && (record.rd == 0 || record.value == reader.Registers()[record.rd]);
+                expected = record.pc == 16 && reader.Registers()[t0] != 0 ? 8 : record.pc + 4;
+                break;
+            case owl::TraceRecord::Kind::Exit:
+                passed &= record.pc == expected;
+                break;
+            }
+        }
+        passed = passed && steps == 2 + 3 * 100 + 1 && starts == runs && record.kind == owl::TraceRecord::Kind::Exit
+                 && record.exit == owl::Exit::Ecall && record.pc == 24 && reader.Registers()[a0] == 5050
+                 && compressed.bytes.size() < raw.bytes.size() / 2 && DecompressLz4(compressed.bytes) == raw.bytes;
+
+        // Straight-line compressed code, each instruction of which follows the previous one without a pc delta.
+        std::vector<std::uint8_t> code(4096);
+        std::uint32_t at = 0;
+        auto const put = [&](auto insn) {
+            std::memcpy(code.data() + at, &insn, sizeof(insn));
+            at += sizeof(insn);
+        };
+        put(CLi(a0, 5));
+        put(CAddi(a0, 1));
+        put(CMv(a1, a0));
+        put(CAdd(a1, a0));
+        put(CNop());
+        put(Ecall());
+        MemoryTraceSink straight;
+        {
+            owl::TraceWriter writer{straight, owl::TraceCompression::None, 4096};
+            owl::Cpu cpu{code};
+            cpu.SetEngine(engine);
+            cpu.SetTrace(&writer);
+            passed = passed && cpu.Run(100) == owl::Exit::Ecall;
+            writer.Flush();
+        }
+        owl::TraceReader straightReader{straight.bytes};
+        std::vector<std::uint32_t> pcs;
+        while (straightReader.Next(record))
+        {
+            if (record.kind == owl::TraceRecord::Kind::Step)
+            {
+                pcs.push_back(record.pc);
+            }
+        }
+
+        // The 12-byte header, a start of 33 bytes as every delta fits in a byte, four steps that write a register,
+        // of 2 bytes each, a c.nop and the ecall, of 1 byte each, and the 3-byte exit.
+        return passed && pcs == std::vector<std::uint32_t>{0, 2, 4, 6, 8, 10}
+               && record.kind == owl::TraceRecord::Kind::Exit && record.pc == 14
+               && straightReader.Registers()[a1] == 12 && straight.bytes.size() == 12 + 33 + 4 * 2 + 2 + 3;
+    }
+
+    // Answers host call 1 with the time, 2 by reading a1 bytes into a0, and stops the guest on 93.
+    class TestHost : public owl::EcallHandler
+    {
+    public:
+        auto OnEcall(owl::HostCall& call) -> bool override
+        {
+            ++calls;
+            switch (call.Number())
+            {
+            case 1:
+                call.Return(12345 + calls);
+                return true;
+            case 2:
+            {
+                std::vector<std::uint8_t> const input{1, 2, 3, 4, 5, 6, 7, 8};
+                auto const size = std::min<std::uint32_t>(call.Argument(1), 8);
+                call.Return(call.WriteMemory(call.Argument(0), std::span{input}.first(size)) ? size : ~0U);
+                return true;
+            }
+            default:
+                return false;
+            }
+        }
+
+        std::uint32_t calls{};
+    };
+
+    auto RecordsAndReplaysEcalls(owl::Engine engine) -> bool
+    {
+        auto memory = Assemble({
+                Addi(a7, zero, 1),
+                Ecall(),
+                Addi(s0, a0, 0),
+                Addi(a7, zero, 2),
+                Addi(a0, zero, 256),
+                Addi(a1, zero, 4),
+                Ecall(),
+                Lw(s1, zero, 256),
+                Addi(a7, zero, 93),
+                Ecall(),
+        });
+        auto const image = memory;
+        auto const finished = [](owl::Cpu const& cpu, owl::Exit exit) {
+            auto const& state = cpu.State();
+            return exit == owl::Exit::Ecall && state.x[s0] == 12346 && state.x[s1] == 0x04030201 && state.x[a0] == 4
+                   && state.pc == 40 && state.instret == 10;
+        };
+
+        TestHost host;
+        std::stringstream log;
+        owl::EcallRecorder recorder{host, log};
+        owl::Cpu live{memory};
+        live.SetEngine(engine);
+        live.SetEcallHandler(&recorder);
+        auto passed = finished(live, live.Run(1000)) && host.calls == 3;
+
+        // The replay sees the same inputs without calling the host, and notices when the guest takes another path.
+        auto replayMemory = image;
+        owl::EcallReplayer replayer{log};
+        owl::Cpu replay{replayMemory};
+        replay.SetEngine(engine);
+        replay.SetEcallHandler(&replayer);
+        passed &= finished(replay, replay.Run(1000)) && host.calls == 3 && replayMemory == memory;
+
+        log.clear();
+        log.seekg(0);
+        owl::EcallReplayer diverging{log};
+        auto divergedMemory = image;
+        auto const otherCall = Addi(a7, zero, 2);
+        std::memcpy(divergedMemory.data(), &otherCall, sizeof(otherCall));
+        owl::Cpu diverged{divergedMemory};
+        diverged.SetEngine(engine);
+        diverged.SetEcallHandler(&diverging);
+        try
+        {
+            diverged.Run(1000);
+            return false;
+        }
+        catch (std::runtime_error const&)
+        {
+            return passed;
+        }
+    }
+
+    auto CountsWhatACoreDoes(owl::Engine engine) -> bool
+    {
+        // A loop, then two host calls, the second of which stops the guest.
+        auto memory = Assemble({
+                Addi(t0, zero, 10),
+                Addi(t0, t0, -1), // loop:
+                Bne(t0, zero, -4),
+                Addi(a7, zero, 1),
+                Ecall(),
+                Addi(a7, zero, 93),
+                Ecall(),
+        });
+        TestHost host;
+        owl::Cpu cpu{memory};
+        cpu.SetEngine(engine);
+        cpu.SetEcallHandler(&host);
+        auto const exit = cpu.Run(1000);
+        auto const stats = cpu.Stats();
+        auto passed = exit == owl::Exit::Ecall && stats.instructions == cpu.State().instret && stats.runs == 1
+                      && stats.ecalls == 2 && stats.pageMisses == 1 && stats.pageHits > 0 && stats.sharedPages == 0
+                      && stats.hostNanoseconds <= stats.runNanoseconds && stats.Mips() > 0;
+
+        // Only the block engines count blocks, and the loop's block chains to itself.
+        auto const blocks = engine == owl::Engine::Block || engine == owl::Engine::Tiered;
+        passed = passed && (blocks ? stats.blockMisses > 0 && stats.blockHits + stats.chainHits > 0
+                                   : stats.blockMisses == 0 && stats.blockHits == 0 && stats.chainHits == 0);
+        passed = passed && (engine != owl::Engine::Block || stats.chainHits > 0);
+
+        // A fork counts for itself.
+        std::vector<std::uint8_t> forked(memory.size());
+        auto fork = cpu.Fork(forked);
+        return passed && fork.Stats().runs == 0 && cpu.Stats().runs == 1;
+    }
+
+    auto RunsABatch(owl::Engine engine) -> bool
+    {
+        // Core i sums 1 + 2 + ... + 60 * i, except that every eighth core spins forever and core 3 faults.
+        constexpr std::uint64_t cycles = 100000;
+        constexpr std::size_t count = 33;
+        std::vector<std::vector<std::uint8_t>> memories;
+        std::vector<owl::Cpu> cpus;
+        memories.reserve(count);
+        cpus.reserve(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            auto const n = static_cast<std::int32_t>(60 * i);
+            if (i % 8 == 0)
+            {
+                memories.push_back(Assemble({Jal(zero, 0)}));
+            }
+            else if (i == 3)
+            {
+                memories.push_back(Assemble({Addi(t0, zero, 1), Lw(a0, zero, 4094)}));
+            }
+            else
+            {
+                memories.push_back(Assemble({
+                        Addi(a0, zero, 0),
+                        Addi(t0, zero, n),
+                        Add(a0, a0, t0),  // loop:
+                        Addi(t0, t0, -1), //
+                        Bne(t0, zero, -8),
+                        Ecall(),
+                }));
+            }
+            cpus.emplace_back(memories.back());
+            cpus.back().SetEngine(engine);
+        }
+
+        owl::BatchRunner runner{3, 97};
+        auto const exits = runner.Run(cpus, cycles);
+        auto passed = runner.Threads() == 3 && exits.size() == count;
+        for (std::size_t i = 0; passed && i < count; ++i)
+        {
+            auto const& state = cpus[i].State();
+            auto const n = 60 * i;
+            if (i % 8 == 0)
+            {
+                passed = exits[i] == owl::Exit::BudgetExhausted && state.instret == cycles;
+            }
+            else if (i == 3)
+            {
+                passed = exits[i] == owl::Exit::LoadFault && state.pc == 4;
+            }
+            else
+            {
+                passed = exits[i] == owl::Exit::Ecall && state.x[a0] == n * (n + 1) / 2 && state.instret == 3 + 3 * n;
+            }
+        }
+
+        // The runner counts what every core did while it ran them.
+        std::uint64_t instructions{};
+        for (auto const& cpu : cpus)
+        {
+            instructions += cpu.State().instret;
+        }
+        auto const stats = runner.Stats();
+        return passed && stats.instructions == instructions && stats.runs >= count;
+    }
+
+    auto RunsABatchWithAsyncEcalls(owl::Engine engine) -> bool
+    {
+        // Core i reads 5 times, with the host answering i + 1, then exits, while the host answers from its own thread.
+        constexpr std::size_t count = 9;
+        std::vector<std::vector<std::uint8_t>> memories;
+        std::vector<owl::Cpu> cpus;
+        memories.reserve(count);
+        cpus.reserve(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            memories.push_back(Assemble({
+                    Addi(t0, zero, 5),
+                    Addi(s0, zero, 0),
+                    Addi(a7, zero, 63), // loop:
+                    Ecall(),            //
+                    Add(s0, s0, a0),    //
+                    Addi(t0, t0, -1),   //
+                    Bne(t0, zero, -16),
+                    Addi(a7, zero, 93),
+                    Ecall(),
+            }));
+            cpus.emplace_back(memories.back());
+            cpus.back().SetEngine(engine);
+        }
+
+        owl::EcallRing ring;
+        std::atomic<bool> done{};
+        std::atomic<std::size_t> calls{};
+        std::thread host{[&] {
+            std::array<owl::EcallRequest, 4> requests;
+            std::vector<owl::EcallCompletion> completions;
+            while (!done)
+            {
+                completions.clear();
+                for (auto const& request : std::span{requests}.first(ring.Wait(requests, std::chrono::milliseconds{1})))
+                {
+                    auto const exiting = request.number == 93;
+                    completions.push_back({.core = request.core,
+                                           .result = exiting ? 0 : static_cast<std::uint32_t>(request.core + 1),
+                                           .resume = !exiting});
+                }
+                calls += completions.size();
+                ring.Complete(completions);
+            }
+        }};
+
+        owl::BatchRunner runner{2, 3};
+        auto const exits = runner.Run(cpus, 1000, ring);
+        done = true;
+        host.join();
+
+        auto passed = calls == count * 6;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            auto const& state = cpus[i].State();
+            passed &= exits[i] == owl::Exit::Ecall && state.x[s0] == 5 * (i + 1) && state.pc == 36
+                      && state.instret == 2 + 5 * 5 + 2;
+        }
+        return passed;
+    }
+
+    auto RunToTheEnd(owl::Cpu& cpu, std::atomic<std::size_t>& slices) -> owl::GuestTask
+    {
+        // The result is awaited into a variable, because GCC 12 miscompiles a co_await in a condition.
+        for (;;)
+        {
+            auto const exit = co_await cpu.RunFor(10);
+            if (exit != owl::Exit::BudgetExhausted)
+            {
+                co_return;
+            }
+            ++slices;
+        }
+    }
+
+    auto FailAfterRunning(owl::Cpu& cpu) -> owl::GuestTask
+    {
+        co_await cpu.RunFor(1);
+        throw std::runtime_error("the guest misbehaved");
+    }
+
+    auto RunsGuestsAsCoroutines(owl::Engine engine) -> bool
+    {
+        // Core i sums 1 + 2 + ... + 3 * (i + 1), ten instructions at a time, sharing two threads with the other cores.
+        constexpr std::size_t count = 50;
+        std::vector<std::vector<std::uint8_t>> memories;
+        std::vector<owl::Cpu> cpus;
+        memories.reserve(count);
+        cpus.reserve(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            auto const n = static_cast<std::int32_t>(3 * (i + 1));
+            memories.push_back(Assemble({
+                    Addi(a0, zero, 0),
+                    Addi(t0, zero, n),
+                    Add(a0, a0, t0),  // loop:
+                    Addi(t0, t0, -1), //
+                    Bne(t0, zero, -8),
+                    Ecall(),
+            }));
+            cpus.emplace_back(memories.back());
+            cpus.back().SetEngine(engine);
+        }
+
+        std::atomic<std::size_t> slices{};
+        owl::Scheduler scheduler{2};
+        for (auto& cpu : cpus)
+        {
+            scheduler.Spawn(RunToTheEnd(cpu, slices));
+        }
+        scheduler.Wait();
+
+        auto passed = scheduler.Threads() == 2;
+        auto expectedSlices = std::size_t{};
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            auto const& state = cpus[i].State();
+            auto const n = 3 * (i + 1);
+            passed &= state.x[a0] == n * (n + 1) / 2 && state.instret == 3 + 3 * n;
+            expectedSlices += (3 + 3 * n - 1) / 10;
+        }
+        passed &= slices == expectedSlices;
+
+        // An exception that escapes a task comes out of Wait().
+        scheduler.Spawn(FailAfterRunning(cpus[0]));
+        try
+        {
+            scheduler.Wait();
+            return false;
+        }
+        catch (std::runtime_error const&)
+        {
+            return passed;
+        }
+    }
+
+    auto AgreesWithCpusInLockstep(owl::Engine engine) -> bool
+    {
+        // Each lane counts the Collatz steps for its input, so lanes diverge and reconverge. Lane 5 stores out of
+        // bounds, and lane 7 stores into its code and so leaves the group.
+        constexpr std::size_t lanes = 12;
+        auto const program = Assemble(
+                {
+                        Addi(a2, zero, 0),  // steps = 0
+                        Addi(t1, zero, 1),  //
+                        Beq(a0, t1, 40),    // loop: if n == 1 then done
+                        Andi(t0, a0, 1),    //
+                        Beq(t0, zero, 20),  // if n is even then halve it
+                        Add(t0, a0, a0),    // n = 3n + 1
+                        Add(a0, t0, a0),    //
+                        Addi(a0, a0, 1),    //
+                        Jal(zero, 8),       //
+                        Srli(a0, a0, 1),    // halve:
+                        Addi(a2, a2, 1),    // steps += 1
+                        Jal(zero, -36),     // to loop
+                        Sw(a2, a1, 0),      // done:
+                        Lw(a3, a1, 0),      //
+                        Ecall(),            //
+                },
+                8192);
+        std::vector<std::vector<std::uint8_t>> laneMemories(lanes, program);
+        std::vector<std::vector<std::uint8_t>> cpuMemories(lanes, program);
+        std::vector<std::span<std::uint8_t>> views(laneMemories.begin(), laneMemories.end());
+        owl::Lockstep group{views};
+        std::vector<owl::Cpu> cpus;
+        cpus.reserve(lanes);
+        for (std::size_t i = 0; i < lanes; ++i)
+        {
+            auto state = group.State(i);
+            state.x[a0] = static_cast<std::uint32_t>(i == 9 ? 1 : 3 * i + 7);
+            state.x[a1] = static_cast<std::uint32_t>(i == 5 ? 8192 : i == 7 ? 60 : 4096 + 4 * i);
+            group.SetState(i, state);
+            cpus.emplace_back(cpuMemories[i]);
+            cpus.back().SetEngine(engine);
+            cpus.back().State() = state;
+        }
+
+        auto passed = group.Lanes() == lanes;
+        for (auto round = 0; passed && round < 30; ++round)
+        {
+            auto const exits = group.Run(40);
+            for (std::size_t i = 0; passed && i < lanes; ++i)
+            {
+                auto const exit = cpus[i].Run(40);
+                auto const state = group.State(i);
+                auto const& expected = cpus[i].State();
+                passed = exits[i] == exit && state.x == expected.x && state.pc == expected.pc
+                         && state.instret == expected.instret && laneMemories[i] == cpuMemories[i];
+            }
+        }
+        return passed;
+    }
+
+    auto RunsLanesThatWriteCodeAheadOfTime(owl::Engine engine) -> bool
+    {
+        // Lane 1 rewrites the code on the second page before the group has executed it, so it can't use the group's
+        // translation of that page, which comes from lane 0's memory. Lane 2 leaves its code alone, like lane 0.
+        constexpr std::size_t lanes = 3;
+        auto program = Assemble(
+                {
+                        Beq(a0, zero, 12), // lanes with a0 = 0 leave the code alone
+                        Lui(t2, 1),        //
+                        Sw(t1, t2, 4),     //
+                        Jal(zero, 4084),   // to the second page
+                },
+                8192);
+        constexpr std::array secondPage{Addi(zero, zero, 0), Addi(a1, zero, 1), Ecall()};
+        std::memcpy(program.data() + 4096, secondPage.data(), sizeof(secondPage));
+        std::vector<std::vector<std::uint8_t>> laneMemories(lanes, program);
+        std::vector<std::vector<std::uint8_t>> cpuMemories(lanes, program);
+        std::vector<std::span<std::uint8_t>> views(laneMemories.begin(), laneMemories.end());
+        owl::Lockstep group{views};
+        std::vector<owl::Cpu> cpus;
+        cpus.reserve(lanes);
+        for (std::size_t i = 0; i < lanes; ++i)
+        {
+            auto state = group.State(i);
+            state.x[a0] = i == 1 ? 1 : 0;
+            state.x[t1] = Addi(a1, zero, 2);
+            group.SetState(i, state);
+            cpus.emplace_back(cpuMemories[i]);
+            cpus.back().SetEngine(engine);
+            cpus.back().State() = state;
+        }
+
+        auto const exits = group.Run(100);
+        auto passed = true;
+        for (std::size_t i = 0; i < lanes; ++i)
+        {
+            auto const exit = cpus[i].Run(100);
+            auto const state = group.State(i);
+            auto const& expected = cpus[i].State();
+            passed = passed && exits[i] == exit && state.x == expected.x && state.pc == expected.pc
+                     && state.instret == expected.instret;
+        }
+        return passed && group.State(0).x[a1] == 1 && group.State(1).x[a1] == 2 && group.State(2).x[a1] == 1;
+    }
+
+    auto RunsInlineLikeACore(owl::Engine engine) -> bool
+    {
+        // A program that rewrites its own code, loops, calls the host, runs compressed code and atomics, then faults.
+        auto image = Assemble(
+                {
+                        Lw(t0, zero, 256),
+                        Sw(t0, zero, 12),
+                        Addi(t1, zero, 10),
+                        Addi(a0, zero, 1), // overwritten by the store above
+                        Add(a0, a0, t1),   // loop:
+                        Addi(t1, t1, -1),  //
+                        Bne(t1, zero, -8),
+                        Lui(s0, 1),
+                        AmoaddW(a1, a0, s0),
+                        Ecall(),
+                        CLw(a2, s0, 0) | (std::uint32_t{CSlli(a2, 1)} << 16),
+                        Ebreak(),
+                        Lw(a3, zero, -4),
+                },
+                8192);
+        constexpr auto replacement = Addi(a0, zero, 7);
+        std::memcpy(image.data() + 256, &replacement, sizeof(replacement));
+
+        // The inline interpreter and the core run side by side, in small budgets, and must agree after every one.
+        auto memory = image;
+        owl::Cpu cpu{image};
+        cpu.SetEngine(engine);
+        owl::CpuState state{};
+        auto passed = true;
+        auto exit = owl::Exit::BudgetExhausted;
+        while (passed && (exit == owl::Exit::BudgetExhausted || exit == owl::Exit::Ecall || exit == owl::Exit::Ebreak))
+        {
+            exit = owl::RunSmall(state, memory, 5);
+            auto const& expected = cpu.State();
+            passed = exit == cpu.Run(5) && state.x == expected.x && state.pc == expected.pc
+                     && state.instret == expected.instret && state.reservation == expected.reservation
+                     && memory == image;
+        }
+        passed = passed && exit == owl::Exit::LoadFault && state.x[a0] == 62 && state.x[a2] == 124;
+
+        // Step() executes one instruction, and can't fetch a four-byte instruction that runs off the end of memory.
+        std::vector<std::uint8_t> tiny(6);
+        constexpr auto nop = Nop();
+        std::memcpy(tiny.data(), &nop, sizeof(nop));
+        std::memcpy(tiny.data() + 4, &nop, 2);
+        owl::CpuState stepped{};
+        passed = passed && owl::Step(stepped, tiny) == owl::Exit::BudgetExhausted && stepped.pc == 4
+                 && stepped.instret == 1;
+        return passed && owl::Step(stepped, tiny) == owl::Exit::FetchFault && stepped.pc == 4 && stepped.instret == 1;
+    }
+
+    auto Check(bool passed, char const* name, owl::Engine engine) -> bool
+    {
+        if (!passed)
+        {
+            std::cerr << "FAILED: " << name << " on engine " << static_cast<int>(engine) << '\n';
+        }
+        return passed;
+    }
+} // namespace
+
+auto main() -> int
+{
+    auto passed = true;
+    for (auto const engine :
+         {owl::Engine::Switch, owl::Engine::Threaded, owl::Engine::Block, owl::Engine::Tiered, owl::Engine::Timed})
+    {
+        if (!owl::IsEngineAvailable(engine))
+        {
+            continue;
+        }
+        passed &= Check(SumsALoop(engine), "SumsALoop", engine);
+        passed &= Check(StopsWhenTheBudgetIsExhausted(engine), "StopsWhenTheBudgetIsExhausted", engine);
+        passed &= Check(ResumesAcrossSmallBudgets(engine), "ResumesAcrossSmallBudgets", engine);
+        passed &= Check(LoadsAndStoresLittleEndian(engine), "LoadsAndStoresLittleEndian", engine);
+        passed &= Check(KeepsX0Zero(engine), "KeepsX0Zero", engine);
+        passed &= Check(RunsInstructionsWithX0Operands(engine), "RunsInstructionsWithX0Operands", engine);
+        passed &= Check(CallsAndReturns(engine), "CallsAndReturns", engine);
+        passed &= Check(DividesLikeRiscV(engine), "DividesLikeRiscV", engine);
+        passed &= Check(ReportsFaults(engine), "ReportsFaults", engine);
+        passed &= Check(SeesItsOwnCodeWrites(engine), "SeesItsOwnCodeWrites", engine);
+        passed &= Check(SeesHostCodeWritesAfterInvalidating(engine), "SeesHostCodeWritesAfterInvalidating", engine);
+        passed &= Check(FaultsFetchingPastTheEndOfMemory(engine), "FaultsFetchingPastTheEndOfMemory", engine);
+        passed &= Check(RunsInAnAddressSpace(engine), "RunsInAnAddressSpace", engine);
+        passed &= Check(FaultsAtTheTopOfAnAddressSpace(engine), "FaultsAtTheTopOfAnAddressSpace", engine);
+        passed &= Check(LoadsElfSegments(engine), "LoadsElfSegments", engine);
+        passed &= Check(LoadsRawBinaries(engine), "LoadsRawBinaries", engine);
+        passed &= Check(AgreesWithTheSwitchEngineOnHotCode(engine), "AgreesWithTheSwitchEngineOnHotCode", engine);
+        passed &= Check(SeesItsOwnCodeWritesFromHotCode(engine), "SeesItsOwnCodeWritesFromHotCode", engine);
+        passed &= Check(RestoresASnapshot(engine), "RestoresASnapshot", engine);
+        passed &= Check(ForksACore(engine), "ForksACore", engine);
+        passed &= Check(AllocatesFromAMemoryResource(engine), "AllocatesFromAMemoryResource", engine);
+        passed &= Check(ProfilesExecution(engine), "ProfilesExecution", engine);
+        passed &= Check(FusesInstructionPairs(engine), "FusesInstructionPairs", engine);
+        passed &= Check(AccessesDevices(engine), "AccessesDevices", engine);
+        passed &= Check(EstimatesCycles(engine), "EstimatesCycles", engine);
+        passed &= Check(RunsCompressedCode(engine), "RunsCompressedCode", engine);
+        passed &= Check(ExecutesAtomics(engine), "ExecutesAtomics", engine);
+        passed &= Check(RunsHartsInParallel(engine), "RunsHartsInParallel", engine);
+        passed &= Check(SharesTranslatedCode(engine), "SharesTranslatedCode", engine);
+        passed &= Check(SharesCodeThatStoresToItsPage(engine), "SharesCodeThatStoresToItsPage", engine);
+        passed &= Check(SavesSharedCode(engine), "SavesSharedCode", engine);
+        passed &= Check(TracesExecution(engine), "TracesExecution", engine);
+        passed &= Check(RecordsAndReplaysEcalls(engine), "RecordsAndReplaysEcalls", engine);
+        passed &= Check(CountsWhatACoreDoes(engine), "CountsWhatACoreDoes", engine);
+        passed &= Check(RunsABatch(engine), "RunsABatch", engine);
+        passed &= Check(RunsABatchWithAsyncEcalls(engine), "RunsABatchWithAsyncEcalls", engine);
+        passed &= Check(RunsGuestsAsCoroutines(engine), "RunsGuestsAsCoroutines", engine);
+        passed &= Check(AgreesWithCpusInLockstep(engine), "AgreesWithCpusInLockstep", engine);
+        passed &= Check(RunsLanesThatWriteCodeAheadOfTime(engine), "RunsLanesThatWriteCodeAheadOfTime", engine);
+        passed &= Check(RunsInlineLikeACore(engine), "RunsInlineLikeACore", engine);
+    }
+    return passed ? 0 : 1;
 }